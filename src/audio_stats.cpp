@@ -0,0 +1,179 @@
+#include "audio_stats.hpp"
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstdio>
+#include <string_view>
+
+// * HDR-style layout: 16 linear sub-buckets for every power of two up to 2^40ns
+constexpr int SUB_BUCKET_BITS = 4;
+constexpr int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+constexpr int MAX_MAGNITUDE = 40;
+constexpr int BUCKET_COUNT = (MAX_MAGNITUDE - SUB_BUCKET_BITS + 2) * SUB_BUCKETS;
+constexpr int MAX_STAGES = 16;
+
+struct audio_stage {
+	const char* name = NULL;
+	std::atomic<ma_uint64> calls = 0;
+	std::atomic<ma_uint64> busy_ns = 0;
+};
+
+static std::array<std::atomic<ma_uint64>, BUCKET_COUNT> duration_histogram;
+static std::array<audio_stage, MAX_STAGES> stages;
+static std::atomic<int> stage_count = 0;
+
+static std::atomic<ma_uint64> callback_count = 0;
+static std::atomic<ma_uint64> frames_mixed = 0;
+static std::atomic<ma_uint64> silent_frames_mixed = 0;
+static std::atomic<ma_uint64> audio_ns = 0;
+static std::atomic<ma_uint64> max_duration_ns = 0;
+static std::atomic<double> load_average = 0;
+static std::atomic<double> peak_load = 0;
+
+static int bucket_index(ma_uint64 value) {
+	if (value < SUB_BUCKETS)
+		return int(value);
+
+	int magnitude = std::bit_width(value) - 1;
+	if (magnitude > MAX_MAGNITUDE)
+		return BUCKET_COUNT - 1;
+
+	int shift = magnitude - SUB_BUCKET_BITS;
+	int sub_bucket = int(value >> shift) & (SUB_BUCKETS - 1);
+	return (shift + 1) * SUB_BUCKETS + sub_bucket;
+}
+
+static ma_uint64 bucket_value(int index) {
+	// * upper bound of the bucket, so reported percentiles never understate
+	if (index < SUB_BUCKETS)
+		return ma_uint64(index);
+
+	int shift = index / SUB_BUCKETS - 1;
+	ma_uint64 sub_bucket = ma_uint64(index % SUB_BUCKETS) | SUB_BUCKETS;
+	return ((sub_bucket + 1) << shift) - 1;
+}
+
+void audio_stats_record_callback(ma_uint64 duration_ns, ma_uint64 period_ns, ma_uint32 frames, ma_uint32 silent_frames) {
+	duration_histogram[bucket_index(duration_ns)].fetch_add(1, std::memory_order_relaxed);
+	callback_count.fetch_add(1, std::memory_order_relaxed);
+	frames_mixed.fetch_add(frames, std::memory_order_relaxed);
+	silent_frames_mixed.fetch_add(silent_frames, std::memory_order_relaxed);
+	audio_ns.fetch_add(period_ns, std::memory_order_relaxed);
+
+	if (duration_ns > max_duration_ns.load(std::memory_order_relaxed))
+		max_duration_ns.store(duration_ns, std::memory_order_relaxed);
+
+	if (period_ns == 0)
+		return;
+
+	// * only the audio thread writes these, so a plain load/store pair is enough
+	double load = double(duration_ns) / double(period_ns);
+	double average = load_average.load(std::memory_order_relaxed);
+	load_average.store(average + (load - average) * 0.05, std::memory_order_relaxed);
+	if (load > peak_load.load(std::memory_order_relaxed))
+		peak_load.store(load, std::memory_order_relaxed);
+}
+
+int audio_stats_register_stage(const char* name) {
+	int count = stage_count.load(std::memory_order_relaxed);
+	for (int i = 0; i < count; i++) {
+		if (std::string_view(stages[i].name) == name)
+			return i;
+	}
+	if (count == MAX_STAGES)
+		return -1;
+
+	stages[count].name = name;
+	stage_count.store(count + 1, std::memory_order_release);
+	return count;
+}
+
+void audio_stats_record_stage(int stage, ma_uint64 duration_ns) {
+	if (stage < 0)
+		return;
+	stages[stage].calls.fetch_add(1, std::memory_order_relaxed);
+	stages[stage].busy_ns.fetch_add(duration_ns, std::memory_order_relaxed);
+}
+
+audio_stats_snapshot audio_stats_get() {
+	audio_stats_snapshot snapshot{};
+	snapshot.callbacks = callback_count.load(std::memory_order_relaxed);
+	snapshot.frames_mixed = frames_mixed.load(std::memory_order_relaxed);
+	snapshot.silent_frames = silent_frames_mixed.load(std::memory_order_relaxed);
+	snapshot.load_percent = load_average.load(std::memory_order_relaxed) * 100;
+	snapshot.peak_load_percent = peak_load.load(std::memory_order_relaxed) * 100;
+	snapshot.max_us = double(max_duration_ns.load(std::memory_order_relaxed)) / 1000;
+
+	std::array<ma_uint64, BUCKET_COUNT> counts;
+	ma_uint64 total = 0;
+	for (int i = 0; i < BUCKET_COUNT; i++) {
+		counts[i] = duration_histogram[i].load(std::memory_order_relaxed);
+		total += counts[i];
+	}
+
+	auto percentile = [&](double fraction) {
+		ma_uint64 target = ma_uint64(fraction * double(total));
+		ma_uint64 seen = 0;
+		for (int i = 0; i < BUCKET_COUNT; i++) {
+			seen += counts[i];
+			if (seen > target)
+				return double(bucket_value(i)) / 1000;
+		}
+		return 0.0;
+	};
+	if (total > 0) {
+		snapshot.p50_us = percentile(0.5);
+		snapshot.p99_us = percentile(0.99);
+		snapshot.p999_us = percentile(0.999);
+	}
+
+	double audio_time_ns = double(audio_ns.load(std::memory_order_relaxed));
+	int count = stage_count.load(std::memory_order_acquire);
+	for (int i = 0; i < count; i++) {
+		ma_uint64 calls = stages[i].calls.load(std::memory_order_relaxed);
+		double busy_ns = double(stages[i].busy_ns.load(std::memory_order_relaxed));
+		snapshot.stages.push_back({
+			.name = stages[i].name,
+			.calls = calls,
+			.average_us = calls > 0 ? busy_ns / double(calls) / 1000 : 0,
+			.load_percent = audio_time_ns > 0 ? busy_ns / audio_time_ns * 100 : 0,
+		});
+	}
+	return snapshot;
+}
+
+std::string audio_stats_report() {
+	audio_stats_snapshot stats = audio_stats_get();
+	char line[256];
+	std::string report;
+
+	std::snprintf(line, sizeof(line), "DSP load %.1f%% (peak %.1f%%)\n", stats.load_percent, stats.peak_load_percent);
+	report += line;
+	std::snprintf(line, sizeof(line), "callback p50 %.0fus  p99 %.0fus  p99.9 %.0fus  max %.0fus\n", stats.p50_us, stats.p99_us, stats.p999_us, stats.max_us);
+	report += line;
+	std::snprintf(line, sizeof(line), "callbacks %llu  frames %llu  silent %llu\n",
+		(unsigned long long)stats.callbacks, (unsigned long long)stats.frames_mixed, (unsigned long long)stats.silent_frames);
+	report += line;
+
+	for (const auto& stage : stats.stages) {
+		std::snprintf(line, sizeof(line), "  %-12s %.1fus/block  %.2f%%\n", stage.name.c_str(), stage.average_us, stage.load_percent);
+		report += line;
+	}
+	return report;
+}
+
+void audio_stats_reset() {
+	for (auto& bucket : duration_histogram)
+		bucket.store(0, std::memory_order_relaxed);
+	for (auto& stage : stages) {
+		stage.calls.store(0, std::memory_order_relaxed);
+		stage.busy_ns.store(0, std::memory_order_relaxed);
+	}
+	callback_count.store(0, std::memory_order_relaxed);
+	frames_mixed.store(0, std::memory_order_relaxed);
+	silent_frames_mixed.store(0, std::memory_order_relaxed);
+	audio_ns.store(0, std::memory_order_relaxed);
+	max_duration_ns.store(0, std::memory_order_relaxed);
+	peak_load.store(0, std::memory_order_relaxed);
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "include/miniaudio.h"
+
+/**
+ * @brief Lock-free instrumentation of the device data callback.
+ *
+ * The audio thread only does relaxed atomic increments, everything else
+ * (percentiles, formatting) happens on the reader side.
+ */
+
+struct audio_stage_stats {
+	std::string name;
+	ma_uint64 calls;
+	double average_us;
+	double load_percent;
+};
+
+struct audio_stats_snapshot {
+	ma_uint64 callbacks;
+	ma_uint64 frames_mixed;
+	ma_uint64 silent_frames;
+	double load_percent;
+	double peak_load_percent;
+	double p50_us;
+	double p99_us;
+	double p999_us;
+	double max_us;
+	std::vector<audio_stage_stats> stages;
+};
+
+void audio_stats_record_callback(ma_uint64 duration_ns, ma_uint64 period_ns, ma_uint32 frames, ma_uint32 silent_frames);
+
+/** @brief Registers a named DSP stage, must be called from the main thread before the stage runs. */
+int audio_stats_register_stage(const char* name);
+void audio_stats_record_stage(int stage, ma_uint64 duration_ns);
+
+audio_stats_snapshot audio_stats_get();
+std::string audio_stats_report();
+void audio_stats_reset();
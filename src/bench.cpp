@@ -0,0 +1,1683 @@
+#include "bench.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <limits>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "Logger.hpp"
+#include "decode_ahead.hpp"
+#include "readahead_vfs.hpp"
+#include "library_scan.hpp"
+#include "header_reader.hpp"
+#include "format_sniff.hpp"
+#include "duration_probe.hpp"
+#include "content_hash.hpp"
+#include "fingerprint.hpp"
+#include "loudness.hpp"
+#include "waveform.hpp"
+#include "limiter_node.hpp"
+#include "true_peak.hpp"
+#include "eq_node.hpp"
+#include "convolution_node.hpp"
+#include "spectrum.hpp"
+#include "resampler.hpp"
+#include "time_stretch_node.hpp"
+#include "channel_mix.hpp"
+#include "pcm_convert.hpp"
+#include "audio_stats.hpp"
+
+#include <gio/gio.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+struct bench_entry {
+	const char* name;
+	const char* description;
+	int (*run)(const std::string& input);
+};
+
+bool write_test_tone(const std::string& path, ma_uint32 sample_rate, float frequency, ma_uint32 seconds) {
+	ma_encoder_config config = ma_encoder_config_init(ma_encoding_format_wav, ma_format_s16, 2, sample_rate);
+	ma_encoder encoder;
+	if (ma_encoder_init_file(path.c_str(), &config, &encoder) != MA_SUCCESS)
+		return false;
+
+	std::vector<ma_int16> frames(std::size_t(sample_rate) * seconds * 2);
+	for (std::size_t i = 0; i < frames.size() / 2; i++) {
+		auto sample = ma_int16(std::sin(2 * M_PI * frequency * double(i) / sample_rate) * 8000);
+		frames[i * 2] = sample;
+		frames[i * 2 + 1] = sample;
+	}
+	ma_encoder_write_pcm_frames(&encoder, frames.data(), frames.size() / 2, NULL);
+	ma_encoder_uninit(&encoder);
+	return true;
+}
+
+static std::string temp_path(const char* name) {
+	return (std::filesystem::temp_directory_path() / name).string();
+}
+
+/**
+ * @brief VFS that forwards to the default one and counts reads. It can also stall reads
+ * at random, standing in for a slow NFS mount or a spinning-up USB disk.
+ */
+struct stalling_vfs {
+	ma_vfs_callbacks cb;
+	ma_default_vfs inner;
+	std::mt19937 random;
+	double stall_chance;
+	int max_stall_ms;
+	ma_uint64 reads;
+	ma_uint64 read_ns;
+};
+
+static ma_result stalling_open(ma_vfs* vfs, const char* path, ma_uint32 mode, ma_vfs_file* file) {
+	return ma_vfs_open(&((stalling_vfs*)vfs)->inner, path, mode, file);
+}
+
+static ma_result stalling_close(ma_vfs* vfs, ma_vfs_file file) {
+	return ma_vfs_close(&((stalling_vfs*)vfs)->inner, file);
+}
+
+static ma_result stalling_read(ma_vfs* vfs, ma_vfs_file file, void* destination, size_t size, size_t* bytes_read) {
+	auto stalling = (stalling_vfs*)vfs;
+	std::uniform_real_distribution<double> chance(0, 1);
+	if (stalling->stall_chance > 0 && chance(stalling->random) < stalling->stall_chance) {
+		std::uniform_int_distribution<int> stall(stalling->max_stall_ms / 4, stalling->max_stall_ms);
+		std::this_thread::sleep_for(std::chrono::milliseconds(stall(stalling->random)));
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	ma_result result = ma_vfs_read(&stalling->inner, file, destination, size, bytes_read);
+	stalling->reads++;
+	stalling->read_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+	return result;
+}
+
+static ma_result stalling_seek(ma_vfs* vfs, ma_vfs_file file, ma_int64 offset, ma_seek_origin origin) {
+	return ma_vfs_seek(&((stalling_vfs*)vfs)->inner, file, offset, origin);
+}
+
+static ma_result stalling_tell(ma_vfs* vfs, ma_vfs_file file, ma_int64* cursor) {
+	return ma_vfs_tell(&((stalling_vfs*)vfs)->inner, file, cursor);
+}
+
+static ma_result stalling_info(ma_vfs* vfs, ma_vfs_file file, ma_file_info* info) {
+	return ma_vfs_info(&((stalling_vfs*)vfs)->inner, file, info);
+}
+
+static void init_stalling_vfs(stalling_vfs* vfs, double stall_chance, int max_stall_ms) {
+	vfs->cb = { stalling_open, NULL, stalling_close, stalling_read, NULL, stalling_seek, stalling_tell, stalling_info };
+	ma_default_vfs_init(&vfs->inner, NULL);
+	vfs->random.seed(1234);
+	vfs->stall_chance = stall_chance;
+	vfs->max_stall_ms = max_stall_ms;
+	vfs->reads = 0;
+	vfs->read_ns = 0;
+}
+
+static int bench_decode_stall(const std::string& input) {
+	std::string path = input;
+	if (path.empty()) {
+		path = temp_path("aurabeat-decode-stall.wav");
+		if (!write_test_tone(path, 44100, 440, 12)) {
+			log("could not write test tone", ERROR);
+			return 1;
+		}
+	}
+
+	const ma_uint32 period_frames = 441;
+	const auto period = std::chrono::milliseconds(10);
+	std::vector<float> output(period_frames * 8);
+
+	// * the ring starts with only the prefill and a seek empties it, so those can underrun at any watermark;
+	// * the second after each of them is left out of the settled count
+	std::printf("%-12s %-10s %-16s %s\n", "watermark", "underruns", "silent frames", "settled underruns");
+	ma_uint64 default_settled = 0;
+	for (ma_uint32 watermark_ms : {100u, 500u, 2000u}) {
+		stalling_vfs vfs{};
+		init_stalling_vfs(&vfs, 0.05, 300);
+
+		decode_ahead_config config;
+		config.watermark_ms = watermark_ms;
+		config.vfs = &vfs;
+		decode_ahead_source* source = decode_ahead_open(path.c_str(), config);
+		if (source == NULL) {
+			log("could not open " + path, ERROR);
+			return 1;
+		}
+
+		// * pull at device pace for 8 seconds, with a seek in the middle
+		auto next = std::chrono::steady_clock::now();
+		ma_uint64 unsettled = 0;
+		ma_uint64 settle_start = 0;
+		for (int i = 0; i < 800; i++) {
+			if (i == 400)
+				ma_data_source_seek_to_pcm_frame(source, 44100);
+			if (i == 0 || i == 400)
+				settle_start = decode_ahead_get_stats(source).underruns;
+			ma_data_source_read_pcm_frames(source, output.data(), period_frames, NULL);
+			if (i == 99 || i == 499)
+				unsettled += decode_ahead_get_stats(source).underruns - settle_start;
+			next += period;
+			std::this_thread::sleep_until(next);
+		}
+
+		decode_ahead_stats stats = decode_ahead_get_stats(source);
+		ma_uint64 settled = stats.underruns - unsettled;
+		std::printf("%-12s %-10llu %-16llu %llu\n", (std::to_string(watermark_ms) + "ms").c_str(),
+			(unsigned long long)stats.underruns, (unsigned long long)stats.underrun_frames, (unsigned long long)settled);
+		if (watermark_ms == decode_ahead_config{}.watermark_ms)
+			default_settled = settled;
+		decode_ahead_close(source);
+	}
+
+	if (input.empty())
+		std::filesystem::remove(path);
+	if (default_settled > 0) {
+		std::printf("FAIL: the default %ums watermark must ride out 300ms stalls once filled\n", decode_ahead_config{}.watermark_ms);
+		return 1;
+	}
+	return 0;
+}
+
+static void evict_from_page_cache(const std::string& path) {
+#if !defined(__APPLE__)
+	int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return;
+	posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+	close(fd);
+#endif
+}
+
+/** @brief Decodes the whole file through vfs, returns seconds spent and frames decoded. */
+static std::pair<double, ma_uint64> decode_through(ma_vfs* vfs, const std::string& path) {
+	ma_decoder_config config = ma_decoder_config_init(ma_format_f32, 0, 0);
+	ma_decoder decoder;
+	auto start = std::chrono::steady_clock::now();
+	if (ma_decoder_init_vfs(vfs, path.c_str(), &config, &decoder) != MA_SUCCESS)
+		return { 0, 0 };
+
+	std::vector<float> frames(4096 * decoder.outputChannels);
+	ma_uint64 total = 0;
+	ma_uint64 decoded = 0;
+	while (ma_decoder_read_pcm_frames(&decoder, frames.data(), 4096, &decoded) == MA_SUCCESS && decoded > 0)
+		total += decoded;
+	ma_decoder_uninit(&decoder);
+
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	return { elapsed.count(), total };
+}
+
+static int bench_vfs(const std::string& input) {
+	std::string path = input;
+	if (path.empty()) {
+		path = temp_path("aurabeat-vfs.wav");
+		if (!write_test_tone(path, 44100, 440, 300)) {
+			log("could not write test tone", ERROR);
+			return 1;
+		}
+	}
+
+	ma_decoder probe;
+	if (ma_decoder_init_file(path.c_str(), NULL, &probe) != MA_SUCCESS) {
+		log("could not decode " + path, ERROR);
+		return 1;
+	}
+	ma_uint32 sample_rate = probe.outputSampleRate;
+	ma_decoder_uninit(&probe);
+	double file_mib = double(std::filesystem::file_size(path)) / (1024 * 1024);
+
+	// * the default VFS is stdio, its reads are fread calls that may or may not reach the kernel; the read-ahead ones are preads
+	std::printf("%-10s %-10s %-12s %-10s %-10s\n", "vfs", "MiB/s", "x realtime", "reads", "read ms");
+	int result = 0;
+	for (int run = 0; run < 2; run++) {
+		stalling_vfs default_vfs{};
+		init_stalling_vfs(&default_vfs, 0, 0);
+		evict_from_page_cache(path);
+		auto [default_seconds, default_frames] = decode_through((ma_vfs*)&default_vfs, path);
+
+		readahead_vfs buffered_vfs;
+		readahead_vfs_init(&buffered_vfs, readahead_vfs_config{});
+		evict_from_page_cache(path);
+		auto [buffered_seconds, buffered_frames] = decode_through((ma_vfs*)&buffered_vfs, path);
+		readahead_io_stats buffered = readahead_vfs_totals(&buffered_vfs);
+
+		std::printf("%-10s %-10.1f %-12.1f %-10llu %-10.1f\n", "default", file_mib / default_seconds,
+			double(default_frames) / sample_rate / default_seconds, (unsigned long long)default_vfs.reads, double(default_vfs.read_ns) / 1e6);
+		std::printf("%-10s %-10.1f %-12.1f %-10llu %-10.1f\n", "readahead", file_mib / buffered_seconds,
+			double(buffered_frames) / sample_rate / buffered_seconds, (unsigned long long)buffered.syscalls, double(buffered.stall_ns) / 1e6);
+		// * speed depends on the storage (a tmpfs or a cache that ignores the eviction makes both warm), the reads don't
+		if (buffered_frames != default_frames || buffered_frames == 0 || buffered.syscalls >= default_vfs.reads) {
+			std::printf("FAIL: the read-ahead VFS must decode every frame, in fewer reads than the default\n");
+			result = 1;
+		}
+	}
+	std::printf("default: fread calls into miniaudio's stdio VFS, readahead: preads of %zu KiB\n", readahead_vfs_config{}.buffer_size / 1024);
+
+	if (input.empty())
+		std::filesystem::remove(path);
+	return result;
+}
+
+constexpr int SYNTHETIC_FOLDERS = 1000;
+constexpr int SYNTHETIC_FILES_PER_FOLDER = 999;
+
+/** @brief Builds a tree of empty files with about a million entries once, later runs reuse it. */
+static std::string synthetic_tree() {
+	std::string root = temp_path("aurabeat-scan-tree");
+	std::filesystem::path marker = std::filesystem::path(root) / ".complete";
+	if (std::filesystem::exists(marker))
+		return root;
+
+	log("creating " + root + ", this only happens once", INFO);
+	for (int folder = 0; folder < SYNTHETIC_FOLDERS; folder++) {
+		std::filesystem::path directory = std::filesystem::path(root) / std::to_string(folder / 100) / std::to_string(folder);
+		std::filesystem::create_directories(directory);
+		for (int file = 0; file < SYNTHETIC_FILES_PER_FOLDER; file++) {
+			int fd = open((directory / (std::to_string(file) + ".flac")).c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+			if (fd >= 0)
+				close(fd);
+		}
+	}
+	close(open(marker.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644));
+	return root;
+}
+
+static library_scan_config walk_only(unsigned threads) {
+	library_scan_config config;
+	config.threads = threads;
+	config.sniff = false;
+	return config;
+}
+
+/** @brief The recursive GIO enumeration the library scan used before, returns entries seen. */
+static ma_uint64 gio_walk(GFile* folder) {
+	GFileEnumerator* enumerator = g_file_enumerate_children(folder, G_FILE_ATTRIBUTE_STANDARD_NAME "," G_FILE_ATTRIBUTE_STANDARD_TYPE,
+		G_FILE_QUERY_INFO_NONE, NULL, NULL);
+	if (enumerator == NULL)
+		return 0;
+
+	ma_uint64 entries = 0;
+	while (GFileInfo* info = g_file_enumerator_next_file(enumerator, NULL, NULL)) {
+		entries++;
+		if (g_file_info_get_file_type(info) == G_FILE_TYPE_DIRECTORY) {
+			GFile* child = g_file_get_child(folder, g_file_info_get_name(info));
+			entries += gio_walk(child);
+			g_object_unref(child);
+		}
+		g_object_unref(info);
+	}
+	g_file_enumerator_close(enumerator, NULL, NULL);
+	g_object_unref(enumerator);
+	return entries;
+}
+
+static int bench_scan(const std::string& input) {
+	std::string root = input.empty() ? synthetic_tree() : input;
+
+	// * one untimed pass so every row runs against a warm dentry cache
+	library_scan(root, walk_only(0));
+
+	std::printf("%-12s %-10s %-12s %-10s\n", "walker", "entries", "entries/s", "statx");
+	GFile* folder = g_file_new_for_path(root.c_str());
+	auto start = std::chrono::steady_clock::now();
+	ma_uint64 gio_entries = gio_walk(folder);
+	std::chrono::duration<double> gio_seconds = std::chrono::steady_clock::now() - start;
+	g_object_unref(folder);
+	std::printf("%-12s %-10llu %-12.0f %-10s\n", "gio", (unsigned long long)gio_entries, double(gio_entries) / gio_seconds.count(), "-");
+
+	unsigned hardware_threads = std::max(1u, std::thread::hardware_concurrency());
+	std::vector<unsigned> thread_counts;
+	for (unsigned threads = 1; threads < hardware_threads; threads *= 2)
+		thread_counts.push_back(threads);
+	thread_counts.push_back(hardware_threads);
+
+	// * GIO follows symlinked folders and the walker doesn't, so the counts only have to agree on the synthetic tree
+	int result = 0;
+	double best_rate = 0;
+	for (unsigned threads : thread_counts) {
+		library_scan_stats stats;
+		library_scan(root, walk_only(threads), &stats);
+		std::string name = "getdents x" + std::to_string(threads);
+		std::printf("%-12s %-10llu %-12.0f %-10llu\n", name.c_str(), (unsigned long long)stats.entries,
+			double(stats.entries) / stats.seconds, (unsigned long long)stats.stat_calls);
+		best_rate = std::max(best_rate, double(stats.entries) / stats.seconds);
+		if (input.empty() && stats.entries != gio_entries) {
+			std::printf("FAIL: %u threads found %llu entries, GIO %llu\n", threads, (unsigned long long)stats.entries, (unsigned long long)gio_entries);
+			result = 1;
+		}
+	}
+	if (best_rate <= double(gio_entries) / gio_seconds.count()) {
+		std::printf("FAIL: the getdents64 walker is no faster than GIO\n");
+		result = 1;
+	}
+	return result;
+}
+
+constexpr int HEADER_TREE_FOLDERS = 100;
+constexpr int HEADER_TREE_FILES_PER_FOLDER = 500;
+
+/** @brief 50k hard links to one short tone, enough files to measure per-file syscall cost. */
+static std::string header_tree() {
+	std::string root = temp_path("aurabeat-header-tree");
+	std::filesystem::path marker = std::filesystem::path(root) / ".complete";
+	if (std::filesystem::exists(marker))
+		return root;
+
+	log("creating " + root + ", this only happens once", INFO);
+	std::filesystem::create_directories(root);
+	std::string tone = root + "/tone.wav";
+	if (!write_test_tone(tone, 8000, 440, 4))
+		return root;
+	for (int folder = 0; folder < HEADER_TREE_FOLDERS; folder++) {
+		std::filesystem::path directory = std::filesystem::path(root) / std::to_string(folder);
+		std::filesystem::create_directories(directory);
+		for (int file = 0; file < HEADER_TREE_FILES_PER_FOLDER; file++)
+			link(tone.c_str(), (directory / (std::to_string(file) + ".wav")).c_str());
+	}
+	close(open(marker.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644));
+	return root;
+}
+
+static int bench_headers(const std::string& input) {
+	std::string root = input.empty() ? header_tree() : input;
+	std::vector<std::string> files;
+	for (auto& track : library_scan(root, walk_only(0)))
+		files.push_back(std::move(track.path));
+
+	std::printf("%-10s %-10s %-12s %-10s %-12s\n", "reader", "files", "files/s", "syscalls", "syscalls/s");
+	int result = 0;
+	for (int run = 0; run < 2; run++) {
+		ma_uint64 sync_files = 0;
+		ma_uint64 sync_syscalls = 0;
+		for (bool use_io_uring : { false, true }) {
+			header_reader_config config;
+			config.use_io_uring = use_io_uring;
+			ma_uint64 audio_files = 0;
+			header_reader_stats stats;
+
+			auto start = std::chrono::steady_clock::now();
+			read_headers(files, config, [&](std::size_t index, const file_header& header) {
+				if (sniff_encoding_format(files[index].c_str(), header.bytes, header.length) != ma_encoding_format_unknown)
+					audio_files++;
+			}, &stats);
+			std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+
+			if (use_io_uring && !stats.used_io_uring)
+				log("io_uring is not available, fell back to plain syscalls", WARNING);
+			std::printf("%-10s %-10llu %-12.0f %-10llu %-12.0f\n", stats.used_io_uring ? "io_uring" : "sync",
+				(unsigned long long)audio_files, double(stats.files) / seconds.count(), (unsigned long long)stats.syscalls,
+				double(stats.syscalls) / seconds.count());
+
+			if (!use_io_uring) {
+				sync_files = audio_files;
+				sync_syscalls = stats.syscalls;
+			} else if (audio_files != sync_files || (stats.used_io_uring && stats.syscalls >= sync_syscalls)) {
+				std::printf("FAIL: io_uring must find the same audio files as the plain syscalls, in fewer syscalls\n");
+				result = 1;
+			}
+		}
+	}
+	return result;
+}
+
+static void print_device_report(const device_scan_report& report) {
+	std::printf("  disk %s %s, %llu files, %.1f MiB/s, %llu slow reads taking %.2fs of %.2fs, %s\n",
+		device_name(report.device).c_str(), report.rotational ? "rotational" : "solid state",
+		(unsigned long long)report.files, double(report.bytes_read) / (1024 * 1024) / report.seconds, (unsigned long long)report.slow_reads,
+		report.slow_read_seconds, report.read_seconds, report.seek_bound ? "seek-bound" : "throughput-bound");
+	if (report.used_fiemap)
+		std::printf("  head travel %.1f GiB in path order, %.1f GiB in physical order\n",
+			double(report.path_order_travel) / (1 << 30), double(report.physical_order_travel) / (1 << 30));
+	else
+		std::printf("  no FIEMAP on this filesystem, sorted by inode\n");
+}
+
+static int bench_hdd(const std::string& input) {
+	if (input.empty())
+		log("without --bench-input this runs on hard links to a single file, which says little about seeks", WARNING);
+	std::string root = input.empty() ? header_tree() : input;
+	std::vector<std::string> files;
+	for (auto& track : library_scan(root, walk_only(0)))
+		files.push_back(std::move(track.path));
+
+	struct run {
+		const char* name;
+		scan_order order;
+		unsigned threads;
+		bool use_io_uring;
+	};
+	const run runs[] = {
+		{ "path x1", scan_order::path, 1, false },
+		{ "path xN", scan_order::path, 0, true },
+		{ "physical", scan_order::physical, 0, false },
+	};
+
+	std::printf("%-10s %-10s %-10s %-10s\n", "order", "tracks", "files/s", "seconds");
+	int result = 0;
+	ma_uint64 path_tracks = 0;
+	for (const auto& run : runs) {
+		// * header reads have to reach the disk, or there is no seek to avoid
+		for (const auto& file : files)
+			evict_from_page_cache(file);
+
+		library_scan_config config;
+		config.order = run.order;
+		config.threads = run.threads;
+		config.headers.use_io_uring = run.use_io_uring;
+		library_scan_stats stats;
+		library_scan(root, config, &stats);
+
+		double header_seconds = stats.seconds - stats.walk_seconds;
+		std::printf("%-10s %-10llu %-10.0f %-10.2f\n", run.name, (unsigned long long)stats.tracks, double(files.size()) / header_seconds, header_seconds);
+		for (const auto& report : stats.devices)
+			print_device_report(report);
+
+		// * the order is the only thing that may change, never the tracks found; sorting must never add head travel
+		if (run.order == scan_order::path && path_tracks == 0)
+			path_tracks = stats.tracks;
+		bool is_longer = std::ranges::any_of(stats.devices, [](const device_scan_report& report) {
+			return report.used_fiemap && report.physical_order_travel > report.path_order_travel;
+		});
+		if (stats.tracks != path_tracks || is_longer) {
+			std::printf("FAIL: %s must find the same %llu tracks without adding head travel\n", run.name, (unsigned long long)path_tracks);
+			result = 1;
+		}
+	}
+	return result;
+}
+
+/** @brief Plain sequential read of the whole file, the speed the hash has to keep up with. */
+static ma_uint64 read_whole_file(const std::string& path) {
+	int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return 0;
+	std::vector<unsigned char> chunk(1024 * 1024);
+	ma_uint64 total = 0;
+	for (ssize_t result; (result = read(fd, chunk.data(), chunk.size())) > 0;)
+		total += ma_uint64(result);
+	close(fd);
+	return total;
+}
+
+/** @brief Copy of a WAV with a LIST/INFO title chunk after the data, the payload untouched. */
+static bool add_wav_tags(const std::string& from, const std::string& to) {
+	std::error_code error;
+	std::vector<char> bytes(std::filesystem::file_size(from, error));
+	FILE* input = std::fopen(from.c_str(), "rb");
+	if (error || input == NULL)
+		return false;
+	bool is_read = std::fread(bytes.data(), 1, bytes.size(), input) == bytes.size();
+	std::fclose(input);
+	if (!is_read || bytes.size() < 12 || (bytes.size() & 1) != 0)
+		return false;
+
+	const char tags[] = "LIST\x12\0\0\0INFOINAM\x06\0\0\0tagged";
+	bytes.insert(bytes.end(), tags, tags + sizeof(tags) - 1);
+	ma_uint32 riff_size = ma_uint32(bytes.size() - 8);
+	for (int byte = 0; byte < 4; byte++)
+		bytes[4 + byte] = char(riff_size >> (byte * 8));
+	FILE* output = std::fopen(to.c_str(), "wb");
+	if (output == NULL)
+		return false;
+	bool is_written = std::fwrite(bytes.data(), 1, bytes.size(), output) == bytes.size();
+	return std::fclose(output) == 0 && is_written;
+}
+
+static int bench_hash(const std::string& input) {
+	std::string root = input;
+	if (root.empty()) {
+		root = temp_path("aurabeat-hash");
+		std::filesystem::create_directories(root);
+		for (int i = 0; i < 8; i++)
+			write_test_tone(root + "/tone" + std::to_string(i) + ".wav", 44100, 220.0f * float(i + 1), 120);
+		add_wav_tags(root + "/tone0.wav", root + "/tagged.wav");
+	}
+	std::vector<library_track> tracks = library_scan(root, library_scan_config{});
+
+	std::printf("%-10s %-10s %-10s\n", "pass", "MiB", "MiB/s");
+	double hash_rate = 0;
+	for (int run = 0; run < 2; run++) {
+		for (const auto& track : tracks)
+			evict_from_page_cache(track.path);
+		ma_uint64 read_bytes = 0;
+		auto start = std::chrono::steady_clock::now();
+		for (const auto& track : tracks)
+			read_bytes += read_whole_file(track.path);
+		std::chrono::duration<double> read_seconds = std::chrono::steady_clock::now() - start;
+
+		for (const auto& track : tracks)
+			evict_from_page_cache(track.path);
+		ma_uint64 hashed_bytes = 0;
+		start = std::chrono::steady_clock::now();
+		for (auto& track : tracks) {
+			content_hash_stats stats{};
+			track.content_hash = content_hash_file(track.path.c_str(), track.format, &stats);
+			hashed_bytes += stats.bytes_hashed;
+		}
+		std::chrono::duration<double> hash_seconds = std::chrono::steady_clock::now() - start;
+
+		std::printf("%-10s %-10.1f %-10.1f\n", "read", double(read_bytes) / (1 << 20), double(read_bytes) / (1 << 20) / read_seconds.count());
+		std::printf("%-10s %-10.1f %-10.1f\n", "hash", double(hashed_bytes) / (1 << 20), double(hashed_bytes) / (1 << 20) / hash_seconds.count());
+		hash_rate = double(hashed_bytes) / (1 << 20) / hash_seconds.count();
+	}
+
+	auto groups = library_duplicate_groups(tracks);
+	std::printf("%zu tracks, %zu duplicate groups\n", tracks.size(), groups.size());
+	if (input.empty())
+		std::filesystem::remove_all(root);
+
+	// * a SATA SSD, anything slower would make the hash rather than the disk the limit; reading alone is too noisy to compare with
+	constexpr double MIN_HASH_MIB_PER_SECOND = 500;
+	int result = 0;
+	if (hash_rate < MIN_HASH_MIB_PER_SECOND) {
+		std::printf("FAIL: hashing below %.0f MiB/s would not keep up with a disk\n", MIN_HASH_MIB_PER_SECOND);
+		result = 1;
+	}
+	// * the synthetic tones differ, except the copy of the first with tags added
+	if (input.empty() && (groups.size() != 1 || groups[0].size() != 2)) {
+		std::printf("FAIL: only the retagged copy must hash the same as its original\n");
+		result = 1;
+	}
+	return result;
+}
+
+/** @brief Chords that change every quarter second, the same seed gives the same music at any rate. */
+static bool write_test_melody(const std::string& path, ma_uint32 sample_rate, ma_uint32 seed, ma_uint32 seconds) {
+	ma_encoder_config config = ma_encoder_config_init(ma_encoding_format_wav, ma_format_s16, 1, sample_rate);
+	ma_encoder encoder;
+	if (ma_encoder_init_file(path.c_str(), &config, &encoder) != MA_SUCCESS)
+		return false;
+
+	std::vector<ma_int16> frames(std::size_t(sample_rate) * seconds);
+	double phases[3] = {};
+	double frequencies[3] = {};
+	std::size_t chord = SIZE_MAX;
+	for (std::size_t i = 0; i < frames.size(); i++) {
+		if (i * 4 / sample_rate != chord) {
+			chord = i * 4 / sample_rate;
+			std::mt19937 random(seed * 100003 + ma_uint32(chord));
+			std::uniform_real_distribution<double> frequency(300, 2000);
+			for (double& note : frequencies)
+				note = frequency(random);
+		}
+		double sample = 0;
+		for (int note = 0; note < 3; note++) {
+			phases[note] += 2 * M_PI * frequencies[note] / sample_rate;
+			sample += std::sin(phases[note]);
+		}
+		frames[i] = ma_int16(sample * 6000);
+	}
+	ma_encoder_write_pcm_frames(&encoder, frames.data(), frames.size(), NULL);
+	ma_encoder_uninit(&encoder);
+	return true;
+}
+
+/** @brief MPEG 1 layer III frames of silence at 44.1 kHz, a constant 128 kbit/s or random bitrates, with a Xing header if asked. */
+static bool write_silent_mp3(const std::string& path, ma_uint32 frames, bool is_vbr, bool has_xing) {
+	static const ma_uint32 bitrates[15] = { 0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320 };
+	std::mt19937 random(frames);
+	std::vector<unsigned char> bytes;
+	ma_uint32 remainder = 0;
+	for (ma_uint32 i = 0; i < frames + (has_xing ? 1 : 0); i++) {
+		int index = is_vbr && !(has_xing && i == 0) ? 1 + int(random() % 14) : 9;
+		// * padding spreads the fraction of a byte that 144 * bitrate / rate leaves over
+		ma_uint32 padding = (remainder + 144 * bitrates[index] * 1000 % 44100) / 44100;
+		remainder = (remainder + 144 * bitrates[index] * 1000 % 44100) % 44100;
+		std::size_t start = bytes.size();
+		bytes.resize(start + 144 * bitrates[index] * 1000 / 44100 + padding);
+		bytes[start] = 0xFF;
+		bytes[start + 1] = 0xFB;
+		bytes[start + 2] = (unsigned char)(index << 4 | padding << 1);
+		if (has_xing && i == 0) {
+			std::copy_n("Xing\0\0\0\1", 8, &bytes[start + 36]);
+			for (int byte = 0; byte < 4; byte++)
+				bytes[start + 44 + byte] = (unsigned char)(frames >> (24 - byte * 8));
+		}
+	}
+	FILE* file = std::fopen(path.c_str(), "wb");
+	if (file == NULL)
+		return false;
+	bool is_written = std::fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+	return std::fclose(file) == 0 && is_written;
+}
+
+static int bench_durations(const std::string& input) {
+	std::string root = input;
+	if (root.empty()) {
+		root = temp_path("aurabeat-durations");
+		std::filesystem::create_directories(root);
+		write_test_melody(root + "/melody.wav", 44100, 1, 60);
+		write_test_melody(root + "/melody-48k.wav", 48000, 2, 90);
+		write_silent_mp3(root + "/cbr.mp3", 20000, false, false);
+		write_silent_mp3(root + "/vbr.mp3", 20000, true, false);
+		write_silent_mp3(root + "/xing.mp3", 20000, true, true);
+	}
+	std::vector<library_track> tracks = library_scan(root, library_scan_config{});
+	// * every file taken as if on a spinning disk: nothing past the header bytes, the rest left for later
+	library_scan_config physical_config;
+	physical_config.order = scan_order::physical;
+	std::vector<library_track> physical = library_scan(root, physical_config);
+
+	// * the decoder's length is the reference, miniaudio walks every MP3 frame for it
+	std::printf("%-10s %-10s %-10s %-10s %-10s %s\n", "source", "probe us", "decode us", "seconds", "error ms", "track");
+	double probe_total = 0;
+	double decoder_total = 0;
+	// * a frame of MP3 is 26ms, and a VBR length extrapolated from its first 4 MiB is only as good as that sample
+	constexpr double MAX_ERROR_MS = 100;
+	constexpr double MAX_ERROR_FRACTION = 0.005;
+	double worst_error = 0;
+	int mismatches = 0;
+	for (std::size_t i = 0; i < tracks.size(); i++) {
+		const library_track& track = tracks[i];
+		auto start = std::chrono::steady_clock::now();
+		track_duration duration = probe_duration(track.path.c_str(), track.format);
+		std::chrono::duration<double, std::micro> probe_us = std::chrono::steady_clock::now() - start;
+
+		start = std::chrono::steady_clock::now();
+		ma_decoder_config decoder_config = ma_decoder_config_init(ma_format_f32, 0, 0);
+		decoder_config.encodingFormat = track.format;
+		ma_decoder decoder;
+		ma_uint64 frames = 0;
+		ma_uint32 sample_rate = 0;
+		if (ma_decoder_init_file(track.path.c_str(), &decoder_config, &decoder) == MA_SUCCESS) {
+			ma_decoder_get_length_in_pcm_frames(&decoder, &frames);
+			ma_decoder_get_data_format(&decoder, NULL, NULL, &sample_rate, NULL, 0);
+			ma_decoder_uninit(&decoder);
+		}
+		std::chrono::duration<double, std::micro> decoder_us = std::chrono::steady_clock::now() - start;
+
+		double reference = sample_rate > 0 ? double(frames) / sample_rate : 0;
+		double error_ms = (duration_seconds(duration) - reference) * 1000;
+		probe_total += probe_us.count();
+		decoder_total += decoder_us.count();
+		worst_error = std::max(worst_error, std::abs(error_ms));
+		mismatches += std::abs(error_ms) > std::max(MAX_ERROR_MS, reference * 1000 * MAX_ERROR_FRACTION);
+		std::printf("%-10s %-10.0f %-10.0f %-10.1f %-10.1f %s\n", duration_source_name(duration.source), probe_us.count(), decoder_us.count(),
+			duration_seconds(duration), error_ms, std::filesystem::path(track.path).filename().c_str());
+
+		// * the physical-order scan either agrees or defers, a length guessed from a cut short read would be wrong
+		bool is_same_track = i < physical.size() && physical[i].path == track.path;
+		track_duration head_only = is_same_track ? physical[i].duration : track_duration{};
+		if (!is_same_track || (head_only.source != duration_source::DEFERRED && (head_only.frames != duration.frames || head_only.source != duration.source))) {
+			std::printf("physical-order scan: %s for %s\n", duration_source_name(head_only.source), track.path.c_str());
+			mismatches++;
+		}
+	}
+	if (!tracks.empty())
+		std::printf("%zu tracks: probe %.0fus, decoder %.0fus per track, worst error %.1fms\n", tracks.size(),
+			probe_total / double(tracks.size()), decoder_total / double(tracks.size()), worst_error);
+	std::printf("physical-order scan deferred %lld of %zu lengths\n",
+		(long long)std::ranges::count(physical, duration_source::DEFERRED, [](const library_track& track) { return track.duration.source; }), physical.size());
+	if (input.empty())
+		std::filesystem::remove_all(root);
+	if (tracks.empty() || mismatches > 0) {
+		std::printf("FAIL: every length within %.0fms or %.1f%% of the decoder's, the physical-order scan agreeing or deferring\n",
+			MAX_ERROR_MS, MAX_ERROR_FRACTION * 100);
+		return 1;
+	}
+	return 0;
+}
+
+static int bench_fingerprint(const std::string& input) {
+	std::string root = temp_path("aurabeat-fingerprint");
+	std::filesystem::create_directories(root);
+	write_test_melody(root + "/original.wav", 44100, 1, 60);
+	write_test_melody(root + "/resampled.wav", 48000, 1, 60);
+	write_test_melody(root + "/other.wav", 44100, 2, 60);
+
+	auto start = std::chrono::steady_clock::now();
+	std::vector<ma_uint32> original = fingerprint_file((root + "/original.wav").c_str(), ma_encoding_format_wav);
+	std::chrono::duration<double> fingerprint_seconds = std::chrono::steady_clock::now() - start;
+	std::vector<ma_uint32> resampled = fingerprint_file((root + "/resampled.wav").c_str(), ma_encoding_format_wav);
+	std::vector<ma_uint32> other = fingerprint_file((root + "/other.wav").c_str(), ma_encoding_format_wav);
+	std::filesystem::remove_all(root);
+	if (original.empty() || resampled.empty() || other.empty()) {
+		log("fingerprinting the test tracks failed", ERROR);
+		return 1;
+	}
+	float resampled_error = fingerprint_bit_error_rate(original, resampled, 0);
+	float other_error = fingerprint_bit_error_rate(original, other, 0);
+	std::printf("fingerprint %.1fms, bit error rate %.3f resampled, %.3f other music\n", fingerprint_seconds.count() * 1000,
+		resampled_error, other_error);
+
+	// * the rest of the library is random words, every track is looked up against all of them
+	std::size_t track_count = input.empty() ? 200000 : std::stoul(input);
+	std::mt19937 random(5);
+	std::vector<std::vector<ma_uint32>> library(track_count);
+	for (auto& fingerprint : library) {
+		fingerprint.resize(original.size());
+		for (ma_uint32& word : fingerprint)
+			word = ma_uint32(random());
+	}
+	library[track_count / 2] = original;
+	std::vector<const std::vector<ma_uint32>*> entries;
+	for (const auto& fingerprint : library)
+		entries.push_back(&fingerprint);
+
+	start = std::chrono::steady_clock::now();
+	fingerprint_index* index = fingerprint_index_build(entries);
+	std::chrono::duration<double> build_seconds = std::chrono::steady_clock::now() - start;
+	start = std::chrono::steady_clock::now();
+	std::size_t matches = 0;
+	for (const auto& fingerprint : library)
+		matches += fingerprint_index_lookup(index, fingerprint).size();
+	std::chrono::duration<double> lookup_seconds = std::chrono::steady_clock::now() - start;
+	std::vector<fingerprint_match> found = fingerprint_index_lookup(index, resampled);
+	fingerprint_index_destroy(index);
+
+	bool is_found = !found.empty() && found.front().entry == track_count / 2;
+	std::printf("%zu tracks: index %.2fs, all lookups %.2fs, %zu matches, resampled copy %s\n", track_count, build_seconds.count(),
+		lookup_seconds.count(), matches, is_found ? "found" : "missed");
+
+	// * the lookup threshold sits between the two bit error rates; random words only ever match themselves;
+	// * "in seconds" for 200k tracks, scaled to the library asked for
+	constexpr float MATCH_ERROR = 0.25f;
+	double max_seconds = 10.0 * double(track_count) / 200000;
+	if (resampled_error >= MATCH_ERROR || other_error <= MATCH_ERROR || !is_found || matches != track_count ||
+		build_seconds.count() + lookup_seconds.count() > max_seconds) {
+		std::printf("FAIL: the resampled copy must match and nothing else, indexing and looking up all of them within %.1fs\n", max_seconds);
+		return 1;
+	}
+	return 0;
+}
+
+static int bench_loudness(const std::string& input) {
+	std::string root = input;
+	if (root.empty()) {
+		root = temp_path("aurabeat-loudness");
+		std::filesystem::create_directories(root);
+		for (int i = 0; i < 8; i++)
+			write_test_melody(root + "/melody" + std::to_string(i) + ".wav", 44100, ma_uint32(i), 120);
+	}
+	std::vector<library_track> tracks = library_scan(root, library_scan_config{});
+
+	std::printf("%-8s %-10s %-10s %-10s %-10s\n", "LUFS", "LU range", "dBTP", "x realtime", "track");
+	double audio_seconds = 0;
+	double analysis_seconds = 0;
+	std::size_t unmeasured = 0;
+	for (const auto& track : tracks) {
+		loudness_stats stats{};
+		track_loudness loudness = loudness_analyse_file(track.path.c_str(), track.format, &stats);
+		if (!loudness.measured || stats.frames == 0) {
+			unmeasured++;
+			continue;
+		}
+		double seconds = double(stats.frames) / stats.sample_rate;
+		audio_seconds += seconds;
+		analysis_seconds += stats.seconds;
+		std::printf("%-8.2f %-10.2f %-10.2f %-10.0f %s\n", loudness.integrated, loudness.range, loudness.true_peak, seconds / stats.seconds,
+			std::filesystem::path(track.path).filename().c_str());
+	}
+
+	// * the same files again with one analysis per core, the way the job pool spreads them
+	unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+	std::atomic<std::size_t> next = 0;
+	auto start = std::chrono::steady_clock::now();
+	std::vector<std::thread> workers;
+	for (unsigned i = 0; i < threads; i++) {
+		workers.emplace_back([&] {
+			for (std::size_t index; (index = next++) < tracks.size();)
+				loudness_analyse_file(tracks[index].path.c_str(), tracks[index].format);
+		});
+	}
+	for (auto& worker : workers)
+		worker.join();
+	std::chrono::duration<double> parallel_seconds = std::chrono::steady_clock::now() - start;
+
+	if (analysis_seconds > 0)
+		std::printf("%.0fx realtime on one core, %.0fx on %u threads\n", audio_seconds / analysis_seconds,
+			audio_seconds / parallel_seconds.count(), threads);
+	if (input.empty())
+		std::filesystem::remove_all(root);
+
+	constexpr double MIN_REALTIME = 100;
+	if (tracks.empty() || unmeasured > 0 || analysis_seconds <= 0 || audio_seconds / analysis_seconds < MIN_REALTIME) {
+		std::printf("FAIL: every track measured, at more than %.0fx realtime on one core\n", MIN_REALTIME);
+		return 1;
+	}
+	return 0;
+}
+
+static int bench_waveform(const std::string& input) {
+	std::string root = input;
+	if (root.empty()) {
+		root = temp_path("aurabeat-waveform");
+		std::filesystem::create_directories(root);
+		for (int i = 0; i < 8; i++)
+			write_test_melody(root + "/melody" + std::to_string(i) + ".wav", 44100, ma_uint32(i), 120);
+	}
+	std::vector<library_track> tracks = library_scan(root, library_scan_config{});
+
+	std::printf("%-8s %-10s %-10s %s\n", "buckets", "levels", "x realtime", "track");
+	double audio_seconds = 0;
+	double analysis_seconds = 0;
+	std::size_t failed = 0;
+	waveform longest;
+	for (const auto& track : tracks) {
+		waveform_stats stats{};
+		waveform overview = waveform_analyse_file(track.path.c_str(), track.format, &stats);
+		if (overview.levels.empty() || stats.frames == 0) {
+			failed++;
+			continue;
+		}
+		double seconds = double(stats.frames) / stats.sample_rate;
+		audio_seconds += seconds;
+		analysis_seconds += stats.seconds;
+		std::printf("%-8zu %-10zu %-10.0f %s\n", overview.levels[0].size(), overview.levels.size(), seconds / stats.seconds,
+			std::filesystem::path(track.path).filename().c_str());
+		if (overview.frames > longest.frames)
+			longest = std::move(overview);
+	}
+
+	// * the same files again with one analysis per core, the way the job pool spreads them
+	unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+	std::atomic<std::size_t> next = 0;
+	auto start = std::chrono::steady_clock::now();
+	std::vector<std::thread> workers;
+	for (unsigned i = 0; i < threads; i++) {
+		workers.emplace_back([&] {
+			for (std::size_t index; (index = next++) < tracks.size();)
+				waveform_analyse_file(tracks[index].path.c_str(), tracks[index].format);
+		});
+	}
+	for (auto& worker : workers)
+		worker.join();
+	std::chrono::duration<double> parallel_seconds = std::chrono::steady_clock::now() - start;
+
+	if (analysis_seconds > 0)
+		std::printf("%.0fx realtime on one core, %.0fx on %u threads\n", audio_seconds / analysis_seconds,
+			audio_seconds / parallel_seconds.count(), threads);
+
+	int result = 0;
+	constexpr double MIN_REALTIME = 200;
+	if (tracks.empty() || failed > 0 || analysis_seconds <= 0 || audio_seconds / analysis_seconds < MIN_REALTIME) {
+		std::printf("FAIL: every track analysed, at more than %.0fx realtime on one core\n", MIN_REALTIME);
+		result = 1;
+	}
+
+	if (!longest.levels.empty()) {
+		// * what the seek bar pays per resize, and per track change once the cache is warm
+		std::vector<waveform_peak> peaks;
+		for (ma_uint32 columns : { 600u, 1920u }) {
+			const int runs = 1000;
+			start = std::chrono::steady_clock::now();
+			for (int run = 0; run < runs; run++)
+				waveform_render(longest, columns, peaks);
+			std::chrono::duration<double, std::micro> render = std::chrono::steady_clock::now() - start;
+			std::printf("render %u columns %.1fus\n", columns, render.count() / runs);
+		}
+
+		std::string file = waveform_cache_file(root, "bench");
+		waveform loaded;
+		waveform_cache_save(file, 1, 2, longest);
+		start = std::chrono::steady_clock::now();
+		bool is_loaded = waveform_cache_load(file, 1, 2, loaded);
+		std::chrono::duration<double, std::micro> load = std::chrono::steady_clock::now() - start;
+		bool is_identical = is_loaded && loaded.levels == longest.levels;
+		std::printf("cache %ju bytes, load %.0fus, %s\n", (uintmax_t)std::filesystem::file_size(file), load.count(),
+			is_identical ? "identical" : "DIFFERENT");
+		std::filesystem::remove(file);
+		if (!is_identical) {
+			std::printf("FAIL: the cache must load back what was saved\n");
+			result = 1;
+		}
+	}
+	if (input.empty())
+		std::filesystem::remove_all(root);
+	return result;
+}
+
+/** @brief Stereo float test signal full of overs: loud chords, intersample peaks at fs/4 and single-sample spikes. */
+static std::vector<float> synthetic_overs(ma_uint32 sample_rate, ma_uint32 seconds) {
+	std::vector<float> frames(std::size_t(sample_rate) * seconds * 2);
+	std::size_t third = frames.size() / 6;
+	for (std::size_t i = 0; i < frames.size() / 2; i++) {
+		double t = double(i) / sample_rate;
+		double sample;
+		if (i < third)
+			sample = 0.7 * (std::sin(2 * M_PI * 220 * t) + std::sin(2 * M_PI * 277 * t) + std::sin(2 * M_PI * 330 * t));
+		else if (i < third * 2)
+			sample = 1.2 * std::sin(M_PI / 2 * double(i) + M_PI / 4);
+		else
+			sample = 0.3 * std::sin(2 * M_PI * 440 * t) + (i % 4800 == 0 ? 2.0 : 0.0);
+		frames[i * 2] = float(sample);
+		frames[i * 2 + 1] = float(sample * 0.9);
+	}
+	return frames;
+}
+
+static bool write_float_wav(const std::string& path, const std::vector<float>& frames, ma_uint32 sample_rate) {
+	ma_encoder_config config = ma_encoder_config_init(ma_encoding_format_wav, ma_format_f32, 2, sample_rate);
+	ma_encoder encoder;
+	if (ma_encoder_init_file(path.c_str(), &config, &encoder) != MA_SUCCESS)
+		return false;
+	ma_encoder_write_pcm_frames(&encoder, frames.data(), frames.size() / 2, NULL);
+	ma_encoder_uninit(&encoder);
+	return true;
+}
+
+/** @brief Pulls input through a fresh limiter in device-sized periods, the way the engine drives it. */
+static std::vector<float> run_limiter(const std::vector<float>& input, const limiter_config& config, limiter_stats* stats) {
+	std::vector<float> output(input.size());
+	ma_node_graph_config graph_config = ma_node_graph_config_init(2);
+	ma_node_graph graph;
+	if (ma_node_graph_init(&graph_config, NULL, &graph) != MA_SUCCESS)
+		return output;
+	limiter_node* limiter = limiter_node_create(&graph, config);
+
+	ma_audio_buffer_config buffer_config = ma_audio_buffer_config_init(ma_format_f32, 2, input.size() / 2, input.data(), NULL);
+	ma_audio_buffer buffer;
+	ma_audio_buffer_init(&buffer_config, &buffer);
+	ma_data_source_node_config source_config = ma_data_source_node_config_init(&buffer);
+	ma_data_source_node source;
+	ma_data_source_node_init(&graph, &source_config, NULL, &source);
+	ma_node_attach_output_bus(&source, 0, (ma_node*)limiter, 0);
+	ma_node_attach_output_bus((ma_node*)limiter, 0, ma_node_graph_get_endpoint(&graph), 0);
+
+	for (std::size_t frame = 0; frame < output.size() / 2; frame += 480) {
+		ma_uint64 count = std::min<ma_uint64>(480, output.size() / 2 - frame);
+		ma_node_graph_read_pcm_frames(&graph, &output[frame * 2], count, NULL);
+	}
+	if (stats != NULL)
+		*stats = limiter_node_get_stats(limiter);
+
+	ma_data_source_node_uninit(&source, NULL);
+	limiter_node_destroy(limiter);
+	ma_audio_buffer_uninit(&buffer);
+	ma_node_graph_uninit(&graph, NULL);
+	return output;
+}
+
+/** @brief Highest true peak of interleaved stereo frames in dBTP, with the interpolator the limiter detects with. */
+static float true_peak_db(const std::vector<float>& frames) {
+	float4 taps[TRUE_PEAK_TAPS];
+	true_peak_taps(taps);
+	float peak = 0;
+	for (int channel = 0; channel < 2; channel++) {
+		std::vector<float> samples(TRUE_PEAK_TAPS - 1 + frames.size() / 2, 0);
+		for (std::size_t frame = 0; frame < frames.size() / 2; frame++)
+			samples[TRUE_PEAK_TAPS - 1 + frame] = frames[frame * 2 + channel];
+		for (std::size_t i = TRUE_PEAK_TAPS - 1; i < samples.size(); i++) {
+			float4 phases = true_peak_phases(taps, &samples[i]);
+			peak = std::max({ peak, std::fabs(samples[i]), phases[0], phases[1], phases[2], phases[3] });
+		}
+	}
+	return 20 * std::log10(std::max(peak, 1e-9f));
+}
+
+static int bench_limiter(const std::string&) {
+	constexpr ma_uint32 SAMPLE_RATE = 48000;
+	std::vector<float> input = synthetic_overs(SAMPLE_RATE, 30);
+	limiter_config config;
+	config.sample_rate = SAMPLE_RATE;
+	limiter_stats stats;
+	std::vector<float> output = run_limiter(input, config, &stats);
+
+	std::string input_path = temp_path("aurabeat-limiter-in.wav");
+	std::string output_path = temp_path("aurabeat-limiter-out.wav");
+	write_float_wav(input_path, input, SAMPLE_RATE);
+	write_float_wav(output_path, output, SAMPLE_RATE);
+	track_loudness before = loudness_analyse_file(input_path.c_str(), ma_encoding_format_wav);
+	track_loudness after = loudness_analyse_file(output_path.c_str(), ma_encoding_format_wav);
+	std::filesystem::remove(input_path);
+	std::filesystem::remove(output_path);
+
+	for (const auto& stage : audio_stats_get().stages) {
+		if (stage.name == "limiter")
+			std::printf("limiter %.2fus per 480 frames, %.2f%% of realtime\n", stage.average_us, stage.average_us / 10000 * 100);
+	}
+	std::printf("true peak %.2f dBTP in, %.2f dBTP out, ceiling %.1f\n", before.true_peak, after.true_peak, config.ceiling_db);
+	std::printf("%.1f%% of frames limited, %.1f dB at most, %.2fms latency\n", 100.0 * double(stats.limited_frames) / double(stats.frames),
+		stats.max_reduction_db, 1000.0 * stats.latency_frames / SAMPLE_RATE);
+
+	// * the interpolators differ slightly, a tenth of a dB is measurement noise
+	bool is_limited = after.true_peak <= config.ceiling_db + 0.1f;
+	if (!is_limited)
+		log("limiter let overs through", ERROR);
+
+	// * onsets out of silence, where the gain has to be down before the first over leaves the delay line. The fs/4
+	// * burst has every sample under the ceiling and its peaks between them, only the interpolator sees those
+	float worst_onset = -INFINITY;
+	for (ma_uint32 offset : { 0u, 1u, 2u, 3u, 5u, 7u, 131u }) {
+		for (bool is_burst : { false, true }) {
+			std::vector<float> step(std::size_t(4800 + offset + 4800) * 2, 0);
+			for (std::size_t i = 4800 + offset; i < step.size() / 2; i++) {
+				float sample = is_burst ? float(1.2 * std::sin(M_PI / 2 * double(i) + M_PI / 4)) : 1.0f;
+				step[i * 2] = sample;
+				step[i * 2 + 1] = sample;
+			}
+			worst_onset = std::max(worst_onset, true_peak_db(run_limiter(step, config, NULL)));
+		}
+	}
+	std::printf("step onsets %.2f dBTP out at most\n", worst_onset);
+	bool is_onset_limited = worst_onset <= config.ceiling_db + 0.1f;
+	if (!is_onset_limited)
+		log("limiter let the onset of a step through", ERROR);
+	return is_limited && is_onset_limited ? 0 : 1;
+}
+
+static int bench_eq(const std::string&) {
+	eq_settings settings = eq_settings_flat();
+	const float gains[EQ_BANDS] = { 6, -3, 4, -2, 3, -4, 2, -3, 5, -6 };
+	for (int band = 0; band < EQ_BANDS; band++)
+		settings.bands[band].gain_db = gains[band];
+
+	// * a shelf is at half its gain at its corner, the neighbouring bands and warping near Nyquist move that a little
+	constexpr double MAX_SHELF_ERROR_DB = 1;
+	constexpr double MAX_REALTIME_PERCENT = 5;
+	std::printf("%-8s %-12s %-12s %-14s %-14s\n", "rate", "us/block", "% realtime", "dB at 31 Hz", "dB at 16 kHz");
+	int result = 0;
+	for (ma_uint32 sample_rate : { 44100u, 96000u, 192000u }) {
+		ma_node_graph_config graph_config = ma_node_graph_config_init(2);
+		ma_node_graph graph;
+		if (ma_node_graph_init(&graph_config, NULL, &graph) != MA_SUCCESS)
+			return 1;
+		eq_node* eq = eq_node_create(&graph, 2, sample_rate);
+		eq_node_set(eq, settings);
+		ma_node_attach_output_bus((ma_node*)eq, 0, ma_node_graph_get_endpoint(&graph), 0);
+
+		// * one second of each test tone, measured once the crossfade and the filters have settled
+		auto measure = [&](double frequency) {
+			ma_uint32 frames = sample_rate;
+			std::vector<float> input(std::size_t(frames) * 2);
+			for (ma_uint32 i = 0; i < frames; i++)
+				input[i * 2] = input[i * 2 + 1] = float(0.1 * std::sin(2 * M_PI * frequency * i / sample_rate));
+			ma_audio_buffer_config buffer_config = ma_audio_buffer_config_init(ma_format_f32, 2, frames, input.data(), NULL);
+			ma_audio_buffer buffer;
+			ma_audio_buffer_init(&buffer_config, &buffer);
+			ma_data_source_node_config source_config = ma_data_source_node_config_init(&buffer);
+			ma_data_source_node source;
+			ma_data_source_node_init(&graph, &source_config, NULL, &source);
+			ma_node_attach_output_bus(&source, 0, (ma_node*)eq, 0);
+
+			std::vector<float> output(input.size());
+			auto start = std::chrono::steady_clock::now();
+			for (ma_uint32 frame = 0; frame < frames; frame += 1024)
+				ma_node_graph_read_pcm_frames(&graph, &output[std::size_t(frame) * 2], std::min<ma_uint32>(1024, frames - frame), NULL);
+			std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+
+			double in_power = 0, out_power = 0;
+			for (std::size_t i = input.size() / 2; i < input.size(); i++) {
+				in_power += double(input[i]) * input[i];
+				out_power += double(output[i]) * output[i];
+			}
+			ma_data_source_node_uninit(&source, NULL);
+			ma_audio_buffer_uninit(&buffer);
+			return std::pair{ 10 * std::log10(out_power / in_power), seconds.count() / ((frames + 1023) / 1024) };
+		};
+		measure(1000);
+		auto [low_db, block_seconds] = measure(31.25);
+		double high_db = measure(16000).first;
+
+		double realtime_percent = block_seconds / (1024.0 / sample_rate) * 100;
+		std::printf("%-8u %-12.1f %-12.2f %-14.2f %-14.2f\n", sample_rate, block_seconds * 1e6, realtime_percent, low_db, high_db);
+		if (std::abs(low_db - gains[0] / 2) > MAX_SHELF_ERROR_DB || std::abs(high_db - gains[EQ_BANDS - 1] / 2) > MAX_SHELF_ERROR_DB ||
+			realtime_percent > MAX_REALTIME_PERCENT) {
+			std::printf("FAIL: shelves within %.0f dB of half their gain at the corner, under %.0f%% of realtime\n", MAX_SHELF_ERROR_DB,
+				MAX_REALTIME_PERCENT);
+			result = 1;
+		}
+		eq_node_destroy(eq);
+		ma_node_graph_uninit(&graph, NULL);
+	}
+	return result;
+}
+
+static int bench_convolution(const std::string&) {
+	constexpr ma_uint32 SAMPLE_RATE = 48000;
+	constexpr ma_uint32 IMPULSE_FRAMES = SAMPLE_RATE * 3;
+	constexpr ma_uint32 PERIOD = 480;
+
+	// * decaying noise, about what a measured room looks like, 60 dB down after two seconds
+	std::mt19937 random(42);
+	std::normal_distribution<float> noise(0, 0.1f);
+	std::vector<float> impulse(std::size_t(IMPULSE_FRAMES) * 2);
+	for (ma_uint32 frame = 0; frame < IMPULSE_FRAMES; frame++) {
+		float decay = std::pow(10.0f, -3.0f * frame / (SAMPLE_RATE * 2));
+		impulse[frame * 2] = noise(random) * decay;
+		impulse[frame * 2 + 1] = noise(random) * decay;
+	}
+	std::string impulse_path = temp_path("aurabeat-impulse.wav");
+	if (!write_float_wav(impulse_path, impulse, SAMPLE_RATE))
+		return 1;
+
+	int result = 0;
+	std::printf("%-7s %-7s %-7s %-12s %-12s %-12s %-8s %-10s\n", "block", "parts", "tail", "head us/ch", "tail us/ch", "% realtime", "misses",
+		"max error");
+	for (ma_uint32 block : { 128u, 256u, 512u }) {
+		double inline_us = 0;
+		for (bool tail_thread : { false, true }) {
+			ma_node_graph_config graph_config = ma_node_graph_config_init(2);
+			ma_node_graph graph;
+			if (ma_node_graph_init(&graph_config, NULL, &graph) != MA_SUCCESS)
+				return 1;
+			convolution_config config;
+			config.block_frames = block;
+			config.tail_thread = tail_thread;
+			convolution_node* convolution = convolution_node_create(&graph, 2, SAMPLE_RATE, impulse_path.c_str(), config);
+			if (convolution == NULL) {
+				log("could not load the impulse response", ERROR);
+				return 1;
+			}
+
+			// * a unit impulse comes back out as the impulse response, one block late
+			std::vector<float> input(std::size_t(IMPULSE_FRAMES + block) * 2);
+			input[0] = input[1] = 1;
+			ma_audio_buffer_config buffer_config = ma_audio_buffer_config_init(ma_format_f32, 2, input.size() / 2, input.data(), NULL);
+			ma_audio_buffer buffer;
+			ma_audio_buffer_init(&buffer_config, &buffer);
+			ma_data_source_node_config source_config = ma_data_source_node_config_init(&buffer);
+			ma_data_source_node source;
+			ma_data_source_node_init(&graph, &source_config, NULL, &source);
+			ma_node_attach_output_bus(&source, 0, (ma_node*)convolution, 0);
+			ma_node_attach_output_bus((ma_node*)convolution, 0, ma_node_graph_get_endpoint(&graph), 0);
+
+			// * device-sized periods at the device's pace, the worker only has a head start when the audio thread waits
+			std::vector<float> output(input.size());
+			auto next = std::chrono::steady_clock::now();
+			for (std::size_t frame = 0; frame < output.size() / 2; frame += PERIOD) {
+				ma_uint64 count = std::min<ma_uint64>(PERIOD, output.size() / 2 - frame);
+				ma_node_graph_read_pcm_frames(&graph, &output[frame * 2], count, NULL);
+				next += std::chrono::microseconds(PERIOD * 1000000ull / SAMPLE_RATE);
+				std::this_thread::sleep_until(next);
+			}
+			convolution_stats stats = convolution_node_get_stats(convolution);
+
+			double max_error = 0;
+			for (std::size_t i = 0; i < impulse.size(); i++)
+				max_error = std::max(max_error, double(std::fabs(output[std::size_t(block) * 2 + i] - impulse[i])));
+			double block_us = block * 1e6 / SAMPLE_RATE;
+			std::printf("%-7u %-7u %-7s %-12.1f %-12.1f %-12.2f %-8llu %-10.1e\n", block, stats.partitions, tail_thread ? "worker" : "inline",
+				stats.head_us_per_channel, stats.tail_us_per_channel, stats.head_us_per_channel * stats.channels / block_us * 100,
+				(unsigned long long)stats.tail_misses, max_error);
+
+			ma_data_source_node_uninit(&source, NULL);
+			convolution_node_destroy(convolution);
+			ma_audio_buffer_uninit(&buffer);
+			ma_node_graph_uninit(&graph, NULL);
+			if (max_error > 1e-4) {
+				log("convolution output does not match the impulse response", ERROR);
+				result = 1;
+			}
+			// * the worker is there to take the tail off the audio thread, and must keep up with it at device pace
+			if (!tail_thread)
+				inline_us = stats.head_us_per_channel;
+			else if (stats.tail_misses > 0 || stats.head_us_per_channel >= inline_us) {
+				std::printf("FAIL: with the tail worker the audio thread must do less and never wait for a missed tail\n");
+				result = 1;
+			}
+		}
+	}
+	std::filesystem::remove(impulse_path);
+	return result;
+}
+
+static int bench_spectrum(const std::string&) {
+	constexpr ma_uint32 SAMPLE_RATE = 48000;
+	constexpr ma_uint32 PERIOD = 480;
+	ma_node_graph_config graph_config = ma_node_graph_config_init(2);
+	ma_node_graph graph;
+	if (ma_node_graph_init(&graph_config, NULL, &graph) != MA_SUCCESS)
+		return 1;
+	spectrum_tap* tap = spectrum_tap_create(&graph, 2);
+	spectrum_analyser* analyser = spectrum_analyser_create(tap, SAMPLE_RATE, 64);
+	ma_node_attach_output_bus((ma_node*)tap, 0, ma_node_graph_get_endpoint(&graph), 0);
+
+	std::vector<float> input(std::size_t(SAMPLE_RATE) * 2);
+	for (ma_uint32 i = 0; i < SAMPLE_RATE; i++)
+		input[i * 2] = input[i * 2 + 1] = float(0.5 * std::sin(2 * M_PI * 1000 * i / SAMPLE_RATE));
+	ma_audio_buffer_config buffer_config = ma_audio_buffer_config_init(ma_format_f32, 2, SAMPLE_RATE, input.data(), NULL);
+	ma_audio_buffer buffer;
+	ma_audio_buffer_init(&buffer_config, &buffer);
+	ma_data_source_node_config source_config = ma_data_source_node_config_init(&buffer);
+	ma_data_source_node source;
+	ma_data_source_node_init(&graph, &source_config, NULL, &source);
+	ma_node_attach_output_bus(&source, 0, (ma_node*)tap, 0);
+
+	// * the tap's share of a period is the difference it makes to the graph, disabled it only passes audio through
+	std::vector<float> output(std::size_t(PERIOD) * 2);
+	auto time_periods = [&](bool enabled) {
+		spectrum_tap_set_enabled(tap, enabled);
+		ma_data_source_seek_to_pcm_frame(&buffer, 0);
+		auto start = std::chrono::steady_clock::now();
+		for (ma_uint32 frame = 0; frame + PERIOD <= SAMPLE_RATE; frame += PERIOD)
+			ma_node_graph_read_pcm_frames(&graph, output.data(), PERIOD, NULL);
+		std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+		return elapsed.count() / (SAMPLE_RATE / PERIOD);
+	};
+	double disabled_us = time_periods(false);
+	double enabled_us = time_periods(true);
+
+	// * the analyser only looks at audio that arrived since its last update, so every frame drawn gets a period
+	constexpr int UPDATES = 1000;
+	ma_data_source_set_looping(&buffer, MA_TRUE);
+	std::chrono::duration<double, std::micro> elapsed{};
+	for (int update = 0; update < UPDATES; update++) {
+		ma_node_graph_read_pcm_frames(&graph, output.data(), PERIOD, NULL);
+		auto start = std::chrono::steady_clock::now();
+		spectrum_analyser_update(analyser, 1.0 / 60);
+		elapsed += std::chrono::steady_clock::now() - start;
+	}
+
+	const std::vector<float>& levels = spectrum_analyser_levels(analyser);
+	auto loudest = std::max_element(levels.begin(), levels.end());
+	long long loudest_bar = loudest - levels.begin();
+	float loudest_level = *loudest;
+	std::printf("period of %u frames %.2fus with the tap disabled, %.2fus enabled\n", PERIOD, disabled_us, enabled_us);
+	std::printf("analysis %.1fus per frame drawn, %.2f%% of a core at 60 Hz\n", elapsed.count() / UPDATES, elapsed.count() / UPDATES * 60 / 1e4);
+	std::printf("-6 dBFS 1 kHz sine: loudest bar %lld of %zu at %.2f\n", loudest_bar, levels.size(), loudest_level);
+
+	// * playback stopped: nothing more is written, the bars must fall instead of showing the last window forever
+	for (int update = 0; update < 120; update++)
+		spectrum_analyser_update(analyser, 1.0 / 60);
+	float stalled = *std::max_element(levels.begin(), levels.end());
+	std::printf("2 s after the audio stops: highest bar at %.2f\n", stalled);
+	int result = 0;
+	if (loudest_level < 0.5f || stalled > 0) {
+		std::printf("FAIL: the sine must show and the bars must fall to zero once the tap stops writing\n");
+		result = 1;
+	}
+
+	ma_data_source_node_uninit(&source, NULL);
+	spectrum_analyser_destroy(analyser);
+	spectrum_tap_destroy(tap);
+	ma_audio_buffer_uninit(&buffer);
+	ma_node_graph_uninit(&graph, NULL);
+	return result;
+}
+
+/** @brief Residual after fitting a sine of the known frequency, relative to the sine, over the middle of the signal. */
+static double thd_n_db(const std::vector<float>& stereo, ma_uint32 sample_rate, double frequency) {
+	std::size_t frames = stereo.size() / 2;
+	std::size_t begin = frames / 10, end = frames - frames / 10;
+	// * least squares for a sin + b cos + c, the normal equations are close to diagonal over whole seconds
+	double ss = 0, cc = 0, sc = 0, ys = 0, yc = 0, y_sum = 0;
+	for (std::size_t i = begin; i < end; i++) {
+		double angle = 2 * M_PI * frequency * double(i) / sample_rate;
+		double s = std::sin(angle), c = std::cos(angle), y = stereo[i * 2];
+		ss += s * s;
+		cc += c * c;
+		sc += s * c;
+		ys += y * s;
+		yc += y * c;
+		y_sum += y;
+	}
+	double determinant = ss * cc - sc * sc;
+	double a = (ys * cc - yc * sc) / determinant;
+	double b = (yc * ss - ys * sc) / determinant;
+	double offset = y_sum / double(end - begin);
+	double signal = 0, residual = 0;
+	for (std::size_t i = begin; i < end; i++) {
+		double angle = 2 * M_PI * frequency * double(i) / sample_rate;
+		double fit = a * std::sin(angle) + b * std::cos(angle) + offset;
+		double error = stereo[i * 2] - fit;
+		signal += fit * fit;
+		residual += error * error;
+	}
+	return 10 * std::log10(residual / signal);
+}
+
+static int bench_resampler(const std::string&) {
+	constexpr ma_uint32 SECONDS = 10;
+	const std::pair<ma_uint32, ma_uint32> conversions[] = { { 44100, 48000 }, { 48000, 44100 }, { 44100, 96000 } };
+
+	// * every preset must beat the engine's resampler and the one below it, and be quick enough for offline analysis too
+	constexpr double MIN_REALTIME = 100;
+	std::printf("%-16s %-10s %-14s %-14s %-12s\n", "conversion", "filter", "THD+N 1 kHz", "THD+N 10 kHz", "x realtime");
+	int result = 0;
+	for (auto [input_rate, output_rate] : conversions) {
+		auto tone = [&](double frequency) {
+			std::vector<float> frames(std::size_t(input_rate) * SECONDS * 2);
+			for (std::size_t i = 0; i < frames.size() / 2; i++)
+				frames[i * 2] = frames[i * 2 + 1] = float(0.9 * std::sin(2 * M_PI * frequency * double(i) / input_rate));
+			return frames;
+		};
+		std::vector<float> low = tone(1000), high = tone(10000);
+
+		// * what the engine does to every sound at another rate: linear interpolation without a low-pass
+		auto linear = [&](const std::vector<float>& input, double& seconds) {
+			ma_linear_resampler_config config = ma_linear_resampler_config_init(ma_format_f32, 2, input_rate, output_rate);
+			config.lpfOrder = 0;
+			ma_linear_resampler resampler;
+			ma_linear_resampler_init(&config, NULL, &resampler);
+			ma_uint64 input_frames = input.size() / 2;
+			ma_uint64 output_frames = input_frames * output_rate / input_rate;
+			std::vector<float> output(std::size_t(output_frames) * 2);
+			auto start = std::chrono::steady_clock::now();
+			ma_linear_resampler_process_pcm_frames(&resampler, input.data(), &input_frames, output.data(), &output_frames);
+			seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			ma_linear_resampler_uninit(&resampler, NULL);
+			output.resize(std::size_t(output_frames) * 2);
+			return output;
+		};
+		auto polyphase = [&](const std::vector<float>& input, resample_quality quality, double& seconds) {
+			auto start = std::chrono::steady_clock::now();
+			std::vector<float> output = resample_buffer(input.data(), input.size() / 2, 2, input_rate, output_rate, quality);
+			seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			return output;
+		};
+
+		std::string conversion = std::to_string(input_rate) + " -> " + std::to_string(output_rate);
+		double seconds, ignored;
+		double low_db = thd_n_db(linear(low, seconds), output_rate, 1000);
+		double high_db = thd_n_db(linear(high, ignored), output_rate, 10000);
+		std::printf("%-16s %-10s %-14.1f %-14.1f %-12.0f\n", conversion.c_str(), "linear", low_db, high_db, SECONDS / seconds);
+		for (resample_quality quality : { resample_quality::FAST, resample_quality::STANDARD, resample_quality::HIGH }) {
+			double previous_low_db = low_db, previous_high_db = high_db;
+			low_db = thd_n_db(polyphase(low, quality, seconds), output_rate, 1000);
+			high_db = thd_n_db(polyphase(high, quality, ignored), output_rate, 10000);
+			std::printf("%-16s %-10s %-14.1f %-14.1f %-12.0f\n", conversion.c_str(), resample_quality_name(quality), low_db, high_db,
+				SECONDS / seconds);
+			if (low_db >= previous_low_db || high_db >= previous_high_db || SECONDS / seconds < MIN_REALTIME) {
+				std::printf("FAIL: %s must have less THD+N than the filter above it, at more than %.0fx realtime\n", resample_quality_name(quality),
+					MIN_REALTIME);
+				result = 1;
+			}
+		}
+	}
+	return result;
+}
+
+struct stretch_run {
+	std::vector<float> output;
+	double seconds;
+	ma_uint64 source_frames;
+	time_stretch_stats stats;
+};
+
+/** @brief A 440 Hz tone at half scale through a time stretch node, pulled in 480-frame periods with the speed speed_at gives for each. */
+template <typename speed_fn>
+static stretch_run run_time_stretch(ma_uint32 sample_rate, ma_uint32 output_frames, speed_fn speed_at) {
+	constexpr ma_uint32 PERIOD = 480;
+	stretch_run run{};
+	ma_node_graph_config graph_config = ma_node_graph_config_init(2);
+	ma_node_graph graph;
+	if (ma_node_graph_init(&graph_config, NULL, &graph) != MA_SUCCESS)
+		return run;
+	time_stretch_node* stretch = time_stretch_node_create(&graph, 2, sample_rate);
+	ma_node_attach_output_bus((ma_node*)stretch, 0, ma_node_graph_get_endpoint(&graph), 0);
+
+	// * enough tone for the fastest speed, plus what the node keeps buffered
+	ma_uint32 input_frames = ma_uint32(output_frames * MAX_PLAYBACK_SPEED) + sample_rate;
+	std::vector<float> input(std::size_t(input_frames) * 2);
+	for (ma_uint32 i = 0; i < input_frames; i++)
+		input[i * 2] = input[i * 2 + 1] = float(0.5 * std::sin(2 * M_PI * 440 * i / sample_rate));
+	ma_audio_buffer_config buffer_config = ma_audio_buffer_config_init(ma_format_f32, 2, input_frames, input.data(), NULL);
+	ma_audio_buffer buffer;
+	ma_audio_buffer_init(&buffer_config, &buffer);
+	ma_data_source_node_config source_config = ma_data_source_node_config_init(&buffer);
+	ma_data_source_node source;
+	ma_data_source_node_init(&graph, &source_config, NULL, &source);
+	ma_node_attach_output_bus(&source, 0, (ma_node*)stretch, 0);
+
+	run.output.resize(std::size_t(output_frames) * 2);
+	auto start = std::chrono::steady_clock::now();
+	for (ma_uint32 frame = 0; frame < output_frames; frame += PERIOD) {
+		time_stretch_node_set_speed(stretch, speed_at(frame));
+		ma_node_graph_read_pcm_frames(&graph, &run.output[std::size_t(frame) * 2], PERIOD, NULL);
+	}
+	run.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	run.source_frames = ma_node_get_time(&source);
+	run.stats = time_stretch_node_get_stats(stretch);
+
+	ma_data_source_node_uninit(&source, NULL);
+	ma_audio_buffer_uninit(&buffer);
+	time_stretch_node_destroy(stretch);
+	ma_node_graph_uninit(&graph, NULL);
+	return run;
+}
+
+/**
+ * @brief Largest second difference of the left channel from frame first on, over the most a clean tone of
+ * this amplitude and frequency reaches. A splice that jumps in phase or level shows up as a spike far above 1.
+ */
+static double worst_curvature(const std::vector<float>& output, ma_uint32 first, double amplitude, double frequency, ma_uint32 sample_rate) {
+	double step = 2 * M_PI * frequency / sample_rate;
+	double limit = amplitude * step * step;
+	double worst = 0;
+	for (std::size_t i = std::max<std::size_t>(first, 2); i < output.size() / 2; i++)
+		worst = std::max(worst, std::fabs(double(output[i * 2]) - 2 * double(output[(i - 1) * 2]) + double(output[(i - 2) * 2])));
+	return worst / limit;
+}
+
+static int bench_time_stretch(const std::string&) {
+	constexpr ma_uint32 SAMPLE_RATE = 48000;
+	constexpr ma_uint32 OUTPUT_SECONDS = 4;
+	constexpr ma_uint32 OUTPUT_FRAMES = SAMPLE_RATE * OUTPUT_SECONDS;
+
+	// * a phase jump of 0.01 rad already doubles the curvature, a clean splice stays at 1
+	constexpr double MAX_CURVATURE = 2;
+	std::printf("%-8s %-12s %-12s %-14s %-14s %-10s\n", "speed", "us/block", "x realtime", "pitch Hz", "source/output", "curvature");
+	double worst = 0;
+	bool is_on_pitch = true;
+	for (float speed : { 0.5f, 0.75f, 1.0f, 1.25f, 1.5f, 2.0f, 3.0f }) {
+		stretch_run run = run_time_stretch(SAMPLE_RATE, OUTPUT_FRAMES, [&](ma_uint32) { return speed; });
+
+		// * pitch from the rising zero crossings of the second half, past the node's initial latency
+		ma_uint32 crossings = 0;
+		ma_uint32 first = 0, last = 0;
+		for (ma_uint32 i = OUTPUT_FRAMES / 2 + 1; i < OUTPUT_FRAMES; i++) {
+			if (run.output[(i - 1) * 2] < 0 && run.output[i * 2] >= 0) {
+				if (crossings++ == 0)
+					first = i;
+				last = i;
+			}
+		}
+		double pitch = crossings > 1 ? (crossings - 1) * double(SAMPLE_RATE) / (last - first) : 0;
+		double curvature = worst_curvature(run.output, SAMPLE_RATE / 10, 0.5, 440, SAMPLE_RATE);
+		worst = std::max(worst, curvature);
+		// * the source count includes what the node holds buffered, a couple of percent over at the slow end
+		is_on_pitch = is_on_pitch && std::fabs(pitch - 440) < 0.5 && std::fabs(double(run.source_frames) / OUTPUT_FRAMES / speed - 1) < 0.02;
+		std::printf("%-8.2f %-12.1f %-12.0f %-14.2f %-14.3f %-10.2f\n", speed, run.stats.us_per_block, OUTPUT_SECONDS / run.seconds, pitch,
+			double(run.source_frames) / OUTPUT_FRAMES, curvature);
+	}
+
+	// * the speed stepping the way [ and ] do mid-stream, in and out of passing through, every quarter second
+	const float speeds[] = { 1.0f, 1.5f, 0.75f, 1.0f, 2.0f, 0.5f, 3.0f, 1.0f, 1.25f, 2.5f, 1.0f, 0.5f, 1.0f, 3.0f, 0.75f, 1.0f };
+	stretch_run switching = run_time_stretch(SAMPLE_RATE, OUTPUT_FRAMES, [&](ma_uint32 frame) { return speeds[frame / (SAMPLE_RATE / 4) % std::size(speeds)]; });
+	double switching_curvature = worst_curvature(switching.output, 0, 0.5, 440, SAMPLE_RATE);
+	worst = std::max(worst, switching_curvature);
+	std::printf("speed switches every 250ms: curvature %.2f\n", switching_curvature);
+
+	if (!is_on_pitch)
+		log("time stretch is off pitch or off speed", ERROR);
+	if (worst > MAX_CURVATURE)
+		log("time stretch splices are discontinuous", ERROR);
+	return is_on_pitch && worst <= MAX_CURVATURE ? 0 : 1;
+}
+
+static int bench_channel_mix(const std::string&) {
+	constexpr ma_uint32 CHUNK = 4096;
+	constexpr int ROUNDS = 2000;
+	const std::pair<ma_uint32, ma_uint32> layouts[] = { { 3, 2 }, { 4, 2 }, { 6, 2 }, { 8, 2 }, { 2, 1 }, { 6, 1 } };
+
+	// * one decode chunk at a time, like the decode thread, so both sides run from cache
+	auto time_per_frame = [&](auto&& mix) {
+		double best = 1e9;
+		for (int repeat = 0; repeat < 5; repeat++) {
+			auto start = std::chrono::steady_clock::now();
+			for (int round = 0; round < ROUNDS; round++)
+				mix();
+			std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+			best = std::min(best, seconds.count() / ROUNDS / CHUNK);
+		}
+		return best * 1e9;
+	};
+
+	std::printf("%-10s %-10s %-14s %-14s %-10s %-12s\n", "layout", "matrix", "ns/frame", "miniaudio", "speedup", "max diff");
+	int result = 0;
+	std::mt19937 random(42);
+	std::uniform_real_distribution<float> sample(-1, 1);
+	for (auto [input_channels, output_channels] : layouts) {
+		std::vector<float> input(std::size_t(CHUNK) * input_channels);
+		for (float& value : input)
+			value = sample(random);
+		std::vector<float> mixed(std::size_t(CHUNK) * output_channels), converted(mixed.size());
+
+		ma_channel_converter_config converter_config = ma_channel_converter_config_init(ma_format_f32, input_channels, NULL, output_channels,
+			NULL, ma_channel_mix_mode_default);
+		ma_channel_converter converter;
+		if (ma_channel_converter_init(&converter_config, NULL, &converter) != MA_SUCCESS)
+			return 1;
+		double generic_ns = time_per_frame([&] { ma_channel_converter_process_pcm_frames(&converter, converted.data(), input.data(), CHUNK); });
+		ma_channel_converter_uninit(&converter, NULL);
+
+		for (downmix_matrix matrix : { downmix_matrix::ITU, downmix_matrix::HEADPHONES }) {
+			channel_mixer* mixer = channel_mixer_create(input_channels, NULL, output_channels, matrix);
+			if (mixer == NULL)
+				return 1;
+			double mixer_ns = time_per_frame([&] { channel_mixer_process(mixer, input.data(), mixed.data(), CHUNK); });
+
+			// * against the same matrix one frame at a time, which takes the unvectorized path
+			float max_diff = 0;
+			for (ma_uint32 frame = 0; frame < CHUNK; frame++) {
+				float reference[2];
+				channel_mixer_process(mixer, &input[std::size_t(frame) * input_channels], reference, 1);
+				for (ma_uint32 channel = 0; channel < output_channels; channel++)
+					max_diff = std::max(max_diff, std::fabs(reference[channel] - mixed[std::size_t(frame) * output_channels + channel]));
+			}
+			channel_mixer_destroy(mixer);
+
+			std::string layout = std::to_string(input_channels) + " -> " + std::to_string(output_channels);
+			std::printf("%-10s %-10s %-14.2f %-14.2f %-10.1f %-12.1e\n", layout.c_str(), downmix_matrix_name(matrix), mixer_ns, generic_ns,
+				generic_ns / mixer_ns, max_diff);
+			// * the vector kernels may only reorder the sums
+			if (max_diff > 1e-5f || mixer_ns >= generic_ns) {
+				std::printf("FAIL: %s %s must agree with the per-frame path and beat miniaudio\n", layout.c_str(), downmix_matrix_name(matrix));
+				result = 1;
+			}
+		}
+	}
+	return result;
+}
+
+static int bench_pcm_convert(const std::string&) {
+	constexpr ma_uint32 CHANNELS = 2;
+	constexpr ma_uint32 FRAMES = 4096;
+	constexpr int ROUNDS = 1000;
+	const ma_format formats[] = { ma_format_s16, ma_format_s24, ma_format_s32 };
+	const char* const format_names[] = { "s16", "s24", "s32" };
+
+	std::mt19937 random(42);
+	std::uniform_real_distribution<float> sample(-1, 1);
+	std::vector<float> input(std::size_t(FRAMES) * CHANNELS), converted(input.size()), reference(input.size());
+	for (float& value : input)
+		value = sample(random);
+	std::vector<unsigned char> output(input.size() * 4), expected(input.size() * 4);
+
+	// * exactness is checked on a copy with every fifth sample an edge case, landing in every lane and channel:
+	// * full scale, out of range, non-finite and denormal. Speed is measured on the plain noise
+	const float edges[] = { 1.0f, -1.0f, 0.99999994f, -0.99999994f, 1.0000001f, -1.0000001f, 1.5f, -3.0f, 1e30f, -1e30f, INFINITY, -INFINITY,
+		NAN, -NAN, 1e-40f, -1e-40f, std::numeric_limits<float>::denorm_min(), -0.0f };
+	std::vector<float> checked = input;
+	for (std::size_t at = 0; at < checked.size(); at += 5)
+		checked[at] = edges[at / 5 % std::size(edges)];
+	bool is_all_exact = true;
+
+	auto samples_per_us = [&](auto&& convert) {
+		double best = 1e9;
+		for (int repeat = 0; repeat < 5; repeat++) {
+			auto start = std::chrono::steady_clock::now();
+			for (int round = 0; round < ROUNDS; round++)
+				convert();
+			best = std::min(best, std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count());
+		}
+		return double(ROUNDS) * input.size() / best;
+	};
+
+	// * miniaudio truncates without dither, so it is only a speed reference
+	std::printf("%-10s %-12s %-8s %-12s %-12s %-10s\n", "isa", "conversion", "dither", "Msamples/s", "miniaudio", "exact");
+	pcm_isa detected = pcm_isa_detected();
+	for (pcm_isa isa : { pcm_isa::BASELINE, pcm_isa::AVX2 }) {
+		if (!pcm_set_isa(isa))
+			continue;
+		for (int index = 0; index < int(std::size(formats)); index++) {
+			ma_format format = formats[index];
+			std::string name = std::string("f32 -> ") + format_names[index];
+			double generic = samples_per_us([&] { ma_pcm_convert(output.data(), format, input.data(), ma_format_f32, input.size(), ma_dither_mode_none); });
+			for (dither_mode dither : { dither_mode::NONE, dither_mode::TPDF, dither_mode::SHAPED }) {
+				dither_state state;
+				double speed = samples_per_us([&] { pcm_f32_to_int(output.data(), format, input.data(), FRAMES, CHANNELS, dither, state); });
+
+				dither_state kernel_state, reference_state;
+				pcm_f32_to_int(output.data(), format, checked.data(), FRAMES, CHANNELS, dither, kernel_state);
+				pcm_f32_to_int_reference(expected.data(), format, checked.data(), FRAMES, CHANNELS, dither, reference_state);
+				bool is_exact = std::equal(output.begin(), output.begin() + input.size() * ma_get_bytes_per_sample(format), expected.begin());
+				is_all_exact = is_all_exact && is_exact;
+				std::printf("%-10s %-12s %-8s %-12.0f %-12.0f %-10s\n", pcm_isa_name(isa), name.c_str(), dither_mode_name(dither), speed, generic,
+					is_exact ? "yes" : "NO");
+			}
+		}
+		for (int index = 0; index < int(std::size(formats)); index++) {
+			ma_format format = formats[index];
+			std::string name = std::string(format_names[index]) + " -> f32";
+			double generic = samples_per_us([&] { ma_pcm_convert(converted.data(), ma_format_f32, output.data(), format, input.size(), ma_dither_mode_none); });
+			double speed = samples_per_us([&] { pcm_int_to_f32(converted.data(), output.data(), format, input.size()); });
+			pcm_int_to_f32_reference(reference.data(), output.data(), format, input.size());
+			bool is_exact = converted == reference;
+			is_all_exact = is_all_exact && is_exact;
+			std::printf("%-10s %-12s %-8s %-12.0f %-12.0f %-10s\n", pcm_isa_name(isa), name.c_str(), "-", speed, generic, is_exact ? "yes" : "NO");
+		}
+	}
+	pcm_set_isa(detected);
+
+	// * the reference itself, without dither: full scale and beyond clamp, denormals and -0 round to silence
+	const float clamped[] = { 1.0f, -1.0f, 1e30f, -INFINITY, 1e-40f, -0.0f };
+	const ma_int16 wanted[] = { 32767, -32768, 32767, -32768, 0, 0 };
+	ma_int16 quantized[std::size(clamped)];
+	dither_state state;
+	pcm_f32_to_int_reference(quantized, ma_format_s16, clamped, std::size(clamped), 1, dither_mode::NONE, state);
+	bool is_clamped = std::equal(std::begin(quantized), std::end(quantized), std::begin(wanted));
+	std::printf("full scale and out of range to s16: %s\n", is_clamped ? "clamped" : "WRONG");
+
+	if (!is_all_exact || !is_clamped) {
+		log("pcm conversion kernels differ from the reference", ERROR);
+		return 1;
+	}
+	return 0;
+}
+
+static const bench_entry benches[] = {
+	{ "decode-stall", "decode-ahead underruns while reads stall for up to 300ms", bench_decode_stall },
+	{ "vfs", "decode throughput of the read-ahead VFS against miniaudio's default", bench_vfs },
+	{ "scan", "directory walk entries/s of the getdents64 scanner against GIO", bench_scan },
+	{ "headers", "statx, open and header read of every file, io_uring batches against one syscall each", bench_headers },
+	{ "hdd", "cold header reads in path order against on-disk order, with seek statistics per disk", bench_hdd },
+	{ "hash", "content hash MiB/s against a plain read of the same files", bench_hash },
+	{ "durations", "track lengths from headers against miniaudio's decoders, per format, with the error and time of each", bench_durations },
+	{ "fingerprint", "fingerprint a resampled copy, then index and look up a library of 200k tracks", bench_fingerprint },
+	{ "loudness", "EBU R128 analysis speed against realtime, on one core and on all of them", bench_loudness },
+	{ "waveform", "seek bar peak analysis against realtime, render cost per width and the cache file it leaves", bench_waveform },
+	{ "limiter", "synthetic overs through the limiter node, true peak before and after and its CPU cost", bench_limiter },
+	{ "eq", "ten active EQ bands per 1024-frame block at 44.1, 96 and 192 kHz, and their response at both ends", bench_eq },
+	{ "convolution", "a 3s stereo impulse response at 48 kHz per block size, audio thread cost with and without the tail worker", bench_convolution },
+	{ "spectrum", "cost of the visualizer tap per period and of one analysis per frame drawn", bench_spectrum },
+	{ "resampler", "THD+N and speed of the polyphase presets against the engine's linear resampler", bench_resampler },
+	{ "channel-mix", "downmix kernels per layout and matrix against miniaudio's generic channel converter", bench_channel_mix },
+	{ "pcm-convert", "f32 to and from s16/s24/s32 per kernel set and dither, bit-exactness against the scalar reference", bench_pcm_convert },
+	{ "time-stretch", "WSOLA cost per block and pitch of a 440 Hz tone at each playback speed", bench_time_stretch },
+};
+
+int run_bench(const std::string& name, const std::string& input) {
+	for (const auto& bench : benches) {
+		if (name == bench.name)
+			return bench.run(input);
+	}
+
+	if (name != "list")
+		log("unknown benchmark " + name, ERROR);
+	for (const auto& bench : benches)
+		std::printf("  %-16s %s\n", bench.name, bench.description);
+	return name == "list" ? 0 : 1;
+}
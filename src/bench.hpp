@@ -0,0 +1,16 @@
+#pragma once
+
+#include <string>
+
+#include "include/miniaudio.h"
+
+/**
+ * @brief Benchmarks and stress runs selected with `--bench NAME`.
+ *
+ * Each one prints its own report and returns the process exit status.
+ * `--bench list` prints the available names.
+ */
+int run_bench(const std::string& name, const std::string& input);
+
+/** @brief Writes a stereo s16 sine tone, used by benchmarks and rt_check. */
+bool write_test_tone(const std::string& path, ma_uint32 sample_rate, float frequency, ma_uint32 seconds);
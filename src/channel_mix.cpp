@@ -0,0 +1,196 @@
+#include "channel_mix.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
+typedef float float8 __attribute__((vector_size(32)));
+typedef int lanes8 __attribute__((vector_size(32)));
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define MIX_CLONES __attribute__((target_clones("default", "avx2,fma")))
+#else
+#define MIX_CLONES
+#endif
+
+typedef void (*mix_kernel)(const float8* rows, const float* input, float* output, ma_uint64 frames);
+
+struct channel_mixer {
+	ma_uint32 input_channels;
+	ma_uint32 output_channels;
+	// * one row of the matrix per output channel, lanes past the input channels are 0
+	float8 rows[2];
+	mix_kernel kernel;
+};
+
+struct speaker_gains {
+	ma_channel position;
+	float left;
+	float right;
+};
+
+// * -3 dB is 0.7071, a source panned halfway between two speakers keeps its power with 0.9239 and 0.3827
+static const speaker_gains itu_gains[] = {
+	{ MA_CHANNEL_MONO, 1, 1 },
+	{ MA_CHANNEL_FRONT_LEFT, 1, 0 },
+	{ MA_CHANNEL_FRONT_RIGHT, 0, 1 },
+	{ MA_CHANNEL_FRONT_CENTER, 0.7071f, 0.7071f },
+	{ MA_CHANNEL_LFE, 0, 0 },
+	{ MA_CHANNEL_BACK_LEFT, 0.7071f, 0 },
+	{ MA_CHANNEL_BACK_RIGHT, 0, 0.7071f },
+	{ MA_CHANNEL_SIDE_LEFT, 0.7071f, 0 },
+	{ MA_CHANNEL_SIDE_RIGHT, 0, 0.7071f },
+	{ MA_CHANNEL_BACK_CENTER, 0.5f, 0.5f },
+	{ MA_CHANNEL_FRONT_LEFT_CENTER, 0.9239f, 0.3827f },
+	{ MA_CHANNEL_FRONT_RIGHT_CENTER, 0.3827f, 0.9239f },
+};
+
+static const speaker_gains headphone_gains[] = {
+	{ MA_CHANNEL_MONO, 1, 1 },
+	{ MA_CHANNEL_FRONT_LEFT, 1, 0 },
+	{ MA_CHANNEL_FRONT_RIGHT, 0, 1 },
+	{ MA_CHANNEL_FRONT_CENTER, 0.7071f, 0.7071f },
+	{ MA_CHANNEL_LFE, 0.5f, 0.5f },
+	{ MA_CHANNEL_BACK_LEFT, 0.7071f, 0.3536f },
+	{ MA_CHANNEL_BACK_RIGHT, 0.3536f, 0.7071f },
+	{ MA_CHANNEL_SIDE_LEFT, 0.7071f, 0.3536f },
+	{ MA_CHANNEL_SIDE_RIGHT, 0.3536f, 0.7071f },
+	{ MA_CHANNEL_BACK_CENTER, 0.5f, 0.5f },
+	{ MA_CHANNEL_FRONT_LEFT_CENTER, 0.9239f, 0.3827f },
+	{ MA_CHANNEL_FRONT_RIGHT_CENTER, 0.3827f, 0.9239f },
+};
+
+static_assert(std::size(itu_gains) == std::size(headphone_gains));
+
+static const char* const matrix_names[] = { "itu", "headphones" };
+
+bool downmix_matrix_from_name(const char* name, downmix_matrix& matrix) {
+	for (int index = 0; index < int(std::size(matrix_names)); index++) {
+		if (std::strcmp(name, matrix_names[index]) == 0) {
+			matrix = downmix_matrix(index);
+			return true;
+		}
+	}
+	return false;
+}
+
+const char* downmix_matrix_name(downmix_matrix matrix) {
+	return matrix_names[int(matrix)];
+}
+
+template <ma_uint32 IN, ma_uint32 OUT>
+static void mix_frame(const float8* rows, const float* input, float* output) {
+	for (ma_uint32 out = 0; out < OUT; out++) {
+		float sum = 0;
+		for (ma_uint32 in = 0; in < IN; in++)
+			sum += rows[out][in] * input[in];
+		output[out] = sum;
+	}
+}
+
+/**
+ * @brief Each frame is loaded whole into a vector and multiplied by every row, the 8 products
+ * of 8 / OUT frames are then summed pairwise in three steps, which leaves them interleaved in order.
+ */
+template <ma_uint32 IN, ma_uint32 OUT>
+MIX_CLONES
+static void mix(const float8* rows, const float* input, float* output, ma_uint64 frames) {
+	constexpr ma_uint32 BLOCK = 8 / OUT;
+	// * the loads of the last few frames would reach past the input
+	constexpr ma_uint32 TAIL = (8 - 1) / IN;
+	ma_uint64 frame = 0;
+
+	// * mono and stereo input is no faster in vectors, the unrolled loop below is all they need
+	if (IN >= 3 && frames > TAIL) {
+		const lanes8 keep = { 0, 1, 2, 3, 4, 5, 6, 7 };
+		const lanes8 even = { 0, 2, 4, 6, 8, 10, 12, 14 };
+		const lanes8 odd = { 1, 3, 5, 7, 9, 11, 13, 15 };
+		// * lanes of the next frame become 0, so a stray NaN can't leak across frames
+		lanes8 mask = keep;
+		for (ma_uint32 lane = IN; lane < 8; lane++)
+			mask[lane] = 8;
+		const float8 zero = {};
+
+		for (; frame + BLOCK <= frames - TAIL; frame += BLOCK) {
+			float8 products[8];
+			for (ma_uint32 i = 0; i < BLOCK; i++) {
+				float8 samples;
+				std::memcpy(&samples, input + (frame + i) * IN, sizeof(samples));
+				samples = __builtin_shuffle(samples, zero, mask);
+				for (ma_uint32 out = 0; out < OUT; out++)
+					products[i * OUT + out] = samples * rows[out];
+			}
+			for (ma_uint32 width = 8; width > 1; width /= 2) {
+				for (ma_uint32 i = 0; i < width / 2; i++)
+					products[i] = __builtin_shuffle(products[i * 2], products[i * 2 + 1], even)
+						+ __builtin_shuffle(products[i * 2], products[i * 2 + 1], odd);
+			}
+			std::memcpy(output + frame * OUT, &products[0], sizeof(float8));
+		}
+	}
+
+	for (; frame < frames; frame++)
+		mix_frame<IN, OUT>(rows, input + frame * IN, output + frame * OUT);
+}
+
+static const mix_kernel kernels[MAX_MIX_INPUT_CHANNELS][2] = {
+	{ mix<1, 1>, mix<1, 2> },
+	{ mix<2, 1>, mix<2, 2> },
+	{ mix<3, 1>, mix<3, 2> },
+	{ mix<4, 1>, mix<4, 2> },
+	{ mix<5, 1>, mix<5, 2> },
+	{ mix<6, 1>, mix<6, 2> },
+	{ mix<7, 1>, mix<7, 2> },
+	{ mix<8, 1>, mix<8, 2> },
+};
+
+channel_mixer* channel_mixer_create(ma_uint32 input_channels, const ma_channel* input_map, ma_uint32 output_channels,
+	downmix_matrix matrix) {
+	if (input_channels == 0 || input_channels > MAX_MIX_INPUT_CHANNELS || output_channels == 0 || output_channels > 2)
+		return NULL;
+
+	ma_channel standard_map[MAX_MIX_INPUT_CHANNELS];
+	if (input_map == NULL) {
+		ma_channel_map_init_standard(ma_standard_channel_map_default, standard_map, MAX_MIX_INPUT_CHANNELS, input_channels);
+		input_map = standard_map;
+	}
+
+	const speaker_gains* gains = matrix == downmix_matrix::HEADPHONES ? headphone_gains : itu_gains;
+	const speaker_gains* gains_end = gains + std::size(itu_gains);
+	auto mixer = new channel_mixer{};
+	mixer->input_channels = input_channels;
+	mixer->output_channels = output_channels;
+	mixer->kernel = kernels[input_channels - 1][output_channels - 1];
+
+	for (ma_uint32 channel = 0; channel < input_channels; channel++) {
+		const speaker_gains* speaker = std::find_if(gains, gains_end,
+			[&](const speaker_gains& gain) { return gain.position == input_map[channel]; });
+		if (speaker == gains_end) {
+			delete mixer;
+			return NULL;
+		}
+		if (output_channels == 1) {
+			mixer->rows[0][channel] = (speaker->left + speaker->right) * 0.5f;
+		} else {
+			mixer->rows[0][channel] = speaker->left;
+			mixer->rows[1][channel] = speaker->right;
+		}
+	}
+	return mixer;
+}
+
+void channel_mixer_destroy(channel_mixer* mixer) {
+	delete mixer;
+}
+
+ma_uint32 channel_mixer_input_channels(const channel_mixer* mixer) {
+	return mixer->input_channels;
+}
+
+ma_uint32 channel_mixer_output_channels(const channel_mixer* mixer) {
+	return mixer->output_channels;
+}
+
+void channel_mixer_process(const channel_mixer* mixer, const float* input, float* output, ma_uint64 frames) {
+	mixer->kernel(mixer->rows, input, output, frames);
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "include/miniaudio.h"
+
+/**
+ * @brief Downmixes interleaved f32 from multichannel files to mono or stereo.
+ *
+ * The matrix is built once from the file's channel map. Mixing is a template on
+ * the input and output channel counts, so every loop bound is a constant: each
+ * frame is one 8-wide load multiplied by a row of the matrix per output, and the
+ * products of several frames are summed pairwise into one interleaved vector of
+ * output. Built for AVX2 as well on x86-64 and picked at load time.
+ *
+ * Matrices don't normalise, a full-scale 5.1 mix can exceed full scale in stereo
+ * like it would on speakers, the limiter catches those peaks.
+ */
+
+enum class downmix_matrix {
+	// * ITU-R BS.775: centre and surrounds at -3 dB, LFE dropped
+	ITU,
+	// * surrounds also reach the far ear at -9 dB instead of sitting inside one, LFE kept at -6 dB
+	HEADPHONES,
+};
+
+/** @brief Takes itu or headphones, false for anything else. */
+bool downmix_matrix_from_name(const char* name, downmix_matrix& matrix);
+const char* downmix_matrix_name(downmix_matrix matrix);
+
+constexpr ma_uint32 MAX_MIX_INPUT_CHANNELS = 8;
+
+struct channel_mixer;
+
+/**
+ * @brief NULL for anything but up to 8 known speaker positions going to 1 or 2 channels,
+ * those are left to miniaudio's converter. input_map NULL means the standard layout.
+ */
+channel_mixer* channel_mixer_create(ma_uint32 input_channels, const ma_channel* input_map, ma_uint32 output_channels,
+	downmix_matrix matrix);
+void channel_mixer_destroy(channel_mixer* mixer);
+
+ma_uint32 channel_mixer_input_channels(const channel_mixer* mixer);
+ma_uint32 channel_mixer_output_channels(const channel_mixer* mixer);
+
+void channel_mixer_process(const channel_mixer* mixer, const float* input, float* output, ma_uint64 frames);
@@ -0,0 +1,276 @@
+#include "content_hash.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+constexpr size_t HASH_CHUNK_SIZE = 1024 * 1024;
+
+constexpr ma_uint64 PRIME64_1 = 11400714785074694791ULL;
+constexpr ma_uint64 PRIME64_2 = 14029467366897019727ULL;
+constexpr ma_uint64 PRIME64_3 = 1609587929392839161ULL;
+constexpr ma_uint64 PRIME64_4 = 9650029242287828579ULL;
+constexpr ma_uint64 PRIME64_5 = 2870177450012600261ULL;
+
+static ma_uint64 rotate_left(ma_uint64 value, int bits) {
+	return (value << bits) | (value >> (64 - bits));
+}
+
+static ma_uint64 read_u64(const unsigned char* bytes) {
+	ma_uint64 value;
+	std::memcpy(&value, bytes, sizeof(value));
+	return value;
+}
+
+static ma_uint32 read_u32(const unsigned char* bytes) {
+	ma_uint32 value;
+	std::memcpy(&value, bytes, sizeof(value));
+	return value;
+}
+
+static ma_uint64 xxh64_round(ma_uint64 accumulator, ma_uint64 input) {
+	accumulator += input * PRIME64_2;
+	return rotate_left(accumulator, 31) * PRIME64_1;
+}
+
+static ma_uint64 xxh64_merge(ma_uint64 accumulator, ma_uint64 value) {
+	accumulator ^= xxh64_round(0, value);
+	return accumulator * PRIME64_1 + PRIME64_4;
+}
+
+/** @brief Streaming XXH64, fed in chunks of any size. */
+struct xxh64_state {
+	ma_uint64 lanes[4];
+	ma_uint64 total_length = 0;
+	unsigned char buffer[32];
+	size_t buffered = 0;
+	ma_uint64 seed;
+
+	explicit xxh64_state(ma_uint64 new_seed) : seed(new_seed) {
+		lanes[0] = seed + PRIME64_1 + PRIME64_2;
+		lanes[1] = seed + PRIME64_2;
+		lanes[2] = seed;
+		lanes[3] = seed - PRIME64_1;
+	}
+
+	void consume_stripe(const unsigned char* stripe) {
+		for (int lane = 0; lane < 4; lane++)
+			lanes[lane] = xxh64_round(lanes[lane], read_u64(stripe + lane * 8));
+	}
+
+	void update(const unsigned char* data, size_t size) {
+		total_length += size;
+		if (buffered > 0) {
+			size_t taken = std::min(size, 32 - buffered);
+			std::memcpy(buffer + buffered, data, taken);
+			buffered += taken;
+			data += taken;
+			size -= taken;
+			if (buffered < 32)
+				return;
+			consume_stripe(buffer);
+			buffered = 0;
+		}
+		for (; size >= 32; data += 32, size -= 32)
+			consume_stripe(data);
+		std::memcpy(buffer, data, size);
+		buffered = size;
+	}
+
+	ma_uint64 digest() const {
+		ma_uint64 hash;
+		if (total_length >= 32) {
+			hash = rotate_left(lanes[0], 1) + rotate_left(lanes[1], 7) + rotate_left(lanes[2], 12) + rotate_left(lanes[3], 18);
+			for (int lane = 0; lane < 4; lane++)
+				hash = xxh64_merge(hash, lanes[lane]);
+		} else {
+			hash = seed + PRIME64_5;
+		}
+		hash += total_length;
+
+		const unsigned char* tail = buffer;
+		size_t remaining = buffered;
+		for (; remaining >= 8; tail += 8, remaining -= 8)
+			hash = rotate_left(hash ^ xxh64_round(0, read_u64(tail)), 27) * PRIME64_1 + PRIME64_4;
+		if (remaining >= 4) {
+			hash = rotate_left(hash ^ (ma_uint64(read_u32(tail)) * PRIME64_1), 23) * PRIME64_2 + PRIME64_3;
+			tail += 4;
+			remaining -= 4;
+		}
+		for (; remaining > 0; tail++, remaining--)
+			hash = rotate_left(hash ^ (*tail * PRIME64_5), 11) * PRIME64_1;
+
+		hash ^= hash >> 33;
+		hash *= PRIME64_2;
+		hash ^= hash >> 29;
+		hash *= PRIME64_3;
+		hash ^= hash >> 32;
+		return hash;
+	}
+};
+
+ma_uint64 xxh64(const void* data, size_t size, ma_uint64 seed) {
+	xxh64_state state(seed);
+	state.update((const unsigned char*)data, size);
+	return state.digest();
+}
+
+static bool read_at(int fd, void* destination, size_t size, ma_uint64 offset) {
+	return pread(fd, destination, size, off_t(offset)) == ssize_t(size);
+}
+
+static ma_uint64 id3v2_end(int fd, ma_uint64 offset) {
+	unsigned char header[10];
+	if (!read_at(fd, header, sizeof(header), offset) || std::memcmp(header, "ID3", 3) != 0)
+		return offset;
+	ma_uint64 size = ma_uint64(header[6] & 0x7F) << 21 | ma_uint64(header[7] & 0x7F) << 14 | ma_uint64(header[8] & 0x7F) << 7 | ma_uint64(header[9] & 0x7F);
+	return offset + size + ((header[5] & 0x10) != 0 ? 20 : 10);
+}
+
+/** @brief Drops an ID3v1 tag and an APEv2 tag from the end of [begin, end). */
+static ma_uint64 trailing_tags_start(int fd, ma_uint64 begin, ma_uint64 end) {
+	unsigned char marker[32];
+	if (end - begin >= 128 && read_at(fd, marker, 3, end - 128) && std::memcmp(marker, "TAG", 3) == 0)
+		end -= 128;
+	if (end - begin >= 32 && read_at(fd, marker, 32, end - 32) && std::memcmp(marker, "APETAGEX", 8) == 0) {
+		// * the size covers items and footer, the optional header comes on top
+		ma_uint64 tag_size = ma_uint64(marker[12]) | ma_uint64(marker[13]) << 8 | ma_uint64(marker[14]) << 16 | ma_uint64(marker[15]) << 24;
+		if ((marker[23] & 0x80) != 0)
+			tag_size += 32;
+		if (tag_size <= end - begin)
+			end -= tag_size;
+	}
+	return end;
+}
+
+/** @brief Byte range of the audio payload inside the file, false when the container doesn't parse. */
+static bool payload_range(int fd, ma_uint64 file_size, ma_encoding_format format, ma_uint64& begin, ma_uint64& end) {
+	begin = 0;
+	end = file_size;
+
+	if (format == ma_encoding_format_wav) {
+		unsigned char chunk[8];
+		for (ma_uint64 offset = 12; offset + 8 <= file_size;) {
+			if (!read_at(fd, chunk, sizeof(chunk), offset))
+				return false;
+			ma_uint64 chunk_size = ma_uint64(chunk[4]) | ma_uint64(chunk[5]) << 8 | ma_uint64(chunk[6]) << 16 | ma_uint64(chunk[7]) << 24;
+			if (std::memcmp(chunk, "data", 4) == 0) {
+				begin = offset + 8;
+				end = std::min(file_size, begin + chunk_size);
+				return true;
+			}
+			offset += 8 + chunk_size + (chunk_size & 1);
+		}
+		return false;
+	}
+
+	begin = id3v2_end(fd, 0);
+	if (format == ma_encoding_format_flac) {
+		unsigned char header[4];
+		if (!read_at(fd, header, sizeof(header), begin) || std::memcmp(header, "fLaC", 4) != 0)
+			return false;
+		begin += 4;
+		// * metadata blocks up to the one flagged last, the frames follow
+		for (bool last = false; !last;) {
+			if (!read_at(fd, header, sizeof(header), begin))
+				return false;
+			last = (header[0] & 0x80) != 0;
+			begin += 4 + (ma_uint64(header[1]) << 16 | ma_uint64(header[2]) << 8 | ma_uint64(header[3]));
+		}
+	}
+	if (begin >= file_size)
+		return false;
+	end = trailing_tags_start(fd, begin, file_size);
+	return begin < end;
+}
+
+#if !defined(__APPLE__)
+/** @brief One byte per page of [page-aligned begin, end), nonzero when it is in the page cache; empty when that can't be told. */
+static std::vector<unsigned char> resident_pages(int fd, ma_uint64 begin, ma_uint64 end, ma_uint64 page_size) {
+	ma_uint64 first = begin - begin % page_size;
+	size_t length = size_t(end - first);
+	// * mapping alone faults nothing in, mincore only reads the page cache state
+	void* mapping = mmap(NULL, length, PROT_READ, MAP_SHARED, fd, off_t(first));
+	if (mapping == MAP_FAILED)
+		return {};
+	std::vector<unsigned char> pages((length + page_size - 1) / page_size);
+	if (mincore(mapping, length, pages.data()) != 0)
+		pages.clear();
+	munmap(mapping, length);
+	return pages;
+}
+
+/** @brief Drops the pages among [from, to) that were not cached before hashing, runs of them in one call each. */
+static void drop_hashed_pages(int fd, const std::vector<unsigned char>& was_resident, size_t from, size_t to, ma_uint64 first_page_offset, ma_uint64 page_size) {
+	size_t page = from;
+	while (page < to) {
+		if (was_resident[page] & 1) {
+			page++;
+			continue;
+		}
+		size_t run = page;
+		while (run < to && !(was_resident[run] & 1))
+			run++;
+		posix_fadvise(fd, off_t(first_page_offset + page * page_size), off_t((run - page) * page_size), POSIX_FADV_DONTNEED);
+		page = run;
+	}
+}
+#endif
+
+ma_uint64 content_hash_file(const char* path, ma_encoding_format format, content_hash_stats* stats) {
+	auto start = std::chrono::steady_clock::now();
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return 0;
+
+	struct stat file_stat;
+	ma_uint64 begin;
+	ma_uint64 end;
+	if (fstat(fd, &file_stat) != 0 || !payload_range(fd, ma_uint64(file_stat.st_size), format, begin, end)) {
+		close(fd);
+		return 0;
+	}
+
+#if !defined(__APPLE__)
+	posix_fadvise(fd, off_t(begin), off_t(end - begin), POSIX_FADV_SEQUENTIAL);
+	// * pages someone else brought in (the playing track, prefetched ones, a WAV mapping) stay cached
+	ma_uint64 page_size = ma_uint64(sysconf(_SC_PAGESIZE));
+	ma_uint64 first_page_offset = begin - begin % page_size;
+	std::vector<unsigned char> was_resident = resident_pages(fd, begin, end, page_size);
+	size_t dropped_pages = 0;
+#endif
+	std::vector<unsigned char> chunk(HASH_CHUNK_SIZE);
+	xxh64_state state(0);
+	for (ma_uint64 offset = begin; offset < end;) {
+		size_t size = size_t(std::min<ma_uint64>(chunk.size(), end - offset));
+		ssize_t result = pread(fd, chunk.data(), size, off_t(offset));
+		if (result <= 0) {
+			close(fd);
+			return 0;
+		}
+		state.update(chunk.data(), size_t(result));
+		offset += ma_uint64(result);
+#if !defined(__APPLE__)
+		// * one pass over the whole library would otherwise push the playing track out of the page cache;
+		// * a page only partly hashed waits for the next chunk
+		size_t hashed_pages = offset >= end ? was_resident.size() : size_t((offset - first_page_offset) / page_size);
+		if (!was_resident.empty() && hashed_pages > dropped_pages) {
+			drop_hashed_pages(fd, was_resident, dropped_pages, hashed_pages, first_page_offset, page_size);
+			dropped_pages = hashed_pages;
+		}
+#endif
+	}
+	close(fd);
+
+	ma_uint64 hash = state.digest();
+	if (stats != NULL) {
+		stats->bytes_hashed = end - begin;
+		stats->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+	return hash != 0 ? hash : 1;
+}
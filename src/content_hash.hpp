@@ -0,0 +1,21 @@
+#pragma once
+
+#include "include/miniaudio.h"
+
+/**
+ * @brief 64-bit hash of the audio payload of a file, blind to its tags.
+ *
+ * ID3v2, ID3v1 and APEv2 tags, FLAC metadata blocks and every RIFF chunk except
+ * "data" are left out, so the same rip with different tags or cover art hashes
+ * the same. The hash is XXH64, fast enough that reading the file is the limit.
+ */
+
+struct content_hash_stats {
+	ma_uint64 bytes_hashed;
+	double seconds;
+};
+
+/** @brief Returns 0 when the file can't be read, a real hash is never 0. */
+ma_uint64 content_hash_file(const char* path, ma_encoding_format format, content_hash_stats* stats = NULL);
+
+ma_uint64 xxh64(const void* data, size_t size, ma_uint64 seed);
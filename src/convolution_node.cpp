@@ -0,0 +1,418 @@
+#include "convolution_node.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "audio_stats.hpp"
+#include "fft.hpp"
+#include "resampler.hpp"
+
+typedef float float4 __attribute__((vector_size(16)));
+
+// * the worker needs some room, a single head partition leaves it no time at all
+constexpr ma_uint32 MIN_HEAD = 2;
+
+struct convolution_node {
+	ma_node_base base;
+	convolution_config config;
+	ma_uint32 channels;
+	ma_uint32 block;
+	// * half spectra have block + 1 bins, padded to a multiple of four
+	ma_uint32 bins;
+	ma_uint32 partitions;
+	ma_uint32 head;
+	ma_uint32 capacity;
+	int stage;
+	fft_plan* plan;
+
+	// * [impulse channel][partition][bin]
+	ma_uint32 impulse_channels;
+	std::vector<float> impulse_real;
+	std::vector<float> impulse_imaginary;
+
+	// * spectra of the last capacity input blocks, [channel][block % capacity][bin]
+	std::vector<float> history_real;
+	std::vector<float> history_imaginary;
+	ma_uint64 block_index = 0;
+
+	// * per channel, the previous and the current input block, then the output being played
+	std::vector<float> time;
+	std::vector<float> output;
+	ma_uint32 fill = 0;
+
+	std::vector<float> z_real;
+	std::vector<float> z_imaginary;
+	std::vector<float> sum_real;
+	std::vector<float> sum_imaginary;
+
+	// * tail sums by the worker, [block % (head + 1)][channel][bin], tail_block says which block a slot holds
+	std::vector<float> tail_real;
+	std::vector<float> tail_imaginary;
+	std::vector<std::atomic<ma_uint64>> tail_block;
+	std::atomic<ma_uint64> tail_requested = 0;
+	std::atomic<ma_uint32> doorbell = 0;
+	std::atomic<bool> quit = false;
+	std::thread worker;
+
+	std::atomic<ma_uint64> blocks = 0;
+	std::atomic<ma_uint64> head_ns = 0;
+	std::atomic<ma_uint64> tail_blocks = 0;
+	std::atomic<ma_uint64> tail_ns = 0;
+	std::atomic<ma_uint64> tail_misses = 0;
+};
+
+static ma_uint64 now_ns() {
+	auto now = std::chrono::steady_clock::now().time_since_epoch();
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+}
+
+static float4 load4(const float* source) {
+	float4 value;
+	std::memcpy(&value, source, sizeof(value));
+	return value;
+}
+
+static void store4(float* destination, float4 value) {
+	std::memcpy(destination, &value, sizeof(value));
+}
+
+/** @brief sum += x * h over all bins, complex, four bins at a time. */
+static void multiply_add(float* sum_re, float* sum_im, const float* x_re, const float* x_im, const float* h_re, const float* h_im, ma_uint32 bins) {
+	for (ma_uint32 k = 0; k < bins; k += 4) {
+		float4 xr = load4(x_re + k), xi = load4(x_im + k);
+		float4 hr = load4(h_re + k), hi = load4(h_im + k);
+		store4(sum_re + k, load4(sum_re + k) + xr * hr - xi * hi);
+		store4(sum_im + k, load4(sum_im + k) + xr * hi + xi * hr);
+	}
+}
+
+/** @brief Adds partitions [first, last) for the output of block n of channel into sum. */
+static void sum_partitions(const convolution_node* convolution, ma_uint32 channel, ma_uint32 first, ma_uint32 last, ma_uint64 n,
+	float* sum_re, float* sum_im) {
+	ma_uint32 bins = convolution->bins;
+	ma_uint32 impulse_channel = std::min(channel, convolution->impulse_channels - 1);
+	std::size_t impulse_base = std::size_t(impulse_channel) * convolution->partitions * bins;
+	std::size_t history_base = std::size_t(channel) * convolution->capacity * bins;
+	for (ma_uint32 partition = first; partition < last && partition <= n; partition++) {
+		std::size_t slot = history_base + ((n - partition) % convolution->capacity) * bins;
+		std::size_t impulse = impulse_base + std::size_t(partition) * bins;
+		multiply_add(sum_re, sum_im, &convolution->history_real[slot], &convolution->history_imaginary[slot],
+			&convolution->impulse_real[impulse], &convolution->impulse_imaginary[impulse], bins);
+	}
+}
+
+static void tail_loop(convolution_node* convolution) {
+	ma_uint64 last_done = 0;
+	std::size_t slot_size = std::size_t(convolution->channels) * convolution->bins;
+
+	while (true) {
+		ma_uint32 bell = convolution->doorbell.load(std::memory_order_acquire);
+		if (convolution->quit.load(std::memory_order_acquire))
+			return;
+		// * up to head blocks past the one just played, nearest first, skipping any the audio thread has already summed itself
+		ma_uint64 wanted = convolution->tail_requested.load(std::memory_order_acquire);
+		if (wanted <= last_done) {
+			convolution->doorbell.wait(bell, std::memory_order_acquire);
+			continue;
+		}
+
+		ma_uint64 start = now_ns();
+		ma_uint64 first = std::max(last_done + 1, wanted - convolution->head + 1);
+		for (ma_uint64 block = first; block <= wanted; block++) {
+			std::size_t slot = block % convolution->tail_block.size();
+			float* sum_re = &convolution->tail_real[slot * slot_size];
+			float* sum_im = &convolution->tail_imaginary[slot * slot_size];
+			std::fill_n(sum_re, slot_size, 0.0f);
+			std::fill_n(sum_im, slot_size, 0.0f);
+			for (ma_uint32 channel = 0; channel < convolution->channels; channel++) {
+				sum_partitions(convolution, channel, convolution->head, convolution->partitions, block, sum_re + channel * convolution->bins,
+					sum_im + channel * convolution->bins);
+			}
+			convolution->tail_block[slot].store(block, std::memory_order_release);
+		}
+		convolution->tail_blocks.fetch_add(wanted - first + 1, std::memory_order_relaxed);
+		convolution->tail_ns.fetch_add(now_ns() - start, std::memory_order_relaxed);
+		last_done = wanted;
+	}
+}
+
+/** @brief Transforms the block just filled, sums it against the impulse response and leaves the result in output. */
+static void process_block(convolution_node* convolution) {
+	ma_uint64 start = now_ns();
+	ma_uint32 block = convolution->block;
+	ma_uint32 size = block * 2;
+	ma_uint32 bins = convolution->bins;
+	ma_uint64 n = convolution->block_index;
+	float* z_re = convolution->z_real.data();
+	float* z_im = convolution->z_imaginary.data();
+
+	// * channel a in the real part, b in the imaginary one, split again by the symmetry of real spectra
+	for (ma_uint32 a = 0; a < convolution->channels; a += 2) {
+		ma_uint32 b = a + 1;
+		std::memcpy(z_re, &convolution->time[std::size_t(a) * size], size * sizeof(float));
+		if (b < convolution->channels)
+			std::memcpy(z_im, &convolution->time[std::size_t(b) * size], size * sizeof(float));
+		else
+			std::fill_n(z_im, size, 0.0f);
+		fft_forward(convolution->plan, z_re, z_im);
+
+		std::size_t slot_a = (std::size_t(a) * convolution->capacity + n % convolution->capacity) * bins;
+		std::size_t slot_b = slot_a + std::size_t(convolution->capacity) * bins;
+		for (ma_uint32 k = 0; k <= block; k++) {
+			ma_uint32 mirror = (size - k) % size;
+			float zr = z_re[k], zi = z_im[k], wr = z_re[mirror], wi = z_im[mirror];
+			convolution->history_real[slot_a + k] = (zr + wr) * 0.5f;
+			convolution->history_imaginary[slot_a + k] = (zi - wi) * 0.5f;
+			if (b < convolution->channels) {
+				convolution->history_real[slot_b + k] = (zi + wi) * 0.5f;
+				convolution->history_imaginary[slot_b + k] = (wr - zr) * 0.5f;
+			}
+		}
+	}
+
+	bool split = convolution->config.tail_thread;
+	ma_uint32 head = split ? convolution->head : convolution->partitions;
+	std::size_t tail_slot = split ? n % convolution->tail_block.size() : 0;
+	bool tail_ready = !split || n < head || convolution->tail_block[tail_slot].load(std::memory_order_acquire) == n;
+	if (!tail_ready)
+		convolution->tail_misses.fetch_add(1, std::memory_order_relaxed);
+
+	std::fill(convolution->sum_real.begin(), convolution->sum_real.end(), 0.0f);
+	std::fill(convolution->sum_imaginary.begin(), convolution->sum_imaginary.end(), 0.0f);
+	for (ma_uint32 channel = 0; channel < convolution->channels; channel++) {
+		float* sum_re = &convolution->sum_real[std::size_t(channel) * bins];
+		float* sum_im = &convolution->sum_imaginary[std::size_t(channel) * bins];
+		sum_partitions(convolution, channel, 0, head, n, sum_re, sum_im);
+		if (!tail_ready) {
+			sum_partitions(convolution, channel, head, convolution->partitions, n, sum_re, sum_im);
+		} else if (split && n >= head) {
+			std::size_t tail = (tail_slot * convolution->channels + channel) * bins;
+			for (ma_uint32 k = 0; k < bins; k += 4) {
+				store4(sum_re + k, load4(sum_re + k) + load4(&convolution->tail_real[tail + k]));
+				store4(sum_im + k, load4(sum_im + k) + load4(&convolution->tail_imaginary[tail + k]));
+			}
+		}
+	}
+
+	// * rebuild the full spectrum of a + ib from both half spectra, one inverse transform gives both channels
+	for (ma_uint32 a = 0; a < convolution->channels; a += 2) {
+		ma_uint32 b = a + 1;
+		const float* a_re = &convolution->sum_real[std::size_t(a) * bins];
+		const float* a_im = &convolution->sum_imaginary[std::size_t(a) * bins];
+		for (ma_uint32 k = 0; k <= block; k++) {
+			float ar = a_re[k], ai = a_im[k];
+			float br = 0, bi = 0;
+			if (b < convolution->channels) {
+				br = convolution->sum_real[std::size_t(b) * bins + k];
+				bi = convolution->sum_imaginary[std::size_t(b) * bins + k];
+			}
+			z_re[k] = ar - bi;
+			z_im[k] = ai + br;
+			if (k > 0 && k < block) {
+				z_re[size - k] = ar + bi;
+				z_im[size - k] = br - ai;
+			}
+		}
+		fft_inverse(convolution->plan, z_re, z_im);
+
+		// * overlap-save keeps the second half, the first is wrapped around
+		std::memcpy(&convolution->output[std::size_t(a) * block], z_re + block, block * sizeof(float));
+		if (b < convolution->channels)
+			std::memcpy(&convolution->output[std::size_t(b) * block], z_im + block, block * sizeof(float));
+	}
+
+	for (ma_uint32 channel = 0; channel < convolution->channels; channel++) {
+		float* time = &convolution->time[std::size_t(channel) * size];
+		std::memcpy(time, time + block, block * sizeof(float));
+	}
+	convolution->block_index = n + 1;
+
+	// * every tail partition of block n + head is now in, the worker can start on it
+	if (split) {
+		convolution->tail_requested.store(n + head, std::memory_order_release);
+		convolution->doorbell.fetch_add(1, std::memory_order_release);
+		convolution->doorbell.notify_one();
+	}
+	convolution->blocks.fetch_add(1, std::memory_order_relaxed);
+	convolution->head_ns.fetch_add(now_ns() - start, std::memory_order_relaxed);
+}
+
+static void convolution_process(ma_node* node, const float** frames_in, ma_uint32* frame_count_in, float** frames_out, ma_uint32* frame_count_out) {
+	auto convolution = (convolution_node*)node;
+	ma_uint64 start = now_ns();
+	ma_uint32 frame_count = std::min(*frame_count_in, *frame_count_out);
+	ma_uint32 channels = convolution->channels;
+	ma_uint32 block = convolution->block;
+
+	// * one block of latency: a frame goes into the block being filled while the previous block's result plays
+	for (ma_uint32 frame = 0; frame < frame_count; frame++) {
+		for (ma_uint32 channel = 0; channel < channels; channel++)
+			convolution->time[std::size_t(channel) * block * 2 + block + convolution->fill] = frames_in[0][frame * channels + channel];
+		for (ma_uint32 channel = 0; channel < channels; channel++)
+			frames_out[0][frame * channels + channel] = convolution->output[std::size_t(channel) * block + convolution->fill];
+		if (++convolution->fill == block) {
+			process_block(convolution);
+			convolution->fill = 0;
+		}
+	}
+
+	*frame_count_in = frame_count;
+	*frame_count_out = frame_count;
+	audio_stats_record_stage(convolution->stage, now_ns() - start);
+}
+
+static ma_node_vtable convolution_vtable = {
+	convolution_process,
+	NULL,
+	1,
+	1,
+	0,
+};
+
+/** @brief Up to max_seconds of the file, interleaved, converted to rate unless it is 0, empty when unreadable. */
+static std::vector<float> decode_impulse(const char* path, ma_uint32 rate, ma_uint32 max_seconds, ma_uint32& channels, ma_uint32& file_rate) {
+	std::vector<float> frames;
+	ma_decoder_config decoder_config = ma_decoder_config_init(ma_format_f32, 0, rate);
+	ma_decoder decoder;
+	if (ma_decoder_init_file(path, &decoder_config, &decoder) != MA_SUCCESS)
+		return frames;
+
+	ma_format format;
+	if (ma_decoder_get_data_format(&decoder, &format, &channels, &file_rate, NULL, 0) != MA_SUCCESS || channels == 0) {
+		ma_decoder_uninit(&decoder);
+		return frames;
+	}
+
+	ma_uint64 max_frames = ma_uint64(max_seconds) * file_rate;
+	ma_uint64 total = 0;
+	while (total < max_frames) {
+		frames.resize(std::size_t(total + 4096) * channels);
+		ma_uint64 read = 0;
+		if (ma_decoder_read_pcm_frames(&decoder, &frames[std::size_t(total) * channels], std::min<ma_uint64>(4096, max_frames - total), &read) != MA_SUCCESS
+			|| read == 0)
+			break;
+		total += read;
+	}
+	frames.resize(std::size_t(total) * channels);
+	ma_decoder_uninit(&decoder);
+	return frames;
+}
+
+/** @brief The whole impulse response at sample_rate, interleaved, empty when unreadable. */
+static std::vector<float> load_impulse(const char* path, ma_uint32 sample_rate, ma_uint32 max_seconds, ma_uint32& channels) {
+	ma_uint32 file_rate = 0;
+	std::vector<float> frames = decode_impulse(path, 0, max_seconds, channels, file_rate);
+	if (frames.empty() || file_rate == sample_rate)
+		return frames;
+
+	// * the response is a filter itself, so it gets the sinc resampler, ratios that one can't take fall back to the decoder's
+	std::vector<float> resampled = resample_buffer(frames.data(), frames.size() / channels, channels, file_rate, sample_rate, resample_quality::HIGH);
+	if (!resampled.empty())
+		return resampled;
+	return decode_impulse(path, sample_rate, max_seconds, channels, file_rate);
+}
+
+convolution_node* convolution_node_create(ma_node_graph* graph, ma_uint32 channels, ma_uint32 sample_rate, const char* impulse_path,
+	const convolution_config& config) {
+	ma_uint32 impulse_channels = 0;
+	std::vector<float> impulse = load_impulse(impulse_path, sample_rate, config.max_seconds, impulse_channels);
+	fft_plan* plan = fft_plan_create(std::size_t(config.block_frames) * 2);
+	if (impulse.empty() || plan == NULL || channels == 0) {
+		fft_plan_destroy(plan);
+		return NULL;
+	}
+
+	auto convolution = new convolution_node;
+	convolution->config = config;
+	convolution->channels = channels;
+	convolution->block = config.block_frames;
+	convolution->bins = (config.block_frames + 1 + 3) & ~3u;
+	convolution->plan = plan;
+	convolution->impulse_channels = impulse_channels;
+	ma_uint32 impulse_frames = ma_uint32(impulse.size() / impulse_channels);
+	convolution->partitions = (impulse_frames + convolution->block - 1) / convolution->block;
+	convolution->head = std::clamp<ma_uint32>(config.head_partitions, MIN_HEAD, convolution->partitions);
+	convolution->config.tail_thread = config.tail_thread && convolution->head < convolution->partitions;
+	// * room for a late worker to finish reading blocks the audio thread has moved past
+	convolution->capacity = convolution->partitions + convolution->head + 1;
+	convolution->stage = audio_stats_register_stage("convolution");
+
+	ma_uint32 block = convolution->block;
+	ma_uint32 bins = convolution->bins;
+	std::size_t spectra = std::size_t(impulse_channels) * convolution->partitions * bins;
+	convolution->impulse_real.assign(spectra, 0);
+	convolution->impulse_imaginary.assign(spectra, 0);
+	std::vector<float> z_re(block * 2), z_im(block * 2);
+	for (ma_uint32 channel = 0; channel < impulse_channels; channel++) {
+		for (ma_uint32 partition = 0; partition < convolution->partitions; partition++) {
+			std::fill(z_re.begin(), z_re.end(), 0.0f);
+			std::fill(z_im.begin(), z_im.end(), 0.0f);
+			for (ma_uint32 i = 0; i < block && partition * block + i < impulse_frames; i++)
+				z_re[i] = impulse[(std::size_t(partition) * block + i) * impulse_channels + channel];
+			fft_forward(plan, z_re.data(), z_im.data());
+			std::size_t offset = (std::size_t(channel) * convolution->partitions + partition) * bins;
+			std::copy_n(z_re.begin(), block + 1, convolution->impulse_real.begin() + offset);
+			std::copy_n(z_im.begin(), block + 1, convolution->impulse_imaginary.begin() + offset);
+		}
+	}
+
+	convolution->history_real.assign(std::size_t(channels) * convolution->capacity * bins, 0);
+	convolution->history_imaginary.assign(convolution->history_real.size(), 0);
+	convolution->time.assign(std::size_t(channels) * block * 2, 0);
+	convolution->output.assign(std::size_t(channels) * block, 0);
+	convolution->z_real.assign(block * 2, 0);
+	convolution->z_imaginary.assign(block * 2, 0);
+	convolution->sum_real.assign(std::size_t(channels) * bins, 0);
+	convolution->sum_imaginary.assign(convolution->sum_real.size(), 0);
+	convolution->tail_block = std::vector<std::atomic<ma_uint64>>(convolution->head + 1);
+	for (auto& slot : convolution->tail_block)
+		slot.store(UINT64_MAX);
+	convolution->tail_real.assign(convolution->tail_block.size() * channels * bins, 0);
+	convolution->tail_imaginary.assign(convolution->tail_real.size(), 0);
+
+	ma_node_config node_config = ma_node_config_init();
+	node_config.vtable = &convolution_vtable;
+	node_config.pInputChannels = &convolution->channels;
+	node_config.pOutputChannels = &convolution->channels;
+	if (ma_node_init(graph, &node_config, NULL, &convolution->base) != MA_SUCCESS) {
+		fft_plan_destroy(plan);
+		delete convolution;
+		return NULL;
+	}
+	if (convolution->config.tail_thread)
+		convolution->worker = std::thread(tail_loop, convolution);
+	return convolution;
+}
+
+void convolution_node_destroy(convolution_node* convolution) {
+	if (convolution == NULL)
+		return;
+	ma_node_uninit(&convolution->base, NULL);
+	if (convolution->worker.joinable()) {
+		convolution->quit.store(true, std::memory_order_release);
+		convolution->doorbell.fetch_add(1, std::memory_order_release);
+		convolution->doorbell.notify_one();
+		convolution->worker.join();
+	}
+	fft_plan_destroy(convolution->plan);
+	delete convolution;
+}
+
+convolution_stats convolution_node_get_stats(convolution_node* convolution) {
+	ma_uint64 blocks = convolution->blocks.load(std::memory_order_relaxed);
+	ma_uint64 tail_blocks = convolution->tail_blocks.load(std::memory_order_relaxed);
+	double channels = convolution->channels;
+	return convolution_stats{
+		.channels = convolution->channels,
+		.partitions = convolution->partitions,
+		.block_frames = convolution->block,
+		.blocks = blocks,
+		.head_us_per_channel = blocks > 0 ? double(convolution->head_ns.load(std::memory_order_relaxed)) / double(blocks) / channels / 1000 : 0,
+		.tail_us_per_channel = tail_blocks > 0 ? double(convolution->tail_ns.load(std::memory_order_relaxed)) / double(tail_blocks) / channels / 1000 : 0,
+		.tail_misses = convolution->tail_misses.load(std::memory_order_relaxed),
+	};
+}
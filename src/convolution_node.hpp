@@ -0,0 +1,44 @@
+#pragma once
+
+#include "include/miniaudio.h"
+
+/**
+ * @brief Uniformly partitioned FFT convolution with an impulse response, for room correction.
+ *
+ * The impulse response is cut into partitions of block_frames and kept as spectra.
+ * Every block of input is transformed once and multiplied against all of them
+ * (overlap-save), so the latency is one block whatever the response length. Two
+ * channels share each complex FFT, one as the real part and one as the imaginary.
+ *
+ * With tail_thread, only the first head_partitions are summed on the audio thread.
+ * The rest only depend on input at least that many blocks old, so a worker sums them
+ * up to head_partitions blocks ahead of need. A block whose tail is not ready in time
+ * is summed in place, which is correct but counted as a miss.
+ */
+
+struct convolution_config {
+	ma_uint32 block_frames = 256;
+	ma_uint32 head_partitions = 4;
+	bool tail_thread = true;
+	// * longer responses are cut, room correction rarely needs more
+	ma_uint32 max_seconds = 10;
+};
+
+struct convolution_stats {
+	ma_uint32 channels;
+	ma_uint32 partitions;
+	ma_uint32 block_frames;
+	ma_uint64 blocks;
+	double head_us_per_channel;
+	double tail_us_per_channel;
+	ma_uint64 tail_misses;
+};
+
+struct convolution_node;
+
+/** @brief Decodes the impulse response at sample_rate, NULL when it can't be read. Attach it with (ma_node*)convolution. */
+convolution_node* convolution_node_create(ma_node_graph* graph, ma_uint32 channels, ma_uint32 sample_rate, const char* impulse_path,
+	const convolution_config& config = {});
+void convolution_node_destroy(convolution_node* convolution);
+
+convolution_stats convolution_node_get_stats(convolution_node* convolution);
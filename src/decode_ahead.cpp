@@ -0,0 +1,342 @@
+#include "decode_ahead.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "pcm_convert.hpp"
+
+struct decode_ahead_source {
+	ma_data_source_base base;
+	ma_decoder decoder;
+	ma_pcm_rb ring;
+	decode_ahead_config config;
+	ma_uint32 watermark_frames;
+	ma_uint32 bytes_per_frame;
+	ma_uint64 length;
+
+	// * only set when resampling, decoded holds one chunk at the file's rate plus the silence that flushes the filter
+	resampler* resampling = NULL;
+	ma_uint32 sample_rate;
+	ma_uint32 channels;
+	std::vector<float> decoded;
+
+	// * only set when downmixing, unmixed holds one chunk in the file's channels
+	channel_mixer* mixer = NULL;
+	std::vector<float> unmixed;
+
+	// * only set when the decoder hands out integers for an f32 source, native holds one chunk of them
+	ma_format native_format = ma_format_unknown;
+	std::vector<unsigned char> native;
+
+	std::thread thread;
+	std::atomic<bool> quit = false;
+	std::atomic<bool> decoder_at_end = false;
+
+	// * seek handshake: callback bumps the generation, decode thread acknowledges it,
+	// * callback drops the stale frames and marks it flushed, decode thread resumes
+	std::atomic<ma_uint64> seek_target = 0;
+	std::atomic<ma_uint64> seek_generation = 0;
+	std::atomic<ma_uint64> seek_ack = 0;
+	std::atomic<ma_uint64> flushed_generation = 0;
+
+	// * only touched by the callback: set after a seek until the first new frames arrive
+	bool is_refilling = false;
+
+	std::atomic<ma_uint64> cursor = 0;
+	std::atomic<ma_uint64> underruns = 0;
+	std::atomic<ma_uint64> underrun_frames = 0;
+};
+
+static std::atomic<ma_uint64> total_underruns = 0;
+
+static ma_uint32 copy_from_ring(decode_ahead_source* source, unsigned char* output, ma_uint32 frame_count) {
+	ma_uint32 copied = 0;
+
+	// * at most two passes, the ring can wrap once
+	while (copied < frame_count) {
+		ma_uint32 frames = frame_count - copied;
+		void* buffer;
+		ma_pcm_rb_acquire_read(&source->ring, &frames, &buffer);
+		if (frames == 0)
+			break;
+
+		std::memcpy(output + copied * source->bytes_per_frame, buffer, frames * source->bytes_per_frame);
+		ma_pcm_rb_commit_read(&source->ring, frames);
+		copied += frames;
+	}
+	return copied;
+}
+
+static ma_result decode_ahead_read(ma_data_source* data_source, void* output, ma_uint64 frame_count, ma_uint64* frames_read) {
+	auto source = (decode_ahead_source*)data_source;
+	auto bytes = (unsigned char*)output;
+	ma_uint32 frames = ma_uint32(frame_count);
+
+	ma_uint64 generation = source->seek_generation.load(std::memory_order_acquire);
+	if (source->flushed_generation.load(std::memory_order_relaxed) != generation) {
+		if (source->seek_ack.load(std::memory_order_acquire) != generation) {
+			std::memset(bytes, 0, frames * source->bytes_per_frame);
+			*frames_read = frames;
+			return MA_SUCCESS;
+		}
+		ma_pcm_rb_seek_read(&source->ring, ma_pcm_rb_available_read(&source->ring));
+		source->flushed_generation.store(generation, std::memory_order_release);
+		source->is_refilling = true;
+	}
+
+	ma_uint32 copied = copy_from_ring(source, bytes, frames);
+	source->cursor.fetch_add(copied, std::memory_order_relaxed);
+	if (copied > 0)
+		source->is_refilling = false;
+
+	if (copied < frames) {
+		if (source->decoder_at_end.load(std::memory_order_acquire) && ma_pcm_rb_available_read(&source->ring) == 0) {
+			*frames_read = copied;
+			return copied == 0 ? MA_AT_END : MA_SUCCESS;
+		}
+
+		std::memset(bytes + copied * source->bytes_per_frame, 0, (frames - copied) * source->bytes_per_frame);
+		*frames_read = frames;
+		if (source->is_refilling)
+			return MA_SUCCESS;
+
+		source->underruns.fetch_add(1, std::memory_order_relaxed);
+		source->underrun_frames.fetch_add(frames - copied, std::memory_order_relaxed);
+		total_underruns.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	*frames_read = frames;
+	return MA_SUCCESS;
+}
+
+static ma_result decode_ahead_seek(ma_data_source* data_source, ma_uint64 frame_index) {
+	auto source = (decode_ahead_source*)data_source;
+	source->seek_target.store(frame_index, std::memory_order_relaxed);
+	source->cursor.store(frame_index, std::memory_order_relaxed);
+	source->seek_generation.fetch_add(1, std::memory_order_release);
+	return MA_SUCCESS;
+}
+
+static ma_result decode_ahead_get_data_format(ma_data_source* data_source, ma_format* format, ma_uint32* channels, ma_uint32* sample_rate, ma_channel* channel_map, size_t channel_map_cap) {
+	auto source = (decode_ahead_source*)data_source;
+	ma_result result = ma_data_source_get_data_format(&source->decoder, format, channels, sample_rate, channel_map, channel_map_cap);
+	*sample_rate = source->sample_rate;
+	if (source->native_format != ma_format_unknown)
+		*format = ma_format_f32;
+	if (source->mixer != NULL) {
+		*channels = source->channels;
+		ma_channel_map_init_standard(ma_standard_channel_map_default, channel_map, channel_map_cap, source->channels);
+	}
+	return result;
+}
+
+static ma_result decode_ahead_get_cursor(ma_data_source* data_source, ma_uint64* cursor) {
+	*cursor = ((decode_ahead_source*)data_source)->cursor.load(std::memory_order_relaxed);
+	return MA_SUCCESS;
+}
+
+static ma_result decode_ahead_get_length(ma_data_source* data_source, ma_uint64* length) {
+	*length = ((decode_ahead_source*)data_source)->length;
+	return *length == 0 ? MA_NOT_IMPLEMENTED : MA_SUCCESS;
+}
+
+static ma_data_source_vtable decode_ahead_vtable = {
+	decode_ahead_read,
+	decode_ahead_seek,
+	decode_ahead_get_data_format,
+	decode_ahead_get_cursor,
+	decode_ahead_get_length,
+	NULL,
+	0,
+};
+
+/** @brief Decodes up to chunk_frames, converted to f32 and downmixed to the played channels where those are set up. */
+static ma_result read_decoder(decode_ahead_source* source, void* output, ma_uint64 frames, ma_uint64* decoded) {
+	if (source->mixer == NULL && source->native_format == ma_format_unknown)
+		return ma_decoder_read_pcm_frames(&source->decoder, output, frames, decoded);
+
+	float* converted = source->mixer != NULL ? source->unmixed.data() : (float*)output;
+	ma_result result;
+	if (source->native_format == ma_format_unknown) {
+		result = ma_decoder_read_pcm_frames(&source->decoder, converted, frames, decoded);
+	} else {
+		result = ma_decoder_read_pcm_frames(&source->decoder, source->native.data(), frames, decoded);
+		pcm_int_to_f32(converted, source->native.data(), source->native_format, *decoded * source->decoder.outputChannels);
+	}
+	if (source->mixer != NULL)
+		channel_mixer_process(source->mixer, converted, (float*)output, *decoded);
+	return result;
+}
+
+/** @brief Decodes just enough to fill frames at the output rate, flushing the filter at the end of the track. */
+static bool resample_chunk(decode_ahead_source* source, void* buffer, ma_uint32 frames) {
+	ma_uint64 wanted = std::min<ma_uint64>(resampler_required_input(source->resampling, frames), source->config.chunk_frames);
+	ma_uint64 decoded = 0;
+	ma_result result = read_decoder(source, source->decoded.data(), wanted, &decoded);
+	bool at_end = result != MA_SUCCESS || decoded < wanted;
+	if (at_end) {
+		ma_uint32 silence = resampler_latency(source->resampling);
+		std::fill_n(source->decoded.begin() + decoded * source->channels, silence * source->channels, 0.0f);
+		decoded += silence;
+	}
+
+	ma_uint64 produced = resampler_process(source->resampling, source->decoded.data(), &decoded, (float*)buffer, frames);
+	ma_pcm_rb_commit_write(&source->ring, ma_uint32(produced));
+	if (at_end) {
+		source->decoder_at_end.store(true, std::memory_order_release);
+		return false;
+	}
+	return true;
+}
+
+/** @brief Decodes one chunk into the ring, returns false once nothing more could be written. */
+static bool decode_chunk(decode_ahead_source* source) {
+	ma_uint32 frames = source->config.chunk_frames;
+	void* buffer;
+	ma_pcm_rb_acquire_write(&source->ring, &frames, &buffer);
+	if (frames == 0)
+		return false;
+	if (source->resampling != NULL)
+		return resample_chunk(source, buffer, frames);
+
+	ma_uint64 decoded = 0;
+	ma_result result = read_decoder(source, buffer, frames, &decoded);
+	ma_pcm_rb_commit_write(&source->ring, ma_uint32(decoded));
+
+	if (result != MA_SUCCESS || decoded < frames) {
+		source->decoder_at_end.store(true, std::memory_order_release);
+		return false;
+	}
+	return true;
+}
+
+static void decode_loop(decode_ahead_source* source) {
+	ma_uint64 handled_generation = 0;
+	auto idle = std::chrono::milliseconds(5);
+
+	while (!source->quit.load(std::memory_order_relaxed)) {
+		ma_uint64 generation = source->seek_generation.load(std::memory_order_acquire);
+		if (generation != handled_generation) {
+			ma_uint64 target = source->seek_target.load(std::memory_order_relaxed);
+			if (source->resampling != NULL)
+				target = resampler_reset(source->resampling, target);
+			ma_decoder_seek_to_pcm_frame(&source->decoder, target);
+			source->decoder_at_end.store(false, std::memory_order_relaxed);
+			handled_generation = generation;
+			source->seek_ack.store(generation, std::memory_order_release);
+		}
+
+		// * anything written before the callback dropped the old frames would be dropped too
+		bool is_flushed = source->flushed_generation.load(std::memory_order_acquire) == handled_generation;
+		bool is_full = ma_pcm_rb_available_read(&source->ring) >= source->watermark_frames;
+
+		if (!is_flushed || is_full || source->decoder_at_end.load(std::memory_order_relaxed) || !decode_chunk(source))
+			std::this_thread::sleep_for(idle);
+	}
+}
+
+decode_ahead_source* decode_ahead_open(const char* path, const decode_ahead_config& config) {
+	auto source = new decode_ahead_source;
+	source->config = config;
+
+	// * WAV in its own integers and FLAC in s32 skip the decoders' scalar f32 conversion, pcm_int_to_f32 does it after
+	ma_format decoded_format = config.format;
+	if (config.format == ma_format_f32 && config.encoding_format == ma_encoding_format_wav)
+		decoded_format = ma_format_unknown;
+	else if (config.format == ma_format_f32 && config.encoding_format == ma_encoding_format_flac)
+		decoded_format = ma_format_s32;
+	ma_decoder_config decoder_config = ma_decoder_config_init(decoded_format, 0, 0);
+	decoder_config.encodingFormat = config.encoding_format;
+	ma_result result = config.vfs != NULL
+		? ma_decoder_init_vfs(config.vfs, path, &decoder_config, &source->decoder)
+		: ma_decoder_init_file(path, &decoder_config, &source->decoder);
+	if (result != MA_SUCCESS) {
+		delete source;
+		return NULL;
+	}
+
+	ma_format format;
+	ma_uint32 channels;
+	ma_uint32 sample_rate;
+	ma_channel channel_map[MA_MAX_CHANNELS];
+	ma_decoder_get_data_format(&source->decoder, &format, &channels, &sample_rate, channel_map, MA_MAX_CHANNELS);
+	ma_decoder_get_length_in_pcm_frames(&source->decoder, &source->length);
+
+	if (config.format == ma_format_f32 && format != ma_format_f32) {
+		source->native_format = format;
+		source->native.resize(std::size_t(config.chunk_frames) * ma_get_bytes_per_frame(format, channels));
+		format = ma_format_f32;
+	}
+
+	if (format == ma_format_f32 && config.output_channels != 0 && channels > config.output_channels)
+		source->mixer = channel_mixer_create(channels, channel_map, config.output_channels, config.downmix);
+	if (source->mixer != NULL) {
+		source->unmixed.resize(std::size_t(config.chunk_frames) * channels);
+		channels = config.output_channels;
+	}
+
+	if (format == ma_format_f32 && config.output_sample_rate != 0 && config.output_sample_rate != sample_rate)
+		source->resampling = resampler_create(channels, sample_rate, config.output_sample_rate, config.quality);
+	if (source->resampling != NULL) {
+		source->length = resampler_output_frames(source->resampling, source->length);
+		source->decoded.resize(std::size_t(config.chunk_frames + resampler_latency(source->resampling)) * channels);
+		sample_rate = config.output_sample_rate;
+	}
+	source->sample_rate = sample_rate;
+	source->channels = channels;
+
+	source->bytes_per_frame = ma_get_bytes_per_frame(format, channels);
+	source->watermark_frames = ma_uint32(ma_uint64(config.watermark_ms) * sample_rate / 1000);
+
+	if (ma_pcm_rb_init(format, channels, source->watermark_frames + config.chunk_frames, NULL, NULL, &source->ring) != MA_SUCCESS) {
+		channel_mixer_destroy(source->mixer);
+		resampler_destroy(source->resampling);
+		ma_decoder_uninit(&source->decoder);
+		delete source;
+		return NULL;
+	}
+
+	ma_data_source_config base_config = ma_data_source_config_init();
+	base_config.vtable = &decode_ahead_vtable;
+	ma_data_source_init(&base_config, &source->base);
+
+	// * decode the first few ms here so playback doesn't begin with an underrun
+	ma_uint32 prefill_frames = ma_uint32(ma_uint64(config.prefill_ms) * sample_rate / 1000);
+	while (ma_pcm_rb_available_read(&source->ring) < prefill_frames && decode_chunk(source))
+		;
+
+	source->thread = std::thread(decode_loop, source);
+	return source;
+}
+
+void decode_ahead_close(decode_ahead_source* source) {
+	if (source == NULL)
+		return;
+
+	source->quit.store(true, std::memory_order_relaxed);
+	source->thread.join();
+
+	ma_data_source_uninit(&source->base);
+	ma_pcm_rb_uninit(&source->ring);
+	channel_mixer_destroy(source->mixer);
+	resampler_destroy(source->resampling);
+	ma_decoder_uninit(&source->decoder);
+	delete source;
+}
+
+decode_ahead_stats decode_ahead_get_stats(decode_ahead_source* source) {
+	return decode_ahead_stats{
+		.underruns = source->underruns.load(std::memory_order_relaxed),
+		.underrun_frames = source->underrun_frames.load(std::memory_order_relaxed),
+		.buffered_frames = ma_pcm_rb_available_read(&source->ring),
+		.watermark_frames = source->watermark_frames,
+	};
+}
+
+ma_uint64 decode_ahead_total_underruns() {
+	return total_underruns.load(std::memory_order_relaxed);
+}
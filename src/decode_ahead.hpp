@@ -0,0 +1,52 @@
+#pragma once
+
+#include "include/miniaudio.h"
+#include "resampler.hpp"
+#include "channel_mix.hpp"
+
+/**
+ * @brief Data source that decodes on its own thread into a ring buffer.
+ *
+ * The decode thread keeps `watermark_ms` of audio ready in a ma_pcm_rb, so the
+ * device callback only copies frames out of the ring. Seeks are handed over to
+ * the decode thread without blocking the callback, which plays silence until the
+ * frames for the new position arrive. With an output_sample_rate the decode thread
+ * also resamples, and cursor, length and seeks all count frames at that rate. With
+ * output_channels it downmixes multichannel files first, so the resampler and the
+ * ring only ever hold the channels that are played.
+ */
+
+struct decode_ahead_config {
+	ma_uint32 watermark_ms = 2000;
+	ma_uint32 prefill_ms = 100;
+	ma_uint32 chunk_frames = 4096;
+	ma_vfs* vfs = NULL;
+	// * known container skips the decoder probing every backend in turn
+	ma_encoding_format encoding_format = ma_encoding_format_unknown;
+	// * anything but f32 is handed out as decoded and never resampled, s32 keeps 16 and 24 bit FLAC exact for bit-transparent output;
+	// * for f32, WAV and FLAC still decode to integers and are converted on the decode thread
+	ma_format format = ma_format_f32;
+	// * 0 keeps the file's rate and leaves resampling to the engine, as does a ratio the resampler can't take
+	ma_uint32 output_sample_rate = 0;
+	resample_quality quality = resample_quality::HIGH;
+	// * 0 keeps the file's channels, as do files with fewer channels and layouts channel_mixer_create can't take, miniaudio converts those
+	ma_uint32 output_channels = 0;
+	downmix_matrix downmix = downmix_matrix::ITU;
+};
+
+struct decode_ahead_stats {
+	ma_uint64 underruns;
+	ma_uint64 underrun_frames;
+	ma_uint32 buffered_frames;
+	ma_uint32 watermark_frames;
+};
+
+struct decode_ahead_source;
+
+decode_ahead_source* decode_ahead_open(const char* path, const decode_ahead_config& config);
+void decode_ahead_close(decode_ahead_source* source);
+
+decode_ahead_stats decode_ahead_get_stats(decode_ahead_source* source);
+
+/** @brief Underruns summed over every source opened so far. */
+ma_uint64 decode_ahead_total_underruns();
@@ -0,0 +1,351 @@
+#include "duration_probe.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+constexpr size_t HEAD_BYTES = 64 * 1024;
+constexpr size_t SCAN_BLOCK_BYTES = 64 * 1024;
+constexpr ma_uint64 MAX_SCAN_BYTES = 4 << 20;
+constexpr int MAX_WAV_CHUNKS = 64;
+// * enough to tell a constant bitrate from a quiet intro of a VBR file in most cases
+constexpr ma_uint64 BITRATE_CHECK_FRAMES = 32;
+
+constexpr ma_uint16 WAVE_FORMAT_PCM = 1;
+constexpr ma_uint16 WAVE_FORMAT_IEEE_FLOAT = 3;
+constexpr ma_uint16 WAVE_FORMAT_ALAW = 6;
+constexpr ma_uint16 WAVE_FORMAT_MULAW = 7;
+constexpr ma_uint16 WAVE_FORMAT_EXTENSIBLE = 0xFFFE;
+
+/** @brief The head read during the scan, and the file behind it for anything further in. */
+struct file_reader {
+	const char* path;
+	const unsigned char* head;
+	size_t head_size;
+	ma_uint64 size;
+	bool is_head_only = false;
+	// * a read past the head was refused, whatever the probe made of it is wrong
+	bool is_cut_short = false;
+	int fd = -1;
+
+	~file_reader() {
+		if (fd >= 0)
+			close(fd);
+	}
+
+	/** @brief Copies up to count bytes at offset, returns how many there were. */
+	size_t read(ma_uint64 offset, unsigned char* bytes, size_t count) {
+		if (offset >= size)
+			return 0;
+		count = size_t(std::min<ma_uint64>(count, size - offset));
+		if (offset + count <= head_size) {
+			std::memcpy(bytes, head + offset, count);
+			return count;
+		}
+		if (is_head_only) {
+			is_cut_short = true;
+			return 0;
+		}
+		if (fd < 0)
+			fd = open(path, O_RDONLY | O_CLOEXEC);
+		if (fd < 0)
+			return 0;
+		ssize_t read_size = pread(fd, bytes, count, off_t(offset));
+		return read_size > 0 ? size_t(read_size) : 0;
+	}
+};
+
+static ma_uint16 read_u16(const unsigned char* bytes) {
+	return ma_uint16(bytes[0] | bytes[1] << 8);
+}
+
+static ma_uint32 read_u32(const unsigned char* bytes) {
+	return ma_uint32(bytes[0]) | ma_uint32(bytes[1]) << 8 | ma_uint32(bytes[2]) << 16 | ma_uint32(bytes[3]) << 24;
+}
+
+static ma_uint64 read_u64(const unsigned char* bytes) {
+	return ma_uint64(read_u32(bytes)) | ma_uint64(read_u32(bytes + 4)) << 32;
+}
+
+static ma_uint32 read_be32(const unsigned char* bytes) {
+	return ma_uint32(bytes[0]) << 24 | ma_uint32(bytes[1]) << 16 | ma_uint32(bytes[2]) << 8 | ma_uint32(bytes[3]);
+}
+
+static track_duration probe_wav(file_reader& file) {
+	track_duration duration;
+	unsigned char riff[12];
+	if (file.read(0, riff, sizeof(riff)) != sizeof(riff))
+		return duration;
+	bool is_rf64 = std::memcmp(riff, "RF64", 4) == 0;
+
+	ma_uint16 format_tag = 0;
+	ma_uint16 block_align = 0;
+	ma_uint64 ds64_data_size = 0;
+	ma_uint64 fact_frames = 0;
+	ma_uint64 offset = 12;
+	for (int chunk = 0; chunk < MAX_WAV_CHUNKS && offset + 8 <= file.size; chunk++) {
+		// * the chunk header and as much of the body as an extensible fmt needs
+		unsigned char bytes[8 + 40];
+		size_t read_size = file.read(offset, bytes, sizeof(bytes));
+		if (read_size < 8)
+			break;
+		ma_uint64 chunk_size = read_u32(bytes + 4);
+		const unsigned char* body = bytes + 8;
+		size_t body_size = read_size - 8;
+
+		if (std::memcmp(bytes, "fmt ", 4) == 0 && body_size >= 16) {
+			format_tag = read_u16(body);
+			duration.sample_rate = read_u32(body + 4);
+			block_align = read_u16(body + 12);
+			// * extensible headers carry the real format tag in the first bytes of the sub-format GUID
+			if (format_tag == WAVE_FORMAT_EXTENSIBLE && chunk_size >= 40 && body_size >= 40)
+				format_tag = read_u16(body + 24);
+		} else if (std::memcmp(bytes, "ds64", 4) == 0 && body_size >= 16) {
+			ds64_data_size = read_u64(body + 8);
+		} else if (std::memcmp(bytes, "fact", 4) == 0 && body_size >= 4) {
+			fact_frames = read_u32(body);
+		} else if (std::memcmp(bytes, "data", 4) == 0) {
+			ma_uint64 data_size = is_rf64 && chunk_size == 0xFFFFFFFF ? ds64_data_size : chunk_size;
+			// * recorders that crash leave a bogus size behind, the file length wins
+			data_size = std::min(data_size, file.size - offset - 8);
+			bool is_sampled = format_tag == WAVE_FORMAT_PCM || format_tag == WAVE_FORMAT_IEEE_FLOAT || format_tag == WAVE_FORMAT_ALAW
+				|| format_tag == WAVE_FORMAT_MULAW;
+			if (is_sampled && block_align > 0)
+				duration.frames = data_size / block_align;
+			else if (!is_sampled)
+				duration.frames = fact_frames;
+			duration.source = duration_source::HEADER;
+			return duration;
+		}
+		offset += 8 + chunk_size + (chunk_size & 1);
+	}
+	return duration;
+}
+
+/** @brief Where the audio starts, after an ID3v2 tag if there is one. */
+static ma_uint64 skip_id3v2(file_reader& file) {
+	unsigned char tag[10];
+	if (file.read(0, tag, sizeof(tag)) != sizeof(tag) || std::memcmp(tag, "ID3", 3) != 0)
+		return 0;
+	// * the size is syncsafe and excludes the 10 byte header and the optional footer
+	ma_uint64 tag_size = ma_uint64(tag[6] & 0x7F) << 21 | ma_uint64(tag[7] & 0x7F) << 14 | ma_uint64(tag[8] & 0x7F) << 7 | ma_uint64(tag[9] & 0x7F);
+	return tag_size + ((tag[5] & 0x10) != 0 ? 20 : 10);
+}
+
+static track_duration probe_flac(file_reader& file) {
+	track_duration duration;
+	// * the marker, then STREAMINFO, which the format requires to be the first metadata block
+	unsigned char bytes[4 + 4 + 18];
+	if (file.read(skip_id3v2(file), bytes, sizeof(bytes)) != sizeof(bytes) || std::memcmp(bytes, "fLaC", 4) != 0 || (bytes[4] & 0x7F) != 0)
+		return duration;
+
+	const unsigned char* info = bytes + 8;
+	duration.sample_rate = ma_uint32(info[10]) << 12 | ma_uint32(info[11]) << 4 | ma_uint32(info[12]) >> 4;
+	// * 0 means the encoder didn't know, as when it was fed from a pipe
+	duration.frames = ma_uint64(info[13] & 0x0F) << 32 | read_be32(info + 14);
+	duration.source = duration_source::HEADER;
+	return duration;
+}
+
+struct mpeg_frame {
+	ma_uint32 bitrate;
+	ma_uint32 sample_rate;
+	ma_uint32 samples;
+	ma_uint32 bytes;
+	// * where a Xing/Info header would start, after the side information
+	ma_uint32 xing_offset;
+};
+
+/** @brief False for anything but a header of a frame with a known size, free-format streams included. */
+static bool parse_mpeg_frame(const unsigned char* bytes, mpeg_frame& frame) {
+	if (bytes[0] != 0xFF || (bytes[1] & 0xE0) != 0xE0)
+		return false;
+	// * version 3 is MPEG 1, 2 MPEG 2 and 0 MPEG 2.5; layer 3 is layer I and 1 layer III
+	int version = (bytes[1] >> 3) & 3;
+	int layer = (bytes[1] >> 1) & 3;
+	int bitrate_index = bytes[2] >> 4;
+	int sample_rate_index = (bytes[2] >> 2) & 3;
+	if (version == 1 || layer == 0 || bitrate_index == 0 || bitrate_index == 15 || sample_rate_index == 3)
+		return false;
+
+	static const ma_uint16 bitrates[2][3][15] = {
+		{
+			{ 0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448 },
+			{ 0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384 },
+			{ 0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320 },
+		},
+		{
+			{ 0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256 },
+			{ 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160 },
+			{ 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160 },
+		},
+	};
+	static const ma_uint32 sample_rates[3] = { 44100, 48000, 32000 };
+	bool is_mpeg1 = version == 3;
+	bool is_mono = bytes[3] >> 6 == 3;
+	ma_uint32 padding = (bytes[2] >> 1) & 1;
+
+	frame.bitrate = ma_uint32(bitrates[is_mpeg1 ? 0 : 1][3 - layer][bitrate_index]) * 1000;
+	frame.sample_rate = sample_rates[sample_rate_index] >> (is_mpeg1 ? 0 : version == 2 ? 1 : 2);
+	if (layer == 3) {
+		frame.samples = 384;
+		frame.bytes = (12 * frame.bitrate / frame.sample_rate + padding) * 4;
+	} else {
+		frame.samples = layer == 1 && !is_mpeg1 ? 576 : 1152;
+		frame.bytes = frame.samples / 8 * frame.bitrate / frame.sample_rate + padding;
+	}
+	frame.xing_offset = 4 + (is_mpeg1 ? (is_mono ? 17 : 32) : (is_mono ? 9 : 17));
+	return true;
+}
+
+struct frame_walk {
+	ma_uint64 frames = 0;
+	ma_uint64 samples = 0;
+	// * just past the last frame counted
+	ma_uint64 end = 0;
+	bool is_constant = true;
+	bool is_complete = false;
+};
+
+/** @brief Steps from header to header, until a limit or something that isn't a frame of the stream, which ends it. */
+static frame_walk walk_frames(file_reader& file, ma_uint64 offset, ma_uint32 sample_rate, ma_uint64 max_frames, ma_uint64 max_bytes) {
+	frame_walk walk;
+	walk.end = offset;
+	std::vector<unsigned char> block(SCAN_BLOCK_BYTES);
+	ma_uint64 block_start = 0;
+	size_t block_size = 0;
+	ma_uint32 bitrate = 0;
+	while (walk.frames < max_frames && walk.end - offset < max_bytes) {
+		if (walk.end < block_start || walk.end + 4 > block_start + block_size) {
+			block_start = walk.end;
+			block_size = file.read(block_start, block.data(), block.size());
+			if (block_size < 4) {
+				walk.is_complete = true;
+				break;
+			}
+		}
+		mpeg_frame frame;
+		if (!parse_mpeg_frame(block.data() + (walk.end - block_start), frame) || frame.sample_rate != sample_rate) {
+			walk.is_complete = true;
+			break;
+		}
+		walk.is_constant = walk.is_constant && (bitrate == 0 || frame.bitrate == bitrate);
+		bitrate = frame.bitrate;
+		walk.frames++;
+		walk.samples += frame.samples;
+		walk.end += frame.bytes;
+	}
+	return walk;
+}
+
+/** @brief The first header followed by another one where the frame size says, a lone sync pattern can be noise. */
+static bool find_first_frame(file_reader& file, ma_uint64& offset, mpeg_frame& frame) {
+	unsigned char bytes[4096];
+	size_t size = file.read(offset, bytes, sizeof(bytes));
+	for (size_t i = 0; i + 4 <= size; i++) {
+		if (!parse_mpeg_frame(bytes + i, frame))
+			continue;
+		mpeg_frame next;
+		if (i + frame.bytes + 4 <= size && (!parse_mpeg_frame(bytes + i + frame.bytes, next) || next.sample_rate != frame.sample_rate))
+			continue;
+		offset += i;
+		return true;
+	}
+	return false;
+}
+
+static track_duration probe_mp3(file_reader& file) {
+	track_duration duration;
+	ma_uint64 start = skip_id3v2(file);
+	mpeg_frame frame;
+	if (!find_first_frame(file, start, frame))
+		return duration;
+	duration.sample_rate = frame.sample_rate;
+
+	// * LAME and most VBR encoders put the frame count in a silent first frame, Fraunhofer uses VBRI instead
+	unsigned char first[4 + 32 + 18];
+	size_t first_size = file.read(start, first, sizeof(first));
+	const unsigned char* xing = first + frame.xing_offset;
+	if (first_size >= frame.xing_offset + 12 && (std::memcmp(xing, "Xing", 4) == 0 || std::memcmp(xing, "Info", 4) == 0)) {
+		if ((read_be32(xing + 4) & 1) != 0) {
+			duration.frames = ma_uint64(read_be32(xing + 8)) * frame.samples;
+			duration.source = duration_source::HEADER;
+			return duration;
+		}
+		start += frame.bytes;
+	} else if (first_size >= 36 + 18 && std::memcmp(first + 36, "VBRI", 4) == 0) {
+		duration.frames = ma_uint64(read_be32(first + 36 + 14)) * frame.samples;
+		duration.source = duration_source::HEADER;
+		return duration;
+	}
+
+	// * an ID3v1 tag at the end is not audio
+	ma_uint64 end = file.size;
+	unsigned char tag[3];
+	if (end >= start + 128 && file.read(end - 128, tag, sizeof(tag)) == sizeof(tag) && std::memcmp(tag, "TAG", 3) == 0)
+		end -= 128;
+
+	frame_walk walk = walk_frames(file, start, frame.sample_rate, BITRATE_CHECK_FRAMES, MAX_SCAN_BYTES);
+	if (!walk.is_complete && walk.is_constant) {
+		duration.frames = (end - start) * 8 * frame.sample_rate / frame.bitrate;
+		duration.source = duration_source::BITRATE;
+		return duration;
+	}
+	if (!walk.is_complete)
+		walk = walk_frames(file, start, frame.sample_rate, UINT64_MAX, MAX_SCAN_BYTES);
+	duration.frames = walk.samples;
+	if (!walk.is_complete && walk.end > start)
+		duration.frames = ma_uint64(double(walk.samples) * double(end - start) / double(walk.end - start));
+	duration.source = duration_source::FRAME_SCAN;
+	return duration;
+}
+
+track_duration probe_duration(const char* path, ma_encoding_format format, const unsigned char* head, size_t head_size, ma_uint64 file_size,
+	bool is_head_only) {
+	file_reader file{ path, head, size_t(std::min<ma_uint64>(head_size, file_size)), file_size, is_head_only };
+	track_duration duration;
+	switch (format) {
+		case ma_encoding_format_wav: duration = probe_wav(file); break;
+		case ma_encoding_format_flac: duration = probe_flac(file); break;
+		case ma_encoding_format_mp3: duration = probe_mp3(file); break;
+		default: break;
+	}
+	if (file.is_cut_short)
+		duration = track_duration{ .source = duration_source::DEFERRED };
+	else if (duration.sample_rate == 0 || duration.frames == 0)
+		duration = track_duration{};
+	return duration;
+}
+
+track_duration probe_duration(const char* path, ma_encoding_format format) {
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return track_duration{};
+
+	struct stat file_stat;
+	std::vector<unsigned char> head(HEAD_BYTES);
+	ssize_t size = fstat(fd, &file_stat) == 0 ? pread(fd, head.data(), head.size(), 0) : -1;
+	close(fd);
+	if (size <= 0)
+		return track_duration{};
+	return probe_duration(path, format, head.data(), size_t(size), ma_uint64(file_stat.st_size));
+}
+
+double duration_seconds(const track_duration& duration) {
+	return duration.sample_rate > 0 ? double(duration.frames) / duration.sample_rate : 0;
+}
+
+const char* duration_source_name(duration_source source) {
+	switch (source) {
+		case duration_source::HEADER: return "header";
+		case duration_source::BITRATE: return "bitrate";
+		case duration_source::FRAME_SCAN: return "frame scan";
+		case duration_source::DEFERRED: return "deferred";
+		default: return "unknown";
+	}
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "include/miniaudio.h"
+
+/**
+ * @brief Length of a track from its headers, without decoding any audio.
+ *
+ * WAV divides the data chunk (or the RF64 ds64 size) by the frame size, or takes the fact
+ * chunk for compressed data. FLAC reads the total sample count from STREAMINFO. MP3 takes the
+ * frame count of a Xing/Info or VBRI header. Without one, the first frames decide: a constant
+ * bitrate gives the length from the file size, a varying one makes the frame headers be walked,
+ * at most the first 4 MiB, with the rest extrapolated from the bytes per frame seen so far.
+ */
+
+enum class duration_source {
+	NONE,
+	HEADER,
+	BITRATE,
+	FRAME_SCAN,
+	// * would have needed reads past the head, probe the file again later to get it
+	DEFERRED,
+};
+
+struct track_duration {
+	ma_uint64 frames = 0;
+	ma_uint32 sample_rate = 0;
+	duration_source source = duration_source::NONE;
+};
+
+/**
+ * @brief From bytes already read at the start of the file, the file is only reopened for chunks or
+ * frames beyond them. frames is 0 when the length can't be told without decoding.
+ *
+ * is_head_only never reopens it: a length that needs more (an MP3 without Xing or VBRI, the ID3v1
+ * check, a WAV data chunk further in) comes back as DEFERRED instead, for a pass where seeks are cheap.
+ */
+track_duration probe_duration(const char* path, ma_encoding_format format, const unsigned char* head, size_t head_size, ma_uint64 file_size,
+	bool is_head_only = false);
+
+/** @brief Same, reading the head itself. */
+track_duration probe_duration(const char* path, ma_encoding_format format);
+
+/** @brief 0 while the length is unknown. */
+double duration_seconds(const track_duration& duration);
+
+const char* duration_source_name(duration_source source);
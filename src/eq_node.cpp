@@ -0,0 +1,257 @@
+#include "eq_node.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <vector>
+
+#include "audio_stats.hpp"
+
+typedef float float4 __attribute__((vector_size(16)));
+
+// * about 20ms at 48 kHz, long enough to hide the filters settling
+constexpr ma_uint32 CROSSFADE_FRAMES = 1024;
+constexpr int DIRTY = 4;
+
+/** @brief Active bands only, in band order, coefficients normalised by a0. */
+struct eq_cascade {
+	int count = 0;
+	int bands[EQ_BANDS];
+	float b0[EQ_BANDS], b1[EQ_BANDS], b2[EQ_BANDS], a1[EQ_BANDS], a2[EQ_BANDS];
+	float preamp = 1;
+};
+
+struct eq_node {
+	ma_node_base base;
+	ma_uint32 channels;
+	ma_uint32 sample_rate;
+	ma_uint32 groups;
+	int stage;
+
+	// * triple buffer: the main thread fills slots[back], the audio thread reads slots[front]
+	eq_cascade slots[3];
+	int back = 1;
+	std::atomic<int> middle = 2;
+	int front = 0;
+
+	// * two float4 per band per channel group, kept by band so a band keeps its state when others change
+	std::vector<float4> state;
+	eq_cascade previous;
+	std::vector<float4> previous_state;
+	ma_uint32 fade_position = CROSSFADE_FRAMES;
+};
+
+static ma_uint64 now_ns() {
+	auto now = std::chrono::steady_clock::now().time_since_epoch();
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+}
+
+eq_settings eq_settings_flat() {
+	eq_settings settings;
+	for (int band = 0; band < EQ_BANDS; band++) {
+		settings.bands[band].frequency = 31.25f * float(1 << band);
+		settings.bands[band].q = 1.41f;
+	}
+	settings.bands[0].type = eq_band_type::LOW_SHELF;
+	settings.bands[0].q = 0.707f;
+	settings.bands[EQ_BANDS - 1].type = eq_band_type::HIGH_SHELF;
+	settings.bands[EQ_BANDS - 1].q = 0.707f;
+	return settings;
+}
+
+static bool is_flat_band(const eq_band& band) {
+	return std::fabs(band.gain_db) < 0.01f || band.frequency <= 0 || band.q <= 0;
+}
+
+bool eq_settings_is_flat(const eq_settings& settings) {
+	return std::fabs(settings.preamp_db) < 0.01f && std::ranges::all_of(settings.bands, is_flat_band);
+}
+
+/** @brief RBJ cookbook biquads, a band that changes nothing is left out of the cascade. */
+static eq_cascade make_cascade(const eq_settings& settings, ma_uint32 sample_rate) {
+	eq_cascade cascade;
+	cascade.preamp = std::pow(10.0f, settings.preamp_db / 20);
+	for (int band = 0; band < EQ_BANDS; band++) {
+		const eq_band& parameters = settings.bands[band];
+		if (is_flat_band(parameters))
+			continue;
+
+		double frequency = std::min<double>(parameters.frequency, sample_rate * 0.45);
+		double a = std::pow(10.0, parameters.gain_db / 40);
+		double w0 = 2 * M_PI * frequency / sample_rate;
+		double cosine = std::cos(w0);
+		double alpha = std::sin(w0) / (2 * parameters.q);
+		double shelf = 2 * std::sqrt(a) * alpha;
+		double b0, b1, b2, a0, a1, a2;
+		switch (parameters.type) {
+			case eq_band_type::LOW_SHELF:
+				b0 = a * ((a + 1) - (a - 1) * cosine + shelf);
+				b1 = 2 * a * ((a - 1) - (a + 1) * cosine);
+				b2 = a * ((a + 1) - (a - 1) * cosine - shelf);
+				a0 = (a + 1) + (a - 1) * cosine + shelf;
+				a1 = -2 * ((a - 1) + (a + 1) * cosine);
+				a2 = (a + 1) + (a - 1) * cosine - shelf;
+				break;
+			case eq_band_type::HIGH_SHELF:
+				b0 = a * ((a + 1) + (a - 1) * cosine + shelf);
+				b1 = -2 * a * ((a - 1) + (a + 1) * cosine);
+				b2 = a * ((a + 1) + (a - 1) * cosine - shelf);
+				a0 = (a + 1) - (a - 1) * cosine + shelf;
+				a1 = 2 * ((a - 1) - (a + 1) * cosine);
+				a2 = (a + 1) - (a - 1) * cosine - shelf;
+				break;
+			default:
+				b0 = 1 + alpha * a;
+				b1 = -2 * cosine;
+				b2 = 1 - alpha * a;
+				a0 = 1 + alpha / a;
+				a1 = -2 * cosine;
+				a2 = 1 - alpha / a;
+				break;
+		}
+
+		int section = cascade.count++;
+		cascade.bands[section] = band;
+		cascade.b0[section] = float(b0 / a0);
+		cascade.b1[section] = float(b1 / a0);
+		cascade.b2[section] = float(b2 / a0);
+		cascade.a1[section] = float(a1 / a0);
+		cascade.a2[section] = float(a2 / a0);
+	}
+	return cascade;
+}
+
+/** @brief One frame of a channel group through every active band, transposed direct form II. */
+static float4 run_cascade(const eq_cascade& cascade, float4* state, float4 x) {
+	for (int section = 0; section < cascade.count; section++) {
+		float4* band_state = state + cascade.bands[section] * 2;
+		float4 y = cascade.b0[section] * x + band_state[0];
+		band_state[0] = cascade.b1[section] * x - cascade.a1[section] * y + band_state[1];
+		band_state[1] = cascade.b2[section] * x - cascade.a2[section] * y;
+		x = y;
+	}
+	return x * cascade.preamp;
+}
+
+/**
+ * @brief Takes new settings if the main thread published some, keeping the old cascade around for the crossfade.
+ * Settings arriving mid-fade wait for it to finish, starting over would drop the blend being heard for one end of it.
+ * Meanwhile newer ones replace them in the middle slot, so only the latest is faded to.
+ */
+static void pick_up_settings(eq_node* eq) {
+	if (eq->fade_position < CROSSFADE_FRAMES || (eq->middle.load(std::memory_order_acquire) & DIRTY) == 0)
+		return;
+
+	eq->previous = eq->slots[eq->front];
+	std::copy(eq->state.begin(), eq->state.end(), eq->previous_state.begin());
+	eq->front = eq->middle.exchange(eq->front, std::memory_order_acq_rel) & 3;
+
+	// * bands switched on now start from silence, not from whatever they held when last used
+	const eq_cascade& current = eq->slots[eq->front];
+	for (int section = 0; section < current.count; section++) {
+		int band = current.bands[section];
+		if (std::find(eq->previous.bands, eq->previous.bands + eq->previous.count, band) != eq->previous.bands + eq->previous.count)
+			continue;
+		for (ma_uint32 group = 0; group < eq->groups; group++) {
+			eq->state[(group * EQ_BANDS + band) * 2] = float4{};
+			eq->state[(group * EQ_BANDS + band) * 2 + 1] = float4{};
+		}
+	}
+	eq->fade_position = 0;
+}
+
+/** @brief Decaying filters end in denormals, which are slow on x86, after silence. */
+static void flush_denormals(float4* state) {
+	for (int i = 0; i < EQ_BANDS * 2; i++) {
+		float4 magnitude = state[i] < 0 ? -state[i] : state[i];
+		state[i] = magnitude < 1e-15f ? float4{} : state[i];
+	}
+}
+
+static void eq_process(ma_node* node, const float** frames_in, ma_uint32* frame_count_in, float** frames_out, ma_uint32* frame_count_out) {
+	auto eq = (eq_node*)node;
+	ma_uint64 start = now_ns();
+	ma_uint32 frame_count = std::min(*frame_count_in, *frame_count_out);
+	ma_uint32 channels = eq->channels;
+	pick_up_settings(eq);
+	const eq_cascade& cascade = eq->slots[eq->front];
+	bool fading = eq->fade_position < CROSSFADE_FRAMES;
+
+	for (ma_uint32 group = 0; group < eq->groups; group++) {
+		ma_uint32 lanes = std::min<ma_uint32>(4, channels - group * 4);
+		float4* state = &eq->state[group * EQ_BANDS * 2];
+		float4* previous_state = &eq->previous_state[group * EQ_BANDS * 2];
+
+		for (ma_uint32 frame = 0; frame < frame_count; frame++) {
+			const float* input = frames_in[0] + std::size_t(frame) * channels + group * 4;
+			float4 x = {};
+			for (ma_uint32 lane = 0; lane < lanes; lane++)
+				x[lane] = input[lane];
+
+			float4 y = run_cascade(cascade, state, x);
+			if (fading) {
+				float4 old = run_cascade(eq->previous, previous_state, x);
+				float mix = std::min(1.0f, float(eq->fade_position + frame) / CROSSFADE_FRAMES);
+				y = old + (y - old) * mix;
+			}
+
+			float* output = frames_out[0] + std::size_t(frame) * channels + group * 4;
+			for (ma_uint32 lane = 0; lane < lanes; lane++)
+				output[lane] = y[lane];
+		}
+
+		flush_denormals(state);
+		if (fading)
+			flush_denormals(previous_state);
+	}
+
+	if (fading)
+		eq->fade_position = std::min(CROSSFADE_FRAMES, eq->fade_position + frame_count);
+	*frame_count_in = frame_count;
+	*frame_count_out = frame_count;
+	audio_stats_record_stage(eq->stage, now_ns() - start);
+}
+
+static ma_node_vtable eq_vtable = {
+	eq_process,
+	NULL,
+	1,
+	1,
+	0,
+};
+
+eq_node* eq_node_create(ma_node_graph* graph, ma_uint32 channels, ma_uint32 sample_rate) {
+	if (channels == 0 || sample_rate == 0)
+		return NULL;
+
+	auto eq = new eq_node;
+	eq->channels = channels;
+	eq->sample_rate = sample_rate;
+	eq->groups = (channels + 3) / 4;
+	eq->stage = audio_stats_register_stage("eq");
+	eq->state.assign(std::size_t(eq->groups) * EQ_BANDS * 2, float4{});
+	eq->previous_state.assign(eq->state.size(), float4{});
+
+	ma_node_config node_config = ma_node_config_init();
+	node_config.vtable = &eq_vtable;
+	node_config.pInputChannels = &eq->channels;
+	node_config.pOutputChannels = &eq->channels;
+	if (ma_node_init(graph, &node_config, NULL, &eq->base) != MA_SUCCESS) {
+		delete eq;
+		return NULL;
+	}
+	return eq;
+}
+
+void eq_node_destroy(eq_node* eq) {
+	if (eq == NULL)
+		return;
+	ma_node_uninit(&eq->base, NULL);
+	delete eq;
+}
+
+void eq_node_set(eq_node* eq, const eq_settings& settings) {
+	eq->slots[eq->back] = make_cascade(settings, eq->sample_rate);
+	eq->back = eq->middle.exchange(eq->back | DIRTY, std::memory_order_acq_rel) & 3;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <array>
+
+#include "include/miniaudio.h"
+
+/**
+ * @brief Ten-band parametric equalizer node, placed between the sounds and the limiter.
+ *
+ * Bands are RBJ peaking or shelving biquads run as one cascade, with up to four
+ * channels in the lanes of a vector. Flat bands are skipped. New settings reach the
+ * audio thread through a triple buffer, and the old and new cascades run side by
+ * side for a short crossfade, so changes never click or zipper.
+ */
+
+constexpr int EQ_BANDS = 10;
+
+enum class eq_band_type {
+	PEAK,
+	LOW_SHELF,
+	HIGH_SHELF,
+};
+
+struct eq_band {
+	eq_band_type type = eq_band_type::PEAK;
+	float frequency = 1000;
+	float gain_db = 0;
+	float q = 1.41f;
+};
+
+struct eq_settings {
+	float preamp_db = 0;
+	std::array<eq_band, EQ_BANDS> bands;
+};
+
+/** @brief Octave-spaced bands from 31 Hz to 16 kHz, shelves at both ends, all flat. */
+eq_settings eq_settings_flat();
+/** @brief True when no band and no preamp would change the signal. */
+bool eq_settings_is_flat(const eq_settings& settings);
+
+struct eq_node;
+
+/** @brief NULL on failure. Attach it with (ma_node*)eq. */
+eq_node* eq_node_create(ma_node_graph* graph, ma_uint32 channels, ma_uint32 sample_rate);
+void eq_node_destroy(eq_node* eq);
+
+/** @brief From the main thread, the audio thread crossfades to it at its next block. */
+void eq_node_set(eq_node* eq, const eq_settings& settings);
@@ -0,0 +1,99 @@
+#include "eq_presets.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <unordered_map>
+
+constexpr const char* PRESETS_HEADER = "aurabeat-eq 1";
+
+static std::string global_preset = "flat";
+static std::unordered_map<std::string, std::string> track_presets;
+
+static eq_preset make_preset(const char* name, std::initializer_list<float> gains, float preamp_db = 0) {
+	eq_preset preset{ name, eq_settings_flat() };
+	preset.settings.preamp_db = preamp_db;
+	int band = 0;
+	for (float gain : gains)
+		preset.settings.bands[band++].gain_db = gain;
+	return preset;
+}
+
+const std::vector<eq_preset>& eq_presets() {
+	// * boosts are left to the limiter, the preamp only takes back part of them
+	static const std::vector<eq_preset> presets = {
+		make_preset("flat", {}),
+		make_preset("bass", { 6, 5, 3, 1, 0, 0, 0, 0, 0, 0 }, -2),
+		make_preset("treble", { 0, 0, 0, 0, 0, 0, 1, 3, 5, 6 }, -2),
+		make_preset("vocal", { -3, -2, -1, 0, 2, 4, 4, 2, 0, -1 }, -1),
+		make_preset("loudness", { 5, 4, 1, 0, -1, -1, 0, 1, 3, 4 }, -2),
+	};
+	return presets;
+}
+
+static const eq_preset* find_preset(const std::string& name) {
+	auto preset = std::ranges::find(eq_presets(), name, &eq_preset::name);
+	return preset == eq_presets().end() ? NULL : &*preset;
+}
+
+void eq_presets_load(const std::string& file) {
+	std::ifstream input(file);
+	std::string line;
+	if (!std::getline(input, line) || line != PRESETS_HEADER)
+		return;
+
+	// * "global\tname" once, then "track\tname\tpath" per track
+	while (std::getline(input, line)) {
+		std::size_t first = line.find('\t');
+		std::size_t second = first == std::string::npos ? first : line.find('\t', first + 1);
+		std::string kind = line.substr(0, first);
+		std::string name = line.substr(first + 1, second == std::string::npos ? std::string::npos : second - first - 1);
+		if (first == std::string::npos || find_preset(name) == NULL)
+			continue;
+		if (kind == "global")
+			global_preset = name;
+		else if (kind == "track" && second != std::string::npos)
+			track_presets[line.substr(second + 1)] = name;
+	}
+}
+
+bool eq_presets_save(const std::string& file) {
+	std::string temporary = file + ".tmp";
+	{
+		std::ofstream output(temporary, std::ios::trunc);
+		output << PRESETS_HEADER << '\n' << "global\t" << global_preset << '\n';
+		for (const auto& [path, name] : track_presets)
+			output << "track\t" << name << '\t' << path << '\n';
+		if (!output.flush())
+			return false;
+	}
+	return std::rename(temporary.c_str(), file.c_str()) == 0;
+}
+
+const std::string& eq_global_preset() {
+	return global_preset;
+}
+
+void eq_set_global_preset(const std::string& name) {
+	if (find_preset(name) != NULL)
+		global_preset = name;
+}
+
+std::string eq_track_preset(const std::string& path) {
+	auto preset = track_presets.find(path);
+	return preset == track_presets.end() ? std::string() : preset->second;
+}
+
+void eq_set_track_preset(const std::string& path, const std::string& name) {
+	if (name.empty() || find_preset(name) == NULL || path.find('\n') != std::string::npos)
+		track_presets.erase(path);
+	else
+		track_presets[path] = name;
+}
+
+const eq_preset& eq_preset_for(const std::string& path) {
+	const eq_preset* preset = find_preset(eq_track_preset(path));
+	if (preset == NULL)
+		preset = find_preset(global_preset);
+	return preset != NULL ? *preset : eq_presets().front();
+}
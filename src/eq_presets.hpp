@@ -0,0 +1,34 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "eq_node.hpp"
+
+/**
+ * @brief Named EQ presets, one chosen for everything and optionally one per track.
+ *
+ * The choices are kept in a small versioned text file next to the other settings,
+ * tracks are remembered by path.
+ */
+
+struct eq_preset {
+	std::string name;
+	eq_settings settings;
+};
+
+/** @brief Built in presets, "flat" first. */
+const std::vector<eq_preset>& eq_presets();
+
+void eq_presets_load(const std::string& file);
+bool eq_presets_save(const std::string& file);
+
+const std::string& eq_global_preset();
+void eq_set_global_preset(const std::string& name);
+
+/** @brief Empty when the track follows the global preset. */
+std::string eq_track_preset(const std::string& path);
+void eq_set_track_preset(const std::string& path, const std::string& name);
+
+/** @brief The track's own preset if it has one, else the global one. */
+const eq_preset& eq_preset_for(const std::string& path);
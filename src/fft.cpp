@@ -0,0 +1,142 @@
+#include "fft.hpp"
+
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+typedef float float4 __attribute__((vector_size(16)));
+
+struct fft_plan {
+	std::size_t size;
+	std::vector<std::size_t> bit_reverse;
+	// * stage with half-size h keeps its h twiddles at offset h - 1
+	std::vector<float> twiddle_real;
+	std::vector<float> twiddle_imaginary;
+};
+
+static float4 load4(const float* source) {
+	float4 value;
+	std::memcpy(&value, source, sizeof(value));
+	return value;
+}
+
+static void store4(float* destination, float4 value) {
+	std::memcpy(destination, &value, sizeof(value));
+}
+
+fft_plan* fft_plan_create(std::size_t size) {
+	if (size < 4 || (size & (size - 1)) != 0)
+		return NULL;
+
+	auto plan = new fft_plan;
+	plan->size = size;
+	plan->bit_reverse.resize(size);
+	int bits = 0;
+	while ((std::size_t(1) << bits) < size)
+		bits++;
+	for (std::size_t i = 0; i < size; i++) {
+		std::size_t reversed = 0;
+		for (int bit = 0; bit < bits; bit++)
+			reversed |= ((i >> bit) & 1) << (bits - 1 - bit);
+		plan->bit_reverse[i] = reversed;
+	}
+
+	plan->twiddle_real.resize(size);
+	plan->twiddle_imaginary.resize(size);
+	for (std::size_t half = 1; half < size; half *= 2) {
+		for (std::size_t k = 0; k < half; k++) {
+			double angle = -M_PI * double(k) / double(half);
+			plan->twiddle_real[half - 1 + k] = float(std::cos(angle));
+			plan->twiddle_imaginary[half - 1 + k] = float(std::sin(angle));
+		}
+	}
+	return plan;
+}
+
+void fft_plan_destroy(fft_plan* plan) {
+	delete plan;
+}
+
+std::size_t fft_size(const fft_plan* plan) {
+	return plan->size;
+}
+
+/** @brief Decimation in time, sign flips the twiddles' imaginary part for the inverse. */
+static void transform(const fft_plan* plan, float* real, float* imaginary, float sign) {
+	std::size_t size = plan->size;
+	for (std::size_t i = 0; i < size; i++) {
+		std::size_t j = plan->bit_reverse[i];
+		if (j > i) {
+			std::swap(real[i], real[j]);
+			std::swap(imaginary[i], imaginary[j]);
+		}
+	}
+
+	// * the first two stages have fewer than four butterflies per group, done as one radix-4 pass
+	for (std::size_t i = 0; i < size; i += 4) {
+		float a_re = real[i] + real[i + 1], a_im = imaginary[i] + imaginary[i + 1];
+		float b_re = real[i] - real[i + 1], b_im = imaginary[i] - imaginary[i + 1];
+		float c_re = real[i + 2] + real[i + 3], c_im = imaginary[i + 2] + imaginary[i + 3];
+		float d_re = real[i + 2] - real[i + 3], d_im = imaginary[i + 2] - imaginary[i + 3];
+		// * d times -i (forward) or +i (inverse)
+		float rotated_re = sign * d_im;
+		float rotated_im = -sign * d_re;
+		real[i] = a_re + c_re;
+		imaginary[i] = a_im + c_im;
+		real[i + 2] = a_re - c_re;
+		imaginary[i + 2] = a_im - c_im;
+		real[i + 1] = b_re + rotated_re;
+		imaginary[i + 1] = b_im + rotated_im;
+		real[i + 3] = b_re - rotated_re;
+		imaginary[i + 3] = b_im - rotated_im;
+	}
+
+	for (std::size_t half = 4; half < size; half *= 2) {
+		const float* twiddle_re = &plan->twiddle_real[half - 1];
+		const float* twiddle_im = &plan->twiddle_imaginary[half - 1];
+		for (std::size_t group = 0; group < size; group += half * 2) {
+			float* top_re = real + group;
+			float* top_im = imaginary + group;
+			float* bottom_re = top_re + half;
+			float* bottom_im = top_im + half;
+			for (std::size_t k = 0; k < half; k += 4) {
+				float4 w_re = load4(twiddle_re + k);
+				float4 w_im = load4(twiddle_im + k) * sign;
+				float4 b_re = load4(bottom_re + k);
+				float4 b_im = load4(bottom_im + k);
+				float4 t_re = b_re * w_re - b_im * w_im;
+				float4 t_im = b_re * w_im + b_im * w_re;
+				float4 a_re = load4(top_re + k);
+				float4 a_im = load4(top_im + k);
+				store4(top_re + k, a_re + t_re);
+				store4(top_im + k, a_im + t_im);
+				store4(bottom_re + k, a_re - t_re);
+				store4(bottom_im + k, a_im - t_im);
+			}
+		}
+	}
+}
+
+void fft_forward(const fft_plan* plan, float* real, float* imaginary) {
+	transform(plan, real, imaginary, 1.0f);
+}
+
+void fft_inverse(const fft_plan* plan, float* real, float* imaginary) {
+	transform(plan, real, imaginary, -1.0f);
+	float scale = 1.0f / float(plan->size);
+	for (std::size_t i = 0; i < plan->size; i++) {
+		real[i] *= scale;
+		imaginary[i] *= scale;
+	}
+}
+
+void fft_power_spectrum(const fft_plan* plan, const float* input, float* power, float* scratch) {
+	std::size_t size = plan->size;
+	float* real = scratch;
+	float* imaginary = scratch + size;
+	std::memcpy(real, input, size * sizeof(float));
+	std::memset(imaginary, 0, size * sizeof(float));
+	fft_forward(plan, real, imaginary);
+	for (std::size_t k = 0; k <= size / 2; k++)
+		power[k] = real[k] * real[k] + imaginary[k] * imaginary[k];
+}
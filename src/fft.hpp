@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+
+/**
+ * @brief Radix-2 complex FFT on real and imaginary parts kept in separate arrays.
+ *
+ * Decimation in time with one radix-4 pass for the first two stages, then plain
+ * radix-2 stages (not the split-radix algorithm; "split" refers to the data layout
+ * only). Butterflies run four at a time on GCC/Clang vector types, which map to SSE or
+ * NEON without any per-architecture code. Twiddles are laid out per stage so the
+ * vector loads stay contiguous. Sizes must be powers of two.
+ */
+
+struct fft_plan;
+
+/** @brief Returns NULL when size is not a power of two of at least 4. */
+fft_plan* fft_plan_create(std::size_t size);
+void fft_plan_destroy(fft_plan* plan);
+std::size_t fft_size(const fft_plan* plan);
+
+/** @brief In place, unscaled. */
+void fft_forward(const fft_plan* plan, float* real, float* imaginary);
+/** @brief In place, scaled by 1/size so forward then inverse gives the input back. */
+void fft_inverse(const fft_plan* plan, float* real, float* imaginary);
+
+/** @brief |X[k]|² of a real input for k = 0 .. size/2, scratch needs 2 * size floats. */
+void fft_power_spectrum(const fft_plan* plan, const float* input, float* power, float* scratch);
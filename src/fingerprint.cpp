@@ -0,0 +1,190 @@
+#include "fingerprint.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+#include "fft.hpp"
+
+constexpr int BAND_COUNT = 33;
+constexpr float LOWEST_FREQUENCY = 300;
+constexpr float HIGHEST_FREQUENCY = 2000;
+
+/** @brief Reads exactly count mono frames from the decoder's current position, false if the track ends first. */
+static bool read_samples(ma_decoder* decoder, std::vector<float>& samples, ma_uint64 count) {
+	samples.resize(count);
+	ma_uint64 total = 0;
+	while (total < count) {
+		ma_uint64 read = 0;
+		if (ma_decoder_read_pcm_frames(decoder, samples.data() + total, count - total, &read) != MA_SUCCESS || read == 0)
+			break;
+		total += read;
+	}
+	return total == count;
+}
+
+std::vector<ma_uint32> fingerprint_file(const char* path, ma_encoding_format format, const fingerprint_config& config) {
+	std::vector<ma_uint32> fingerprint;
+	ma_decoder_config decoder_config = ma_decoder_config_init(ma_format_f32, 1, config.sample_rate);
+	decoder_config.encodingFormat = format;
+	ma_decoder decoder;
+	if (ma_decoder_init_file(path, &decoder_config, &decoder) != MA_SUCCESS)
+		return fingerprint;
+
+	// * one extra frame, the first word needs a previous one to compare against
+	ma_uint64 needed = ma_uint64(config.frames) * config.hop + config.frame_size;
+	std::vector<float> samples;
+	bool complete = ma_decoder_seek_to_pcm_frame(&decoder, ma_uint64(config.offset_seconds) * config.sample_rate) == MA_SUCCESS
+		&& read_samples(&decoder, samples, needed);
+	if (!complete)
+		complete = ma_decoder_seek_to_pcm_frame(&decoder, 0) == MA_SUCCESS && read_samples(&decoder, samples, needed);
+	ma_decoder_uninit(&decoder);
+	if (!complete)
+		return fingerprint;
+
+	fft_plan* plan = fft_plan_create(config.frame_size);
+	if (plan == NULL)
+		return fingerprint;
+
+	std::vector<float> window(config.frame_size);
+	for (std::size_t i = 0; i < window.size(); i++)
+		window[i] = 0.5f - 0.5f * std::cos(2 * float(M_PI) * float(i) / float(window.size()));
+
+	// * band edges as FFT bins, log-spaced like pitch
+	int band_edges[BAND_COUNT + 1];
+	for (int band = 0; band <= BAND_COUNT; band++) {
+		float frequency = LOWEST_FREQUENCY * std::pow(HIGHEST_FREQUENCY / LOWEST_FREQUENCY, float(band) / BAND_COUNT);
+		band_edges[band] = int(frequency * float(config.frame_size) / float(config.sample_rate));
+	}
+
+	std::vector<float> frame(config.frame_size);
+	std::vector<float> power(config.frame_size / 2 + 1);
+	std::vector<float> scratch(config.frame_size * 2);
+	float previous_differences[BAND_COUNT - 1] = {};
+	fingerprint.reserve(config.frames);
+
+	for (ma_uint32 index = 0; index <= config.frames; index++) {
+		const float* source = samples.data() + std::size_t(index) * config.hop;
+		for (std::size_t i = 0; i < frame.size(); i++)
+			frame[i] = source[i] * window[i];
+		fft_power_spectrum(plan, frame.data(), power.data(), scratch.data());
+
+		float energies[BAND_COUNT];
+		for (int band = 0; band < BAND_COUNT; band++) {
+			energies[band] = 0;
+			for (int bin = band_edges[band]; bin < std::max(band_edges[band + 1], band_edges[band] + 1); bin++)
+				energies[band] += power[bin];
+		}
+
+		ma_uint32 word = 0;
+		for (int band = 0; band < BAND_COUNT - 1; band++) {
+			float difference = energies[band] - energies[band + 1];
+			if (difference - previous_differences[band] > 0)
+				word |= 1u << band;
+			previous_differences[band] = difference;
+		}
+		if (index > 0)
+			fingerprint.push_back(word);
+	}
+
+	fft_plan_destroy(plan);
+	return fingerprint;
+}
+
+float fingerprint_bit_error_rate(const std::vector<ma_uint32>& a, const std::vector<ma_uint32>& b, int offset) {
+	// * b[i] lines up with a[i + offset]
+	std::size_t a_start = offset > 0 ? std::size_t(offset) : 0;
+	std::size_t b_start = offset < 0 ? std::size_t(-offset) : 0;
+	if (a_start >= a.size() || b_start >= b.size())
+		return 1;
+	std::size_t overlap = std::min(a.size() - a_start, b.size() - b_start);
+	if (overlap * 2 < std::min(a.size(), b.size()))
+		return 1;
+
+	std::size_t differing = 0;
+	for (std::size_t i = 0; i < overlap; i++)
+		differing += std::size_t(std::popcount(a[a_start + i] ^ b[b_start + i]));
+	return float(differing) / float(overlap * 32);
+}
+
+constexpr int BUCKET_BITS = 20;
+
+struct fingerprint_index {
+	std::vector<const std::vector<ma_uint32>*> fingerprints;
+	// * indexed words sorted, with entry << 8 | frame alongside, and where each top-bits bucket starts
+	std::vector<ma_uint32> words;
+	std::vector<ma_uint32> locations;
+	std::vector<ma_uint32> bucket_starts;
+};
+
+/** @brief Silence and constant tones give words that would match everything. */
+static bool is_informative(ma_uint32 word) {
+	return word != 0 && word != 0xFFFFFFFFu;
+}
+
+fingerprint_index* fingerprint_index_build(const std::vector<const std::vector<ma_uint32>*>& fingerprints) {
+	std::vector<ma_uint64> keys;
+	for (std::size_t entry = 0; entry < fingerprints.size() && entry < (1u << 24); entry++) {
+		if (fingerprints[entry] == NULL)
+			continue;
+		const std::vector<ma_uint32>& words = *fingerprints[entry];
+		for (std::size_t frame = 0; frame < words.size() && frame < 256; frame += 2) {
+			if (is_informative(words[frame]))
+				keys.push_back(ma_uint64(words[frame]) << 32 | ma_uint64(entry) << 8 | frame);
+		}
+	}
+	std::ranges::sort(keys);
+
+	auto index = new fingerprint_index;
+	index->fingerprints = fingerprints;
+	index->words.resize(keys.size());
+	index->locations.resize(keys.size());
+	index->bucket_starts.assign((std::size_t(1) << BUCKET_BITS) + 1, 0);
+	for (std::size_t i = 0; i < keys.size(); i++) {
+		index->words[i] = ma_uint32(keys[i] >> 32);
+		index->locations[i] = ma_uint32(keys[i]);
+		index->bucket_starts[(index->words[i] >> (32 - BUCKET_BITS)) + 1]++;
+	}
+	for (std::size_t bucket = 1; bucket < index->bucket_starts.size(); bucket++)
+		index->bucket_starts[bucket] += index->bucket_starts[bucket - 1];
+	return index;
+}
+
+void fingerprint_index_destroy(fingerprint_index* index) {
+	delete index;
+}
+
+std::vector<fingerprint_match> fingerprint_index_lookup(const fingerprint_index* index, const std::vector<ma_uint32>& fingerprint, float max_bit_error_rate) {
+	std::vector<ma_uint64> checked;
+	std::vector<fingerprint_match> matches;
+
+	for (std::size_t frame = 0; frame < fingerprint.size(); frame++) {
+		ma_uint32 word = fingerprint[frame];
+		if (!is_informative(word))
+			continue;
+		ma_uint32 bucket = word >> (32 - BUCKET_BITS);
+		for (ma_uint32 i = index->bucket_starts[bucket]; i < index->bucket_starts[bucket + 1]; i++) {
+			if (index->words[i] != word)
+				continue;
+			std::size_t entry = index->locations[i] >> 8;
+			int offset = int(index->locations[i] & 0xFF) - int(frame);
+			// * one bit error rate per alignment, however many words vote for it
+			ma_uint64 alignment = ma_uint64(entry) << 16 | ma_uint16(offset);
+			if (std::ranges::find(checked, alignment) != checked.end())
+				continue;
+			checked.push_back(alignment);
+
+			float bit_error_rate = fingerprint_bit_error_rate(*index->fingerprints[entry], fingerprint, offset);
+			if (bit_error_rate > max_bit_error_rate)
+				continue;
+			auto known = std::ranges::find(matches, entry, &fingerprint_match::entry);
+			if (known == matches.end())
+				matches.push_back(fingerprint_match{ entry, offset, bit_error_rate });
+			else if (bit_error_rate < known->bit_error_rate)
+				*known = fingerprint_match{ entry, offset, bit_error_rate };
+		}
+	}
+
+	std::ranges::sort(matches, {}, &fingerprint_match::bit_error_rate);
+	return matches;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <vector>
+
+#include "include/miniaudio.h"
+
+/**
+ * @brief Acoustic fingerprints that survive re-encoding, for finding the same recording as FLAC and MP3.
+ *
+ * A stretch of the track is decoded to mono at a low sample rate. Each frame's energy
+ * is split into 33 log-spaced bands between 300 and 2000 Hz. Every frame becomes one
+ * 32-bit word: bit m is the sign of how the energy difference between bands m and m+1
+ * changed since the previous frame. Two encodings of the same master differ in a few
+ * percent of the bits, different recordings in about half.
+ */
+
+struct fingerprint_config {
+	ma_uint32 sample_rate = 11025;
+	ma_uint32 frame_size = 2048;
+	ma_uint32 hop = 1024;
+	ma_uint32 frames = 128;
+	// * past intros and fades, short tracks fall back to their start
+	ma_uint32 offset_seconds = 30;
+};
+
+/** @brief Empty when the file can't be decoded or is too short. */
+std::vector<ma_uint32> fingerprint_file(const char* path, ma_encoding_format format, const fingerprint_config& config = {});
+
+/** @brief Share of differing bits where b, shifted by offset frames, overlaps a, 1 without enough overlap. */
+float fingerprint_bit_error_rate(const std::vector<ma_uint32>& a, const std::vector<ma_uint32>& b, int offset);
+
+struct fingerprint_match {
+	std::size_t entry;
+	int offset;
+	float bit_error_rate;
+};
+
+/**
+ * @brief Lookup table over many fingerprints. Every other word is indexed, and a query
+ * checks only the entries that share at least one exact word with it, at that alignment.
+ */
+struct fingerprint_index;
+
+/** @brief Entries are the positions in fingerprints, which must outlive the index, NULL or empty ones are skipped. */
+fingerprint_index* fingerprint_index_build(const std::vector<const std::vector<ma_uint32>*>& fingerprints);
+void fingerprint_index_destroy(fingerprint_index* index);
+
+/** @brief Best alignment of every entry that matches under max_bit_error_rate. */
+std::vector<fingerprint_match> fingerprint_index_lookup(const fingerprint_index* index, const std::vector<ma_uint32>& fingerprint, float max_bit_error_rate = 0.25f);
@@ -0,0 +1,76 @@
+#include "format_sniff.hpp"
+
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+constexpr size_t SNIFF_WINDOW = 4096;
+
+/** @brief Frame sync plus the fields that may not hold reserved values, which rules out ADTS and most noise. */
+static bool is_mpeg_frame_header(const unsigned char* bytes) {
+	if (bytes[0] != 0xFF || (bytes[1] & 0xE0) != 0xE0)
+		return false;
+
+	int version = (bytes[1] >> 3) & 3;
+	int layer = (bytes[1] >> 1) & 3;
+	int bitrate_index = bytes[2] >> 4;
+	int sample_rate_index = (bytes[2] >> 2) & 3;
+	return version != 1 && layer != 0 && bitrate_index != 15 && sample_rate_index != 3;
+}
+
+/** @brief What follows an ID3v2 tag: FLAC, or MPEG frames after some padding. */
+static ma_encoding_format sniff_after_tag(const unsigned char* bytes, size_t size) {
+	if (size >= 4 && std::memcmp(bytes, "fLaC", 4) == 0)
+		return ma_encoding_format_flac;
+	for (size_t offset = 0; offset + 4 <= size; offset++) {
+		if (is_mpeg_frame_header(bytes + offset))
+			return ma_encoding_format_mp3;
+	}
+	return ma_encoding_format_unknown;
+}
+
+ma_encoding_format sniff_encoding_format(const char* path, const unsigned char* head, size_t head_size) {
+	if (head_size >= 12 && (std::memcmp(head, "RIFF", 4) == 0 || std::memcmp(head, "RF64", 4) == 0) && std::memcmp(head + 8, "WAVE", 4) == 0)
+		return ma_encoding_format_wav;
+	if (head_size >= 4 && std::memcmp(head, "fLaC", 4) == 0)
+		return ma_encoding_format_flac;
+	if (head_size < 10 || std::memcmp(head, "ID3", 3) != 0)
+		return head_size >= 4 && is_mpeg_frame_header(head) ? ma_encoding_format_mp3 : ma_encoding_format_unknown;
+
+	// * ID3v2 size is syncsafe and excludes the 10 byte header and the optional footer
+	size_t tag_size = size_t(head[6] & 0x7F) << 21 | size_t(head[7] & 0x7F) << 14 | size_t(head[8] & 0x7F) << 7 | size_t(head[9] & 0x7F);
+	tag_size += (head[5] & 0x10) != 0 ? 20 : 10;
+	if (tag_size + 4 <= head_size)
+		return sniff_after_tag(head + tag_size, head_size - tag_size);
+
+	// * cover art can make the tag bigger than the head, read what comes after it
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return ma_encoding_format_unknown;
+	unsigned char bytes[SNIFF_WINDOW];
+	ssize_t size = pread(fd, bytes, sizeof(bytes), off_t(tag_size));
+	close(fd);
+	return size > 0 ? sniff_after_tag(bytes, size_t(size)) : ma_encoding_format_unknown;
+}
+
+ma_encoding_format sniff_encoding_format(const char* path) {
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return ma_encoding_format_unknown;
+
+	unsigned char head[SNIFF_WINDOW];
+	ssize_t size = pread(fd, head, sizeof(head), 0);
+	close(fd);
+	return size > 0 ? sniff_encoding_format(path, head, size_t(size)) : ma_encoding_format_unknown;
+}
+
+const char* encoding_format_name(ma_encoding_format format) {
+	switch (format) {
+		case ma_encoding_format_wav: return "wav";
+		case ma_encoding_format_flac: return "flac";
+		case ma_encoding_format_mp3: return "mp3";
+		case ma_encoding_format_vorbis: return "vorbis";
+		default: return "unknown";
+	}
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "include/miniaudio.h"
+
+/**
+ * @brief Detects the container of an audio file from its first bytes.
+ *
+ * Looks for the RIFF/RF64 WAVE header, the fLaC marker, or an MPEG audio frame
+ * header, skipping a leading ID3v2 tag. File names are never consulted, so
+ * misnamed files are recognised and the result can be handed to the decoder as
+ * a hint instead of letting it try every backend in turn.
+ */
+
+/** @brief Returns ma_encoding_format_unknown for anything that is not WAV, FLAC or MP3. */
+ma_encoding_format sniff_encoding_format(const char* path);
+
+/** @brief Same, from bytes already read at the start of the file, which is only reopened for an oversized ID3v2 tag. */
+ma_encoding_format sniff_encoding_format(const char* path, const unsigned char* head, size_t head_size);
+
+const char* encoding_format_name(ma_encoding_format format);
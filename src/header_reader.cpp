@@ -0,0 +1,308 @@
+#include "header_reader.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+static void read_headers_sync(const std::vector<std::string>& paths, std::size_t first, const header_reader_config& config, const header_visitor& visitor, header_reader_stats& stats) {
+	std::vector<unsigned char> buffer(config.header_bytes);
+
+	for (std::size_t i = first; i < paths.size(); i++) {
+		stats.syscalls++;
+		int fd = open(paths[i].c_str(), O_RDONLY | O_CLOEXEC);
+		if (fd < 0)
+			continue;
+
+		struct stat file_stat;
+		stats.syscalls += 3;
+		if (fstat(fd, &file_stat) != 0) {
+			close(fd);
+			continue;
+		}
+		auto read_start = std::chrono::steady_clock::now();
+		ssize_t length = pread(fd, buffer.data(), buffer.size(), 0);
+		auto read_ns = ma_uint64(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - read_start).count());
+		close(fd);
+		stats.read_ns += read_ns;
+		if (read_ns > config.slow_read_ns) {
+			stats.slow_reads++;
+			stats.slow_read_ns += read_ns;
+		}
+		if (length < 0)
+			continue;
+
+		stats.files++;
+		stats.bytes_read += ma_uint64(length);
+		visitor(i, file_header{
+			.size = ma_uint64(file_stat.st_size),
+			.modified = ma_int64(file_stat.st_mtime),
+			.bytes = buffer.data(),
+			.length = size_t(length),
+			.is_truncated = ma_uint64(length) < std::min<ma_uint64>(ma_uint64(file_stat.st_size), buffer.size()),
+		});
+	}
+}
+
+#if defined(__linux__) && defined(SYS_io_uring_setup)
+
+/** @brief Just enough of an io_uring to queue requests and reap completions, no liburing needed. */
+struct uring {
+	int fd = -1;
+	void* sq_ring = MAP_FAILED;
+	void* cq_ring = MAP_FAILED;
+	size_t sq_ring_size = 0;
+	size_t cq_ring_size = 0;
+	io_uring_sqe* sqes = (io_uring_sqe*)MAP_FAILED;
+	size_t sqes_size = 0;
+
+	unsigned* sq_tail;
+	unsigned* sq_mask;
+	unsigned* sq_array;
+	unsigned* cq_head;
+	unsigned* cq_tail;
+	unsigned* cq_mask;
+	io_uring_cqe* cqes;
+	unsigned queued = 0;
+	// * requests may still be in flight that can no longer be waited for
+	bool is_stuck = false;
+};
+
+static void uring_uninit(uring& ring) {
+	if (ring.sqes != MAP_FAILED)
+		munmap(ring.sqes, ring.sqes_size);
+	if (ring.cq_ring != MAP_FAILED && ring.cq_ring != ring.sq_ring)
+		munmap(ring.cq_ring, ring.cq_ring_size);
+	if (ring.sq_ring != MAP_FAILED)
+		munmap(ring.sq_ring, ring.sq_ring_size);
+	if (ring.fd >= 0)
+		close(ring.fd);
+}
+
+static bool uring_init(uring& ring, unsigned entries) {
+	io_uring_params params{};
+	ring.fd = int(syscall(SYS_io_uring_setup, entries, &params));
+	// * file opcodes and statx arrived together with IORING_FEAT_CUR_PERSONALITY in 5.6
+	if (ring.fd < 0 || (params.features & IORING_FEAT_CUR_PERSONALITY) == 0)
+		return false;
+
+	ring.sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	ring.cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+	bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+	if (single_mmap)
+		ring.sq_ring_size = ring.cq_ring_size = std::max(ring.sq_ring_size, ring.cq_ring_size);
+
+	ring.sq_ring = mmap(NULL, ring.sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQ_RING);
+	if (ring.sq_ring == MAP_FAILED)
+		return false;
+	ring.cq_ring = single_mmap ? ring.sq_ring
+		: mmap(NULL, ring.cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_CQ_RING);
+	if (ring.cq_ring == MAP_FAILED)
+		return false;
+	ring.sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+	ring.sqes = (io_uring_sqe*)mmap(NULL, ring.sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQES);
+	if (ring.sqes == MAP_FAILED)
+		return false;
+
+	auto sq = (unsigned char*)ring.sq_ring;
+	auto cq = (unsigned char*)ring.cq_ring;
+	ring.sq_tail = (unsigned*)(sq + params.sq_off.tail);
+	ring.sq_mask = (unsigned*)(sq + params.sq_off.ring_mask);
+	ring.sq_array = (unsigned*)(sq + params.sq_off.array);
+	ring.cq_head = (unsigned*)(cq + params.cq_off.head);
+	ring.cq_tail = (unsigned*)(cq + params.cq_off.tail);
+	ring.cq_mask = (unsigned*)(cq + params.cq_off.ring_mask);
+	ring.cqes = (io_uring_cqe*)(cq + params.cq_off.cqes);
+	return true;
+}
+
+static io_uring_sqe* uring_queue(uring& ring, ma_uint8 opcode, int fd, const void* address, ma_uint32 length, ma_uint64 offset, ma_uint64 user_data) {
+	unsigned tail = *ring.sq_tail + ring.queued;
+	unsigned index = tail & *ring.sq_mask;
+	io_uring_sqe* sqe = &ring.sqes[index];
+	*sqe = io_uring_sqe{};
+	sqe->opcode = opcode;
+	sqe->fd = fd;
+	sqe->addr = ma_uint64(address);
+	sqe->len = length;
+	sqe->off = offset;
+	sqe->user_data = user_data;
+	ring.sq_array[index] = index;
+	ring.queued++;
+	return sqe;
+}
+
+/**
+ * @brief Submits everything queued and waits for all of it, completions go to on_complete.
+ *
+ * On failure it still waits for whatever the kernel already took, so once it returns nothing writes into
+ * the caller's buffers any more; the entries never taken are not run. Only when even that wait fails is
+ * ring.is_stuck set, and the requests in flight keep their memory and fds.
+ */
+template <typename on_complete_fn>
+static bool uring_submit_and_wait(uring& ring, header_reader_stats& stats, on_complete_fn on_complete) {
+	unsigned submitted = ring.queued;
+	std::atomic_ref(*ring.sq_tail).store(*ring.sq_tail + submitted, std::memory_order_release);
+	ring.queued = 0;
+
+	// * the kernel may take fewer entries than offered (out of memory, a full completion queue), then it returns
+	// * without waiting and the rest is offered again
+	bool ok = true;
+	unsigned unsubmitted = submitted;
+	for (unsigned completed = 0; completed < submitted;) {
+		unsigned in_flight = submitted - unsubmitted - completed;
+		if (!ok && in_flight == 0)
+			break;
+
+		stats.syscalls++;
+		// * after a failure nothing more is offered, the wait is only for what is in flight
+		long consumed = syscall(SYS_io_uring_enter, ring.fd, ok ? unsubmitted : 0, ok ? submitted - completed : in_flight, IORING_ENTER_GETEVENTS, NULL, 0);
+		if (consumed < 0 && errno != EINTR) {
+			if (!ok) {
+				ring.is_stuck = true;
+				return false;
+			}
+			ok = false;
+		}
+		if (ok && consumed > 0)
+			unsubmitted -= unsigned(consumed);
+
+		unsigned head = *ring.cq_head;
+		unsigned tail = std::atomic_ref(*ring.cq_tail).load(std::memory_order_acquire);
+		for (; head != tail; head++, completed++) {
+			const io_uring_cqe& cqe = ring.cqes[head & *ring.cq_mask];
+			on_complete(cqe.user_data, cqe.res);
+		}
+		std::atomic_ref(*ring.cq_head).store(head, std::memory_order_release);
+		// * nothing taken and nothing left in flight, offering again would spin
+		if (ok && consumed == 0 && completed + unsubmitted == submitted)
+			ok = false;
+	}
+	return ok;
+}
+
+enum request_kind : ma_uint64 { REQUEST_STATX, REQUEST_OPEN, REQUEST_READ, REQUEST_CLOSE };
+
+struct pending_file {
+	struct statx file_stat;
+	int stat_result;
+	int fd;
+	int read_result;
+	bool is_closed;
+};
+
+/** @brief Closes what the batch still holds open when a submission failed halfway, only once nothing is in flight. */
+static void close_batch(std::vector<pending_file>& batch, std::size_t count) {
+	for (std::size_t i = 0; i < count; i++)
+		if (batch[i].fd >= 0 && !batch[i].is_closed)
+			close(batch[i].fd);
+}
+
+/** @brief Returns how many paths were handled, the rest is left to the synchronous path. */
+static std::size_t read_headers_uring(const std::vector<std::string>& paths, const header_reader_config& config, const header_visitor& visitor, header_reader_stats& stats) {
+	uring ring;
+	if (!uring_init(ring, config.batch_size * 2)) {
+		uring_uninit(ring);
+		return 0;
+	}
+	stats.used_io_uring = true;
+
+	std::vector<unsigned char> buffers(config.header_bytes * config.batch_size);
+	std::vector<pending_file> batch(config.batch_size);
+	std::size_t first = 0;
+	bool ok = true;
+
+	for (; first < paths.size() && ok; first += config.batch_size) {
+		std::size_t count = std::min<std::size_t>(config.batch_size, paths.size() - first);
+
+		// * first submission: statx and open for every file of the batch
+		for (std::size_t i = 0; i < count; i++) {
+			batch[i] = pending_file{ .file_stat = {}, .stat_result = -1, .fd = -1, .read_result = -1, .is_closed = false };
+			const char* path = paths[first + i].c_str();
+			io_uring_sqe* stat_sqe = uring_queue(ring, IORING_OP_STATX, AT_FDCWD, path, STATX_SIZE | STATX_MTIME, ma_uint64(&batch[i].file_stat), i << 2 | REQUEST_STATX);
+			stat_sqe->statx_flags = AT_STATX_DONT_SYNC;
+			io_uring_sqe* open_sqe = uring_queue(ring, IORING_OP_OPENAT, AT_FDCWD, path, 0, 0, i << 2 | REQUEST_OPEN);
+			open_sqe->open_flags = O_RDONLY | O_CLOEXEC;
+		}
+		ok = uring_submit_and_wait(ring, stats, [&](ma_uint64 user_data, int result) {
+			pending_file& file = batch[user_data >> 2];
+			if ((user_data & 3) == REQUEST_STATX)
+				file.stat_result = result;
+			else
+				file.fd = result;
+		});
+
+		// * second submission: the header read, with the close linked behind it
+		for (std::size_t i = 0; i < count && ok; i++) {
+			if (batch[i].fd < 0)
+				continue;
+			io_uring_sqe* read_sqe = uring_queue(ring, IORING_OP_READ, batch[i].fd, &buffers[i * config.header_bytes], ma_uint32(config.header_bytes), 0, i << 2 | REQUEST_READ);
+			read_sqe->flags = IOSQE_IO_LINK;
+			uring_queue(ring, IORING_OP_CLOSE, batch[i].fd, NULL, 0, 0, i << 2 | REQUEST_CLOSE);
+		}
+		ok = ok && uring_submit_and_wait(ring, stats, [&](ma_uint64 user_data, int result) {
+			pending_file& file = batch[user_data >> 2];
+			if ((user_data & 3) == REQUEST_READ) {
+				file.read_result = result;
+				return;
+			}
+			if (result == -ECANCELED)
+				close(file.fd); // * a failed or short read cancels the linked close
+			file.is_closed = true;
+		});
+
+		// * the batch is left to the synchronous path
+		if (!ok) {
+			if (ring.is_stuck) {
+				// * a close may still run against these fds and a statx or read into this memory, both are left to them
+				(void)new std::vector<unsigned char>(std::move(buffers));
+				(void)new std::vector<pending_file>(std::move(batch));
+			} else {
+				close_batch(batch, count);
+			}
+			break;
+		}
+		for (std::size_t i = 0; i < count; i++) {
+			const pending_file& file = batch[i];
+			if (file.fd < 0 || file.stat_result < 0 || file.read_result < 0)
+				continue;
+			stats.files++;
+			stats.bytes_read += ma_uint64(file.read_result);
+			visitor(first + i, file_header{
+				.size = file.file_stat.stx_size,
+				.modified = file.file_stat.stx_mtime.tv_sec,
+				.bytes = &buffers[i * config.header_bytes],
+				.length = size_t(file.read_result),
+				.is_truncated = ma_uint64(file.read_result) < std::min<ma_uint64>(file.file_stat.stx_size, config.header_bytes),
+			});
+		}
+	}
+
+	uring_uninit(ring);
+	return std::min(first, paths.size());
+}
+
+#endif
+
+void read_headers(const std::vector<std::string>& paths, const header_reader_config& config, const header_visitor& visitor, header_reader_stats* stats) {
+	header_reader_stats totals{};
+	std::size_t handled = 0;
+
+#if defined(__linux__) && defined(SYS_io_uring_setup)
+	if (config.use_io_uring && config.batch_size > 0)
+		handled = read_headers_uring(paths, config, visitor, totals);
+#endif
+	read_headers_sync(paths, handled, config, visitor, totals);
+
+	if (stats != NULL)
+		*stats = totals;
+}
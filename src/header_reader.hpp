@@ -0,0 +1,48 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "include/miniaudio.h"
+
+/**
+ * @brief Reads size, mtime and the first bytes of many files with as few syscalls as possible.
+ *
+ * On Linux the statx, open, read and close of a whole batch go through one io_uring,
+ * two submissions per batch instead of four syscalls per file. When io_uring is missing
+ * or refused (old kernel, seccomp, RLIMIT_MEMLOCK) the same work is done one file
+ * at a time with plain syscalls.
+ */
+
+struct header_reader_config {
+	unsigned batch_size = 256;
+	size_t header_bytes = 64 * 1024;
+	bool use_io_uring = true;
+	// * synchronous reads slower than this most likely waited on a disk seek
+	ma_uint64 slow_read_ns = 2000000;
+};
+
+struct file_header {
+	ma_uint64 size;
+	ma_int64 modified; // * seconds since the epoch
+	const unsigned char* bytes;
+	size_t length;
+	// * the read stopped before the end of the file and of the buffer, anything parsed from bytes can be cut off
+	bool is_truncated;
+};
+
+struct header_reader_stats {
+	ma_uint64 files;
+	ma_uint64 syscalls;
+	ma_uint64 bytes_read;
+	ma_uint64 read_ns; // * synchronous path only, io_uring reads complete together
+	ma_uint64 slow_reads;
+	ma_uint64 slow_read_ns;
+	bool used_io_uring;
+};
+
+/** @brief Called on the reading thread for every file that could be opened, index is into paths. */
+using header_visitor = std::function<void(std::size_t index, const file_header& header)>;
+
+void read_headers(const std::vector<std::string>& paths, const header_reader_config& config, const header_visitor& visitor, header_reader_stats* stats = NULL);
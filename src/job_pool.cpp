@@ -0,0 +1,88 @@
+#include "job_pool.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+static std::vector<std::thread> workers;
+static std::mutex pool_mutex;
+static std::condition_variable queue_changed;
+static std::deque<std::function<void()>> queue;
+static std::size_t running = 0;
+static bool quit = false;
+
+static void lower_thread_priority() {
+#if defined(__linux__)
+	// * nice applies per thread on Linux, and the idle I/O class only gets the disk when nobody else wants it
+	setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), 19);
+	constexpr int IOPRIO_WHO_PROCESS = 1;
+	constexpr int IOPRIO_CLASS_IDLE = 3;
+	syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, IOPRIO_CLASS_IDLE << 13);
+#endif
+}
+
+static void worker_loop() {
+	lower_thread_priority();
+	std::unique_lock lock(pool_mutex);
+
+	while (true) {
+		queue_changed.wait(lock, [] { return quit || !queue.empty(); });
+		if (quit)
+			return;
+
+		std::function<void()> job = std::move(queue.front());
+		queue.pop_front();
+		running++;
+		lock.unlock();
+		job();
+		lock.lock();
+		running--;
+	}
+}
+
+void job_pool_start(unsigned threads) {
+	quit = false;
+	for (unsigned i = 0; i < threads; i++)
+		workers.emplace_back(worker_loop);
+}
+
+void job_pool_stop() {
+	{
+		std::lock_guard lock(pool_mutex);
+		quit = true;
+		queue.clear();
+	}
+	queue_changed.notify_all();
+	for (auto& worker : workers)
+		worker.join();
+	workers.clear();
+}
+
+void job_pool_submit(std::function<void()> job) {
+	{
+		std::lock_guard lock(pool_mutex);
+		queue.push_back(std::move(job));
+	}
+	queue_changed.notify_one();
+}
+
+void job_pool_submit_urgent(std::function<void()> job) {
+	{
+		std::lock_guard lock(pool_mutex);
+		queue.push_front(std::move(job));
+	}
+	queue_changed.notify_one();
+}
+
+std::size_t job_pool_pending() {
+	std::lock_guard lock(pool_mutex);
+	return queue.size() + running;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+
+/**
+ * @brief Background threads for library analysis, running at idle CPU and I/O priority.
+ *
+ * Jobs are plain closures run in submission order, urgent ones first. They must not touch GTK, results go
+ * back to the main loop through g_idle_add. Stopping drops whatever has not started.
+ */
+
+void job_pool_start(unsigned threads);
+void job_pool_stop();
+
+void job_pool_submit(std::function<void()> job);
+/** @brief Runs ahead of everything queued, for results the user is waiting on. */
+void job_pool_submit_urgent(std::function<void()> job);
+
+/** @brief Jobs queued or running. */
+std::size_t job_pool_pending();
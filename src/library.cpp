@@ -0,0 +1,76 @@
+#include "library.hpp"
+
+#include <algorithm>
+#include <numeric>
+#include <unordered_map>
+
+#include "fingerprint.hpp"
+
+/** @brief Union-find root with path halving. */
+static std::size_t find_root(std::vector<std::size_t>& parents, std::size_t i) {
+	while (parents[i] != i) {
+		parents[i] = parents[parents[i]];
+		i = parents[i];
+	}
+	return i;
+}
+
+static void join(std::vector<std::size_t>& parents, std::size_t a, std::size_t b) {
+	a = find_root(parents, a);
+	b = find_root(parents, b);
+	// * the lower index becomes the root, so it stays the visible copy
+	if (a != b)
+		parents[std::max(a, b)] = std::min(a, b);
+}
+
+std::vector<std::vector<std::size_t>> library_duplicate_groups(const std::vector<library_track>& tracks) {
+	std::vector<std::size_t> parents(tracks.size());
+	std::iota(parents.begin(), parents.end(), 0);
+
+	std::unordered_map<ma_uint64, std::size_t> first_with_hash;
+	for (std::size_t i = 0; i < tracks.size(); i++) {
+		if (tracks[i].content_hash == 0)
+			continue;
+		auto [first, inserted] = first_with_hash.try_emplace(tracks[i].content_hash, i);
+		if (!inserted)
+			join(parents, first->second, i);
+	}
+
+	std::vector<const std::vector<ma_uint32>*> fingerprints(tracks.size(), NULL);
+	bool any_fingerprint = false;
+	for (std::size_t i = 0; i < tracks.size(); i++) {
+		if (!tracks[i].fingerprint.empty()) {
+			fingerprints[i] = &tracks[i].fingerprint;
+			any_fingerprint = true;
+		}
+	}
+	if (any_fingerprint) {
+		fingerprint_index* index = fingerprint_index_build(fingerprints);
+		for (std::size_t i = 0; i < tracks.size(); i++) {
+			if (fingerprints[i] == NULL)
+				continue;
+			for (const fingerprint_match& match : fingerprint_index_lookup(index, tracks[i].fingerprint)) {
+				if (match.entry != i)
+					join(parents, match.entry, i);
+			}
+		}
+		fingerprint_index_destroy(index);
+	}
+
+	std::unordered_map<std::size_t, std::vector<std::size_t>> by_root;
+	for (std::size_t i = 0; i < tracks.size(); i++) {
+		std::size_t root = find_root(parents, i);
+		if (root == i)
+			continue;
+		std::vector<std::size_t>& group = by_root[root];
+		if (group.empty())
+			group.push_back(root);
+		group.push_back(i);
+	}
+
+	std::vector<std::vector<std::size_t>> groups;
+	for (auto& [root, indexes] : by_root)
+		groups.push_back(std::move(indexes));
+	std::ranges::sort(groups, {}, [](const auto& group) { return group.front(); });
+	return groups;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "include/miniaudio.h"
+#include "loudness.hpp"
+#include "duration_probe.hpp"
+
+/** @brief A playable file found while scanning, with what was learned about it on the way. */
+struct library_track {
+	std::string path;
+	ma_encoding_format format = ma_encoding_format_unknown;
+	ma_uint64 size = 0;
+	ma_int64 modified = 0;
+	// * from the headers read during the scan, frames is 0 when they don't tell
+	track_duration duration;
+
+	// * tags found in the header read during the scan, has_tags is false when the whole file is needed
+	bool has_tags = false;
+	std::string title;
+	std::string artist;
+	std::string album;
+	std::string genre;
+
+	// * filled in the background, 0, empty and unmeasured until then (see content_hash.hpp, fingerprint.hpp and loudness.hpp)
+	ma_uint64 content_hash = 0;
+	std::vector<ma_uint32> fingerprint;
+	track_loudness loudness;
+};
+
+/**
+ * @brief Indexes of tracks that are the same recording, groups ordered by their first track.
+ *
+ * Tracks sharing a content hash are byte-identical audio, tracks whose fingerprints match
+ * are other encodings of it. Fingerprint matching indexes the whole library, so callers
+ * should keep the result instead of asking again for every redraw.
+ */
+std::vector<std::vector<std::size_t>> library_duplicate_groups(const std::vector<library_track>& tracks);
@@ -0,0 +1,220 @@
+#include "library_cache.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <unordered_map>
+
+#include "Logger.hpp"
+
+constexpr const char* CACHE_HEADER = "aurabeat-library-cache 4";
+constexpr char FINGERPRINTS_MAGIC[8] = { 'a', 'b', 'f', 'p', 'r', 'i', '0', '1' };
+
+struct cache_entry {
+	ma_uint64 size;
+	ma_int64 modified;
+	ma_uint64 content_hash;
+	// * shared with snapshots, which then copy a pointer instead of a kilobyte per track
+	std::shared_ptr<const std::vector<ma_uint32>> fingerprint;
+	track_loudness loudness;
+};
+
+struct library_cache_snapshot {
+	std::vector<std::pair<std::string, cache_entry>> entries;
+	ma_uint64 generation;
+};
+
+static std::mutex cache_mutex;
+static std::unordered_map<std::string, cache_entry> entries;
+// * bumped by every store, the table is dirty while the last saved generation is behind
+static ma_uint64 generation = 0;
+static ma_uint64 saved_generation = 0;
+// * one writer at a time, so the table and side file renamed into place always come from the same snapshot
+static std::mutex write_mutex;
+
+// * the side file starts with the magic and the stamp of the table it belongs to, then the words of every fingerprint in table order
+struct fingerprints_header {
+	char magic[8];
+	ma_uint64 stamp;
+	ma_uint64 words;
+};
+
+/**
+ * @brief Integrated/range/true peak/gated seconds in hundredths, in one column, "-" when unmeasured.
+ * Integers keep the file readable whatever decimal separator the locale uses.
+ */
+static std::string format_loudness(const track_loudness& loudness) {
+	if (!loudness.measured)
+		return "-";
+	char text[64];
+	std::snprintf(text, sizeof(text), "%ld/%ld/%ld/%ld", std::lround(loudness.integrated * 100), std::lround(loudness.range * 100),
+		std::lround(loudness.true_peak * 100), std::lround(loudness.gated_seconds * 100));
+	return text;
+}
+
+static bool parse_loudness(const std::string& text, track_loudness& loudness) {
+	loudness = track_loudness{};
+	if (text == "-")
+		return true;
+	long integrated, range, true_peak, gated_seconds;
+	if (std::sscanf(text.c_str(), "%ld/%ld/%ld/%ld", &integrated, &range, &true_peak, &gated_seconds) != 4)
+		return false;
+	loudness.measured = true;
+	loudness.integrated = float(integrated) / 100;
+	loudness.range = float(range) / 100;
+	loudness.true_peak = float(true_peak) / 100;
+	loudness.gated_seconds = float(gated_seconds) / 100;
+	return true;
+}
+
+/** @brief All words of the side file, empty when it is missing or doesn't belong to the table with this stamp. */
+static std::vector<ma_uint32> load_fingerprints(const std::string& file, ma_uint64 stamp) {
+	std::ifstream input(file, std::ios::binary);
+	fingerprints_header header;
+	if (!input.read((char*)&header, sizeof(header)) || std::memcmp(header.magic, FINGERPRINTS_MAGIC, sizeof(FINGERPRINTS_MAGIC)) != 0
+		|| header.stamp != stamp)
+		return {};
+	std::vector<ma_uint32> words(header.words);
+	if (!input.read((char*)words.data(), std::streamsize(words.size() * sizeof(ma_uint32))))
+		return {};
+	return words;
+}
+
+void library_cache_load(const std::string& file) {
+	std::ifstream input(file);
+	std::string line;
+	// * a different version means different columns, starting over is cheaper than migrating
+	std::size_t header_size = std::strlen(CACHE_HEADER);
+	if (!std::getline(input, line) || line.compare(0, header_size, CACHE_HEADER) != 0 || line.size() <= header_size || line[header_size] != ' ')
+		return;
+	ma_uint64 stamp = std::strtoull(line.c_str() + header_size, NULL, 10);
+	std::vector<ma_uint32> words = load_fingerprints(file + ".fingerprints", stamp);
+
+	std::lock_guard lock(cache_mutex);
+	std::size_t next_word = 0;
+	while (std::getline(input, line)) {
+		std::istringstream fields(line);
+		cache_entry entry;
+		std::string loudness;
+		std::string path;
+		std::size_t fingerprint_words = 0;
+		fields >> entry.size >> entry.modified >> std::hex >> entry.content_hash >> std::dec >> loudness >> fingerprint_words;
+		if (!fields || !parse_loudness(loudness, entry.loudness))
+			continue;
+		if (fields.get() != '\t' || !std::getline(fields, path) || path.empty())
+			continue;
+		// * with the side file lost, tracks that had a fingerprint are left out and analysed again
+		if (fingerprint_words > 0) {
+			if (next_word + fingerprint_words > words.size())
+				continue;
+			entry.fingerprint = std::make_shared<const std::vector<ma_uint32>>(words.begin() + std::ptrdiff_t(next_word),
+				words.begin() + std::ptrdiff_t(next_word + fingerprint_words));
+			next_word += fingerprint_words;
+		}
+		entries[path] = std::move(entry);
+	}
+}
+
+library_cache_snapshot* library_cache_snapshot_take() {
+	std::lock_guard lock(cache_mutex);
+	if (generation == saved_generation)
+		return NULL;
+	auto snapshot = new library_cache_snapshot;
+	snapshot->entries.assign(entries.begin(), entries.end());
+	snapshot->generation = generation;
+	return snapshot;
+}
+
+bool library_cache_snapshot_write(library_cache_snapshot* snapshot, const std::string& file) {
+	// * both files carry the same stamp, a crash between the two renames leaves a pair that doesn't match
+	ma_uint64 stamp = ma_uint64(std::chrono::system_clock::now().time_since_epoch().count());
+	std::lock_guard write_lock(write_mutex);
+	std::string fingerprints_file = file + ".fingerprints";
+	std::string temporary = file + ".tmp";
+	std::string fingerprints_temporary = fingerprints_file + ".tmp";
+
+	bool is_written;
+	{
+		std::ofstream output(temporary, std::ios::trunc);
+		std::ofstream fingerprints(fingerprints_temporary, std::ios::binary | std::ios::trunc);
+		fingerprints_header header{};
+		std::memcpy(header.magic, FINGERPRINTS_MAGIC, sizeof(FINGERPRINTS_MAGIC));
+		header.stamp = stamp;
+		for (const auto& [path, entry] : snapshot->entries)
+			header.words += entry.fingerprint != nullptr ? entry.fingerprint->size() : 0;
+		fingerprints.write((const char*)&header, sizeof(header));
+
+		output << CACHE_HEADER << ' ' << stamp << '\n';
+		for (const auto& [path, entry] : snapshot->entries) {
+			std::size_t words = entry.fingerprint != nullptr ? entry.fingerprint->size() : 0;
+			output << entry.size << ' ' << entry.modified << ' ' << std::hex << entry.content_hash << std::dec << ' '
+				<< format_loudness(entry.loudness) << ' ' << words << '\t' << path << '\n';
+			if (words > 0)
+				fingerprints.write((const char*)entry.fingerprint->data(), std::streamsize(words * sizeof(ma_uint32)));
+		}
+		is_written = output.flush() && fingerprints.flush();
+	}
+	if (!is_written || std::rename(fingerprints_temporary.c_str(), fingerprints_file.c_str()) != 0
+		|| std::rename(temporary.c_str(), file.c_str()) != 0) {
+		log("cannot write the library cache to " + file, WARNING);
+		std::remove(temporary.c_str());
+		std::remove(fingerprints_temporary.c_str());
+		return false;
+	}
+
+	std::lock_guard lock(cache_mutex);
+	saved_generation = std::max(saved_generation, snapshot->generation);
+	return true;
+}
+
+void library_cache_snapshot_destroy(library_cache_snapshot* snapshot) {
+	delete snapshot;
+}
+
+bool library_cache_save(const std::string& file) {
+	library_cache_snapshot* snapshot = library_cache_snapshot_take();
+	if (snapshot == NULL)
+		return true;
+	bool is_saved = library_cache_snapshot_write(snapshot, file);
+	library_cache_snapshot_destroy(snapshot);
+	return is_saved;
+}
+
+bool library_cache_lookup(library_track& track) {
+	std::lock_guard lock(cache_mutex);
+	auto entry = entries.find(track.path);
+	if (entry == entries.end() || entry->second.size != track.size || entry->second.modified != track.modified)
+		return false;
+
+	track.content_hash = entry->second.content_hash;
+	if (entry->second.fingerprint != nullptr)
+		track.fingerprint = *entry->second.fingerprint;
+	else
+		track.fingerprint.clear();
+	track.loudness = entry->second.loudness;
+	return true;
+}
+
+void library_cache_store(const library_track& track) {
+	// * the path is the last column and runs to the end of the line
+	if (track.path.find('\n') != std::string::npos)
+		return;
+
+	auto fingerprint = track.fingerprint.empty() ? nullptr : std::make_shared<const std::vector<ma_uint32>>(track.fingerprint);
+	std::lock_guard lock(cache_mutex);
+	entries[track.path] = cache_entry{
+		.size = track.size,
+		.modified = track.modified,
+		.content_hash = track.content_hash,
+		.fingerprint = std::move(fingerprint),
+		.loudness = track.loudness,
+	};
+	generation++;
+}
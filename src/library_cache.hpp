@@ -0,0 +1,31 @@
+#pragma once
+
+#include <string>
+
+#include "library.hpp"
+
+/**
+ * @brief Analysis results kept across runs, so a rescan only analyses new or changed files.
+ *
+ * Entries are keyed by path and only trusted while size and mtime still match. The
+ * cache is a small versioned text table, with the fingerprints in a binary side file
+ * next to it (file + ".fingerprints"), both safe to delete at any time.
+ */
+
+void library_cache_load(const std::string& file);
+/** @brief Writes the table when anything was stored since the last save, on the calling thread. */
+bool library_cache_save(const std::string& file);
+
+/**
+ * @brief Copy of the table for writing it on another thread. Taking one only copies entries, the
+ * fingerprints are shared, so it is cheap enough for the main loop. NULL when nothing changed.
+ */
+struct library_cache_snapshot;
+library_cache_snapshot* library_cache_snapshot_take();
+/** @brief The table counts as saved only once the files are renamed into place, a failed write is retried next time. */
+bool library_cache_snapshot_write(library_cache_snapshot* snapshot, const std::string& file);
+void library_cache_snapshot_destroy(library_cache_snapshot* snapshot);
+
+/** @brief Copies the cached analysis into track, false when there is no entry or the file changed since. */
+bool library_cache_lookup(library_track& track);
+void library_cache_store(const library_track& track);
@@ -0,0 +1,361 @@
+#include "library_scan.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+
+#include "format_sniff.hpp"
+#include "duration_probe.hpp"
+
+constexpr size_t DIRENT_BUFFER_SIZE = 64 * 1024;
+
+/** @brief Open directory shared by the work items of its subdirectories, closed with the last of them. */
+struct directory_handle {
+	int fd;
+	std::string path;
+	ma_uint64 device;
+
+	~directory_handle() {
+		close(fd);
+	}
+};
+
+/** @brief Directory still to be read, the root is the only one without a parent. */
+struct directory_work {
+	std::shared_ptr<directory_handle> parent;
+	std::string name;
+};
+
+struct scan_worker {
+	std::mutex mutex;
+	std::deque<directory_work> stack;
+	std::vector<scanned_file> files;
+	std::vector<char> buffer;
+	library_scan_stats stats{};
+};
+
+struct scan_state {
+	const library_scan_config* config;
+	std::vector<std::unique_ptr<scan_worker>> workers;
+	// * directories pushed but not finished yet, the walk is over when it drops to 0
+	std::atomic<ma_uint64> pending = 0;
+	// * bumped for every directory pushed and once when the walk ends, idle workers wait on it
+	std::atomic<ma_uint32> pushes = 0;
+};
+
+enum class entry_kind { other, file, directory };
+
+static entry_kind kind_from_mode(mode_t mode) {
+	if (S_ISREG(mode))
+		return entry_kind::file;
+	if (S_ISDIR(mode))
+		return entry_kind::directory;
+	return entry_kind::other;
+}
+
+static entry_kind stat_entry_kind(int directory_fd, const char* name, bool is_symlink, library_scan_stats& stats) {
+	stats.stat_calls++;
+#if defined(__linux__) && defined(STATX_TYPE)
+	struct statx entry_stat;
+	if (statx(directory_fd, name, AT_STATX_DONT_SYNC | (is_symlink ? 0 : AT_SYMLINK_NOFOLLOW), STATX_TYPE, &entry_stat) != 0)
+		return entry_kind::other;
+	entry_kind kind = kind_from_mode(entry_stat.stx_mode);
+#else
+	struct stat entry_stat;
+	if (fstatat(directory_fd, name, &entry_stat, is_symlink ? 0 : AT_SYMLINK_NOFOLLOW) != 0)
+		return entry_kind::other;
+	entry_kind kind = kind_from_mode(entry_stat.st_mode);
+#endif
+	// * symlinked folders could loop back on themselves, only files are followed
+	return is_symlink && kind == entry_kind::directory ? entry_kind::other : kind;
+}
+
+static void visit_entry(scan_state& state, scan_worker& worker, const std::shared_ptr<directory_handle>& directory, const char* name, ma_uint64 inode, unsigned char type) {
+	if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+		return;
+	worker.stats.entries++;
+
+	entry_kind kind = entry_kind::other;
+	if (type == DT_REG)
+		kind = entry_kind::file;
+	else if (type == DT_DIR)
+		kind = entry_kind::directory;
+	else if (type == DT_UNKNOWN || type == DT_LNK)
+		kind = stat_entry_kind(directory->fd, name, type == DT_LNK, worker.stats);
+
+	if (kind == entry_kind::directory) {
+		state.pending++;
+		{
+			std::lock_guard lock(worker.mutex);
+			worker.stack.push_back({ directory, name });
+		}
+		state.pushes++;
+		state.pushes.notify_one();
+		return;
+	}
+	if (kind != entry_kind::file)
+		return;
+
+	worker.files.push_back({ directory->path + "/" + name, directory->device, inode, 0 });
+}
+
+static void read_directory(scan_state& state, scan_worker& worker, const std::shared_ptr<directory_handle>& directory) {
+	worker.stats.directories++;
+#if defined(__linux__)
+	while (true) {
+		long size = syscall(SYS_getdents64, directory->fd, worker.buffer.data(), worker.buffer.size());
+		if (size <= 0)
+			return;
+		for (long offset = 0; offset < size;) {
+			// * linux_dirent64 layout: d_ino, d_off, d_reclen, d_type, d_name
+			const char* record = worker.buffer.data() + offset;
+			ma_uint64 inode;
+			unsigned short record_length;
+			std::memcpy(&inode, record, sizeof(inode));
+			std::memcpy(&record_length, record + 16, sizeof(record_length));
+			visit_entry(state, worker, directory, record + 19, inode, (unsigned char)record[18]);
+			offset += record_length;
+		}
+	}
+#else
+	DIR* stream = fdopendir(dup(directory->fd));
+	if (stream == NULL)
+		return;
+	while (dirent* entry = readdir(stream))
+		visit_entry(state, worker, directory, entry->d_name, entry->d_ino, entry->d_type);
+	closedir(stream);
+#endif
+}
+
+static bool pop_or_steal(scan_state& state, std::size_t self, directory_work& work) {
+	{
+		scan_worker& own = *state.workers[self];
+		std::lock_guard lock(own.mutex);
+		if (!own.stack.empty()) {
+			work = std::move(own.stack.back());
+			own.stack.pop_back();
+			return true;
+		}
+	}
+	// * take the oldest entry of someone else's stack, that is the one closest to the root
+	for (std::size_t i = 1; i < state.workers.size(); i++) {
+		scan_worker& victim = *state.workers[(self + i) % state.workers.size()];
+		std::lock_guard lock(victim.mutex);
+		if (!victim.stack.empty()) {
+			work = std::move(victim.stack.front());
+			victim.stack.pop_front();
+			return true;
+		}
+	}
+	return false;
+}
+
+static void scan_loop(scan_state& state, std::size_t self) {
+	scan_worker& worker = *state.workers[self];
+	worker.buffer.resize(DIRENT_BUFFER_SIZE);
+
+	while (state.pending.load() > 0) {
+		directory_work work;
+		// * read before looking, so a push in between makes the wait return at once
+		ma_uint32 pushes = state.pushes.load();
+		if (!pop_or_steal(state, self, work)) {
+			// * the last directory may have finished before pushes was read, its bump is then already in the value waited on
+			if (state.pending.load() == 0)
+				break;
+			state.pushes.wait(pushes);
+			continue;
+		}
+
+		int fd = work.parent != nullptr
+			? openat(work.parent->fd, work.name.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC)
+			: open(work.name.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+		struct stat directory_stat;
+		if (fd >= 0 && fstat(fd, &directory_stat) != 0) {
+			close(fd);
+			fd = -1;
+		}
+		if (fd >= 0) {
+			auto directory = std::make_shared<directory_handle>(fd, work.parent != nullptr ? work.parent->path + "/" + work.name : work.name, ma_uint64(directory_stat.st_dev));
+			work.parent.reset();
+			read_directory(state, worker, directory);
+		}
+		if (--state.pending == 0) {
+			state.pushes++;
+			state.pushes.notify_all();
+		}
+	}
+}
+
+/** @brief Header reads done by one thread: a slice of the files, or every file of one disk in physical order. */
+struct header_job {
+	std::vector<std::string> paths;
+	header_reader_config headers;
+	// * lengths from the header bytes only, the fallbacks' seeks would break the physical order
+	bool is_head_only;
+	device_scan_report* report;
+	std::vector<library_track> tracks;
+	header_reader_stats stats;
+};
+
+/** @brief Reads the headers of the job's files, keeping what sniffs as audio. */
+static void identify_files(header_job& job, const library_scan_config& config) {
+	auto start = std::chrono::steady_clock::now();
+	const std::vector<std::string>& files = job.paths;
+	std::vector<library_track>& tracks = job.tracks;
+	read_headers(files, job.headers, [&](std::size_t index, const file_header& header) {
+		library_track track;
+		track.path = files[index];
+		track.format = sniff_encoding_format(files[index].c_str(), header.bytes, header.length);
+		track.size = header.size;
+		track.modified = header.modified;
+		if (track.format == ma_encoding_format_unknown)
+			return;
+		track.duration = probe_duration(files[index].c_str(), track.format, header.bytes, header.length, header.size, job.is_head_only);
+		// * tags from a cut off header would be partial, has_tags stays false and the whole file is read later
+		if (config.parse_tags && !header.is_truncated)
+			config.parse_tags(track, header.bytes, header.length);
+		tracks.push_back(std::move(track));
+	}, &job.stats);
+
+	if (job.report == NULL)
+		return;
+	job.report->files = job.stats.files;
+	job.report->bytes_read = job.stats.bytes_read;
+	job.report->slow_reads = job.stats.slow_reads;
+	job.report->read_seconds = double(job.stats.read_ns) / 1e9;
+	job.report->slow_read_seconds = double(job.stats.slow_read_ns) / 1e9;
+	job.report->seek_bound = job.stats.slow_read_ns * 2 > job.stats.read_ns;
+	job.report->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/** @brief Takes the files of every disk that should be read in physical order out of files, one job per disk. */
+static std::vector<header_job> physical_order_jobs(std::vector<scanned_file>& files, const library_scan_config& config, std::vector<device_scan_report>& reports) {
+	std::vector<header_job> jobs;
+	if (config.order == scan_order::path)
+		return jobs;
+
+	std::map<ma_uint64, std::vector<scanned_file>> by_device;
+	std::vector<scanned_file> remaining;
+	std::map<ma_uint64, bool> rotational;
+	for (auto& file : files) {
+		auto known = rotational.find(file.device);
+		if (known == rotational.end())
+			known = rotational.emplace(file.device, device_is_rotational(file.device)).first;
+		if (config.order == scan_order::physical || known->second)
+			by_device[file.device].push_back(std::move(file));
+		else
+			remaining.push_back(std::move(file));
+	}
+	files = std::move(remaining);
+
+	// * reports are pointed at by the jobs, so the vector must not grow once they exist
+	reports.resize(by_device.size());
+	for (auto& [device, device_files] : by_device) {
+		device_scan_report& report = reports[jobs.size()];
+		report = {};
+		report.device = device;
+		report.rotational = rotational[device];
+		report.used_fiemap = locate_physical_offsets(device_files);
+		if (report.used_fiemap)
+			report.path_order_travel = head_travel(device_files);
+		std::ranges::sort(device_files, {}, &scanned_file::physical_offset);
+		if (report.used_fiemap)
+			report.physical_order_travel = head_travel(device_files);
+
+		header_job job{};
+		job.headers = config.headers;
+		// * one request at a time, in order, so the elevator has nothing to reshuffle
+		job.headers.use_io_uring = false;
+		job.is_head_only = true;
+		job.report = &report;
+		for (auto& file : device_files)
+			job.paths.push_back(std::move(file.path));
+		jobs.push_back(std::move(job));
+	}
+	return jobs;
+}
+
+std::vector<library_track> library_scan(const std::string& root, const library_scan_config& config, library_scan_stats* stats) {
+	auto start = std::chrono::steady_clock::now();
+	std::vector<library_track> tracks;
+
+	scan_state state;
+	state.config = &config;
+	unsigned thread_count = config.threads != 0 ? config.threads : std::max(1u, std::thread::hardware_concurrency());
+	for (unsigned i = 0; i < thread_count; i++)
+		state.workers.push_back(std::make_unique<scan_worker>());
+
+	state.pending = 1;
+	state.workers[0]->stack.push_back({ nullptr, root.size() > 1 && root.ends_with('/') ? root.substr(0, root.size() - 1) : root });
+
+	std::vector<std::thread> threads;
+	for (unsigned i = 1; i < thread_count; i++)
+		threads.emplace_back(scan_loop, std::ref(state), std::size_t(i));
+	scan_loop(state, 0);
+	for (auto& thread : threads)
+		thread.join();
+
+	library_scan_stats totals{};
+	std::vector<scanned_file> files;
+	for (auto& worker : state.workers) {
+		totals.directories += worker->stats.directories;
+		totals.entries += worker->stats.entries;
+		totals.stat_calls += worker->stats.stat_calls;
+		std::move(worker->files.begin(), worker->files.end(), std::back_inserter(files));
+	}
+	std::ranges::sort(files, {}, &scanned_file::path);
+	totals.walk_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	if (!config.sniff) {
+		tracks.resize(files.size());
+		for (std::size_t i = 0; i < files.size(); i++)
+			tracks[i].path = std::move(files[i].path);
+	} else {
+		// * spinning disks get one sequential job each, so several disks still scan side by side
+		std::vector<header_job> jobs = physical_order_jobs(files, config, totals.devices);
+
+		std::size_t slice_size = (files.size() + thread_count - 1) / thread_count;
+		for (std::size_t first = 0; first < files.size(); first += slice_size) {
+			header_job job{};
+			job.headers = config.headers;
+			for (std::size_t i = first; i < std::min(first + slice_size, files.size()); i++)
+				job.paths.push_back(std::move(files[i].path));
+			jobs.push_back(std::move(job));
+		}
+
+		threads.clear();
+		for (std::size_t i = 1; i < jobs.size(); i++)
+			threads.emplace_back([&, i] { identify_files(jobs[i], config); });
+		if (!jobs.empty())
+			identify_files(jobs[0], config);
+		for (auto& thread : threads)
+			thread.join();
+
+		for (auto& job : jobs) {
+			totals.header_syscalls += job.stats.syscalls;
+			totals.used_io_uring = totals.used_io_uring || job.stats.used_io_uring;
+			std::move(job.tracks.begin(), job.tracks.end(), std::back_inserter(tracks));
+		}
+		std::ranges::sort(tracks, {}, &library_track::path);
+	}
+
+	totals.tracks = tracks.size();
+	totals.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	if (stats != NULL)
+		*stats = totals;
+	return tracks;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "library.hpp"
+#include "header_reader.hpp"
+#include "physical_order.hpp"
+
+/**
+ * @brief Parallel directory walker that fills the library.
+ *
+ * Directories are opened relative to their parent's fd and read with getdents64,
+ * and the entry's d_type decides file or folder without a stat. statx is only
+ * needed when the filesystem leaves d_type empty or for symlinks. Each worker
+ * keeps its own stack of directories and steals from the others when it runs
+ * dry, so deep and wide trees both keep every thread busy.
+ *
+ * The files found are then split between the threads, which read their headers in
+ * batches (see header_reader.hpp), sniff the format and the length from those bytes
+ * (see duration_probe.hpp) and hand them to parse_tags, so most tracks never need a
+ * second open.
+ *
+ * Files on spinning disks skip that split: each disk gets a single thread that reads
+ * its files one at a time in on-disk order (see physical_order.hpp). Different disks
+ * are still read in parallel, and SSD files keep the batched path. Lengths there come
+ * from the header bytes alone, the tracks that need more are left DEFERRED for the
+ * caller to probe once the scan is done.
+ */
+
+enum class scan_order {
+	path,
+	physical_on_rotational,
+	physical,
+};
+
+struct library_scan_config {
+	unsigned threads = 0; // * 0 picks the hardware concurrency
+	// * false keeps every regular file with an unknown format, used to time the walk alone
+	bool sniff = true;
+	scan_order order = scan_order::physical_on_rotational;
+	header_reader_config headers;
+	std::function<void(library_track& track, const unsigned char* bytes, size_t size)> parse_tags;
+};
+
+struct library_scan_stats {
+	ma_uint64 directories;
+	ma_uint64 entries;
+	ma_uint64 stat_calls;
+	ma_uint64 tracks;
+	ma_uint64 header_syscalls;
+	bool used_io_uring;
+	double walk_seconds;
+	double seconds;
+	std::vector<device_scan_report> devices;
+};
+
+/** @brief Walks everything below root, returns the playable tracks sorted by path. */
+std::vector<library_track> library_scan(const std::string& root, const library_scan_config& config, library_scan_stats* stats = NULL);
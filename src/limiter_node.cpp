@@ -0,0 +1,217 @@
+#include "limiter_node.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include "audio_stats.hpp"
+#include "true_peak.hpp"
+
+constexpr ma_uint32 MAX_BLOCK = 1024;
+// * the interpolator centres on the middle of its taps, a point between two samples is only seen this many frames after them
+constexpr ma_uint32 DETECTION_DELAY = TRUE_PEAK_TAPS / 2;
+
+struct limiter_node {
+	ma_node_base base;
+	limiter_config config;
+	int stage;
+	float ceiling;
+	float release_coefficient;
+	ma_uint32 lookahead;
+	// * lookahead plus the detection delay, both the delay line and the hold span it
+	ma_uint32 latency;
+	float4 taps[TRUE_PEAK_TAPS];
+
+	// * per channel, the last TRUE_PEAK_TAPS - 1 input samples followed by the block being processed
+	std::vector<float> history;
+	std::vector<float> frame_peaks;
+	std::vector<float> gains;
+
+	// * input delayed by latency frames, interleaved
+	std::vector<float> delay;
+	ma_uint32 delay_position = 0;
+
+	// * monotonic queue of required gains over the last latency + 1 frames, oldest first
+	std::vector<float> window_gains;
+	std::vector<ma_uint64> window_times;
+	ma_uint32 window_head = 0;
+	ma_uint32 window_size = 0;
+	ma_uint64 time = 0;
+
+	float envelope = 1;
+	std::vector<float> box;
+	ma_uint32 box_position = 0;
+	double box_sum;
+
+	std::atomic<ma_uint64> frames = 0;
+	std::atomic<ma_uint64> limited_frames = 0;
+	std::atomic<float> min_gain = 1;
+};
+
+static ma_uint64 now_ns() {
+	auto now = std::chrono::steady_clock::now().time_since_epoch();
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+}
+
+/** @brief Highest oversampled magnitude of every frame across all channels, into frame_peaks. */
+static void detect_peaks(limiter_node* limiter, const float* input, ma_uint32 frame_count) {
+	ma_uint32 channels = limiter->config.channels;
+	std::fill_n(limiter->frame_peaks.begin(), frame_count, 0.0f);
+
+	for (ma_uint32 channel = 0; channel < channels; channel++) {
+		float* history = &limiter->history[std::size_t(channel) * (TRUE_PEAK_TAPS - 1 + MAX_BLOCK)];
+		for (ma_uint32 frame = 0; frame < frame_count; frame++)
+			history[TRUE_PEAK_TAPS - 1 + frame] = input[frame * channels + channel];
+
+		for (ma_uint32 frame = 0; frame < frame_count; frame++) {
+			const float* newest = history + TRUE_PEAK_TAPS - 1 + frame;
+			float4 sum = true_peak_phases(limiter->taps, newest);
+			float peak = std::max({ std::fabs(*newest), sum[0], sum[1], sum[2], sum[3] });
+			limiter->frame_peaks[frame] = std::max(limiter->frame_peaks[frame], peak);
+		}
+		std::memmove(history, history + frame_count, (TRUE_PEAK_TAPS - 1) * sizeof(float));
+	}
+}
+
+/** @brief Gain for every frame leaving the delay line, never above what any peak inside the look-ahead needs. */
+static void compute_gains(limiter_node* limiter, ma_uint32 frame_count) {
+	ma_uint32 capacity = ma_uint32(limiter->window_gains.size());
+	ma_uint32 lookahead = limiter->lookahead;
+	ma_uint32 hold = limiter->latency;
+
+	for (ma_uint32 frame = 0; frame < frame_count; frame++) {
+		float peak = limiter->frame_peaks[frame];
+		float required = peak > limiter->ceiling ? limiter->ceiling / peak : 1.0f;
+
+		// * sliding minimum: drop the gains this one undercuts, then whatever left the window
+		while (limiter->window_size > 0) {
+			ma_uint32 newest = (limiter->window_head + limiter->window_size - 1) % capacity;
+			if (limiter->window_gains[newest] < required)
+				break;
+			limiter->window_size--;
+		}
+		ma_uint32 slot = (limiter->window_head + limiter->window_size) % capacity;
+		limiter->window_gains[slot] = required;
+		limiter->window_times[slot] = limiter->time;
+		limiter->window_size++;
+		if (limiter->window_times[limiter->window_head] + hold < limiter->time) {
+			limiter->window_head = (limiter->window_head + 1) % capacity;
+			limiter->window_size--;
+		}
+		limiter->time++;
+		float held = limiter->window_gains[limiter->window_head];
+
+		// * instant attack, the box filter below spreads it over the look-ahead
+		if (held < limiter->envelope)
+			limiter->envelope = held;
+		else
+			limiter->envelope += (held - limiter->envelope) * limiter->release_coefficient;
+
+		limiter->box_sum += limiter->envelope - limiter->box[limiter->box_position];
+		limiter->box[limiter->box_position] = limiter->envelope;
+		limiter->box_position = (limiter->box_position + 1) % lookahead;
+		limiter->gains[frame] = std::min(1.0f, float(limiter->box_sum / lookahead));
+	}
+}
+
+static void limiter_process(ma_node* node, const float** frames_in, ma_uint32* frame_count_in, float** frames_out, ma_uint32* frame_count_out) {
+	auto limiter = (limiter_node*)node;
+	ma_uint64 start = now_ns();
+	ma_uint32 channels = limiter->config.channels;
+	ma_uint32 frame_count = std::min(*frame_count_in, *frame_count_out);
+	ma_uint64 limited = 0;
+	float min_gain = limiter->min_gain.load(std::memory_order_relaxed);
+
+	for (ma_uint32 done = 0; done < frame_count;) {
+		ma_uint32 block = std::min(frame_count - done, MAX_BLOCK);
+		const float* input = frames_in[0] + std::size_t(done) * channels;
+		float* output = frames_out[0] + std::size_t(done) * channels;
+
+		detect_peaks(limiter, input, block);
+		compute_gains(limiter, block);
+
+		for (ma_uint32 frame = 0; frame < block; frame++) {
+			float gain = limiter->gains[frame];
+			float* delayed = &limiter->delay[std::size_t(limiter->delay_position) * channels];
+			// * input is read before output is written, miniaudio may hand both out as one buffer
+			for (ma_uint32 channel = 0; channel < channels; channel++) {
+				float sample = input[frame * channels + channel];
+				output[frame * channels + channel] = delayed[channel] * gain;
+				delayed[channel] = sample;
+			}
+			limiter->delay_position = (limiter->delay_position + 1) % limiter->latency;
+			// * the release only approaches unity, under 0.01 dB of reduction doesn't count
+			limited += gain < 0.999f;
+			min_gain = std::min(min_gain, gain);
+		}
+		done += block;
+	}
+
+	*frame_count_in = frame_count;
+	*frame_count_out = frame_count;
+	limiter->frames.fetch_add(frame_count, std::memory_order_relaxed);
+	limiter->limited_frames.fetch_add(limited, std::memory_order_relaxed);
+	limiter->min_gain.store(min_gain, std::memory_order_relaxed);
+	audio_stats_record_stage(limiter->stage, now_ns() - start);
+}
+
+static ma_node_vtable limiter_vtable = {
+	limiter_process,
+	NULL,
+	1,
+	1,
+	0,
+};
+
+limiter_node* limiter_node_create(ma_node_graph* graph, const limiter_config& config) {
+	if (config.channels == 0 || config.sample_rate == 0)
+		return NULL;
+
+	auto limiter = new limiter_node;
+	limiter->config = config;
+	limiter->stage = audio_stats_register_stage("limiter");
+	limiter->ceiling = std::pow(10.0f, config.ceiling_db / 20);
+	limiter->release_coefficient = 1 - std::exp(-1000 / (config.release_ms * float(config.sample_rate)));
+	limiter->lookahead = std::max<ma_uint32>(1, ma_uint32(config.lookahead_ms * float(config.sample_rate) / 1000));
+	limiter->latency = limiter->lookahead + DETECTION_DELAY;
+	true_peak_taps(limiter->taps);
+
+	limiter->history.assign(std::size_t(config.channels) * (TRUE_PEAK_TAPS - 1 + MAX_BLOCK), 0);
+	limiter->frame_peaks.assign(MAX_BLOCK, 0);
+	limiter->gains.assign(MAX_BLOCK, 1);
+	limiter->delay.assign(std::size_t(limiter->latency) * config.channels, 0);
+	limiter->window_gains.assign(limiter->latency + 2, 1);
+	limiter->window_times.assign(limiter->latency + 2, 0);
+	limiter->box.assign(limiter->lookahead, 1);
+	limiter->box_sum = limiter->lookahead;
+
+	ma_node_config node_config = ma_node_config_init();
+	node_config.vtable = &limiter_vtable;
+	node_config.pInputChannels = &limiter->config.channels;
+	node_config.pOutputChannels = &limiter->config.channels;
+	if (ma_node_init(graph, &node_config, NULL, &limiter->base) != MA_SUCCESS) {
+		delete limiter;
+		return NULL;
+	}
+	return limiter;
+}
+
+void limiter_node_destroy(limiter_node* limiter) {
+	if (limiter == NULL)
+		return;
+	ma_node_uninit(&limiter->base, NULL);
+	delete limiter;
+}
+
+limiter_stats limiter_node_get_stats(limiter_node* limiter) {
+	float min_gain = limiter->min_gain.load(std::memory_order_relaxed);
+	return limiter_stats{
+		.frames = limiter->frames.load(std::memory_order_relaxed),
+		.limited_frames = limiter->limited_frames.load(std::memory_order_relaxed),
+		.max_reduction_db = min_gain < 1 ? -20 * std::log10(min_gain) : 0,
+		.latency_frames = limiter->latency,
+	};
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "include/miniaudio.h"
+
+/**
+ * @brief Look-ahead true-peak limiter, a node between the sounds and the engine endpoint.
+ *
+ * Peaks are found on the signal oversampled four times, so overs that only appear
+ * between samples (after the DAC's reconstruction filter) are caught too. The gain
+ * needed for each peak is held for the look-ahead time and smoothed over the same
+ * span, which brings it down just in time for the delayed audio without ever
+ * overshooting. The interpolator sees a point between samples half its length late,
+ * so the delay and the hold are that much longer than the look-ahead. Everything is
+ * allocated when the node is created, processing only touches those buffers.
+ */
+
+struct limiter_config {
+	ma_uint32 channels = 2;
+	ma_uint32 sample_rate = 48000;
+	float ceiling_db = -1;
+	float lookahead_ms = 1.5f;
+	float release_ms = 80;
+};
+
+struct limiter_stats {
+	ma_uint64 frames;
+	ma_uint64 limited_frames;
+	float max_reduction_db;
+	ma_uint32 latency_frames;
+};
+
+struct limiter_node;
+
+/** @brief Creates the node in graph with one input and one output bus, NULL on failure. Attach it with (ma_node*)limiter. */
+limiter_node* limiter_node_create(ma_node_graph* graph, const limiter_config& config);
+void limiter_node_destroy(limiter_node* limiter);
+
+limiter_stats limiter_node_get_stats(limiter_node* limiter);
@@ -0,0 +1,227 @@
+#include "loudness.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+#include "true_peak.hpp"
+
+constexpr ma_uint64 CHUNK_FRAMES = 4096;
+constexpr double ABSOLUTE_GATE = -70;
+constexpr double MAX_BOOST = 12;
+
+struct biquad {
+	float b0, b1, b2, a1, a2;
+};
+
+/** @brief The two K-weighting stages of BS.1770 for any sample rate, head shelf then high-pass. */
+static void k_weighting(double sample_rate, biquad& shelf, biquad& highpass) {
+	double k = std::tan(M_PI * 1681.974450955533 / sample_rate);
+	double q = 0.7071752369554196;
+	double vh = std::pow(10.0, 3.999843853973347 / 20);
+	double vb = std::pow(vh, 0.4996667741545416);
+	double a0 = 1 + k / q + k * k;
+	shelf = biquad{ float((vh + vb * k / q + k * k) / a0), float(2 * (k * k - vh) / a0), float((vh - vb * k / q + k * k) / a0),
+		float(2 * (k * k - 1) / a0), float((1 - k / q + k * k) / a0) };
+
+	k = std::tan(M_PI * 38.13547087602444 / sample_rate);
+	q = 0.5003270373238773;
+	a0 = 1 + k / q + k * k;
+	highpass = biquad{ 1, -2, 1, float(2 * (k * k - 1) / a0), float((1 - k / q + k * k) / a0) };
+}
+
+/** @brief Transposed direct form II, one channel per lane. */
+static float4 run_biquad(const biquad& filter, float4* state, float4 input) {
+	float4 output = filter.b0 * input + state[0];
+	state[0] = filter.b1 * input - filter.a1 * output + state[1];
+	state[1] = filter.b2 * input - filter.a2 * output;
+	return output;
+}
+
+/** @brief BS.1770 channel weights, surrounds count more and the LFE not at all. */
+static float channel_weight(ma_channel channel) {
+	switch (channel) {
+		case MA_CHANNEL_LFE: return 0;
+		case MA_CHANNEL_SIDE_LEFT:
+		case MA_CHANNEL_SIDE_RIGHT:
+		case MA_CHANNEL_BACK_LEFT:
+		case MA_CHANNEL_BACK_RIGHT: return 1.41f;
+		default: return 1;
+	}
+}
+
+static double energy_to_lufs(double energy) {
+	return -0.691 + 10 * std::log10(energy);
+}
+
+/** @brief Mean energy of windows of length blocks that pass the absolute gate and relative_gate below their mean. */
+static std::vector<double> gated_windows(const std::vector<double>& blocks, std::size_t length, double relative_gate) {
+	std::vector<double> windows;
+	double sum = 0;
+	for (std::size_t i = 0; i < blocks.size(); i++) {
+		sum += blocks[i];
+		if (i >= length)
+			sum -= blocks[i - length];
+		if (i + 1 >= length && energy_to_lufs(sum / double(length)) > ABSOLUTE_GATE)
+			windows.push_back(sum / double(length));
+	}
+	if (windows.empty())
+		return windows;
+
+	double mean = 0;
+	for (double window : windows)
+		mean += window;
+	double threshold = energy_to_lufs(mean / double(windows.size())) + relative_gate;
+	std::erase_if(windows, [threshold](double window) { return energy_to_lufs(window) <= threshold; });
+	return windows;
+}
+
+track_loudness loudness_analyse_file(const char* path, ma_encoding_format format, loudness_stats* stats) {
+	auto start = std::chrono::steady_clock::now();
+	track_loudness loudness;
+	ma_decoder_config decoder_config = ma_decoder_config_init(ma_format_f32, 0, 0);
+	decoder_config.encodingFormat = format;
+	ma_decoder decoder;
+	if (ma_decoder_init_file(path, &decoder_config, &decoder) != MA_SUCCESS)
+		return loudness;
+
+	ma_format sample_format;
+	ma_uint32 channels;
+	ma_uint32 sample_rate;
+	ma_channel channel_map[MA_MAX_CHANNELS];
+	if (ma_decoder_get_data_format(&decoder, &sample_format, &channels, &sample_rate, channel_map, MA_MAX_CHANNELS) != MA_SUCCESS
+		|| channels == 0 || sample_rate < 8000) {
+		ma_decoder_uninit(&decoder);
+		return loudness;
+	}
+
+	biquad shelf, highpass;
+	k_weighting(sample_rate, shelf, highpass);
+	float4 taps[TRUE_PEAK_TAPS];
+	true_peak_taps(taps);
+
+	// * channels in groups of four lanes, missing lanes weigh nothing
+	std::size_t groups = (channels + 3) / 4;
+	std::vector<float4> weights(groups, float4{});
+	std::vector<float4> filter_state(groups * 4, float4{});
+	std::vector<float4> energies(groups, float4{});
+	for (ma_uint32 channel = 0; channel < channels; channel++)
+		weights[channel / 4][channel % 4] = channel_weight(channel_map[channel]);
+
+	std::vector<std::vector<float>> peak_history(channels, std::vector<float>(TRUE_PEAK_TAPS - 1 + CHUNK_FRAMES, 0));
+	float4 peaks = {};
+
+	ma_uint64 block_frames = (sample_rate + 5) / 10;
+	ma_uint64 frames_in_block = 0;
+	std::vector<double> blocks;
+	std::vector<float> samples(CHUNK_FRAMES * channels);
+	ma_uint64 total_frames = 0;
+
+	while (true) {
+		ma_uint64 frames = 0;
+		if (ma_decoder_read_pcm_frames(&decoder, samples.data(), CHUNK_FRAMES, &frames) != MA_SUCCESS || frames == 0)
+			break;
+		total_frames += frames;
+
+		std::size_t first_block = blocks.size();
+		for (std::size_t group = 0; group < groups; group++) {
+			std::size_t completed = 0;
+			ma_uint32 lanes = std::min<ma_uint32>(4, channels - ma_uint32(group) * 4);
+			float4* state = &filter_state[group * 4];
+			float4 energy = energies[group];
+			ma_uint64 block_position = frames_in_block;
+			for (ma_uint64 frame = 0; frame < frames; frame++) {
+				const float* input = &samples[frame * channels + group * 4];
+				float4 x = {};
+				for (ma_uint32 lane = 0; lane < lanes; lane++)
+					x[lane] = input[lane];
+				float4 weighted = run_biquad(highpass, state + 2, run_biquad(shelf, state, x));
+				energy += weighted * weighted;
+
+				if (++block_position == block_frames) {
+					float4 block = energy * weights[group];
+					// * the first group opens the block, the others add to it
+					if (first_block + completed == blocks.size())
+						blocks.push_back(0);
+					blocks[first_block + completed++] += (double(block[0]) + block[1] + block[2] + block[3]) / double(block_frames);
+					energy = float4{};
+					block_position = 0;
+				}
+			}
+			energies[group] = energy;
+			if (group + 1 == groups)
+				frames_in_block = block_position;
+		}
+
+		for (ma_uint32 channel = 0; channel < channels; channel++) {
+			float* history = peak_history[channel].data();
+			for (ma_uint64 frame = 0; frame < frames; frame++)
+				history[TRUE_PEAK_TAPS - 1 + frame] = samples[frame * channels + channel];
+			for (ma_uint64 frame = 0; frame < frames; frame++) {
+				const float* newest = history + TRUE_PEAK_TAPS - 1 + frame;
+				float4 sum = true_peak_phases(taps, newest);
+				peaks = peaks > sum ? peaks : sum;
+				float sample = std::fabs(*newest);
+				peaks[0] = std::max(peaks[0], sample);
+			}
+			std::memmove(history, history + frames, (TRUE_PEAK_TAPS - 1) * sizeof(float));
+		}
+	}
+	ma_decoder_uninit(&decoder);
+
+	// * momentary windows are 4 blocks, short-term ones 30
+	std::vector<double> momentary = gated_windows(blocks, 4, -10);
+	double mean = 0;
+	for (double window : momentary)
+		mean += window;
+	loudness.integrated = momentary.empty() ? float(ABSOLUTE_GATE) : float(energy_to_lufs(mean / double(momentary.size())));
+	loudness.gated_seconds = float(momentary.size()) / 10;
+
+	std::vector<double> short_term = gated_windows(blocks, 30, -20);
+	if (short_term.size() > 1) {
+		std::ranges::sort(short_term);
+		double low = short_term[std::size_t(double(short_term.size() - 1) * 0.10 + 0.5)];
+		double high = short_term[std::size_t(double(short_term.size() - 1) * 0.95 + 0.5)];
+		loudness.range = float(energy_to_lufs(high) - energy_to_lufs(low));
+	}
+
+	float peak = std::max({ peaks[0], peaks[1], peaks[2], peaks[3] });
+	loudness.true_peak = peak > 0 ? 20 * std::log10(peak) : -200.0f;
+	loudness.measured = true;
+
+	if (stats != NULL) {
+		stats->frames = total_frames;
+		stats->sample_rate = sample_rate;
+		stats->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+	return loudness;
+}
+
+track_loudness loudness_combine(const std::vector<const track_loudness*>& tracks) {
+	track_loudness combined;
+	double energy = 0;
+	double seconds = 0;
+	combined.true_peak = -200;
+	for (const track_loudness* track : tracks) {
+		if (track == NULL || !track->measured)
+			continue;
+		combined.measured = true;
+		energy += double(track->gated_seconds) * std::pow(10.0, (track->integrated + 0.691) / 10);
+		seconds += track->gated_seconds;
+		combined.range = std::max(combined.range, track->range);
+		combined.true_peak = std::max(combined.true_peak, track->true_peak);
+	}
+	combined.gated_seconds = float(seconds);
+	combined.integrated = seconds > 0 ? float(energy_to_lufs(energy / seconds)) : float(ABSOLUTE_GATE);
+	return combined;
+}
+
+float loudness_gain_db(const track_loudness& loudness, float target_lufs, float peak_ceiling) {
+	if (!loudness.measured)
+		return 0;
+	// * quiet or silent tracks would otherwise get boosted into their noise floor
+	double gain = std::min<double>(target_lufs - loudness.integrated, MAX_BOOST);
+	gain = std::min<double>(gain, peak_ceiling - loudness.true_peak);
+	return float(gain);
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <vector>
+
+#include "include/miniaudio.h"
+
+/**
+ * @brief EBU R128 loudness of a whole track, measured the ITU-R BS.1770 way.
+ *
+ * Samples are K-weighted by two biquads, then summed per channel into 100ms energy
+ * blocks. Integrated loudness gates 400ms windows at -70 LUFS and then 10 LU below
+ * their mean. Loudness range is the spread of 3s windows between their 10th and 95th
+ * percentiles. True peak looks at the signal oversampled four times. Channels run in
+ * the lanes of one vector, four at a time.
+ */
+
+struct track_loudness {
+	bool measured = false;
+	float integrated = 0;
+	float range = 0;
+	float true_peak = 0;
+	// * time above the gates, so albums weigh long tracks more
+	float gated_seconds = 0;
+};
+
+struct loudness_stats {
+	ma_uint64 frames;
+	ma_uint32 sample_rate;
+	double seconds;
+};
+
+/** @brief Decodes the whole file at its own rate, measured is false when it can't be decoded. */
+track_loudness loudness_analyse_file(const char* path, ma_encoding_format format, loudness_stats* stats = NULL);
+
+/**
+ * @brief Loudness of tracks played together. Integrated loudness is the energy mean weighted by
+ * gated time, which is what measuring them back to back gives when their levels are steady.
+ * The range is the widest of the tracks and the peak the highest.
+ */
+track_loudness loudness_combine(const std::vector<const track_loudness*>& tracks);
+
+/** @brief Gain in dB that brings loudness to target_lufs, lowered so the true peak stays under peak_ceiling. */
+float loudness_gain_db(const track_loudness& loudness, float target_lufs = -18, float peak_ceiling = -1);
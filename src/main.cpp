@@ -10,23 +10,92 @@
 #include <taglib/attachedpictureframe.h>
 #include <taglib/id3v2tag.h>
 #include <taglib/flacfile.h>
+#include <taglib/tbytevectorstream.h>
 
 #include <format>
+#include <chrono>
+#include <cmath>
+#include <utility>
 #include <vector>
 #include <algorithm>
+#include <memory>
 #include <optional>
+#include <unordered_set>
+#include <thread>
 
 #include "Logger.hpp"
+#include "output_device.hpp"
+#include "audio_stats.hpp"
+#include "rt_check.hpp"
+#include "decode_ahead.hpp"
+#include "bench.hpp"
+#include "prefetch.hpp"
+#include "readahead_vfs.hpp"
+#include "wav_mmap_source.hpp"
+#include "format_sniff.hpp"
+#include "library.hpp"
+#include "library_scan.hpp"
+#include "library_cache.hpp"
+#include "content_hash.hpp"
+#include "fingerprint.hpp"
+#include "loudness.hpp"
+#include "waveform.hpp"
+#include "limiter_node.hpp"
+#include "eq_node.hpp"
+#include "eq_presets.hpp"
+#include "convolution_node.hpp"
+#include "time_stretch_node.hpp"
+#include "pcm_convert.hpp"
+#include "spectrum.hpp"
+#include "spectrum_view.hpp"
+#include "waveform_scale.hpp"
+#include "job_pool.hpp"
 
 #define MINIAUDIO_IMPLEMENTATION
 #include "include/miniaudio.h"
 
-std::vector<std::string> played_file_path;
+std::vector<library_track> library;
 
 ma_engine engine;
+ma_resource_manager resource_manager;
+readahead_vfs library_vfs;
+
+limiter_node* limiter = NULL;
+eq_node* equalizer = NULL;
+convolution_node* room_correction = NULL;
+time_stretch_node* time_stretch = NULL;
+spectrum_tap* output_tap = NULL;
+spectrum_analyser* output_spectrum = NULL;
+std::string eq_presets_file;
 
 ma_sound sound;
 ma_uint64 sound_length;
+decode_ahead_source* sound_source = NULL;
+wav_mmap_source* sound_mapping = NULL;
+decode_ahead_config decode_config;
+// * rate of the source while it feeds the device directly (see --bit-transparent)
+ma_uint32 direct_sample_rate = 0;
+ma_uint64 open_count = 0;
+double open_total_ms = 0;
+
+std::string library_cache_file;
+std::string waveform_directory;
+// * track whose waveform the seek bar shows or is waiting for
+std::string shown_waveform;
+bool hide_duplicates = false;
+bool sort_by_length = false;
+bool duplicates_changed = false;
+std::vector<std::vector<std::size_t>> duplicate_groups;
+bool regrouping = false;
+
+enum class normalization {
+	OFF,
+	TRACK,
+	ALBUM,
+};
+normalization normalize = normalization::TRACK;
+std::size_t playing_track = SIZE_MAX;
+float playback_gain_db = 0;
 
 float sound_length_s = 0;
 int end_min = 0;
@@ -38,11 +107,28 @@ bool is_sound_paused = false;
 bool volume_changed = false;
 
 GtkWidget* song_list;
+GtkWidget* stats_overlay;
+GtkWidget* output_warning = NULL;
+GtkWidget* spectrum = NULL;
+GtkWidget* seek_bar = NULL;
 double volume = 0.1;
 
+gboolean print_stats = FALSE;
+gboolean run_rt_check = FALSE;
+int decode_ahead_ms = 2000;
+char* bench_name = NULL;
+char* bench_input = NULL;
+char* impulse_path = NULL;
+char* resampler_name = NULL;
+char* downmix_name = NULL;
+char* dither_name = NULL;
+gboolean bit_transparent = FALSE;
+
 GtkListBoxRow* selected_row = NULL;
 
-const std::array<std::string, 6> file_types = {".wav", ".mp3", ".flac"}; 
+const std::array<std::string_view, 3> file_types = {".wav", ".mp3", ".flac"};
+// * title, artist, album, genre and length
+constexpr int SONG_COLUMNS = 5;
 
 long bar_id = 0;
 long volume_bar_id = 0;
@@ -93,7 +179,8 @@ struct song_data {
 };
 
 struct _song_row : GObject {
-	std::array<std::string, 4> info;
+	std::array<std::string, SONG_COLUMNS> info;
+	std::size_t track;
 };
 
 
@@ -101,9 +188,10 @@ G_DECLARE_FINAL_TYPE(song_row, song_row, , SONG_ROW, GObject)
 
 G_DEFINE_TYPE(song_row, song_row, G_TYPE_OBJECT)
 
-song_row* song_row_new(std::array<std::string, 4> info) {
+song_row* song_row_new(std::array<std::string, SONG_COLUMNS> info, std::size_t track) {
 	song_row* row = (song_row*)g_object_new(song_row_get_type(), NULL);
 	row->info = info;
+	row->track = track;
 	return row;
 }
 
@@ -122,21 +210,26 @@ GListStore* song_store = g_list_store_new(song_row_get_type());
 GtkSingleSelection* song_selection = gtk_single_selection_new(G_LIST_MODEL(song_store));
 GtkListItemFactory* factory = gtk_signal_list_item_factory_new();
 
-static bool check_valid_format(std::string_view file_name) {
-	// * goes through every file in the file dialog and checks weather the type is correct
-
+static std::size_t audio_extension_size(std::string_view file_name) {
+// * Length of a known audio extension at the end of the name, any case, 0 when there is none
 	for (auto ext : file_types) {
-		std::size_t ext_index = file_name.find(ext);
-		if (ext_index == 0 || ext_index >= file_name.size())
+		if (file_name.size() <= ext.size())
 			continue;
-		// log(ext_index, INFO);
-
-		if (ext_index == (file_name.size() - ext.size()))
-			return true;
-		// if (file_name.find(ext) != std::string_view::npos)
-		// 	return true;
+		auto tail = file_name.substr(file_name.size() - ext.size());
+		if (g_ascii_strncasecmp(tail.data(), ext.data(), ext.size()) == 0)
+			return ext.size();
 	}
-	return false;
+	return 0;
+}
+
+static std::string format_length(double seconds) {
+// * m:ss, or h:mm:ss from an hour on, empty while the length is unknown
+	if (seconds <= 0)
+		return "";
+	int total = int(std::lround(seconds));
+	if (total < 3600)
+		return std::format("{}:{:02}", total / 60, total % 60);
+	return std::format("{}:{:02}:{:02}", total / 3600, total / 60 % 60, total % 60);
 }
 
 static bool set_song_metadata(std::string file) {
@@ -160,39 +253,59 @@ static bool set_song_metadata(std::string file) {
 	return true;
 }
 
-static void append_songs_to_list(std::vector<std::string>* file_names) {
+static void parse_header_tags(library_track& track, const unsigned char* bytes, size_t size) {
+// * Runs on the scan threads with the header bytes, tracks whose tags lie beyond them are read whole later
+	TagLib::ByteVector header((const char*)bytes, (unsigned int)size);
+	TagLib::ByteVectorStream stream(header);
+	TagLib::FileRef file_ref(&stream, false);
+	if (file_ref.isNull() || file_ref.tag() == nullptr || file_ref.tag()->isEmpty())
+		return;
+
+	auto tag = file_ref.tag();
+	track.title = tag->title().to8Bit(true);
+	track.artist = tag->artist().to8Bit(true);
+	track.album = tag->album().to8Bit(true);
+	track.genre = tag->genre().to8Bit(true);
+	track.has_tags = true;
+}
+
+static void append_songs_to_list(std::vector<std::string>* file_names, std::size_t first_track) {
 	// * Gets files from the file dialog result and adds them to a list box
 	std::vector<std::string> names = *file_names;
 
 	for (std::size_t i = 0; i < names.size(); i++) {
-		for (std::string ext : file_types) {
-			auto start_pos = names[i].find(ext);
-			if (start_pos > names[i].size())
-				continue;
-			names[i].erase(start_pos, ext.size());
-		}
+		names[i].erase(names[i].size() - audio_extension_size(names[i]));
+		library_track& track = library[first_track + i];
 
 
 		// GtkWidget* song_box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 30);
 
-		if (!set_song_metadata(played_file_path[i])) {
-			// gtk_list_box_append(GTK_LIST_BOX(song_list), song_box);
-			continue;
+		if (!track.has_tags) {
+			if (!set_song_metadata(track.path)) {
+				// gtk_list_box_append(GTK_LIST_BOX(song_list), song_box);
+				continue;
+			}
+			track.title = played_song.title;
+			track.artist = played_song.author;
+			track.album = played_song.album;
+			track.genre = played_song.genre;
+			track.has_tags = true;
 		}
 
-		auto title = played_song.title;
-		auto artist = played_song.author;
-		auto album = played_song.album;
-		auto genre = played_song.genre;
-		std::array<std::string, 4> song_labels = {
+		auto title = track.title;
+		auto artist = track.artist;
+		auto album = track.album;
+		auto genre = track.genre;
+		std::array<std::string, SONG_COLUMNS> song_labels = {
 			title,
 			artist,
 			album,
 			genre,
+			format_length(duration_seconds(track.duration)),
 		};
 
-		song_row* row = song_row_new(song_labels);
-		for(int i = 0; i < 4; ++i)
+		song_row* row = song_row_new(song_labels, first_track + i);
+		for(int i = 0; i < SONG_COLUMNS; ++i)
 			g_list_store_append(song_store, row);
 
 
@@ -232,52 +345,234 @@ static void append_songs_to_list(std::vector<std::string>* file_names) {
 	}
 }
 
-static void loop_folder(std::vector<std::string>& file_names, GFile* file) {
+static void add_scanned_tracks(std::vector<std::string>& file_names, std::vector<library_track>& tracks) {
+// * Appends the tracks of a scan to the library, skipping file names that are already in it
+	std::unordered_set<std::string> seen_names(file_names.begin(), file_names.end());
 
-	GFileEnumerator* enumerator = g_file_enumerate_children(file, "", G_FILE_QUERY_INFO_NONE, NULL, NULL);
-	
-	if (enumerator == NULL)
-		return;
+	for (auto& track : tracks) {
+		std::string file_name = track.path.substr(track.path.rfind('/') + 1);
+		if (!seen_names.insert(file_name).second)
+			continue;
 
-	while(true) {
+		// * the content decided, so misnamed files and any extension case still get in
+		if (audio_extension_size(file_name) == 0)
+			log(std::format("{} is {} without a matching extension", track.path, encoding_format_name(track.format)), INFO);
 
-		GFileInfo* current_file = g_file_enumerator_next_file(enumerator, NULL, NULL);
-		if (current_file == NULL)
-			break;
+		library.push_back(std::move(track));
+		file_names.push_back(file_name);
+	}
+}
+
+static void refresh_song_store() {
+// * Rebuilds the song list from the library, leaving out all but the first copy of a duplicate when hidden
+	std::vector<bool> hidden(library.size(), false);
+	if (hide_duplicates) {
+		for (const auto& group : duplicate_groups) {
+			for (std::size_t i = 1; i < group.size(); i++)
+				hidden[group[i]] = true;
+		}
+	}
 
-		const char* file_name_cstr = g_file_info_get_name(current_file);
-        if (file_name_cstr == NULL) {
-            g_object_unref(current_file);
-            continue;
-        }
+	std::vector<std::size_t> order(library.size());
+	for (std::size_t i = 0; i < order.size(); i++)
+		order[i] = i;
+	// * unknown lengths are 0 and sort last
+	if (sort_by_length)
+		std::ranges::stable_sort(order, std::greater(), [](std::size_t i) { return duration_seconds(library[i].duration); });
+
+	g_list_store_remove_all(song_store);
+	for (std::size_t i : order) {
+		const library_track& track = library[i];
+		if (!track.has_tags || hidden[i])
+			continue;
+		song_row* row = song_row_new({ track.title, track.artist, track.album, track.genre, format_length(duration_seconds(track.duration)) }, i);
+		for (int column = 0; column < SONG_COLUMNS; ++column)
+			g_list_store_append(song_store, row);
+		g_object_unref(row);
+	}
+}
 
-        std::string file_name(file_name_cstr);
+struct track_analysis_result {
+	std::size_t track;
+	std::string path;
+	ma_uint64 hash;
+	std::vector<ma_uint32> fingerprint;
+	track_loudness loudness;
+};
 
-		if (g_file_info_get_file_type(current_file) == G_FILE_TYPE_DIRECTORY) {
-			GFile* subfolder = g_file_get_child(file, file_name.c_str());
-			loop_folder(file_names, subfolder);
-			g_object_unref(subfolder);
-			g_object_unref(current_file);
+static gboolean apply_track_analysis(void* data) {
+// * Runs on the main loop, the library may have changed since the job was queued
+	auto result = (track_analysis_result*)data;
+	if (result->track < library.size() && library[result->track].path == result->path) {
+		library[result->track].content_hash = result->hash;
+		library[result->track].fingerprint = std::move(result->fingerprint);
+		library[result->track].loudness = result->loudness;
+		library_cache_store(library[result->track]);
+		duplicates_changed = true;
+	}
+	delete result;
+	return G_SOURCE_REMOVE;
+}
+
+struct deferred_durations_result {
+	std::vector<std::size_t> tracks;
+	std::vector<std::string> paths;
+	std::vector<track_duration> durations;
+};
+
+static gboolean apply_deferred_durations(void* data) {
+// * Runs on the main loop, one redraw for the whole folder rather than one per track
+	auto result = (deferred_durations_result*)data;
+	bool changed = false;
+	for (std::size_t i = 0; i < result->tracks.size(); i++) {
+		std::size_t track = result->tracks[i];
+		if (track >= library.size() || library[track].path != result->paths[i])
 			continue;
-		}
+		library[track].duration = result->durations[i];
+		changed = changed || result->durations[i].frames > 0;
+	}
+	if (changed)
+		refresh_song_store();
+	delete result;
+	return G_SOURCE_REMOVE;
+}
+
+struct waveform_result {
+	std::string path;
+	waveform overview;
+};
+
+static gboolean apply_waveform(void* data) {
+// * Runs on the main loop, another track may be playing by now
+	auto result = (waveform_result*)data;
+	if (playing_track < library.size() && library[playing_track].path == result->path)
+		waveform_scale_set_waveform(WAVEFORM_SCALE(seek_bar), &result->overview);
+	delete result;
+	return G_SOURCE_REMOVE;
+}
 
-		// log(g_file_info_get_display_name(current_file), INFO);
-		// log(file_name, INFO);
+static waveform analyse_waveform(const std::string& path, ma_encoding_format format, ma_uint64 size, ma_int64 modified) {
+// * Runs on the job pool, a failed write only means the track is decoded again next time
+	waveform overview = waveform_analyse_file(path.c_str(), format);
+	if (!overview.levels.empty() && !waveform_cache_save(waveform_cache_file(waveform_directory, path), size, modified, overview))
+		log("cannot write the waveform cache of " + path, WARNING);
+	return overview;
+}
+
+static void show_waveform(const library_track& track) {
+// * Cached peaks show at once, otherwise the track jumps the analysis queue and the bar stays plain until they arrive
+	if (shown_waveform == track.path)
+		return;
+	shown_waveform = track.path;
 
-		// log(file_name, INFO);
-		if (!check_valid_format(file_name))
+	waveform overview;
+	if (waveform_cache_load(waveform_cache_file(waveform_directory, track.path), track.size, track.modified, overview)) {
+		waveform_scale_set_waveform(WAVEFORM_SCALE(seek_bar), &overview);
+		return;
+	}
+	waveform_scale_set_waveform(WAVEFORM_SCALE(seek_bar), NULL);
+	job_pool_submit_urgent([path = track.path, format = track.format, size = track.size, modified = track.modified] {
+		g_idle_add(apply_waveform, new waveform_result{ path, analyse_waveform(path, format, size, modified) });
+	});
+}
+
+static void queue_track_analysis(std::size_t first_track) {
+// * Hashes, fingerprints and measures the loudness of new or changed tracks in the background, cached ones are done already
+	// * lengths the scan left to later (spinning disks read in physical order) come first, in one job so the disk sees them in path order
+	deferred_durations_result deferred;
+	std::vector<ma_encoding_format> formats;
+	for (std::size_t i = first_track; i < library.size(); i++) {
+		if (library[i].duration.source != duration_source::DEFERRED)
 			continue;
+		deferred.tracks.push_back(i);
+		deferred.paths.push_back(library[i].path);
+		formats.push_back(library[i].format);
+	}
+	if (!deferred.tracks.empty()) {
+		job_pool_submit([deferred = std::move(deferred), formats = std::move(formats)]() mutable {
+			for (std::size_t i = 0; i < deferred.paths.size(); i++)
+				deferred.durations.push_back(probe_duration(deferred.paths[i].c_str(), formats[i]));
+			g_idle_add(apply_deferred_durations, new deferred_durations_result(std::move(deferred)));
+		});
+	}
 
-		if (std::ranges::contains(file_names, file_name)) 
+	for (std::size_t i = first_track; i < library.size(); i++) {
+		// * seek bar peaks have their own cache, one job per track spreads a new folder over every pool thread
+		job_pool_submit([path = library[i].path, format = library[i].format, size = library[i].size, modified = library[i].modified] {
+			if (!waveform_cache_is_current(waveform_cache_file(waveform_directory, path), size, modified))
+				analyse_waveform(path, format, size, modified);
+		});
+		if (library_cache_lookup(library[i]))
 			continue;
 
-		played_file_path.push_back(std::format("{}/{}", g_file_get_path(file), file_name));
-		file_names.push_back(file_name);
-		g_object_unref(current_file);
+		job_pool_submit([i, path = library[i].path, format = library[i].format] {
+			ma_uint64 hash = content_hash_file(path.c_str(), format);
+			std::vector<ma_uint32> fingerprint = fingerprint_file(path.c_str(), format);
+			track_loudness loudness = loudness_analyse_file(path.c_str(), format);
+			g_idle_add(apply_track_analysis, new track_analysis_result{ i, path, hash, std::move(fingerprint), loudness });
+		});
 	}
+	duplicates_changed = true;
+}
+
+struct duplicate_groups_result {
+	std::size_t library_size;
+	std::vector<std::vector<std::size_t>> groups;
+};
 
-	g_file_enumerator_close(enumerator, NULL, NULL);
-	g_object_unref(enumerator);
+static gboolean apply_duplicate_groups(void* data) {
+	auto result = (duplicate_groups_result*)data;
+	regrouping = false;
+	// * tracks added meanwhile left duplicates_changed set, the next tick groups again
+	if (result->library_size == library.size()) {
+		duplicate_groups = std::move(result->groups);
+		if (hide_duplicates)
+			refresh_song_store();
+	}
+	delete result;
+	return G_SOURCE_REMOVE;
+}
+
+static void update_duplicate_groups() {
+// * Regroups once the analysis queue drains, on the pool since matching fingerprints indexes the whole library
+	if (!duplicates_changed || regrouping || job_pool_pending() > 0)
+		return;
+	duplicates_changed = false;
+	regrouping = true;
+	job_pool_submit([tracks = library] {
+		g_idle_add(apply_duplicate_groups, new duplicate_groups_result{ tracks.size(), library_duplicate_groups(tracks) });
+	});
+}
+
+static gboolean save_library_cache(void*) {
+// * Analysis survives a crash or kill, the next start only queues what is still missing.
+// * Only the copy is made here, formatting and writing a large library would stall the UI
+	library_cache_snapshot* snapshot = library_cache_snapshot_take();
+	if (snapshot == NULL)
+		return G_SOURCE_CONTINUE;
+	// * a pool stopped before the job runs drops it, the snapshot goes with the closure
+	std::shared_ptr<library_cache_snapshot> owned(snapshot, library_cache_snapshot_destroy);
+	job_pool_submit([owned] {
+		library_cache_snapshot_write(owned.get(), library_cache_file);
+	});
+	return G_SOURCE_CONTINUE;
+}
+
+struct folder_scan_result {
+	std::vector<library_track> tracks;
+};
+
+static gboolean apply_folder_scan(void* data) {
+// * Runs on the main loop once the scan thread is done
+	auto result = (folder_scan_result*)data;
+	std::vector<std::string> file_names;
+	std::size_t first_track = library.size();
+	add_scanned_tracks(file_names, result->tracks);
+
+	append_songs_to_list(&file_names, first_track);
+	queue_track_analysis(first_track);
+	delete result;
+	return G_SOURCE_REMOVE;
 }
 
 static void get_file_dialog_result( GObject* source_object, GAsyncResult* res, void*) {
@@ -286,13 +581,25 @@ static void get_file_dialog_result( GObject* source_object, GAsyncResult* res, v
 	if (file == NULL)
 		return;
 
-	std::vector<std::string> file_names;
-	
-	loop_folder(file_names, file);
-
-	append_songs_to_list(&file_names);
-
+	char* folder = g_file_get_path(file);
 	g_object_unref(file);
+	if (folder == NULL)
+		return;
+
+	// * a large folder takes seconds to walk, the window stays responsive while a thread of its own does it
+	std::thread([folder = std::string(folder)] {
+		library_scan_config scan_config;
+		scan_config.parse_tags = parse_header_tags;
+		library_scan_stats scan_stats;
+		std::vector<library_track> tracks = library_scan(folder, scan_config, &scan_stats);
+		log(std::format("scanned {} entries in {} folders, {} tracks in {:.2f}s ({} header syscalls{})", scan_stats.entries,
+			scan_stats.directories, scan_stats.tracks, scan_stats.seconds, scan_stats.header_syscalls, scan_stats.used_io_uring ? ", io_uring" : ""), INFO);
+		for (const auto& device : scan_stats.devices)
+			log(std::format("disk {} read in physical order: {} files, {} slow reads, {}", device_name(device.device), device.files,
+				device.slow_reads, device.seek_bound ? "seek-bound" : "throughput-bound"), INFO);
+		g_idle_add(apply_folder_scan, new folder_scan_result{ std::move(tracks) });
+	}).detach();
+	g_free(folder);
 }
 
 static void on_open_button_click([[maybe_unused]]GtkButton* a, void* user_data) {
@@ -302,50 +609,249 @@ static void on_open_button_click([[maybe_unused]]GtkButton* a, void* user_data)
 	g_object_unref(file_chooser);
 }
 
-static void save_sound_length() {
+static void save_sound_length(ma_data_source* data_source) {
 // * Gets the current length of the played sound and saves it in a global variable
 
 	is_sound_init = true;
-	ma_sound_get_length_in_pcm_frames(&sound, &sound_length);
-	ma_sound_get_length_in_seconds(&sound, &sound_length_s);
+	ma_data_source_get_length_in_pcm_frames(data_source, &sound_length);
+	ma_data_source_get_length_in_seconds(data_source, &sound_length_s);
 	end_min = int(sound_length_s) / 60;
 	end_s = int(sound_length_s) % 60;
 	end_time = std::to_string(end_min) + (end_s < 10 ? ":0" : ":") + std::to_string(end_s);
 }
 
-static void play_sound(std::string played_file) {
+static void prefetch_following(std::size_t index) {
+// * Warms the page cache for the tracks that come after index in the play queue
+	std::vector<std::string> next_paths;
+	for (std::size_t i = 1; i <= prefetch_get_config().track_count && i < library.size(); i++)
+		next_paths.push_back(library[(index + i) % library.size()].path);
+	prefetch_request(next_paths);
+}
+
+static void close_sound_source() {
+	// * a direct device reads the source itself, it has to be handed back to the engine first
+	output_device_play_engine();
+	decode_ahead_close(sound_source);
+	wav_mmap_close(sound_mapping);
+	sound_source = NULL;
+	sound_mapping = NULL;
+}
+
+static ma_data_source* open_sound_source(const library_track& track, bool is_direct) {
+// * Uncompressed WAV is served straight from a memory mapping, everything else is decoded ahead
+	if (track.format == ma_encoding_format_wav) {
+		// * the engine mixes in f32, converting while copying out of the mapping saves the sound its own pass
+		sound_mapping = wav_mmap_open(track.path.c_str(), !is_direct);
+		if (sound_mapping != NULL) {
+			ma_uint32 channels = 0;
+			ma_uint32 sample_rate = 0;
+			ma_data_source_get_data_format(sound_mapping, NULL, &channels, &sample_rate, NULL, 0);
+			bool is_resampled = decode_config.output_sample_rate != 0 && sample_rate != decode_config.output_sample_rate;
+			bool is_downmixed = decode_config.output_channels != 0 && channels > decode_config.output_channels;
+			if (is_direct || (!is_resampled && !is_downmixed))
+				return sound_mapping;
+			// * a mapping is played as it is, files at another rate or with more channels go through the decode thread
+			wav_mmap_close(sound_mapping);
+			sound_mapping = NULL;
+		}
+	}
+
+	decode_ahead_config track_config = decode_config;
+	track_config.encoding_format = track.format;
+	if (is_direct) {
+		// * FLAC decodes to s32 without touching a bit, the others are f32 inside the decoder anyway
+		track_config.format = track.format == ma_encoding_format_flac ? ma_format_s32 : ma_format_f32;
+		track_config.output_sample_rate = 0;
+		track_config.output_channels = 0;
+	}
+	sound_source = decode_ahead_open(track.path.c_str(), track_config);
+	return sound_source;
+}
+
+static ma_data_source* playing_source() {
+	return sound_source != NULL ? (ma_data_source*)sound_source : (ma_data_source*)sound_mapping;
+}
+
+static ma_uint64 playback_time_in_pcm_frames() {
+// * The engine's clock for its sounds, the source's own cursor while it feeds the device directly
+	if (!output_device_is_direct())
+		return ma_sound_get_time_in_pcm_frames(&sound);
+	ma_uint64 cursor = 0;
+	ma_data_source_get_cursor_in_pcm_frames(playing_source(), &cursor);
+	return cursor;
+}
+
+static track_loudness album_loudness(const library_track& track) {
+// * An album is the tracks sharing the album tag in one folder, untagged tracks stand alone
+	if (track.album.empty())
+		return track.loudness;
+	std::string_view folder = std::string_view(track.path).substr(0, track.path.rfind('/'));
+	std::vector<const track_loudness*> tracks;
+	for (const library_track& other : library) {
+		if (other.album == track.album && std::string_view(other.path).substr(0, other.path.rfind('/')) == folder)
+			tracks.push_back(&other.loudness);
+	}
+	return loudness_combine(tracks);
+}
+
+static float track_gain_db(const library_track& track) {
+	if (normalize == normalization::OFF)
+		return 0;
+	return loudness_gain_db(normalize == normalization::ALBUM ? album_loudness(track) : track.loudness);
+}
+
+static void apply_playback_gain() {
+// * The gain is a plain volume on the sound, it takes effect with the next mixed buffer and adds no latency
+	playback_gain_db = playing_track < library.size() ? track_gain_db(library[playing_track]) : 0;
+	if (is_sound_init && !output_device_is_direct())
+		ma_sound_set_volume(&sound, ma_volume_db_to_linear(playback_gain_db));
+}
+
+static bool is_transparent(const library_track& track) {
+// * Bit-transparent playback only while nothing would change a sample: full volume, no normalization gain, 1x, flat EQ, no room correction
+	return bit_transparent && volume >= 0.999 && std::fabs(track_gain_db(track)) < 0.01f && room_correction == NULL
+		&& (time_stretch == NULL || time_stretch_node_get_speed(time_stretch) == 1.0f)
+		&& (equalizer == NULL || eq_settings_is_flat(eq_preset_for(track.path).settings));
+}
+
+static void cycle_eq_preset(bool for_track) {
+// * Steps through the presets, for the playing track the step after the last one goes back to the global preset
+	const std::vector<eq_preset>& presets = eq_presets();
+	if (for_track && playing_track < library.size()) {
+		const std::string& path = library[playing_track].path;
+		std::string current = eq_track_preset(path);
+		auto next = current.empty() ? presets.begin() : std::ranges::find(presets, current, &eq_preset::name) + 1;
+		eq_set_track_preset(path, next == presets.end() ? "" : next->name);
+	} else if (!for_track) {
+		auto next = std::ranges::find(presets, eq_global_preset(), &eq_preset::name) + 1;
+		eq_set_global_preset(next == presets.end() ? presets.front().name : next->name);
+	}
+
+	if (equalizer != NULL && playing_track < library.size())
+		eq_node_set(equalizer, eq_preset_for(library[playing_track].path).settings);
+	eq_presets_save(eq_presets_file);
+}
+
+static void attach_sound(const library_track& track) {
+// * Sounds go through the time stretch, the EQ and room correction, then the limiter, since gain and boosts can push peaks past full scale
+	if (equalizer != NULL)
+		eq_node_set(equalizer, eq_preset_for(track.path).settings);
+
+	if (time_stretch != NULL) {
+		// * the previous track's windows must not be spliced into this one
+		time_stretch_node_reset(time_stretch);
+		ma_node_attach_output_bus(&sound, 0, (ma_node*)time_stretch, 0);
+	} else if (equalizer != NULL) {
+		ma_node_attach_output_bus(&sound, 0, (ma_node*)equalizer, 0);
+	} else if (room_correction != NULL) {
+		ma_node_attach_output_bus(&sound, 0, (ma_node*)room_correction, 0);
+	} else if (limiter != NULL) {
+		ma_node_attach_output_bus(&sound, 0, (ma_node*)limiter, 0);
+	}
+}
+
+static void play_sound(const library_track& track, bool is_direct_allowed = true) {
+	const std::string& played_file = track.path;
 	ma_sound_uninit(&sound);
+	// * a direct track never inits the sound, zeroed it is safe to uninit again like at startup
+	MA_ZERO_OBJECT(&sound);
+	// * the old source keeps playing until the new one is prefilled, a direct switch is then only silent for the device reopen
+	decode_ahead_source* previous_source = std::exchange(sound_source, NULL);
+	wav_mmap_source* previous_mapping = std::exchange(sound_mapping, NULL);
+
+	auto open_start = std::chrono::steady_clock::now();
+	ma_data_source* data_source = NULL;
+	bool is_direct = false;
+	if (is_direct_allowed && is_transparent(track)) {
+		data_source = open_sound_source(track, true);
+		is_direct = data_source != NULL && output_device_play_direct(data_source);
+		if (!is_direct)
+			close_sound_source();
+	}
+	if (!is_direct) {
+		data_source = open_sound_source(track, false);
+		output_device_play_engine();
+	}
+	decode_ahead_close(previous_source);
+	wav_mmap_close(previous_mapping);
 
-	if (ma_sound_init_from_file(&engine, played_file.c_str(), 0, NULL, NULL, &sound) != MA_SUCCESS) {
+	std::chrono::duration<double, std::milli> open_time = std::chrono::steady_clock::now() - open_start;
+	if (is_direct) {
+		ma_data_source_get_data_format(data_source, NULL, NULL, &direct_sample_rate, NULL, 0);
+	} else if (data_source == NULL || ma_sound_init_from_data_source(&engine, data_source, 0, NULL, &sound) != MA_SUCCESS) {
 		log("CANNOT INIT SOUND", ERROR);
 		log(played_file, INFO);
 		return;
 	}
+	if (!is_direct)
+		attach_sound(track);
+	open_count++;
+	open_total_ms += open_time.count();
 
-	save_sound_length();
+	save_sound_length(data_source);
+	playing_track = &track - library.data();
+	apply_playback_gain();
+	show_waveform(track);
 
-	if (ma_sound_start(&sound) != MA_SUCCESS) {
+	if (!is_direct && ma_sound_start(&sound) != MA_SUCCESS) {
 		log("CANNOT START SOUND", ERROR);
 		log(played_file, INFO);
 		return;
 	}
+	std::chrono::duration<double, std::milli> first_audio = std::chrono::steady_clock::now() - open_start;
+	prefetch_record_first_audio(played_file, first_audio.count());
+	prefetch_following(std::ranges::find(library, played_file, &library_track::path) - library.begin());
+
 	set_song_metadata(played_file);
 	gtk_label_set_text(GTK_LABEL(info_box->title), played_song.title.c_str());
 	gtk_label_set_text(GTK_LABEL(info_box->artist), played_song.author.c_str());
 }
 
+static gboolean reopen_lost_direct(void*) {
+// * The device fell back to the engine's format under a direct track, the same spot goes on through the engine
+	// * another track started meanwhile
+	if (is_sound_init || playing_track >= library.size() || playing_source() == NULL)
+		return G_SOURCE_REMOVE;
+
+	ma_uint64 cursor = 0;
+	ma_data_source_get_cursor_in_pcm_frames(playing_source(), &cursor);
+	double position = double(cursor) / double(sound_length);
+	play_sound(library[playing_track], false);
+	ma_sound_seek_to_pcm_frame(&sound, ma_uint64(position * double(sound_length)));
+	if (is_sound_paused)
+		ma_sound_stop(&sound);
+	return G_SOURCE_REMOVE;
+}
+
+static void on_direct_lost() {
+// * Runs inside output_device_update, the sound was never initialised for the direct track so nothing may read it until it is reopened
+	is_sound_init = false;
+	g_idle_add(reopen_lost_direct, NULL);
+}
+
+static void check_transparency() {
+// * Leaves direct playback for the engine at the same spot as soon as volume, gain or EQ would change the samples
+	if (!output_device_is_direct() || playing_track >= library.size() || is_transparent(library[playing_track]))
+		return;
+
+	double position = double(playback_time_in_pcm_frames()) / double(sound_length);
+	play_sound(library[playing_track]);
+	ma_sound_seek_to_pcm_frame(&sound, ma_uint64(position * double(sound_length)));
+	if (is_sound_paused)
+		ma_sound_stop(&sound);
+}
 
 static void start_next_sound() {
 
 	int selected_row_index = gtk_list_box_row_get_index(selected_row);
 	int new_row_index = selected_row_index + 1;
-	int total_songs = played_file_path.size();
+	int total_songs = library.size();
 
 	if (new_row_index >= total_songs) {
 		new_row_index = 0;
 	}
 
-	play_sound(played_file_path[new_row_index]);
+	play_sound(library[new_row_index]);
 
 	selected_row = gtk_list_box_get_row_at_index(GTK_LIST_BOX(song_list), new_row_index);
 }
@@ -353,7 +859,7 @@ static void start_next_sound() {
 static void select_sound_from_list(GtkButton* button, void* progress_bar) {
 // * Plays the selected song and resets the current_time label to 0:00
 
-	if (played_file_path.size() == 0)
+	if (library.size() == 0)
 		return;
 	is_sound_paused = false;
 
@@ -363,7 +869,7 @@ static void select_sound_from_list(GtkButton* button, void* progress_bar) {
 	
 	ma_engine_set_volume(&engine, volume);
 
-	play_sound(played_file_path[gtk_list_box_row_get_index(selected_row)]);
+	play_sound(library[gtk_list_box_row_get_index(selected_row)]);
 
 	gtk_range_set_value(GTK_RANGE(progress_bar), 0);
 
@@ -382,7 +888,10 @@ static void select_sound_from_list(GtkButton* button, void* progress_bar) {
  * after which it will proceed like normal
  */
 static void sound_continue(GtkButton* button) {
-	ma_sound_start(&sound);
+	if (output_device_is_direct())
+		output_device_pause_direct(false);
+	else
+		ma_sound_start(&sound);
 	is_sound_paused = false;
 	gtk_button_set_label(button, "Pause");
 }
@@ -397,7 +906,10 @@ static void sound_continue(GtkButton* button) {
  * @param button The button widget used for controlling playback.
  */
 static void sound_pause(GtkButton* button) {
-	ma_sound_stop(&sound);
+	if (output_device_is_direct())
+		output_device_pause_direct(true);
+	else
+		ma_sound_stop(&sound);
 	is_sound_paused = true;
 	gtk_button_set_label(button, "Play");
 }
@@ -421,7 +933,7 @@ static void prev_song(GtkButton* , void* ) {
 
 	new_row_index = new_row_index < 0 ? 0 : new_row_index;
 
-	play_sound(played_file_path[new_row_index]);
+	play_sound(library[new_row_index]);
 
 	selected_row = gtk_list_box_get_row_at_index(GTK_LIST_BOX(song_list), new_row_index);
 }
@@ -441,7 +953,13 @@ static void on_timestamp_change(GtkRange* progress_bar, void*) {
 	if (!is_sound_init)
 		return;
 	double value = gtk_range_get_value(progress_bar);
-	ma_sound_seek_to_pcm_frame(&sound, value * sound_length);
+	if (output_device_is_direct()) {
+		output_device_seek_direct(value * sound_length);
+	} else {
+		ma_sound_seek_to_pcm_frame(&sound, value * sound_length);
+		if (time_stretch != NULL)
+			time_stretch_node_reset(time_stretch);
+	}
 }
 
 
@@ -459,21 +977,22 @@ static gboolean progress_bar_tick(GtkWidget* progress_bar, GdkFrameClock* , void
 	if (is_sound_paused)
 		return G_SOURCE_CONTINUE;
 
-	if (ma_sound_at_end(&sound)) {
+	if (output_device_is_direct() ? output_device_direct_at_end() : ma_sound_at_end(&sound)) {
 		start_next_sound();
 		gtk_range_set_value(GTK_RANGE(progress_bar), 0);
 	}
 	
 	auto bar = GTK_RANGE(progress_bar);
 	auto labels = (timestamp_labels *) data;
-	double value = double (ma_sound_get_time_in_pcm_frames(&sound)) / double(sound_length);
+	ma_uint64 current_frame = playback_time_in_pcm_frames();
+	double value = double (current_frame) / double(sound_length);
 
 	// if (value == 0)
 	// 	log(played_song.title);
 
 	gtk_label_set_text(GTK_LABEL(labels->end), end_time.c_str());
 
-	double current_ms = double (ma_sound_get_time_in_milliseconds(&sound));
+	double current_ms = output_device_is_direct() ? double(current_frame) * 1000 / direct_sample_rate : double (ma_sound_get_time_in_milliseconds(&sound));
 	int current_s = current_ms / 1000;
 	int current_min = current_s / 60;
 	
@@ -510,9 +1029,10 @@ static void on_volume_change(GtkRange* range, void* volume_data) {
 	volume = gtk_range_get_value(range) / 100;
 	change_volume_icon(data);
 	ma_engine_set_volume(&engine, volume);
+	check_transparency();
 }
 
-static gboolean on_key_pressed(GtkEventControllerKey* , int keyval, int, GdkModifierType, void* data) {
+static gboolean on_key_pressed(GtkEventControllerKey* , int keyval, int, GdkModifierType modifiers, void* data) {
 	auto song_data = (song_controller*) data;
 
 	if (!song_data) {
@@ -546,6 +1066,37 @@ static gboolean on_key_pressed(GtkEventControllerKey* , int keyval, int, GdkModi
 			volume -= 0.1;
 			if (volume < 0.0) volume = 0.0;
 			break;
+		case GDK_KEY_F3:
+			gtk_widget_set_visible(stats_overlay, !gtk_widget_get_visible(stats_overlay));
+			break;
+		case GDK_KEY_F4:
+			hide_duplicates = !hide_duplicates;
+			refresh_song_store();
+			break;
+		case GDK_KEY_F5:
+			normalize = normalize == normalization::OFF ? normalization::TRACK
+				: normalize == normalization::TRACK ? normalization::ALBUM : normalization::OFF;
+			apply_playback_gain();
+			break;
+		case GDK_KEY_F6:
+			cycle_eq_preset((modifiers & GDK_SHIFT_MASK) != 0);
+			break;
+		case GDK_KEY_F7:
+			if (spectrum != NULL)
+				gtk_widget_set_visible(spectrum, !gtk_widget_get_visible(spectrum));
+			break;
+		case GDK_KEY_F8:
+			sort_by_length = !sort_by_length;
+			refresh_song_store();
+			break;
+		case GDK_KEY_bracketleft:
+		case GDK_KEY_bracketright:
+			if (time_stretch != NULL) {
+				float speed = time_stretch_node_get_speed(time_stretch) + (keyval == GDK_KEY_bracketright ? 0.25f : -0.25f);
+				time_stretch_node_set_speed(time_stretch, speed);
+				log(std::format("playback speed {:.2f}x", time_stretch_node_get_speed(time_stretch)), INFO);
+			}
+			break;
 		default:
 			break;
 	}
@@ -557,6 +1108,7 @@ static gboolean on_key_pressed(GtkEventControllerKey* , int keyval, int, GdkModi
 	gtk_range_set_value(GTK_RANGE(song_data->volume_data->scale), volume * 100);
 	change_volume_icon(song_data->volume_data);
 	ma_engine_set_volume(&engine, volume);
+	check_transparency();
 
 	return GDK_EVENT_STOP;
 }
@@ -588,14 +1140,37 @@ static void factory_bind(GtkSignalListItemFactory* , GObject* obj, void*){
 	// if (item == NULL)
 	// 	return;
 	assert(item != NULL);
-	int index = gtk_list_item_get_position(list_item) % 4;
+	int index = gtk_list_item_get_position(list_item) % SONG_COLUMNS;
 	gtk_label_set_text(GTK_LABEL(gtk_list_item_get_child(list_item)) ,((song_row*)item)->info[index].c_str());
 	
 	g_object_unref(item);
 }
 
+static void prefetch_position(guint position) {
+	if (position == GTK_INVALID_LIST_POSITION)
+		return;
+	auto row = (song_row*)g_list_model_get_item(G_LIST_MODEL(song_store), position);
+	if (row == NULL)
+		return;
+	if (row->track < library.size())
+		prefetch_request({library[row->track].path});
+	g_object_unref(row);
+}
+
+static void on_song_hover(GtkEventControllerMotion* , double , double , void* list_item) {
+	prefetch_position(gtk_list_item_get_position(GTK_LIST_ITEM(list_item)));
+}
+
+static void on_song_selected(GtkSingleSelection* selection, GParamSpec* , void* ) {
+	prefetch_position(gtk_single_selection_get_selected(selection));
+}
+
 static void factory_setup(GtkSignalListItemFactory* , GObject* obj, void*) {
-	gtk_list_item_set_child(GTK_LIST_ITEM(obj), gtk_label_new(NULL));
+	GtkWidget* label = gtk_label_new(NULL);
+	GtkEventController* hover = gtk_event_controller_motion_new();
+	g_signal_connect(hover, "enter", G_CALLBACK(on_song_hover), obj);
+	gtk_widget_add_controller(label, hover);
+	gtk_list_item_set_child(GTK_LIST_ITEM(obj), label);
 }
 
 
@@ -632,15 +1207,27 @@ static GtkWidget* create_gui(GtkWidget* window) {
 		.prev_button = gtk_button_new_with_label("Prev"),
 		.next_button = gtk_button_new_with_label("Next"),
 		.open_button = gtk_button_new_with_label("Open"),
-		.progress_bar = gtk_scale_new_with_range(GTK_ORIENTATION_HORIZONTAL, 0, 1, 0.1),
+		.progress_bar = waveform_scale_new(),
 		.volume_data = volume_data,
 	};
 
 	gtk_widget_set_sensitive(song_control->progress_bar, FALSE);
+	seek_bar = song_control->progress_bar;
 
 	GtkWidget* progress_bar_box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5);
 	GtkWidget* control_button_box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5);
 	GtkWidget* scrollable_song_box = gtk_scrolled_window_new();
+	GtkWidget* song_list_overlay = gtk_overlay_new();
+
+	stats_overlay = gtk_label_new("");
+	gtk_widget_add_css_class(stats_overlay, "osd");
+	gtk_widget_add_css_class(stats_overlay, "monospace");
+	gtk_widget_set_halign(stats_overlay, GTK_ALIGN_END);
+	gtk_widget_set_valign(stats_overlay, GTK_ALIGN_START);
+	gtk_widget_set_margin_top(stats_overlay, 6);
+	gtk_widget_set_margin_end(stats_overlay, 6);
+	gtk_widget_set_can_target(stats_overlay, false);
+	gtk_widget_set_visible(stats_overlay, false);
 
 
 
@@ -653,8 +1240,8 @@ static GtkWidget* create_gui(GtkWidget* window) {
 	song_list = gtk_grid_view_new(GTK_SELECTION_MODEL(song_selection), factory);
 
 	gtk_grid_view_set_single_click_activate(GTK_GRID_VIEW(song_list), true);
-	gtk_grid_view_set_max_columns(GTK_GRID_VIEW(song_list), 4);
-	gtk_grid_view_set_min_columns(GTK_GRID_VIEW(song_list), 4);
+	gtk_grid_view_set_max_columns(GTK_GRID_VIEW(song_list), SONG_COLUMNS);
+	gtk_grid_view_set_min_columns(GTK_GRID_VIEW(song_list), SONG_COLUMNS);
 
 	GtkGesture* controller = gtk_gesture_click_new();
 	gtk_gesture_single_set_button(GTK_GESTURE_SINGLE(controller), 0);
@@ -664,7 +1251,7 @@ static GtkWidget* create_gui(GtkWidget* window) {
 
 	gtk_range_set_value(GTK_RANGE(volume_data->scale), volume * 100);
 
-	gtk_widget_set_size_request(song_control->progress_bar, 600, 10);
+	gtk_widget_set_size_request(song_control->progress_bar, 600, 40);
 	gtk_widget_set_size_request(volume_data->scale, 200, 20);
 
 	set_control_box(control_button_box);
@@ -679,6 +1266,7 @@ static GtkWidget* create_gui(GtkWidget* window) {
 
 	g_signal_connect(factory, "setup", G_CALLBACK(factory_setup), NULL);
 	g_signal_connect(factory, "bind", G_CALLBACK(factory_bind), NULL);
+	g_signal_connect(song_selection, "notify::selected", G_CALLBACK(on_song_selected), NULL);
 
 	g_signal_connect(event_controller, "key-pressed", G_CALLBACK(on_key_pressed), song_control);
 	g_signal_connect(window_controller, "key-pressed", G_CALLBACK(on_key_pressed), song_control);
@@ -718,8 +1306,25 @@ static GtkWidget* create_gui(GtkWidget* window) {
 	gtk_box_append(GTK_BOX(progress_bar_box), song_control->progress_bar);
 	gtk_box_append(GTK_BOX(progress_bar_box), labels->end);
 
+	// * shown while no output device could be opened, output_device_update keeps retrying
+	output_warning = gtk_label_new("No audio output device, trying to reopen it");
+	gtk_widget_add_css_class(output_warning, "error");
+	gtk_widget_set_margin_top(output_warning, 6);
+	gtk_widget_set_margin_bottom(output_warning, 6);
+	gtk_widget_set_visible(output_warning, false);
+
 	gtk_box_append(GTK_BOX(main_box), tool_bar);
-	gtk_box_append(GTK_BOX(main_box), scrollable_song_box);
+	gtk_box_append(GTK_BOX(main_box), output_warning);
+	gtk_overlay_set_child(GTK_OVERLAY(song_list_overlay), scrollable_song_box);
+	gtk_overlay_add_overlay(GTK_OVERLAY(song_list_overlay), stats_overlay);
+	gtk_box_append(GTK_BOX(main_box), song_list_overlay);
+	if (output_spectrum != NULL) {
+		spectrum = spectrum_view_new(output_spectrum, output_tap);
+		gtk_widget_set_size_request(spectrum, -1, 64);
+		gtk_widget_set_margin_start(spectrum, 6);
+		gtk_widget_set_margin_end(spectrum, 6);
+		gtk_box_append(GTK_BOX(main_box), spectrum);
+	}
 	gtk_box_append(GTK_BOX(main_box), progress_bar_box);
 	gtk_box_append(GTK_BOX(main_box), control_button_box);
 
@@ -739,26 +1344,267 @@ static void activate_cb (GtkApplication *app)
 	gtk_window_present (GTK_WINDOW (window));
 }
 
-int main(int argc, char* argv[])
-{
+static gboolean update_output_device(void*) {
+	output_device_update();
+	if (output_warning != NULL)
+		gtk_widget_set_visible(output_warning, output_device_stats().is_lost);
+	return G_SOURCE_CONTINUE;
+}
+
+static std::string stats_report() {
+	output_latency_stats latency = output_device_stats();
+	if (latency.is_lost)
+		return std::string("output lost, reopening\n") + audio_stats_report();
+	std::string report = std::format("output {} Hz, {}x{} frames, latency {:.1f}ms, xruns {}, deadline misses {}\n",
+		latency.sample_rate, latency.periods, latency.period_frames, latency.latency_ms, latency.xruns, latency.deadline_misses);
+	if (!latency.is_direct && latency.format != ma_format_f32)
+		report += std::format("output {} {}ch from f32, {} dither, {} kernels\n", ma_get_format_name(latency.format), latency.channels,
+			dither_mode_name(latency.dither), pcm_isa_name(pcm_get_isa()));
+	if (bit_transparent)
+		report += std::format("bit-transparent {}, {} {}ch, {} reopens {:.1f}ms last {:.1f}ms average\n", latency.is_direct ? "on" : "off",
+			ma_get_format_name(latency.format), latency.channels, latency.reconfigures, latency.last_reconfigure_ms, latency.average_reconfigure_ms);
+
+	if (sound_source != NULL) {
+		decode_ahead_stats decode = decode_ahead_get_stats(sound_source);
+		report += std::format("decode-ahead {}/{} frames buffered, underruns {} ({} total)\n",
+			decode.buffered_frames, decode.watermark_frames, decode.underruns, decode_ahead_total_underruns());
+	}
+
+	if (open_count > 0)
+		report += std::format("open {:.2f}ms average over {} tracks\n", open_total_ms / double(open_count), open_count);
+
+	readahead_io_stats io = readahead_vfs_totals(&library_vfs);
+	report += std::format("file I/O {} MiB in {} reads, {:.1f}ms stalled\n",
+		io.bytes_read >> 20, io.syscalls, double(io.stall_ns) / 1e6);
+
+	std::size_t hashed = std::ranges::count_if(library, [](const library_track& track) { return track.content_hash != 0; });
+	std::size_t fingerprinted = std::ranges::count_if(library, [](const library_track& track) { return !track.fingerprint.empty(); });
+	report += std::format("content hash {}/{} tracks, {} fingerprinted, {} duplicate groups{}{}\n", hashed, library.size(), fingerprinted,
+		duplicate_groups.size(), hide_duplicates ? " hidden" : "", job_pool_pending() > 0 ? " (analysing)" : "");
+
+	double library_seconds = 0;
+	std::size_t timed = 0;
+	for (const auto& track : library) {
+		library_seconds += duration_seconds(track.duration);
+		timed += track.duration.frames > 0;
+	}
+	report += std::format("length {} of {}/{} tracks{}\n", format_length(library_seconds), timed, library.size(),
+		sort_by_length ? ", sorted by length" : "");
+
+	std::size_t measured = std::ranges::count_if(library, [](const library_track& track) { return track.loudness.measured; });
+	constexpr std::array<std::string_view, 3> normalization_names = { "off", "track", "album" };
+	report += std::format("loudness {}/{} tracks, {} gain {:+.1f}dB", measured, library.size(), normalization_names[int(normalize)], playback_gain_db);
+	if (playing_track < library.size() && library[playing_track].loudness.measured) {
+		const track_loudness& loudness = library[playing_track].loudness;
+		report += std::format(" ({:.1f} LUFS, {:.1f} LU range, {:.1f} dBTP)", loudness.integrated, loudness.range, loudness.true_peak);
+	}
+	report += "\n";
+
+	if (equalizer != NULL && playing_track < library.size()) {
+		bool own_preset = !eq_track_preset(library[playing_track].path).empty();
+		report += std::format("eq {} ({})\n", eq_preset_for(library[playing_track].path).name, own_preset ? "track" : "global");
+	}
+
+	if (limiter != NULL) {
+		limiter_stats limiting = limiter_node_get_stats(limiter);
+		report += std::format("limiter {:.1f}% of frames, {:.1f}dB at most, {:.1f}ms look-ahead\n",
+			limiting.frames > 0 ? 100.0 * double(limiting.limited_frames) / double(limiting.frames) : 0.0, limiting.max_reduction_db,
+			1000.0 * limiting.latency_frames / ma_engine_get_sample_rate(&engine));
+	}
+
+	if (time_stretch != NULL) {
+		time_stretch_stats stretching = time_stretch_node_get_stats(time_stretch);
+		report += std::format("speed {:.2f}x, {} blocks of {} frames, {:.1f}us per block\n",
+			stretching.speed, stretching.blocks, stretching.block_frames, stretching.us_per_block);
+	}
+
+	if (room_correction != NULL) {
+		convolution_stats convolution = convolution_node_get_stats(room_correction);
+		report += std::format("room correction {} partitions of {}, {:.1f}us head {:.1f}us tail per channel, {} tail misses\n",
+			convolution.partitions, convolution.block_frames, convolution.head_us_per_channel, convolution.tail_us_per_channel,
+			convolution.tail_misses);
+	}
+
+	prefetch_stats prefetch = prefetch_get_stats();
+	report += std::format("prefetch {} tracks {} MiB, first audio {:.1f}ms on {} hits, {:.1f}ms on {} misses\n",
+		prefetch.prefetched_tracks, prefetch.prefetched_bytes >> 20, prefetch.hit_first_audio_ms, prefetch.hits,
+		prefetch.miss_first_audio_ms, prefetch.misses);
+	return report + audio_stats_report();
+}
+
+static gboolean update_stats(void*) {
+// * Prints the callback stats for --stats and refreshes the overlay when it is shown (F3)
+	update_duplicate_groups();
+
+	if (print_stats)
+		std::cout << stats_report() << std::endl;
+
+	if (stats_overlay != NULL && gtk_widget_get_visible(stats_overlay)) {
+		std::string report = stats_report();
+		report.pop_back();
+		gtk_label_set_text(GTK_LABEL(stats_overlay), report.c_str());
+	}
+	return G_SOURCE_CONTINUE;
+}
+
+static const GOptionEntry option_entries[] = {
+	{ "stats", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_NONE, &print_stats, "Print audio callback statistics every second", NULL },
+	{ "rt-check", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_NONE, &run_rt_check, "Check that the audio thread never allocates or locks, then exit", NULL },
+	{ "decode-ahead-ms", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_INT, &decode_ahead_ms, "Milliseconds of audio decoded ahead of playback", "MS" },
+	{ "bench", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_STRING, &bench_name, "Run a benchmark and exit (list shows them all)", "NAME" },
+	{ "bench-input", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_FILENAME, &bench_input, "File or folder used by the benchmark", "PATH" },
+	{ "room-correction", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_FILENAME, &impulse_path, "Convolve playback with this impulse response", "PATH" },
+	{ "resampler", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_STRING, &resampler_name, "Resampling to the output rate: fast, standard, high (default) or linear", "QUALITY" },
+	{ "downmix", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_STRING, &downmix_name, "Matrix for multichannel files: itu (default) or headphones", "MATRIX" },
+	{ "dither", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_STRING, &dither_name, "Dither towards an integer output format: none, tpdf (default) or shaped", "MODE" },
+	{ "bit-transparent", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_NONE, &bit_transparent, "At full volume with no gain or EQ, reopen the output in each track's own rate and format", NULL },
+	{ NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL },
+};
+
+static void startup_cb(GApplication*) {
+// * Opens the output device and the engine once the primary instance starts
 
 	ma_engine_config engineConfig = ma_engine_config_init();
-	ma_resource_manager resource_manager;
 	auto resource_manager_config = ma_resource_manager_config_init();
 
+	readahead_vfs_init(&library_vfs, readahead_vfs_config{});
+	resource_manager_config.pVFS = &library_vfs;
+
 	ma_resource_manager_init(&resource_manager_config, &resource_manager);
 	engineConfig.pResourceManager = &resource_manager;
 
+	decode_config.watermark_ms = std::max(decode_ahead_ms, 100);
+	decode_config.vfs = &library_vfs;
+
+	dither_mode dither = dither_mode::TPDF;
+	if (dither_name != NULL && !dither_mode_from_name(dither_name, dither))
+		log(std::format("unknown dither {}, using {}", dither_name, dither_mode_name(dither)), WARNING);
+	output_device_set_dither(dither);
+
+	output_latency_config latency_config;
+	if (!output_device_init(latency_config)) {
+		log("failed to open the output device", ERROR);
+		std::abort();
+	}
+	engineConfig.pDevice = output_device_get();
+
 	if (ma_engine_init(&engineConfig, &engine) != MA_SUCCESS) {
 		log("failed to init engine from miniaudio", ERROR);
 		std::abort();
 	}
+	// * files at another rate are resampled on the decode thread, so the engine's linear interpolation never runs
+	if (resampler_name == NULL || std::string_view(resampler_name) != "linear") {
+		if (resampler_name != NULL && !resample_quality_from_name(resampler_name, decode_config.quality))
+			log(std::format("unknown resampler {}, using {}", resampler_name, resample_quality_name(decode_config.quality)), WARNING);
+		decode_config.output_sample_rate = ma_engine_get_sample_rate(&engine);
+	}
+	// * and multichannel files are downmixed there too, before resampling, instead of by the engine's generic converter
+	if (downmix_name != NULL && !downmix_matrix_from_name(downmix_name, decode_config.downmix))
+		log(std::format("unknown downmix {}, using {}", downmix_name, downmix_matrix_name(decode_config.downmix)), WARNING);
+	decode_config.output_channels = ma_engine_get_channels(&engine);
+
+	// * the visualizer taps what leaves the limiter, just before the endpoint
+	ma_node* engine_output = ma_engine_get_endpoint(&engine);
+	output_tap = spectrum_tap_create(ma_engine_get_node_graph(&engine), ma_engine_get_channels(&engine));
+	if (output_tap != NULL) {
+		ma_node_attach_output_bus((ma_node*)output_tap, 0, engine_output, 0);
+		engine_output = (ma_node*)output_tap;
+		output_spectrum = spectrum_analyser_create(output_tap, ma_engine_get_sample_rate(&engine), 64);
+	}
+
+	limiter_config limiter_settings;
+	limiter_settings.channels = ma_engine_get_channels(&engine);
+	limiter_settings.sample_rate = ma_engine_get_sample_rate(&engine);
+	limiter = limiter_node_create(ma_engine_get_node_graph(&engine), limiter_settings);
+	if (limiter != NULL)
+		ma_node_attach_output_bus((ma_node*)limiter, 0, engine_output, 0);
+	else
+		log("failed to create the limiter, playing without it", WARNING);
+
+	ma_node* after_equalizer = limiter != NULL ? (ma_node*)limiter : engine_output;
+	if (impulse_path != NULL) {
+		room_correction = convolution_node_create(ma_engine_get_node_graph(&engine), limiter_settings.channels, limiter_settings.sample_rate, impulse_path);
+		if (room_correction != NULL) {
+			ma_node_attach_output_bus((ma_node*)room_correction, 0, after_equalizer, 0);
+			after_equalizer = (ma_node*)room_correction;
+		} else {
+			log(std::format("failed to load the impulse response {}, playing without room correction", impulse_path), WARNING);
+		}
+	}
+
+	equalizer = eq_node_create(ma_engine_get_node_graph(&engine), limiter_settings.channels, limiter_settings.sample_rate);
+	if (equalizer != NULL)
+		ma_node_attach_output_bus((ma_node*)equalizer, 0, after_equalizer, 0);
+	else
+		log("failed to create the equalizer, playing without it", WARNING);
+
+	time_stretch = time_stretch_node_create(ma_engine_get_node_graph(&engine), limiter_settings.channels, limiter_settings.sample_rate);
+	if (time_stretch != NULL)
+		ma_node_attach_output_bus((ma_node*)time_stretch, 0, equalizer != NULL ? (ma_node*)equalizer : after_equalizer, 0);
+	else
+		log("failed to create the time stretch, playing at 1x only", WARNING);
+
+	output_device_attach(&engine);
+	output_device_on_direct_lost(on_direct_lost);
+	g_timeout_add(500, update_output_device, NULL);
+
+	g_timeout_add(1000, update_stats, NULL);
+
+	prefetch_start(prefetch_config{});
+
+	std::string cache_directory = std::format("{}/aurabeat", g_get_user_cache_dir());
+	g_mkdir_with_parents(cache_directory.c_str(), 0700);
+	library_cache_file = cache_directory + "/library.tsv";
+	library_cache_load(library_cache_file);
+	waveform_directory = cache_directory + "/waveforms";
+	g_mkdir_with_parents(waveform_directory.c_str(), 0700);
+
+	std::string config_directory = std::format("{}/aurabeat", g_get_user_config_dir());
+	g_mkdir_with_parents(config_directory.c_str(), 0700);
+	eq_presets_file = config_directory + "/eq.tsv";
+	eq_presets_load(eq_presets_file);
+	// * analysis decodes whole tracks, one per core in use keeps the idle pool busy without hogging the machine
+	job_pool_start(std::max(2u, std::thread::hardware_concurrency() / 2));
+	g_timeout_add_seconds(60, save_library_cache, NULL);
+}
+
+static void shutdown_cb(GApplication*) {
+	job_pool_stop();
+	library_cache_save(library_cache_file);
+	prefetch_stop();
+	ma_sound_uninit(&sound);
+	close_sound_source();
+	time_stretch_node_destroy(time_stretch);
+	eq_node_destroy(equalizer);
+	convolution_node_destroy(room_correction);
+	limiter_node_destroy(limiter);
+	spectrum_analyser_destroy(output_spectrum);
+	spectrum_tap_destroy(output_tap);
+	ma_engine_uninit(&engine);
+	ma_resource_manager_uninit(&resource_manager);
+	output_device_uninit();
+}
+
+static int handle_local_options(GApplication*, GVariantDict*, void*) {
+// * Diagnostic modes run before the engine is opened and exit with their own status
+	if (run_rt_check)
+		return rt_check_run();
+	if (bench_name != NULL)
+		return run_bench(bench_name, bench_input != NULL ? bench_input : "");
+	return -1;
+}
+
+int main(int argc, char* argv[])
+{
 	auto app = adw_application_new("org.player.audio", G_APPLICATION_DEFAULT_FLAGS);
+	g_application_add_main_option_entries(G_APPLICATION(app), option_entries);
 
+	g_signal_connect (app, "handle-local-options", G_CALLBACK (handle_local_options), NULL);
+	g_signal_connect (app, "startup", G_CALLBACK (startup_cb), NULL);
+	g_signal_connect (app, "shutdown", G_CALLBACK (shutdown_cb), NULL);
 	g_signal_connect (app, "activate", G_CALLBACK (activate_cb), NULL);
 
 	int result_code = g_application_run(G_APPLICATION (app), argc, argv);
-	ma_engine_uninit(&engine);
 
 	return result_code;
 }
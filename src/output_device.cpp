@@ -0,0 +1,457 @@
+#include "output_device.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <algorithm>
+#include <vector>
+
+#include "Logger.hpp"
+#include "audio_stats.hpp"
+#include "rt_check.hpp"
+
+static ma_context output_context;
+static ma_device output_device;
+static ma_device_config device_config;
+// * device_config as the engine needs it, restored when direct playback ends
+static ma_device_config engine_device_config;
+static output_latency_config latency_config;
+static bool is_output_init = false;
+// * false once every reopen failed, output_device_update then keeps trying the engine's configuration
+static bool is_device_open = false;
+static bool is_start_pending = false;
+
+static ma_uint32 period_ms = 0;
+static ma_uint64 resize_count = 0;
+
+static std::atomic<ma_engine*> output_engine = NULL;
+static std::atomic<ma_uint64> xrun_count = 0;
+static std::atomic<ma_uint64> deadline_miss_count = 0;
+
+static std::atomic<dither_mode> output_dither = dither_mode::TPDF;
+// * only touched by the device thread: the engine's f32 before quantizing, sized when the device opens
+static std::vector<float> engine_frames;
+static dither_state output_dither_state;
+
+constexpr ma_uint64 NO_SEEK = ~ma_uint64(0);
+
+// * while set the callback plays this source instead of the engine, in the format the device was reopened with
+static std::atomic<ma_data_source*> direct_source = NULL;
+// * raised around every use of direct_source, so a swap can wait until the callback let go of the old one
+static std::atomic<bool> is_reading_direct = false;
+static std::atomic<ma_uint64> direct_seek_target = NO_SEEK;
+static std::atomic<bool> is_direct_paused = false;
+static std::atomic<bool> is_direct_at_end = false;
+static void (*direct_lost_callback)() = NULL;
+
+static ma_uint64 reconfigure_count = 0;
+static double last_reconfigure_ms = 0;
+static double total_reconfigure_ms = 0;
+
+// * only touched by the device thread, reset while the device is closed
+static ma_uint64 last_callback_ns = 0;
+
+static ma_uint64 handled_xruns = 0;
+static ma_uint64 handled_misses = 0;
+static std::chrono::steady_clock::time_point last_trouble;
+
+static ma_uint64 now_ns() {
+	auto now = std::chrono::steady_clock::now().time_since_epoch();
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+}
+
+static ma_uint32 count_silent_frames(const void* frames, ma_uint32 frame_count, ma_uint32 bytes_per_frame) {
+	const unsigned char* bytes = (const unsigned char*)frames;
+	ma_uint32 silent = 0;
+
+	for (ma_uint32 frame = 0; frame < frame_count; frame++) {
+		bool is_silent = true;
+		for (ma_uint32 i = 0; i < bytes_per_frame && is_silent; i++)
+			is_silent = bytes[i] == 0;
+		silent += is_silent;
+		bytes += bytes_per_frame;
+	}
+	return silent;
+}
+
+/** @brief Direct playback: the source is read as it is, anything it can't fill stays silent. */
+static void read_direct(ma_data_source* source, ma_device* device, void* output, ma_uint32 frame_count) {
+	ma_format format = device->playback.format;
+	ma_uint32 channels = device->playback.channels;
+
+	ma_uint64 target = direct_seek_target.exchange(NO_SEEK, std::memory_order_acquire);
+	if (target != NO_SEEK) {
+		ma_data_source_seek_to_pcm_frame(source, target);
+		is_direct_at_end.store(false, std::memory_order_relaxed);
+	}
+
+	ma_uint64 frames_read = 0;
+	if (!is_direct_paused.load(std::memory_order_relaxed) && !is_direct_at_end.load(std::memory_order_relaxed)) {
+		ma_data_source_read_pcm_frames(source, output, frame_count, &frames_read);
+		if (frames_read < frame_count)
+			is_direct_at_end.store(true, std::memory_order_release);
+	}
+	ma_silence_pcm_frames(ma_offset_pcm_frames_ptr(output, frames_read, format, channels), frame_count - frames_read, format, channels);
+}
+
+/** @brief The engine mixes in f32, an integer device gets it quantized in chunks of engine_frames. */
+static void read_engine_quantized(ma_engine* engine, ma_device* device, void* output, ma_uint32 frame_count) {
+	ma_format format = device->playback.format;
+	ma_uint32 channels = device->playback.channels;
+	ma_uint32 chunk_frames = ma_uint32(engine_frames.size() / channels);
+	dither_mode dither = output_dither.load(std::memory_order_relaxed);
+
+	for (ma_uint32 done = 0; done < frame_count;) {
+		ma_uint32 frames = std::min(frame_count - done, chunk_frames);
+		ma_engine_read_pcm_frames(engine, engine_frames.data(), frames, NULL);
+		pcm_f32_to_int(ma_offset_pcm_frames_ptr(output, done, format, channels), format, engine_frames.data(), frames, channels, dither,
+			output_dither_state);
+		done += frames;
+	}
+}
+
+/**
+ * @brief Device data callback, pulls the engine (or the direct source) and watches the callback cadence.
+ *
+ * A callback arriving later than the whole device buffer means the backend ran dry (xrun).
+ * A callback arriving more than half a period late, or taking longer than its own period,
+ * is counted as a deadline miss.
+ */
+static void output_data_callback(ma_device* device, void* output, const void*, ma_uint32 frame_count) {
+	rt_check_enter();
+	ma_uint64 start = now_ns();
+	ma_uint64 period_ns = ma_uint64(frame_count) * 1000000000 / device->sampleRate;
+	ma_uint64 buffer_ns = ma_uint64(device->playback.internalPeriodSizeInFrames) * device->playback.internalPeriods * 1000000000 / device->sampleRate;
+
+	if (last_callback_ns != 0) {
+		ma_uint64 gap = start - last_callback_ns;
+		if (gap > buffer_ns)
+			xrun_count.fetch_add(1, std::memory_order_relaxed);
+		else if (gap > period_ns * 3 / 2)
+			deadline_miss_count.fetch_add(1, std::memory_order_relaxed);
+	}
+	last_callback_ns = start;
+
+	// * sequentially consistent with the store in swap_direct_source, one of the two sides sees the other
+	is_reading_direct.store(true);
+	ma_data_source* source = direct_source.load();
+	if (source != NULL)
+		read_direct(source, device, output, frame_count);
+	is_reading_direct.store(false, std::memory_order_release);
+
+	if (source == NULL) {
+		ma_engine* engine = output_engine.load(std::memory_order_acquire);
+		if (engine == NULL)
+			ma_silence_pcm_frames(output, frame_count, device->playback.format, device->playback.channels);
+		else if (device->playback.format == ma_format_f32)
+			ma_engine_read_pcm_frames(engine, output, frame_count, NULL);
+		else
+			read_engine_quantized(engine, device, output, frame_count);
+	}
+
+	ma_uint32 bytes_per_frame = ma_get_bytes_per_frame(device->playback.format, device->playback.channels);
+	ma_uint32 silent_frames = count_silent_frames(output, frame_count, bytes_per_frame);
+
+	ma_uint64 duration_ns = now_ns() - start;
+	if (duration_ns > period_ns)
+		deadline_miss_count.fetch_add(1, std::memory_order_relaxed);
+
+	audio_stats_record_callback(duration_ns, period_ns, frame_count, silent_frames);
+	rt_check_leave();
+}
+
+static bool open_device(ma_uint32 new_period_ms) {
+	device_config.periodSizeInMilliseconds = new_period_ms;
+	if (ma_device_init(&output_context, &device_config, &output_device) != MA_SUCCESS)
+		return false;
+
+	is_device_open = true;
+	period_ms = new_period_ms;
+	last_callback_ns = 0;
+	output_dither_state = dither_state{};
+	// * the callback may be asked for more than a period, it then renders in several chunks
+	std::size_t period_samples = std::size_t(std::max(output_device.playback.internalPeriodSizeInFrames, 256u)) * output_device.playback.channels;
+	if (output_device.playback.format != ma_format_f32 && engine_frames.size() < period_samples)
+		engine_frames.resize(period_samples);
+	return true;
+}
+
+static void close_device() {
+	if (!is_device_open)
+		return;
+	ma_device_uninit(&output_device);
+	is_device_open = false;
+}
+
+/**
+ * @brief Last resort once the wanted configuration failed: the engine's own format in shared mode at the
+ * period it started with, on whatever the default device is by now. Without it the device is left
+ * closed and output_device_update tries again.
+ */
+static bool open_fallback_device() {
+	device_config = engine_device_config;
+	// * reopen_device already dropped its source, only a restart under a direct track lands here with one
+	bool was_direct = direct_source.exchange(NULL) != NULL;
+	if (was_direct && direct_lost_callback != NULL)
+		direct_lost_callback();
+
+	ma_uint32 start_period_ms = std::clamp(latency_config.start_period_ms, latency_config.min_period_ms, latency_config.max_period_ms);
+	if (open_device(start_period_ms)) {
+		log("output device reopened with the engine's format and a " + std::to_string(start_period_ms) + "ms period", WARNING);
+		return true;
+	}
+	log("no output device can be opened, retrying", ERROR);
+	return false;
+}
+
+static void restart_device(ma_uint32 new_period_ms) {
+	// * the engine keeps pointing at output_device, only the backend buffers are recreated
+	bool was_started = ma_device_is_started(&output_device);
+	ma_uint32 old_period_ms = period_ms;
+	close_device();
+
+	if (!open_device(new_period_ms)) {
+		log("failed to reopen output device with " + std::to_string(new_period_ms) + "ms period", ERROR);
+		if (!open_device(old_period_ms) && !open_fallback_device()) {
+			is_start_pending = was_started;
+			return;
+		}
+	}
+	if (was_started)
+		ma_device_start(&output_device);
+
+	resize_count++;
+	output_latency_stats stats = output_device_stats();
+	log("output period " + std::to_string(stats.period_frames) + " frames, latency " + std::to_string(stats.latency_ms) + "ms", INFO);
+}
+
+bool output_device_init(const output_latency_config& config, const ma_backend* backends, ma_uint32 backend_count, ma_format format) {
+	latency_config = config;
+
+	if (ma_context_init(backends, backend_count, NULL, &output_context) != MA_SUCCESS) {
+		log("failed to init audio context", ERROR);
+		return false;
+	}
+
+	device_config = ma_device_config_init(ma_device_type_playback);
+	// * by default the native format, so miniaudio has nothing left to convert
+	device_config.playback.format = format;
+	device_config.periods = config.periods;
+	device_config.dataCallback = output_data_callback;
+	device_config.noPreSilencedOutputBuffer = MA_TRUE;
+	device_config.noClip = MA_TRUE;
+	// * callbacks follow the backend period so their cadence can be measured
+	device_config.noFixedSizedCallback = MA_TRUE;
+
+	if (!open_device(std::clamp(config.start_period_ms, config.min_period_ms, config.max_period_ms))) {
+		log("failed to init output device", ERROR);
+		ma_context_uninit(&output_context);
+		return false;
+	}
+
+	// * pin the format so later reopens stay compatible with the engine's node graph
+	device_config.sampleRate = output_device.sampleRate;
+	device_config.playback.format = output_device.playback.format;
+	device_config.playback.channels = output_device.playback.channels;
+	engine_device_config = device_config;
+
+	last_trouble = std::chrono::steady_clock::now();
+	is_output_init = true;
+	return true;
+}
+
+void output_device_set_dither(dither_mode dither) {
+	output_dither.store(dither, std::memory_order_relaxed);
+}
+
+void output_device_uninit() {
+	if (!is_output_init)
+		return;
+	output_engine.store(NULL, std::memory_order_release);
+	close_device();
+	direct_source.store(NULL);
+	ma_context_uninit(&output_context);
+	is_output_init = false;
+}
+
+ma_device* output_device_get() {
+	return &output_device;
+}
+
+void output_device_attach(ma_engine* engine) {
+	output_engine.store(engine, std::memory_order_release);
+}
+
+static void reset_direct_controls() {
+	direct_seek_target.store(NO_SEEK, std::memory_order_relaxed);
+	is_direct_paused.store(false, std::memory_order_relaxed);
+	is_direct_at_end.store(false, std::memory_order_relaxed);
+}
+
+/** @brief Points the running callback at another source and waits until it let go of the previous one. */
+static void swap_direct_source(ma_data_source* source) {
+	direct_source.store(source);
+	while (is_reading_direct.load())
+		std::this_thread::yield();
+	reset_direct_controls();
+}
+
+/**
+ * @brief Reopens the device with device_config and plays source in it, NULL plays the engine.
+ *
+ * Returns false when the backend does not take the format as it is, miniaudio would convert and
+ * that is not bit-transparent; the device is then back on the engine, or closed when even that
+ * fails. The time from closing to restarting is recorded, it is how long the output goes silent.
+ */
+static bool reopen_device(ma_data_source* source) {
+	auto start = std::chrono::steady_clock::now();
+	// * uninit waits for the callback to return, so the source can change without the swap handshake
+	close_device();
+	direct_source.store(NULL);
+
+	bool is_open = open_device(period_ms);
+	if (!is_open && device_config.playback.shareMode == ma_share_mode_exclusive) {
+		// * not every backend has exclusive access, the format check decides whether shared mode will do
+		device_config.playback.shareMode = ma_share_mode_shared;
+		is_open = open_device(period_ms);
+	}
+	bool is_exact = is_open && (source == NULL || (output_device.playback.internalFormat == device_config.playback.format
+		&& output_device.playback.internalChannels == device_config.playback.channels
+		&& output_device.playback.internalSampleRate == device_config.sampleRate));
+	if (!is_exact) {
+		close_device();
+		device_config = engine_device_config;
+		source = NULL;
+		if (!open_device(period_ms) && !open_fallback_device()) {
+			is_start_pending = true;
+			return false;
+		}
+	}
+
+	reset_direct_controls();
+	direct_source.store(source);
+	ma_device_start(&output_device);
+
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+	last_reconfigure_ms = elapsed.count();
+	total_reconfigure_ms += last_reconfigure_ms;
+	reconfigure_count++;
+	return is_exact;
+}
+
+bool output_device_play_direct(ma_data_source* source) {
+	ma_format format;
+	ma_uint32 channels;
+	ma_uint32 sample_rate;
+	if (!is_output_init || !is_device_open || ma_data_source_get_data_format(source, &format, &channels, &sample_rate, NULL, 0) != MA_SUCCESS)
+		return false;
+
+	if (output_device_is_direct() && device_config.playback.format == format && device_config.playback.channels == channels
+		&& device_config.sampleRate == sample_rate) {
+		swap_direct_source(source);
+		return true;
+	}
+
+	device_config.playback.format = format;
+	device_config.playback.channels = channels;
+	device_config.sampleRate = sample_rate;
+	device_config.playback.shareMode = ma_share_mode_exclusive;
+	if (reopen_device(source))
+		return true;
+	log("output device can't play " + std::to_string(sample_rate) + " Hz " + ma_get_format_name(format) + " as it is", INFO);
+	return false;
+}
+
+void output_device_play_engine() {
+	if (!output_device_is_direct())
+		return;
+	device_config = engine_device_config;
+	reopen_device(NULL);
+}
+
+bool output_device_is_direct() {
+	return direct_source.load(std::memory_order_relaxed) != NULL;
+}
+
+void output_device_pause_direct(bool is_paused) {
+	is_direct_paused.store(is_paused, std::memory_order_relaxed);
+}
+
+void output_device_seek_direct(ma_uint64 frame) {
+	direct_seek_target.store(frame, std::memory_order_release);
+}
+
+bool output_device_direct_at_end() {
+	return is_direct_at_end.load(std::memory_order_acquire);
+}
+
+void output_device_on_direct_lost(void (*callback)()) {
+	direct_lost_callback = callback;
+}
+
+void output_device_update() {
+	if (!is_output_init)
+		return;
+	if (!is_device_open) {
+		device_config = engine_device_config;
+		if (!open_device(period_ms))
+			return;
+		log("output device is back", INFO);
+		if (is_start_pending)
+			ma_device_start(&output_device);
+		is_start_pending = false;
+		last_trouble = std::chrono::steady_clock::now();
+		handled_xruns = xrun_count.load(std::memory_order_relaxed);
+		handled_misses = deadline_miss_count.load(std::memory_order_relaxed);
+		return;
+	}
+	if (!latency_config.adaptive)
+		return;
+
+	auto now = std::chrono::steady_clock::now();
+	ma_uint64 xruns = xrun_count.load(std::memory_order_relaxed);
+	ma_uint64 misses = deadline_miss_count.load(std::memory_order_relaxed);
+
+	bool in_trouble = xruns > handled_xruns || misses >= handled_misses + 3;
+	handled_xruns = xruns;
+	handled_misses = misses;
+
+	if (in_trouble) {
+		last_trouble = now;
+		if (period_ms < latency_config.max_period_ms)
+			restart_device(std::min(period_ms * 2, latency_config.max_period_ms));
+		return;
+	}
+
+	if (period_ms > latency_config.min_period_ms && now - last_trouble >= std::chrono::seconds(latency_config.stable_seconds)) {
+		// * wait a whole stable window again before shrinking any further
+		last_trouble = now;
+		restart_device(std::max(period_ms / 2, latency_config.min_period_ms));
+	}
+}
+
+output_latency_stats output_device_stats() {
+	output_latency_stats stats{};
+	if (!is_output_init)
+		return stats;
+	stats.is_lost = !is_device_open;
+	if (stats.is_lost)
+		return stats;
+
+	stats.sample_rate = output_device.sampleRate;
+	stats.period_frames = output_device.playback.internalPeriodSizeInFrames;
+	stats.periods = output_device.playback.internalPeriods;
+	stats.latency_ms = double(stats.period_frames) * stats.periods * 1000.0 / stats.sample_rate;
+	stats.xruns = xrun_count.load(std::memory_order_relaxed);
+	stats.deadline_misses = deadline_miss_count.load(std::memory_order_relaxed);
+	stats.resizes = resize_count;
+	stats.format = output_device.playback.format;
+	stats.channels = output_device.playback.channels;
+	stats.dither = output_dither.load(std::memory_order_relaxed);
+	stats.is_direct = output_device_is_direct();
+	stats.reconfigures = reconfigure_count;
+	stats.last_reconfigure_ms = last_reconfigure_ms;
+	stats.average_reconfigure_ms = reconfigure_count > 0 ? total_reconfigure_ms / double(reconfigure_count) : 0;
+	return stats;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "include/miniaudio.h"
+#include "pcm_convert.hpp"
+
+/**
+ * @brief Tuning knobs for the adaptive output latency controller.
+ *
+ * The controller starts at `start_period_ms`, doubles the device period whenever
+ * xruns are seen and halves it again after `stable_seconds` without any.
+ */
+struct output_latency_config {
+	ma_uint32 min_period_ms = 5;
+	ma_uint32 max_period_ms = 80;
+	ma_uint32 start_period_ms = 10;
+	ma_uint32 periods = 3;
+	ma_uint32 stable_seconds = 30;
+	bool adaptive = true;
+};
+
+struct output_latency_stats {
+	ma_uint32 sample_rate;
+	ma_uint32 period_frames;
+	ma_uint32 periods;
+	double latency_ms;
+	ma_uint64 xruns;
+	ma_uint64 deadline_misses;
+	ma_uint64 resizes;
+	ma_format format;
+	ma_uint32 channels;
+	// * only applies while the engine plays into an integer format
+	dither_mode dither;
+	bool is_direct;
+	// * reopens for a change of rate or format, each one leaves the output silent for a while
+	ma_uint64 reconfigures;
+	double last_reconfigure_ms;
+	double average_reconfigure_ms;
+	// * no device is open, every reopen failed; output_device_update keeps retrying and the rest is zero until then
+	bool is_lost;
+};
+
+/**
+ * @brief The device opens in its native format. For s16/s24/s32 the callback renders the engine
+ * in f32 and quantizes it itself with this dither, rather than leaving miniaudio to truncate.
+ */
+void output_device_set_dither(dither_mode dither);
+
+/** @brief format ma_format_unknown takes the device's native one. */
+bool output_device_init(const output_latency_config& config, const ma_backend* backends = NULL, ma_uint32 backend_count = 0,
+	ma_format format = ma_format_unknown);
+void output_device_uninit();
+
+ma_device* output_device_get();
+void output_device_attach(ma_engine* engine);
+
+/**
+ * @brief Bit-transparent playback: reopens the device at the source's own rate, format and
+ * channels and has the callback read the source itself, with no engine, resampling or volume.
+ *
+ * Returns false and leaves the device on the engine when the backend would convert anyway.
+ * A source in the format already open is swapped in without reopening. Either way, once this
+ * returns the callback no longer reads the previous source, so it can be closed.
+ */
+bool output_device_play_direct(ma_data_source* source);
+/** @brief Back to the engine at its own format, with the same guarantee for the direct source. No-op unless playing direct. */
+void output_device_play_engine();
+bool output_device_is_direct();
+
+/** @brief Direct playback controls, applied by the callback at its next period. */
+void output_device_pause_direct(bool is_paused);
+void output_device_seek_direct(ma_uint64 frame);
+/** @brief True once the direct source ran out, until the next seek or source. */
+bool output_device_direct_at_end();
+/**
+ * @brief Called from output_device_update when a failed reopen had to fall back to the engine's format
+ * while a source played direct. The callback no longer reads that source, the track has to go through the engine.
+ */
+void output_device_on_direct_lost(void (*callback)());
+
+/** @brief Applies pending period changes and reopens a lost device. Must be called periodically from the main thread. */
+void output_device_update();
+
+output_latency_stats output_device_stats();
@@ -0,0 +1,501 @@
+#include "pcm_convert.hpp"
+
+#include <cmath>
+#include <cstring>
+#include <iterator>
+
+/**
+ * @brief 4 lanes are native on every x86-64 and ARM64 CPU, 8 only with AVX. Wider than the
+ * target, GCC splits arithmetic into halves but compares lane by lane, so each build gets its own.
+ */
+template <int LANES>
+struct vectors {
+	typedef float floats __attribute__((vector_size(LANES * 4)));
+	typedef ma_int32 ints __attribute__((vector_size(LANES * 4)));
+	typedef ma_uint32 uints __attribute__((vector_size(LANES * 4)));
+	typedef ma_int16 shorts __attribute__((vector_size(LANES * 2)));
+	typedef unsigned char bytes __attribute__((vector_size(LANES * 4)));
+};
+
+// * samples per step whatever the width, one per generator in dither_state
+constexpr int GROUP = 8;
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define PCM_HAS_AVX2 1
+#define AVX2_TARGET __attribute__((target("avx2")))
+#else
+#define PCM_HAS_AVX2 0
+#endif
+
+// * from 2^23 on every float is a whole number, adding a half there would only round again
+constexpr float WHOLE_FLOATS = 8388608.0f;
+constexpr float SHAPING_ERROR_LIMIT = 1.5f;
+
+static const char* const dither_names[] = { "none", "tpdf", "shaped" };
+static const char* const isa_names[] = { "baseline", "avx2" };
+
+bool dither_mode_from_name(const char* name, dither_mode& mode) {
+	for (int index = 0; index < int(std::size(dither_names)); index++) {
+		if (std::strcmp(name, dither_names[index]) == 0) {
+			mode = dither_mode(index);
+			return true;
+		}
+	}
+	return false;
+}
+
+const char* dither_mode_name(dither_mode mode) {
+	return dither_names[int(mode)];
+}
+
+const char* pcm_isa_name(pcm_isa isa) {
+	return isa_names[int(isa)];
+}
+
+/** @brief Scale from f32 to the format, a power of two so the product is exact. */
+template <ma_format FORMAT>
+constexpr float full_scale() {
+	return FORMAT == ma_format_s16 ? 32768.0f : FORMAT == ma_format_s24 ? 8388608.0f : 2147483648.0f;
+}
+
+/** @brief Largest positive sample as a float, for s32 the last float below 2^31. */
+template <ma_format FORMAT>
+constexpr float largest_sample() {
+	return FORMAT == ma_format_s16 ? 32767.0f : FORMAT == ma_format_s24 ? 8388607.0f : 2147483520.0f;
+}
+
+static float next_uniform(ma_uint32& random) {
+	random ^= random << 13;
+	random ^= random >> 17;
+	random ^= random << 5;
+	return float(ma_int32(random >> 8)) * (1.0f / 16777216);
+}
+
+static float next_tpdf(ma_uint32& random) {
+	float first = next_uniform(random);
+	return first - next_uniform(random);
+}
+
+/** @brief Clamps, NaN included, and rounds half away from zero. */
+template <ma_format FORMAT>
+static ma_int32 quantize(float value) {
+	value = value > -full_scale<FORMAT>() ? value : -full_scale<FORMAT>();
+	value = value < largest_sample<FORMAT>() ? value : largest_sample<FORMAT>();
+	float half = std::fabs(value) < WHOLE_FLOATS ? (value < 0 ? -0.5f : 0.5f) : 0.0f;
+	return ma_int32(value + half);
+}
+
+template <ma_format FORMAT>
+static void store_sample(void* output, ma_uint64 index, ma_int32 sample) {
+	if (FORMAT == ma_format_s16) {
+		((ma_int16*)output)[index] = ma_int16(sample);
+	} else if (FORMAT == ma_format_s24) {
+		auto bytes = (unsigned char*)output + index * 3;
+		bytes[0] = (unsigned char)sample;
+		bytes[1] = (unsigned char)(sample >> 8);
+		bytes[2] = (unsigned char)(sample >> 16);
+	} else {
+		((ma_int32*)output)[index] = sample;
+	}
+}
+
+template <ma_format FORMAT>
+static float load_sample(const void* input, ma_uint64 index) {
+	if (FORMAT == ma_format_s16)
+		return float(((const ma_int16*)input)[index]) * (1.0f / full_scale<FORMAT>());
+	if (FORMAT == ma_format_s24) {
+		auto bytes = (const unsigned char*)input + index * 3;
+		ma_int32 sample = ma_int32(ma_uint32(bytes[0]) << 8 | ma_uint32(bytes[1]) << 16 | ma_uint32(bytes[2]) << 24) >> 8;
+		return float(sample) * (1.0f / full_scale<FORMAT>());
+	}
+	return float(((const ma_int32*)input)[index]) * (1.0f / full_scale<FORMAT>());
+}
+
+/** @brief The shaping filter for one channel, the same steps as the vector loop in quantize_shaped. */
+template <ma_format FORMAT>
+static ma_int32 quantize_shaped_sample(float sample, ma_uint32& random, float& last_error, float& previous_error) {
+	float wanted = sample * full_scale<FORMAT>() - (last_error + last_error - previous_error);
+	ma_int32 quantized = quantize<FORMAT>(wanted + next_tpdf(random));
+	float error = float(quantized) - wanted;
+	error = error > -SHAPING_ERROR_LIMIT ? error : -SHAPING_ERROR_LIMIT;
+	error = error < SHAPING_ERROR_LIMIT ? error : SHAPING_ERROR_LIMIT;
+	previous_error = last_error;
+	last_error = error;
+	return quantized;
+}
+
+template <ma_format FORMAT>
+static void f32_to_int_reference(void* output, const float* input, ma_uint64 frames, ma_uint32 channels, dither_mode dither,
+	dither_state& state) {
+	if (dither == dither_mode::SHAPED && channels <= GROUP) {
+		// * all 8 generators run like in the vector loop, the ones past the channels on silence
+		for (ma_uint64 frame = 0; frame < frames; frame++) {
+			for (ma_uint32 lane = 0; lane < GROUP; lane++) {
+				float sample = lane < channels ? input[frame * channels + lane] : 0.0f;
+				ma_int32 quantized = quantize_shaped_sample<FORMAT>(sample, state.random[lane], state.error[0][lane], state.error[1][lane]);
+				if (lane < channels)
+					store_sample<FORMAT>(output, frame * channels + lane, quantized);
+			}
+		}
+		return;
+	}
+
+	// * sample i of each call draws from generator i % 8, as the vectors do
+	ma_uint64 samples = frames * channels;
+	for (ma_uint64 index = 0; index < samples; index++) {
+		float value = input[index] * full_scale<FORMAT>();
+		if (dither != dither_mode::NONE)
+			value += next_tpdf(state.random[index % 8]);
+		store_sample<FORMAT>(output, index, quantize<FORMAT>(value));
+	}
+}
+
+template <int LANES>
+[[gnu::always_inline]] inline void next_uniforms(typename vectors<LANES>::uints& random, typename vectors<LANES>::floats& uniform) {
+	random ^= random << 13;
+	random ^= random >> 17;
+	random ^= random << 5;
+	uniform = __builtin_convertvector((typename vectors<LANES>::ints)(random >> 8), typename vectors<LANES>::floats) * (1.0f / 16777216);
+}
+
+template <int LANES>
+[[gnu::always_inline]] inline void next_tpdfs(typename vectors<LANES>::uints& random, typename vectors<LANES>::floats& noise) {
+	typename vectors<LANES>::floats first, second;
+	next_uniforms<LANES>(random, first);
+	next_uniforms<LANES>(random, second);
+	noise = first - second;
+}
+
+/** @brief In bits, ?: on vectors is lowered lane by lane more often than not. */
+template <int LANES>
+[[gnu::always_inline]] inline void clamp_lanes(typename vectors<LANES>::floats& value, float lowest, float largest) {
+	typedef typename vectors<LANES>::floats floats;
+	typedef typename vectors<LANES>::ints ints;
+	ints is_above = value > lowest;
+	value = (floats)((is_above & (ints)value) | (~is_above & (ints)(lowest + floats{})));
+	ints is_below = value < largest;
+	value = (floats)((is_below & (ints)value) | (~is_below & (ints)(largest + floats{})));
+}
+
+template <ma_format FORMAT, int LANES>
+[[gnu::always_inline]] inline void quantize_lanes(typename vectors<LANES>::floats& value, typename vectors<LANES>::ints& quantized) {
+	typedef typename vectors<LANES>::floats floats;
+	typedef typename vectors<LANES>::ints ints;
+	const ints sign = ints{} + ma_int32(0x80000000u);
+	clamp_lanes<LANES>(value, -full_scale<FORMAT>(), largest_sample<FORMAT>());
+	// * a half with the value's sign, none from 2^23 on
+	floats magnitude = (floats)((ints)value & ~sign);
+	ints half = ((ints)value & sign) | (ints)(0.5f + floats{});
+	half &= magnitude < WHOLE_FLOATS;
+	quantized = __builtin_convertvector(value + (floats)half, ints);
+}
+
+template <ma_format FORMAT, int LANES>
+[[gnu::always_inline]] inline void store_lanes(void* output, ma_uint64 index, const typename vectors<LANES>::ints& quantized) {
+	if (FORMAT == ma_format_s16) {
+		auto narrow = __builtin_convertvector(quantized, typename vectors<LANES>::shorts);
+		std::memcpy((ma_int16*)output + index, &narrow, sizeof(narrow));
+	} else if (FORMAT == ma_format_s24) {
+		if constexpr (LANES == 8) {
+			// * the low three bytes of each lane, back to back
+			const typename vectors<LANES>::bytes packing = { 0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, 16, 17, 18, 20, 21, 22, 24, 25, 26, 28,
+				29, 30 };
+			auto packed = __builtin_shuffle((typename vectors<LANES>::bytes)quantized, packing);
+			std::memcpy((unsigned char*)output + index * 3, &packed, LANES * 3);
+		} else {
+			// * byte shuffles came with SSSE3, past the baseline
+			for (int lane = 0; lane < LANES; lane++)
+				store_sample<FORMAT>(output, index + lane, quantized[lane]);
+		}
+	} else {
+		std::memcpy((ma_int32*)output + index, &quantized, sizeof(quantized));
+	}
+}
+
+/** @brief No dither or TPDF, a group of samples at a time whatever the channels. */
+template <ma_format FORMAT, int LANES, bool IS_DITHERED>
+[[gnu::always_inline]] inline void quantize_samples(void* output, const float* input, ma_uint64 samples, dither_state& state) {
+	constexpr int PARTS = GROUP / LANES;
+	typename vectors<LANES>::uints random[PARTS];
+	std::memcpy(random, state.random, sizeof(random));
+
+	ma_uint64 index = 0;
+	for (; index + GROUP <= samples; index += GROUP) {
+		for (int part = 0; part < PARTS; part++) {
+			typename vectors<LANES>::floats value;
+			std::memcpy(&value, input + index + part * LANES, sizeof(value));
+			value *= full_scale<FORMAT>();
+			if (IS_DITHERED) {
+				typename vectors<LANES>::floats noise;
+				next_tpdfs<LANES>(random[part], noise);
+				value += noise;
+			}
+			typename vectors<LANES>::ints quantized;
+			quantize_lanes<FORMAT, LANES>(value, quantized);
+			store_lanes<FORMAT, LANES>(output, index + part * LANES, quantized);
+		}
+	}
+
+	std::memcpy(state.random, random, sizeof(random));
+	for (ma_uint64 lane = 0; index < samples; index++, lane++) {
+		float value = input[index] * full_scale<FORMAT>();
+		if (IS_DITHERED)
+			value += next_tpdf(state.random[lane]);
+		store_sample<FORMAT>(output, index, quantize<FORMAT>(value));
+	}
+}
+
+/** @brief The error feedback runs along each channel, so here the group is the channels of one frame. */
+template <ma_format FORMAT, int LANES>
+[[gnu::always_inline]] inline void quantize_shaped(void* output, const float* input, ma_uint64 frames, ma_uint32 channels,
+	dither_state& state) {
+	typedef typename vectors<LANES>::floats floats;
+	typedef typename vectors<LANES>::ints ints;
+	constexpr int PARTS = GROUP / LANES;
+	typename vectors<LANES>::uints random[PARTS];
+	floats last_error[PARTS], previous_error[PARTS];
+	std::memcpy(random, state.random, sizeof(random));
+	std::memcpy(last_error, state.error[0], sizeof(last_error));
+	std::memcpy(previous_error, state.error[1], sizeof(previous_error));
+
+	for (ma_uint64 frame = 0; frame < frames; frame++) {
+		float samples[GROUP] = {};
+		ma_int32 quantized[GROUP];
+		std::memcpy(samples, input + frame * channels, channels * sizeof(float));
+		for (int part = 0; part < PARTS; part++) {
+			floats sample;
+			std::memcpy(&sample, samples + part * LANES, sizeof(sample));
+			floats wanted = sample * full_scale<FORMAT>() - (last_error[part] + last_error[part] - previous_error[part]);
+			floats noise;
+			next_tpdfs<LANES>(random[part], noise);
+			floats value = wanted + noise;
+			ints part_quantized;
+			quantize_lanes<FORMAT, LANES>(value, part_quantized);
+			std::memcpy(quantized + part * LANES, &part_quantized, sizeof(part_quantized));
+
+			floats error = __builtin_convertvector(part_quantized, floats) - wanted;
+			clamp_lanes<LANES>(error, -SHAPING_ERROR_LIMIT, SHAPING_ERROR_LIMIT);
+			previous_error[part] = last_error[part];
+			last_error[part] = error;
+		}
+		for (ma_uint32 channel = 0; channel < channels; channel++)
+			store_sample<FORMAT>(output, frame * channels + channel, quantized[channel]);
+	}
+
+	std::memcpy(state.random, random, sizeof(random));
+	std::memcpy(state.error[0], last_error, sizeof(last_error));
+	std::memcpy(state.error[1], previous_error, sizeof(previous_error));
+}
+
+template <ma_format FORMAT, int LANES>
+[[gnu::always_inline]] inline void f32_to_int(void* output, const float* input, ma_uint64 frames, ma_uint32 channels, dither_mode dither,
+	dither_state& state) {
+	if (dither == dither_mode::SHAPED && channels <= GROUP)
+		quantize_shaped<FORMAT, LANES>(output, input, frames, channels, state);
+	else if (dither == dither_mode::NONE)
+		quantize_samples<FORMAT, LANES, false>(output, input, frames * channels, state);
+	else
+		quantize_samples<FORMAT, LANES, true>(output, input, frames * channels, state);
+}
+
+template <ma_format FORMAT, int LANES>
+[[gnu::always_inline]] inline void int_to_f32(float* output, const void* input, ma_uint64 samples) {
+	typedef typename vectors<LANES>::floats floats;
+	typedef typename vectors<LANES>::ints ints;
+	typedef typename vectors<LANES>::bytes bytes;
+	ma_uint64 index = 0;
+	for (; index + LANES <= samples; index += LANES) {
+		ints sample;
+		if (FORMAT == ma_format_s16) {
+			typename vectors<LANES>::shorts narrow;
+			std::memcpy(&narrow, (const ma_int16*)input + index, sizeof(narrow));
+			sample = __builtin_convertvector(narrow, ints);
+		} else if (FORMAT == ma_format_s24) {
+			if constexpr (LANES == 8) {
+				// * each sample's three bytes go to the top of its lane, the arithmetic shift brings back the sign
+				const bytes unpacking = { 32, 0, 1, 2, 32, 3, 4, 5, 32, 6, 7, 8, 32, 9, 10, 11, 32, 12, 13, 14, 32, 15, 16, 17, 32, 18, 19, 20,
+					32, 21, 22, 23 };
+				bytes packed = {};
+				std::memcpy(&packed, (const unsigned char*)input + index * 3, LANES * 3);
+				sample = (ints)__builtin_shuffle(packed, bytes{}, unpacking) >> 8;
+			} else {
+				auto packed = (const unsigned char*)input + index * 3;
+				for (int lane = 0; lane < LANES; lane++, packed += 3)
+					sample[lane] = ma_int32(ma_uint32(packed[0]) << 8 | ma_uint32(packed[1]) << 16 | ma_uint32(packed[2]) << 24) >> 8;
+			}
+		} else {
+			std::memcpy(&sample, (const ma_int32*)input + index, sizeof(sample));
+		}
+		floats value = __builtin_convertvector(sample, floats) * (1.0f / full_scale<FORMAT>());
+		std::memcpy(output + index, &value, sizeof(value));
+	}
+	for (; index < samples; index++)
+		output[index] = load_sample<FORMAT>(input, index);
+}
+
+typedef void (*to_int_kernel)(void* output, const float* input, ma_uint64 frames, ma_uint32 channels, dither_mode dither,
+	dither_state& state);
+typedef void (*to_f32_kernel)(float* output, const void* input, ma_uint64 samples);
+
+struct pcm_kernels {
+	// * s16, s24, s32
+	to_int_kernel to_int[3];
+	to_f32_kernel to_f32[3];
+};
+
+static int format_index(ma_format format) {
+	return format == ma_format_s16 ? 0 : format == ma_format_s24 ? 1 : format == ma_format_s32 ? 2 : -1;
+}
+
+static void f32_to_s16_baseline(void* output, const float* input, ma_uint64 frames, ma_uint32 channels, dither_mode dither,
+	dither_state& state) {
+	f32_to_int<ma_format_s16, 4>(output, input, frames, channels, dither, state);
+}
+
+static void f32_to_s24_baseline(void* output, const float* input, ma_uint64 frames, ma_uint32 channels, dither_mode dither,
+	dither_state& state) {
+	f32_to_int<ma_format_s24, 4>(output, input, frames, channels, dither, state);
+}
+
+static void f32_to_s32_baseline(void* output, const float* input, ma_uint64 frames, ma_uint32 channels, dither_mode dither,
+	dither_state& state) {
+	f32_to_int<ma_format_s32, 4>(output, input, frames, channels, dither, state);
+}
+
+static void s16_to_f32_baseline(float* output, const void* input, ma_uint64 samples) {
+	int_to_f32<ma_format_s16, 4>(output, input, samples);
+}
+
+static void s24_to_f32_baseline(float* output, const void* input, ma_uint64 samples) {
+	int_to_f32<ma_format_s24, 4>(output, input, samples);
+}
+
+static void s32_to_f32_baseline(float* output, const void* input, ma_uint64 samples) {
+	int_to_f32<ma_format_s32, 4>(output, input, samples);
+}
+
+static const pcm_kernels baseline_kernels = {
+	{ f32_to_s16_baseline, f32_to_s24_baseline, f32_to_s32_baseline },
+	{ s16_to_f32_baseline, s24_to_f32_baseline, s32_to_f32_baseline },
+};
+
+#if PCM_HAS_AVX2
+AVX2_TARGET static void f32_to_s16_avx2(void* output, const float* input, ma_uint64 frames, ma_uint32 channels, dither_mode dither,
+	dither_state& state) {
+	f32_to_int<ma_format_s16, 8>(output, input, frames, channels, dither, state);
+}
+
+AVX2_TARGET static void f32_to_s24_avx2(void* output, const float* input, ma_uint64 frames, ma_uint32 channels, dither_mode dither,
+	dither_state& state) {
+	f32_to_int<ma_format_s24, 8>(output, input, frames, channels, dither, state);
+}
+
+AVX2_TARGET static void f32_to_s32_avx2(void* output, const float* input, ma_uint64 frames, ma_uint32 channels, dither_mode dither,
+	dither_state& state) {
+	f32_to_int<ma_format_s32, 8>(output, input, frames, channels, dither, state);
+}
+
+AVX2_TARGET static void s16_to_f32_avx2(float* output, const void* input, ma_uint64 samples) {
+	int_to_f32<ma_format_s16, 8>(output, input, samples);
+}
+
+AVX2_TARGET static void s24_to_f32_avx2(float* output, const void* input, ma_uint64 samples) {
+	int_to_f32<ma_format_s24, 8>(output, input, samples);
+}
+
+AVX2_TARGET static void s32_to_f32_avx2(float* output, const void* input, ma_uint64 samples) {
+	int_to_f32<ma_format_s32, 8>(output, input, samples);
+}
+
+static const pcm_kernels avx2_kernels = {
+	{ f32_to_s16_avx2, f32_to_s24_avx2, f32_to_s32_avx2 },
+	{ s16_to_f32_avx2, s24_to_f32_avx2, s32_to_f32_avx2 },
+};
+#endif
+
+pcm_isa pcm_isa_detected() {
+#if PCM_HAS_AVX2
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		return pcm_isa::AVX2;
+#endif
+	return pcm_isa::BASELINE;
+}
+
+static const pcm_kernels* kernels_for(pcm_isa isa) {
+#if PCM_HAS_AVX2
+	if (isa == pcm_isa::AVX2)
+		return &avx2_kernels;
+#endif
+	return &baseline_kernels;
+}
+
+// * picked before main runs, only a benchmark changes it afterwards
+static pcm_isa active_isa = pcm_isa_detected();
+static const pcm_kernels* active_kernels = kernels_for(active_isa);
+
+bool pcm_set_isa(pcm_isa isa) {
+	if (isa == pcm_isa::AVX2 && pcm_isa_detected() != pcm_isa::AVX2)
+		return false;
+	active_isa = isa;
+	active_kernels = kernels_for(isa);
+	return true;
+}
+
+pcm_isa pcm_get_isa() {
+	return active_isa;
+}
+
+void pcm_f32_to_int(void* output, ma_format format, const float* input, ma_uint64 frames, ma_uint32 channels, dither_mode dither,
+	dither_state& state) {
+	int index = format_index(format);
+	if (index < 0)
+		ma_convert_pcm_frames_format(output, format, input, ma_format_f32, frames, channels, ma_dither_mode_none);
+	else
+		active_kernels->to_int[index](output, input, frames, channels, dither, state);
+}
+
+void pcm_int_to_f32(float* output, const void* input, ma_format format, ma_uint64 samples) {
+	int index = format_index(format);
+	if (index < 0)
+		ma_pcm_convert(output, ma_format_f32, input, format, samples, ma_dither_mode_none);
+	else
+		active_kernels->to_f32[index](output, input, samples);
+}
+
+void pcm_f32_to_int_reference(void* output, ma_format format, const float* input, ma_uint64 frames, ma_uint32 channels,
+	dither_mode dither, dither_state& state) {
+	switch (format) {
+		case ma_format_s16:
+			f32_to_int_reference<ma_format_s16>(output, input, frames, channels, dither, state);
+			break;
+		case ma_format_s24:
+			f32_to_int_reference<ma_format_s24>(output, input, frames, channels, dither, state);
+			break;
+		case ma_format_s32:
+			f32_to_int_reference<ma_format_s32>(output, input, frames, channels, dither, state);
+			break;
+		default:
+			ma_convert_pcm_frames_format(output, format, input, ma_format_f32, frames, channels, ma_dither_mode_none);
+			break;
+	}
+}
+
+void pcm_int_to_f32_reference(float* output, const void* input, ma_format format, ma_uint64 samples) {
+	for (ma_uint64 index = 0; index < samples; index++) {
+		switch (format) {
+			case ma_format_s16:
+				output[index] = load_sample<ma_format_s16>(input, index);
+				break;
+			case ma_format_s24:
+				output[index] = load_sample<ma_format_s24>(input, index);
+				break;
+			case ma_format_s32:
+				output[index] = load_sample<ma_format_s32>(input, index);
+				break;
+			default:
+				ma_pcm_convert(output, ma_format_f32, input, format, samples, ma_dither_mode_none);
+				return;
+		}
+	}
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "include/miniaudio.h"
+
+/**
+ * @brief Sample format conversion between f32 and s16/s24/s32, with dither towards integers.
+ *
+ * Integers are scaled by powers of two, so s16 and s24 survive a round trip to f32 and
+ * back unchanged, and rounding is to the nearest step rather than truncation. The kernels
+ * are generic 8-wide vector code built once for the baseline and once for AVX2, the set
+ * is picked from the CPU at startup. Each has a scalar reference it matches bit for bit,
+ * the dither generators included.
+ */
+
+enum class dither_mode {
+	NONE,
+	// * triangular noise of +-1 step, the quantization error no longer follows the signal
+	TPDF,
+	// * TPDF with the error fed back through (1 - z^-1)^2, moving the noise floor up out of the band the ear hears best
+	SHAPED,
+};
+
+/** @brief Takes none, tpdf or shaped, false for anything else. */
+bool dither_mode_from_name(const char* name, dither_mode& mode);
+const char* dither_mode_name(dither_mode mode);
+
+enum class pcm_isa {
+	BASELINE,
+	AVX2,
+};
+
+const char* pcm_isa_name(pcm_isa isa);
+/** @brief The best kernel set this CPU runs. */
+pcm_isa pcm_isa_detected();
+/** @brief Overrides the startup pick, for benchmarks. False when the CPU can't run it. */
+bool pcm_set_isa(pcm_isa isa);
+pcm_isa pcm_get_isa();
+
+/** @brief One per output stream, default constructed is a valid start. Shaping keeps up to 8 channels, more are only TPDF. */
+struct dither_state {
+	// * one xorshift generator per vector lane, seeds must not be 0
+	ma_uint32 random[8] = { 0x9E3779B9, 0x7F4A7C15, 0xF39CC060, 0x5CEDC834, 0x2FE12A69, 0xA4093822, 0x299F31D0, 0x082EFA98 };
+	// * per channel, the last two quantization errors
+	float error[2][8] = {};
+};
+
+/** @brief output is s16, packed s24 or s32. Anything else is left to miniaudio, undithered. */
+void pcm_f32_to_int(void* output, ma_format format, const float* input, ma_uint64 frames, ma_uint32 channels, dither_mode dither,
+	dither_state& state);
+/** @brief input is s16, packed s24 or s32. Anything else is left to miniaudio. */
+void pcm_int_to_f32(float* output, const void* input, ma_format format, ma_uint64 samples);
+
+/** @brief One sample at a time, what the kernels are checked against. */
+void pcm_f32_to_int_reference(void* output, ma_format format, const float* input, ma_uint64 frames, ma_uint32 channels,
+	dither_mode dither, dither_state& state);
+void pcm_int_to_f32_reference(float* output, const void* input, ma_format format, ma_uint64 samples);
@@ -0,0 +1,97 @@
+#include "physical_order.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <numeric>
+
+#include <fcntl.h>
+#include <sys/types.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <linux/fiemap.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/sysmacros.h>
+#endif
+
+bool device_is_rotational(ma_uint64 device) {
+#if defined(__linux__)
+	unsigned int major_number = major(dev_t(device));
+	unsigned int minor_number = minor(dev_t(device));
+	if (major_number == 0)
+		return false;
+
+	// * partitions have no queue of their own, the disk they belong to is one level up
+	for (const char* queue : { "queue", "../queue" }) {
+		char path[96];
+		std::snprintf(path, sizeof(path), "/sys/dev/block/%u:%u/%s/rotational", major_number, minor_number, queue);
+		FILE* file = std::fopen(path, "r");
+		if (file == NULL)
+			continue;
+		int rotational = std::fgetc(file);
+		std::fclose(file);
+		return rotational == '1';
+	}
+#else
+	(void)device;
+#endif
+	return false;
+}
+
+std::string device_name(ma_uint64 device) {
+	return std::to_string(major(dev_t(device))) + ":" + std::to_string(minor(dev_t(device)));
+}
+
+/** @brief Physical byte offset of the first extent, 0 for empty or inline files, false when FIEMAP is unsupported. */
+static bool first_extent(const std::string& path, ma_uint64& offset) {
+	offset = 0;
+#if defined(__linux__)
+	int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC | O_NOATIME);
+	if (fd < 0)
+		fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return true;
+
+	alignas(fiemap) unsigned char request[sizeof(fiemap) + sizeof(fiemap_extent)] = {};
+	auto map = (fiemap*)request;
+	map->fm_start = 0;
+	map->fm_length = FIEMAP_MAX_OFFSET;
+	map->fm_extent_count = 1;
+	int result = ioctl(fd, FS_IOC_FIEMAP, map);
+	close(fd);
+
+	if (result != 0)
+		return false;
+	if (map->fm_mapped_extents > 0)
+		offset = map->fm_extents[0].fe_physical;
+	return true;
+#else
+	(void)path;
+	return false;
+#endif
+}
+
+bool locate_physical_offsets(std::vector<scanned_file>& files) {
+	std::vector<std::size_t> by_inode(files.size());
+	std::iota(by_inode.begin(), by_inode.end(), 0);
+	std::ranges::sort(by_inode, {}, [&](std::size_t i) { return files[i].inode; });
+
+	for (std::size_t i : by_inode) {
+		if (!first_extent(files[i].path, files[i].physical_offset)) {
+			for (auto& file : files)
+				file.physical_offset = file.inode;
+			return false;
+		}
+	}
+	return true;
+}
+
+ma_uint64 head_travel(const std::vector<scanned_file>& files) {
+	ma_uint64 travel = 0;
+	for (std::size_t i = 1; i < files.size(); i++) {
+		ma_uint64 from = files[i - 1].physical_offset;
+		ma_uint64 to = files[i].physical_offset;
+		travel += from > to ? from - to : to - from;
+	}
+	return travel;
+}
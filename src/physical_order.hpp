@@ -0,0 +1,51 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "include/miniaudio.h"
+
+/**
+ * @brief On-disk ordering of scanned files, so a spinning disk reads them in one sweep.
+ *
+ * The first data block of every file comes from FIEMAP. Filesystems without it fall
+ * back to the inode number, which on ext4 and xfs roughly follows allocation order.
+ * The lookups run in inode order themselves to keep the inode table reads sequential.
+ */
+
+struct scanned_file {
+	std::string path;
+	ma_uint64 device;
+	ma_uint64 inode;
+	ma_uint64 physical_offset;
+};
+
+/** @brief How the headers of one disk were read, filled by library_scan for every disk scanned in physical order. */
+struct device_scan_report {
+	ma_uint64 device;
+	bool rotational;
+	bool used_fiemap;
+	ma_uint64 files;
+	ma_uint64 bytes_read;
+	// * summed distance between consecutive first blocks, only known with FIEMAP
+	ma_uint64 path_order_travel;
+	ma_uint64 physical_order_travel;
+	ma_uint64 slow_reads;
+	double read_seconds;
+	double slow_read_seconds;
+	double seconds;
+	// * more than half of the read time went to reads that waited on a seek
+	bool seek_bound;
+};
+
+/** @brief True when sysfs says the disk behind device spins, false for SSDs, network and virtual filesystems. */
+bool device_is_rotational(ma_uint64 device);
+
+/** @brief "major:minor" for reports. */
+std::string device_name(ma_uint64 device);
+
+/** @brief Fills physical_offset for every file, returns false when it had to use inode numbers instead. */
+bool locate_physical_offsets(std::vector<scanned_file>& files);
+
+/** @brief Bytes the disk head travels between the first blocks of files, read in the given order. */
+ma_uint64 head_travel(const std::vector<scanned_file>& files);
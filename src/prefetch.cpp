@@ -0,0 +1,148 @@
+#include "prefetch.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+constexpr std::size_t MAX_QUEUED = 16;
+constexpr std::size_t MAX_REMEMBERED = 512;
+
+static prefetch_config config;
+static std::thread worker;
+static std::mutex prefetch_mutex;
+static std::condition_variable queue_changed;
+static std::deque<std::string> queue;
+// * when each path was last warmed, the page cache may have dropped it since
+static std::unordered_map<std::string, std::chrono::steady_clock::time_point> warmed_paths;
+static bool quit = false;
+
+static prefetch_stats stats{};
+static double hit_total_ms = 0;
+static double miss_total_ms = 0;
+
+/** @brief Asks the kernel to pull the head of the file into the page cache, returns the bytes requested. */
+static ma_uint64 warm_file(const std::string& path) {
+	int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return 0;
+
+	struct stat file_stat;
+	if (fstat(fd, &file_stat) != 0) {
+		close(fd);
+		return 0;
+	}
+	ma_uint64 length = std::min<ma_uint64>(file_stat.st_size, config.bytes_per_track);
+
+#if defined(__APPLE__)
+	radvisory advice{ .ra_offset = 0, .ra_count = int(length) };
+	fcntl(fd, F_RDADVISE, &advice);
+#else
+	posix_fadvise(fd, 0, off_t(length), POSIX_FADV_WILLNEED);
+#endif
+	close(fd);
+	return length;
+}
+
+/** @brief True while path was warmed within warm_seconds. */
+static bool is_warm(const std::string& path) {
+	auto warmed = warmed_paths.find(path);
+	return warmed != warmed_paths.end() && std::chrono::steady_clock::now() - warmed->second < std::chrono::seconds(config.warm_seconds);
+}
+
+static void prefetch_loop() {
+	std::unique_lock lock(prefetch_mutex);
+
+	while (true) {
+		queue_changed.wait(lock, [] { return quit || !queue.empty(); });
+		if (quit)
+			return;
+
+		std::string path = std::move(queue.front());
+		queue.pop_front();
+		if (is_warm(path))
+			continue;
+
+		lock.unlock();
+		ma_uint64 bytes = warm_file(path);
+		lock.lock();
+
+		if (bytes == 0)
+			continue;
+		if (warmed_paths.size() >= MAX_REMEMBERED) {
+			auto expired = std::chrono::steady_clock::now() - std::chrono::seconds(config.warm_seconds);
+			std::erase_if(warmed_paths, [&](const auto& warmed) { return warmed.second <= expired; });
+			if (warmed_paths.size() >= MAX_REMEMBERED)
+				warmed_paths.clear();
+		}
+		warmed_paths.insert_or_assign(path, std::chrono::steady_clock::now());
+		stats.prefetched_tracks++;
+		stats.prefetched_bytes += bytes;
+
+		// * stay under the I/O budget, newer requests can still be queued meanwhile
+		auto pause = std::chrono::duration<double>(double(bytes) / double(config.budget_bytes_per_second));
+		queue_changed.wait_for(lock, pause, [] { return quit; });
+	}
+}
+
+void prefetch_start(const prefetch_config& new_config) {
+	config = new_config;
+	quit = false;
+	worker = std::thread(prefetch_loop);
+}
+
+void prefetch_stop() {
+	if (!worker.joinable())
+		return;
+	{
+		std::lock_guard lock(prefetch_mutex);
+		quit = true;
+	}
+	queue_changed.notify_all();
+	worker.join();
+}
+
+const prefetch_config& prefetch_get_config() {
+	return config;
+}
+
+void prefetch_request(const std::vector<std::string>& paths) {
+	{
+		std::lock_guard lock(prefetch_mutex);
+		for (auto path = paths.rbegin(); path != paths.rend(); path++) {
+			if (is_warm(*path))
+				continue;
+			std::erase(queue, *path);
+			queue.push_front(*path);
+		}
+		if (queue.size() > MAX_QUEUED)
+			queue.resize(MAX_QUEUED);
+	}
+	queue_changed.notify_all();
+}
+
+void prefetch_record_first_audio(const std::string& path, double milliseconds) {
+	std::lock_guard lock(prefetch_mutex);
+	if (is_warm(path)) {
+		stats.hits++;
+		hit_total_ms += milliseconds;
+	} else {
+		stats.misses++;
+		miss_total_ms += milliseconds;
+	}
+}
+
+prefetch_stats prefetch_get_stats() {
+	std::lock_guard lock(prefetch_mutex);
+	prefetch_stats result = stats;
+	result.hit_first_audio_ms = stats.hits > 0 ? hit_total_ms / double(stats.hits) : 0;
+	result.miss_first_audio_ms = stats.misses > 0 ? miss_total_ms / double(stats.misses) : 0;
+	return result;
+}
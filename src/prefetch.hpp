@@ -0,0 +1,43 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "include/miniaudio.h"
+
+/**
+ * @brief Background page cache warmer for tracks that are likely to be played next.
+ *
+ * Requests are served newest first by one worker thread, which asks the kernel to read
+ * the head of each file ahead of time while staying under an I/O budget.
+ */
+
+struct prefetch_config {
+	ma_uint32 track_count = 3;
+	ma_uint64 bytes_per_track = 8 * 1024 * 1024;
+	ma_uint64 budget_bytes_per_second = 32 * 1024 * 1024;
+	// * a warmed track is assumed cached for this long, after it is warmed again on request and no longer counts as a hit
+	ma_uint32 warm_seconds = 60;
+};
+
+struct prefetch_stats {
+	ma_uint64 prefetched_tracks;
+	ma_uint64 prefetched_bytes;
+	ma_uint64 hits;
+	ma_uint64 misses;
+	double hit_first_audio_ms;
+	double miss_first_audio_ms;
+};
+
+void prefetch_start(const prefetch_config& config);
+void prefetch_stop();
+
+const prefetch_config& prefetch_get_config();
+
+/** @brief Queues paths in order of likelihood, ahead of anything requested earlier. */
+void prefetch_request(const std::vector<std::string>& paths);
+
+/** @brief Records the time from a track change to decoded audio, split by prefetch hit or miss. */
+void prefetch_record_first_audio(const std::string& path, double milliseconds);
+
+prefetch_stats prefetch_get_stats();
@@ -0,0 +1,194 @@
+#include "readahead_vfs.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+constexpr std::size_t MAX_RECENT_FILES = 32;
+
+struct readahead_file {
+	int fd;
+	std::string path;
+	unsigned char* buffer;
+	ma_uint64 buffer_start;
+	size_t buffer_length;
+	ma_uint64 cursor;
+	ma_uint64 size;
+	readahead_io_stats stats;
+};
+
+/** @brief Counted for the file and for the VFS at once, so the totals don't wait for the file to be closed. */
+static ssize_t timed_pread(readahead_vfs* readahead, readahead_file* file, void* destination, size_t size, ma_uint64 offset) {
+	auto start = std::chrono::steady_clock::now();
+	ssize_t result = pread(file->fd, destination, size, off_t(offset));
+	ma_uint64 stall_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+	ma_uint64 bytes = result > 0 ? ma_uint64(result) : 0;
+
+	file->stats.syscalls++;
+	file->stats.stall_ns += stall_ns;
+	file->stats.bytes_read += bytes;
+	readahead->syscalls.fetch_add(1, std::memory_order_relaxed);
+	readahead->stall_ns.fetch_add(stall_ns, std::memory_order_relaxed);
+	readahead->bytes_read.fetch_add(bytes, std::memory_order_relaxed);
+	return result;
+}
+
+static ma_result readahead_open(ma_vfs* vfs, const char* path, ma_uint32 mode, ma_vfs_file* out_file) {
+	auto readahead = (readahead_vfs*)vfs;
+	*out_file = NULL;
+	if ((mode & MA_OPEN_MODE_WRITE) != 0)
+		return MA_NOT_IMPLEMENTED;
+
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return errno == ENOENT ? MA_DOES_NOT_EXIST : MA_ERROR;
+
+	struct stat file_stat;
+	if (fstat(fd, &file_stat) != 0) {
+		close(fd);
+		return MA_ERROR;
+	}
+
+	void* buffer = NULL;
+	if (posix_memalign(&buffer, readahead->config.alignment, readahead->config.buffer_size) != 0) {
+		close(fd);
+		return MA_OUT_OF_MEMORY;
+	}
+
+#if !defined(__APPLE__)
+	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+	*out_file = new readahead_file{
+		.fd = fd,
+		.path = path,
+		.buffer = (unsigned char*)buffer,
+		.buffer_start = 0,
+		.buffer_length = 0,
+		.cursor = 0,
+		.size = ma_uint64(file_stat.st_size),
+		.stats = {},
+	};
+	return MA_SUCCESS;
+}
+
+static ma_result readahead_close(ma_vfs* vfs, ma_vfs_file handle) {
+	auto readahead = (readahead_vfs*)vfs;
+	auto file = (readahead_file*)handle;
+	{
+		std::lock_guard lock(readahead->recent_mutex);
+		if (readahead->recent_files.size() == MAX_RECENT_FILES)
+			readahead->recent_files.erase(readahead->recent_files.begin());
+		readahead->recent_files.push_back({ file->path, file->stats });
+	}
+
+	close(file->fd);
+	std::free(file->buffer);
+	delete file;
+	return MA_SUCCESS;
+}
+
+static ma_result readahead_read(ma_vfs* vfs, ma_vfs_file handle, void* destination, size_t size, size_t* bytes_read) {
+	auto readahead = (readahead_vfs*)vfs;
+	auto file = (readahead_file*)handle;
+	auto output = (unsigned char*)destination;
+	size_t total = 0;
+
+	while (total < size && file->cursor < file->size) {
+		ma_uint64 buffer_end = file->buffer_start + file->buffer_length;
+
+		if (file->cursor >= file->buffer_start && file->cursor < buffer_end) {
+			size_t available = size_t(buffer_end - file->cursor);
+			size_t count = std::min(available, size - total);
+			std::memcpy(output + total, file->buffer + (file->cursor - file->buffer_start), count);
+			file->cursor += count;
+			total += count;
+			continue;
+		}
+
+		// * reads bigger than the buffer go straight to the destination
+		if (size - total >= readahead->config.buffer_size) {
+			ssize_t result = timed_pread(readahead, file, output + total, size - total, file->cursor);
+			if (result <= 0)
+				break;
+			file->cursor += ma_uint64(result);
+			total += size_t(result);
+			continue;
+		}
+
+		ma_uint64 aligned_start = file->cursor - file->cursor % readahead->config.alignment;
+		ssize_t result = timed_pread(readahead, file, file->buffer, readahead->config.buffer_size, aligned_start);
+		if (result <= 0 || aligned_start + ma_uint64(result) <= file->cursor)
+			break;
+		file->buffer_start = aligned_start;
+		file->buffer_length = size_t(result);
+	}
+
+	if (bytes_read != NULL)
+		*bytes_read = total;
+	return (total == 0 && size > 0) ? MA_AT_END : MA_SUCCESS;
+}
+
+static ma_result readahead_seek(ma_vfs* , ma_vfs_file handle, ma_int64 offset, ma_seek_origin origin) {
+	auto file = (readahead_file*)handle;
+	ma_int64 base = 0;
+	if (origin == ma_seek_origin_current)
+		base = ma_int64(file->cursor);
+	else if (origin == ma_seek_origin_end)
+		base = ma_int64(file->size);
+
+	if (base + offset < 0)
+		return MA_INVALID_ARGS;
+	file->cursor = ma_uint64(base + offset);
+	return MA_SUCCESS;
+}
+
+static ma_result readahead_tell(ma_vfs* , ma_vfs_file handle, ma_int64* cursor) {
+	*cursor = ma_int64(((readahead_file*)handle)->cursor);
+	return MA_SUCCESS;
+}
+
+static ma_result readahead_info(ma_vfs* , ma_vfs_file handle, ma_file_info* info) {
+	info->sizeInBytes = ((readahead_file*)handle)->size;
+	return MA_SUCCESS;
+}
+
+ma_result readahead_vfs_init(readahead_vfs* vfs, const readahead_vfs_config& config) {
+	if (config.alignment == 0 || config.buffer_size % config.alignment != 0)
+		return MA_INVALID_ARGS;
+
+	vfs->cb = {
+		readahead_open,
+		NULL,
+		readahead_close,
+		readahead_read,
+		NULL,
+		readahead_seek,
+		readahead_tell,
+		readahead_info,
+	};
+	vfs->config = config;
+	vfs->bytes_read = 0;
+	vfs->syscalls = 0;
+	vfs->stall_ns = 0;
+	return MA_SUCCESS;
+}
+
+readahead_io_stats readahead_vfs_totals(readahead_vfs* vfs) {
+	return readahead_io_stats{
+		.bytes_read = vfs->bytes_read.load(),
+		.syscalls = vfs->syscalls.load(),
+		.stall_ns = vfs->stall_ns.load(),
+	};
+}
+
+std::vector<readahead_file_report> readahead_vfs_recent_files(readahead_vfs* vfs) {
+	std::lock_guard lock(vfs->recent_mutex);
+	return vfs->recent_files;
+}
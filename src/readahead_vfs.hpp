@@ -0,0 +1,50 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "include/miniaudio.h"
+
+/**
+ * @brief ma_vfs with large aligned read-ahead buffers for slow storage.
+ *
+ * Small decoder reads are served from a per-file buffer that is refilled with one
+ * big aligned pread(), and files are opened with a sequential access hint. Per-file
+ * I/O counters are kept for the most recently closed files.
+ */
+
+struct readahead_vfs_config {
+	size_t buffer_size = 1024 * 1024;
+	size_t alignment = 4096;
+};
+
+struct readahead_io_stats {
+	ma_uint64 bytes_read;
+	ma_uint64 syscalls;
+	ma_uint64 stall_ns;
+};
+
+struct readahead_file_report {
+	std::string path;
+	readahead_io_stats stats;
+};
+
+struct readahead_vfs {
+	ma_vfs_callbacks cb;
+	readahead_vfs_config config;
+
+	std::atomic<ma_uint64> bytes_read;
+	std::atomic<ma_uint64> syscalls;
+	std::atomic<ma_uint64> stall_ns;
+
+	std::mutex recent_mutex;
+	std::vector<readahead_file_report> recent_files;
+};
+
+ma_result readahead_vfs_init(readahead_vfs* vfs, const readahead_vfs_config& config);
+
+/** @brief Every pread so far, files still open included. */
+readahead_io_stats readahead_vfs_totals(readahead_vfs* vfs);
+std::vector<readahead_file_report> readahead_vfs_recent_files(readahead_vfs* vfs);
@@ -0,0 +1,242 @@
+#include "resampler.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+
+typedef float float8 __attribute__((vector_size(32)));
+
+// * 44.1 kHz to 48 kHz needs 160, common pairs stay far below this
+constexpr ma_uint32 MAX_PHASES = 4096;
+constexpr ma_uint32 BLOCK_FRAMES = 1024;
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define DOT_CLONES __attribute__((target_clones("default", "avx2,fma")))
+#else
+#define DOT_CLONES
+#endif
+
+struct resample_preset {
+	const char* name;
+	ma_uint32 taps;
+	double attenuation_db;
+};
+
+// * taps at unity ratio, the transition band is placed just below Nyquist
+static const resample_preset presets[] = {
+	{ "fast", 16, 60 },
+	{ "standard", 48, 96 },
+	{ "high", 128, 120 },
+};
+
+struct resampler {
+	ma_uint32 channels;
+	ma_uint32 taps;
+	ma_uint32 phases;
+	ma_uint32 step;
+	ma_uint32 step_whole;
+	ma_uint32 step_fraction;
+	// * phases rows of taps coefficients
+	std::vector<float> table;
+
+	// * per channel, capacity input frames, the next window starts at index
+	std::vector<float> buffer;
+	ma_uint32 capacity;
+	ma_uint32 filled;
+	ma_uint32 index;
+	ma_uint32 phase;
+};
+
+bool resample_quality_from_name(const char* name, resample_quality& quality) {
+	for (int preset = 0; preset < int(std::size(presets)); preset++) {
+		if (std::strcmp(name, presets[preset].name) == 0) {
+			quality = resample_quality(preset);
+			return true;
+		}
+	}
+	return false;
+}
+
+const char* resample_quality_name(resample_quality quality) {
+	return presets[int(quality)].name;
+}
+
+static double bessel_i0(double x) {
+	double sum = 1, term = 1;
+	for (int k = 1; k < 50; k++) {
+		term *= (x / (2 * k)) * (x / (2 * k));
+		sum += term;
+		if (term < sum * 1e-12)
+			break;
+	}
+	return sum;
+}
+
+/** @brief Kaiser-windowed sinc for every phase, each row normalised to unity gain at DC. */
+static void build_table(resampler* resampler, const resample_preset& preset, double ratio) {
+	ma_uint32 taps = resampler->taps;
+	double attenuation = preset.attenuation_db;
+	double beta = attenuation > 50 ? 0.1102 * (attenuation - 8.7) : 0.5842 * std::pow(attenuation - 21, 0.4) + 0.07886 * (attenuation - 21);
+	// * transition width in cycles per input sample for this many taps, stopband starting at the lower Nyquist
+	double transition = (attenuation - 8) / (2.285 * 2 * M_PI * taps);
+	double cutoff = std::min(1.0, ratio) * 0.5 - transition / 2;
+	double half = taps / 2.0;
+	double window_norm = bessel_i0(beta);
+
+	resampler->table.assign(std::size_t(resampler->phases) * taps, 0);
+	for (ma_uint32 phase = 0; phase < resampler->phases; phase++) {
+		float* row = &resampler->table[std::size_t(phase) * taps];
+		double sum = 0;
+		for (ma_uint32 k = 0; k < taps; k++) {
+			double x = half - 1 - k + double(phase) / resampler->phases;
+			double sinc = x == 0 ? 1 : std::sin(2 * M_PI * cutoff * x) / (2 * M_PI * cutoff * x);
+			double position = x / half;
+			double window = std::fabs(position) >= 1 ? 0 : bessel_i0(beta * std::sqrt(1 - position * position)) / window_norm;
+			row[k] = float(2 * cutoff * sinc * window);
+			sum += row[k];
+		}
+		for (ma_uint32 k = 0; k < taps; k++)
+			row[k] = float(row[k] / sum);
+	}
+}
+
+resampler* resampler_create(ma_uint32 channels, ma_uint32 input_rate, ma_uint32 output_rate, resample_quality quality) {
+	if (channels == 0 || input_rate == 0 || output_rate == 0)
+		return NULL;
+	ma_uint32 divisor = std::gcd(input_rate, output_rate);
+	ma_uint32 phases = output_rate / divisor;
+	ma_uint32 step = input_rate / divisor;
+	if (phases > MAX_PHASES)
+		return NULL;
+
+	const resample_preset& preset = presets[int(quality)];
+	double ratio = double(phases) / step;
+	auto resampler = new struct resampler;
+	resampler->channels = channels;
+	// * a lower cutoff needs proportionally more taps for the same transition, rounded up for the vector loop
+	ma_uint32 taps = ma_uint32(std::ceil(preset.taps / std::min(1.0, ratio)));
+	resampler->taps = (taps + 7) & ~7u;
+	resampler->phases = phases;
+	resampler->step = step;
+	resampler->step_whole = step / phases;
+	resampler->step_fraction = step % phases;
+	build_table(resampler, preset, ratio);
+
+	resampler->capacity = resampler->taps + std::max(BLOCK_FRAMES, resampler->step_whole * 2 + 2);
+	resampler->buffer.assign(std::size_t(resampler->capacity) * channels, 0);
+	resampler_reset(resampler, 0);
+	return resampler;
+}
+
+void resampler_destroy(resampler* resampler) {
+	delete resampler;
+}
+
+ma_uint64 resampler_reset(resampler* resampler, ma_uint64 output_frame) {
+	// * half a window of silence before the first frame, so output frame 0 lines up with input frame 0
+	std::fill(resampler->buffer.begin(), resampler->buffer.end(), 0.0f);
+	resampler->filled = resampler->taps / 2 - 1;
+	resampler->index = 0;
+	ma_uint64 position = output_frame * resampler->step;
+	resampler->phase = ma_uint32(position % resampler->phases);
+	return position / resampler->phases;
+}
+
+ma_uint64 resampler_required_input(const resampler* resampler, ma_uint64 output_frames) {
+	if (output_frames == 0)
+		return 0;
+	ma_uint64 last = resampler->index + (resampler->phase + (output_frames - 1) * resampler->step) / resampler->phases;
+	ma_uint64 end = last + resampler->taps;
+	return end > resampler->filled ? end - resampler->filled : 0;
+}
+
+ma_uint64 resampler_output_frames(const resampler* resampler, ma_uint64 input_frames) {
+	return (input_frames * resampler->phases + resampler->step - 1) / resampler->step;
+}
+
+ma_uint32 resampler_latency(const resampler* resampler) {
+	return resampler->taps / 2 + 1;
+}
+
+DOT_CLONES
+static float dot(const float* taps, const float* samples, ma_uint32 count) {
+	float8 sum = {};
+	for (ma_uint32 k = 0; k < count; k += 8) {
+		float8 a, b;
+		std::memcpy(&a, taps + k, sizeof(a));
+		std::memcpy(&b, samples + k, sizeof(b));
+		sum += a * b;
+	}
+	return (sum[0] + sum[4]) + (sum[1] + sum[5]) + (sum[2] + sum[6]) + (sum[3] + sum[7]);
+}
+
+ma_uint64 resampler_process(resampler* resampler, const float* input, ma_uint64* input_frames, float* output, ma_uint64 output_capacity) {
+	ma_uint32 channels = resampler->channels;
+	ma_uint32 capacity = resampler->capacity;
+	ma_uint64 consumed = 0;
+	ma_uint64 produced = 0;
+
+	while (true) {
+		while (produced < output_capacity && resampler->index + resampler->taps <= resampler->filled) {
+			const float* row = &resampler->table[std::size_t(resampler->phase) * resampler->taps];
+			for (ma_uint32 channel = 0; channel < channels; channel++) {
+				const float* samples = &resampler->buffer[std::size_t(channel) * capacity + resampler->index];
+				output[produced * channels + channel] = dot(row, samples, resampler->taps);
+			}
+			produced++;
+			resampler->index += resampler->step_whole;
+			resampler->phase += resampler->step_fraction;
+			if (resampler->phase >= resampler->phases) {
+				resampler->phase -= resampler->phases;
+				resampler->index++;
+			}
+		}
+		if (produced == output_capacity || consumed == *input_frames)
+			break;
+
+		// * drop what no window reaches anymore, a large step can leave index past the end
+		ma_uint32 drop = std::min(resampler->index, resampler->filled);
+		if (drop > 0) {
+			for (ma_uint32 channel = 0; channel < channels; channel++) {
+				float* samples = &resampler->buffer[std::size_t(channel) * capacity];
+				std::memmove(samples, samples + drop, (resampler->filled - drop) * sizeof(float));
+			}
+			resampler->filled -= drop;
+			resampler->index -= drop;
+		}
+
+		ma_uint32 count = ma_uint32(std::min<ma_uint64>(capacity - resampler->filled, *input_frames - consumed));
+		const float* frames = input + consumed * channels;
+		for (ma_uint32 channel = 0; channel < channels; channel++) {
+			float* samples = &resampler->buffer[std::size_t(channel) * capacity + resampler->filled];
+			for (ma_uint32 frame = 0; frame < count; frame++)
+				samples[frame] = frames[std::size_t(frame) * channels + channel];
+		}
+		resampler->filled += count;
+		consumed += count;
+	}
+
+	*input_frames = consumed;
+	return produced;
+}
+
+std::vector<float> resample_buffer(const float* input, ma_uint64 frames, ma_uint32 channels, ma_uint32 input_rate, ma_uint32 output_rate,
+	resample_quality quality) {
+	std::vector<float> output;
+	resampler* resampler = resampler_create(channels, input_rate, output_rate, quality);
+	if (resampler == NULL)
+		return output;
+
+	ma_uint64 length = resampler_output_frames(resampler, frames);
+	output.resize(std::size_t(length) * channels);
+	ma_uint64 consumed = frames;
+	ma_uint64 produced = resampler_process(resampler, input, &consumed, output.data(), length);
+
+	std::vector<float> silence(std::size_t(resampler_latency(resampler)) * channels, 0.0f);
+	ma_uint64 tail = resampler_latency(resampler);
+	produced += resampler_process(resampler, silence.data(), &tail, output.data() + produced * channels, length - produced);
+	output.resize(std::size_t(produced) * channels);
+	resampler_destroy(resampler);
+	return output;
+}
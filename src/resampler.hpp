@@ -0,0 +1,55 @@
+#pragma once
+
+#include <vector>
+
+#include "include/miniaudio.h"
+
+/**
+ * @brief Windowed-sinc polyphase resampler on interleaved f32.
+ *
+ * The rates are reduced to a ratio L/M and a Kaiser-windowed sinc is tabulated once
+ * for each of the L phases, so producing a frame is one dot product per channel
+ * with no interpolation. Input is kept per channel so the taps and samples are
+ * both contiguous; the dot product uses 8-wide vector types, built for AVX2 as well
+ * on x86-64 and picked at load time, NEON on ARM.
+ *
+ * Output frame n sits exactly at input time n * M / L, the filter's delay is
+ * compensated, and when downsampling the cutoff follows the lower Nyquist.
+ */
+
+enum class resample_quality {
+	FAST,
+	STANDARD,
+	HIGH,
+};
+
+/** @brief Takes fast, standard or high, false for anything else. */
+bool resample_quality_from_name(const char* name, resample_quality& quality);
+const char* resample_quality_name(resample_quality quality);
+
+struct resampler;
+
+/** @brief NULL when the ratio needs more phases than are worth tabulating, miniaudio's resampler can take those. */
+resampler* resampler_create(ma_uint32 channels, ma_uint32 input_rate, ma_uint32 output_rate, resample_quality quality);
+void resampler_destroy(resampler* resampler);
+
+/** @brief Forgets past input for a seek to output_frame, returns the input frame to continue from. */
+ma_uint64 resampler_reset(resampler* resampler, ma_uint64 output_frame);
+
+/** @brief Input frames still needed before output_frames more can be produced. */
+ma_uint64 resampler_required_input(const resampler* resampler, ma_uint64 output_frames);
+/** @brief Output length of input_frames, rounded up. */
+ma_uint64 resampler_output_frames(const resampler* resampler, ma_uint64 input_frames);
+/** @brief Input frames of silence that push the last real frames through the filter at the end of a stream. */
+ma_uint32 resampler_latency(const resampler* resampler);
+
+/**
+ * @brief Consumes input until output_capacity frames are produced or the input runs out.
+ * @param input_frames the available input on entry, the consumed input on return
+ * @return frames written to output
+ */
+ma_uint64 resampler_process(resampler* resampler, const float* input, ma_uint64* input_frames, float* output, ma_uint64 output_capacity);
+
+/** @brief Resamples a whole buffer at once, for offline use. Empty when the ratio is unsupported. */
+std::vector<float> resample_buffer(const float* input, ma_uint64 frames, ma_uint32 channels, ma_uint32 input_rate, ma_uint32 output_rate,
+	resample_quality quality = resample_quality::HIGH);
@@ -0,0 +1,279 @@
+#include "rt_check.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Logger.hpp"
+#include "output_device.hpp"
+#include "decode_ahead.hpp"
+#include "limiter_node.hpp"
+#include "eq_node.hpp"
+#include "convolution_node.hpp"
+#include "time_stretch_node.hpp"
+#include "spectrum.hpp"
+#include "bench.hpp"
+
+static std::atomic<unsigned long> hit_count = 0;
+
+#ifdef AURABEAT_RT_CHECK_ACTIVE
+
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* pointer, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+void __libc_free(void* pointer);
+}
+
+static thread_local int rt_depth = 0;
+static thread_local bool is_reporting = false;
+
+using mutex_lock_fn = int (*)(pthread_mutex_t*);
+static std::atomic<mutex_lock_fn> real_mutex_lock = NULL;
+
+static void report_hit(const char* function) {
+	// * backtrace() may allocate on first use, so never report from inside a report
+	if (rt_depth == 0 || is_reporting)
+		return;
+	is_reporting = true;
+	hit_count.fetch_add(1, std::memory_order_relaxed);
+
+	const char* prefix = "\x1B[31m[RT]\033[0m\t";
+	write(STDERR_FILENO, prefix, std::strlen(prefix));
+	write(STDERR_FILENO, function, std::strlen(function));
+	write(STDERR_FILENO, " called on the audio thread\n", 28);
+
+	void* frames[32];
+	int frame_count = backtrace(frames, 32);
+	backtrace_symbols_fd(frames, frame_count, STDERR_FILENO);
+	is_reporting = false;
+}
+
+extern "C" void* malloc(size_t size) {
+	report_hit("malloc");
+	return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t count, size_t size) {
+	report_hit("calloc");
+	return __libc_calloc(count, size);
+}
+
+extern "C" void* realloc(void* pointer, size_t size) {
+	report_hit("realloc");
+	return __libc_realloc(pointer, size);
+}
+
+extern "C" int posix_memalign(void** pointer, size_t alignment, size_t size) {
+	report_hit("posix_memalign");
+	*pointer = __libc_memalign(alignment, size);
+	return *pointer == NULL ? ENOMEM : 0;
+}
+
+extern "C" void free(void* pointer) {
+	report_hit("free");
+	__libc_free(pointer);
+}
+
+extern "C" int pthread_mutex_lock(pthread_mutex_t* mutex) {
+	report_hit("pthread_mutex_lock");
+
+	mutex_lock_fn lock = real_mutex_lock.load(std::memory_order_relaxed);
+	if (lock == NULL) {
+		lock = (mutex_lock_fn)dlsym(RTLD_NEXT, "pthread_mutex_lock");
+		real_mutex_lock.store(lock, std::memory_order_relaxed);
+	}
+	return lock(mutex);
+}
+
+void rt_check_enter() {
+	rt_depth++;
+}
+
+void rt_check_leave() {
+	rt_depth--;
+}
+
+#endif
+
+unsigned long rt_check_hits() {
+	return hit_count.load(std::memory_order_relaxed);
+}
+
+int rt_check_run() {
+#ifndef AURABEAT_RT_CHECK_ACTIVE
+	// * nothing is interposed, a clean run would prove nothing
+	log("not built with rt_check, configure with -Drt_check=true on a glibc system to interpose allocations", ERROR);
+	return 1;
+#endif
+	auto directory = std::filesystem::temp_directory_path();
+	std::vector<std::string> files = {
+		(directory / "aurabeat-rt-check-a.wav").string(),
+		(directory / "aurabeat-rt-check-b.wav").string(),
+		(directory / "aurabeat-rt-check-ir.wav").string(),
+	};
+	// * any second of audio does as an impulse response, it only has to be long enough to need the tail worker
+	if (!write_test_tone(files[0], 44100, 440, 2) || !write_test_tone(files[1], 48000, 660, 2) || !write_test_tone(files[2], 48000, 1000, 1)) {
+		log("could not write rt check tones", ERROR);
+		return 1;
+	}
+
+	ma_backend backend = ma_backend_null;
+	output_latency_config latency_config;
+	latency_config.adaptive = false;
+	// * an s16 device has the callback quantize the engine's output, with the costliest dither
+	output_device_set_dither(dither_mode::SHAPED);
+	if (!output_device_init(latency_config, &backend, 1, ma_format_s16))
+		return 1;
+
+	ma_resource_manager resource_manager;
+	auto resource_manager_config = ma_resource_manager_config_init();
+	ma_resource_manager_init(&resource_manager_config, &resource_manager);
+
+	ma_engine engine;
+	ma_engine_config engine_config = ma_engine_config_init();
+	engine_config.pResourceManager = &resource_manager;
+	engine_config.pDevice = output_device_get();
+	if (ma_engine_init(&engine_config, &engine) != MA_SUCCESS) {
+		output_device_uninit();
+		return 1;
+	}
+	limiter_config limiter_settings;
+	limiter_settings.channels = ma_engine_get_channels(&engine);
+	limiter_settings.sample_rate = ma_engine_get_sample_rate(&engine);
+	ma_node* engine_output = ma_engine_get_endpoint(&engine);
+	spectrum_tap* tap = spectrum_tap_create(ma_engine_get_node_graph(&engine), limiter_settings.channels);
+	if (tap != NULL) {
+		ma_node_attach_output_bus((ma_node*)tap, 0, engine_output, 0);
+		spectrum_tap_set_enabled(tap, true);
+		engine_output = (ma_node*)tap;
+	}
+	limiter_node* limiter = limiter_node_create(ma_engine_get_node_graph(&engine), limiter_settings);
+	if (limiter != NULL)
+		ma_node_attach_output_bus((ma_node*)limiter, 0, engine_output, 0);
+	ma_node* after_eq = limiter != NULL ? (ma_node*)limiter : engine_output;
+	convolution_node* convolution = convolution_node_create(ma_engine_get_node_graph(&engine), limiter_settings.channels,
+		limiter_settings.sample_rate, files[2].c_str());
+	if (convolution != NULL) {
+		ma_node_attach_output_bus((ma_node*)convolution, 0, after_eq, 0);
+		after_eq = (ma_node*)convolution;
+	}
+	eq_node* eq = eq_node_create(ma_engine_get_node_graph(&engine), limiter_settings.channels, limiter_settings.sample_rate);
+	if (eq != NULL)
+		ma_node_attach_output_bus((ma_node*)eq, 0, after_eq, 0);
+	time_stretch_node* stretch = time_stretch_node_create(ma_engine_get_node_graph(&engine), limiter_settings.channels,
+		limiter_settings.sample_rate);
+	if (stretch != NULL)
+		ma_node_attach_output_bus((ma_node*)stretch, 0, eq != NULL ? (ma_node*)eq : after_eq, 0);
+	eq_settings boosted = eq_settings_flat();
+	boosted.bands[1].gain_db = 6;
+	output_device_attach(&engine);
+
+	// * the 44.1 kHz tone is resampled on the decode thread like any file at another rate, both decode to s16 and are converted there
+	decode_ahead_config track_config;
+	track_config.encoding_format = ma_encoding_format_wav;
+	track_config.output_sample_rate = ma_engine_get_sample_rate(&engine);
+	auto wait = [](int ms) { std::this_thread::sleep_for(std::chrono::milliseconds(ms)); };
+	ma_sound sound{};
+	decode_ahead_source* source = NULL;
+	bool is_sound_init = false;
+
+	// * same transitions the UI goes through: play, seek, pause/resume, next
+	for (int round = 0; round < 4; round++) {
+		if (is_sound_init)
+			ma_sound_uninit(&sound);
+		decode_ahead_close(source);
+
+		source = decode_ahead_open(files[round % 2].c_str(), track_config);
+		is_sound_init = source != NULL && ma_sound_init_from_data_source(&engine, source, 0, NULL, &sound) == MA_SUCCESS;
+		if (!is_sound_init) {
+			log("rt check could not open " + files[round % 2], ERROR);
+			break;
+		}
+		// * every round switches EQ settings, so the crossfade runs too, and every other one is stretched
+		if (eq != NULL)
+			eq_node_set(eq, round % 2 == 0 ? boosted : eq_settings_flat());
+		if (stretch != NULL) {
+			time_stretch_node_set_speed(stretch, round % 2 == 0 ? 1.0f : 1.5f);
+			time_stretch_node_reset(stretch);
+			ma_node_attach_output_bus(&sound, 0, (ma_node*)stretch, 0);
+		} else if (eq != NULL) {
+			ma_node_attach_output_bus(&sound, 0, (ma_node*)eq, 0);
+		}
+		ma_sound_start(&sound);
+		wait(200);
+
+		ma_uint64 length = 0;
+		ma_sound_get_length_in_pcm_frames(&sound, &length);
+		ma_sound_seek_to_pcm_frame(&sound, length / 2);
+		if (stretch != NULL)
+			time_stretch_node_reset(stretch);
+		wait(200);
+
+		ma_sound_stop(&sound);
+		wait(50);
+		ma_sound_start(&sound);
+		wait(200);
+	}
+
+	// * bit-transparent: the device reopens at each tone's rate and format, the same format twice is swapped in without a reopen
+	decode_ahead_config direct_config;
+	direct_config.format = ma_format_s32;
+	decode_ahead_source* direct = NULL;
+	for (int round = 0; round < 3; round++) {
+		decode_ahead_source* previous = direct;
+		direct = decode_ahead_open(files[round / 2].c_str(), direct_config);
+		if (direct == NULL || !output_device_play_direct(direct)) {
+			log("rt check could not play " + files[round / 2] + " directly", ERROR);
+			break;
+		}
+		decode_ahead_close(previous);
+		wait(200);
+
+		ma_uint64 length = 0;
+		ma_data_source_get_length_in_pcm_frames(direct, &length);
+		output_device_seek_direct(length / 2);
+		wait(200);
+
+		output_device_pause_direct(true);
+		wait(50);
+		output_device_pause_direct(false);
+		wait(200);
+	}
+	output_device_play_engine();
+	decode_ahead_close(direct);
+
+	if (is_sound_init)
+		ma_sound_uninit(&sound);
+	decode_ahead_close(source);
+	time_stretch_node_destroy(stretch);
+	eq_node_destroy(eq);
+	convolution_node_destroy(convolution);
+	limiter_node_destroy(limiter);
+	spectrum_tap_destroy(tap);
+	ma_engine_uninit(&engine);
+	ma_resource_manager_uninit(&resource_manager);
+	output_device_uninit();
+
+	for (const auto& file : files)
+		std::filesystem::remove(file);
+
+	unsigned long hits = rt_check_hits();
+	if (hits != 0) {
+		log(std::to_string(hits) + " allocations or locks on the audio thread", ERROR);
+		return 1;
+	}
+	log("no allocations or locks on the audio thread", INFO);
+	return 0;
+}
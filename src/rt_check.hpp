@@ -0,0 +1,30 @@
+#pragma once
+
+/**
+ * @brief Real-time safety checker for the device thread.
+ *
+ * When built with `-Drt_check=true`, malloc/free and pthread_mutex_lock are interposed
+ * and every call made between rt_check_enter() and rt_check_leave() is reported with a
+ * stack trace. In regular builds the markers compile to nothing.
+ */
+
+// * for __GLIBC__, interposing relies on glibc's __libc_malloc and friends
+#include <climits>
+
+#if defined(AURABEAT_RT_CHECK) && defined(__GLIBC__)
+#define AURABEAT_RT_CHECK_ACTIVE 1
+void rt_check_enter();
+void rt_check_leave();
+#else
+inline void rt_check_enter() {}
+inline void rt_check_leave() {}
+#endif
+
+unsigned long rt_check_hits();
+
+/**
+ * @brief Drives the engine on the null backend through play/seek/next/pause transitions.
+ * @return 0 when the device thread never allocated or locked, 1 otherwise, and 1 in a build that
+ * doesn't check anything (without rt_check, or without glibc).
+ */
+int rt_check_run();
@@ -0,0 +1,220 @@
+#include "spectrum.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+
+#include "fft.hpp"
+
+// * about a third of a second at 48 kHz, many periods more than one analysis window
+constexpr ma_uint32 RING_FRAMES = 16384;
+// * 11.7 Hz bins at 48 kHz, fine enough for the lowest bars
+constexpr ma_uint32 FFT_SIZE = 4096;
+constexpr float LOWEST_HZ = 30;
+constexpr float HIGHEST_HZ = 16000;
+constexpr float FLOOR_DB = -72;
+// * bars fall across the whole range in this long
+constexpr float FALL_SECONDS = 1.5f;
+// * no new audio for this long means playback stopped, shorter gaps are only frames drawn faster than periods arrive
+constexpr double STALL_SECONDS = 0.1;
+
+struct spectrum_tap {
+	ma_node_base base;
+	ma_uint32 channels;
+	std::atomic<bool> enabled = false;
+	std::vector<float> ring;
+	// * claimed is moved before the copy and written after it, a reader that sees them apart may have read a torn period
+	std::atomic<ma_uint64> claimed = 0;
+	std::atomic<ma_uint64> written = 0;
+};
+
+struct spectrum_analyser {
+	spectrum_tap* tap;
+	fft_plan* plan;
+	std::vector<float> window;
+	std::vector<float> frames;
+	std::vector<float> mono;
+	std::vector<float> power;
+	std::vector<float> scratch;
+	// * bar b covers bins [first_bins[b], first_bins[b + 1])
+	std::vector<ma_uint32> first_bins;
+	std::vector<float> targets;
+	std::vector<float> levels;
+	float scale;
+	// * the tap's write counter at the last analysis, and how long it has stood still since
+	ma_uint64 last_written = 0;
+	double stalled_seconds = 0;
+};
+
+static void spectrum_tap_process(ma_node* node, const float** frames_in, ma_uint32* frame_count_in, float**, ma_uint32*) {
+	auto tap = (spectrum_tap*)node;
+	if (!tap->enabled.load(std::memory_order_relaxed))
+		return;
+
+	// * passthrough: miniaudio has already put the input in the output buffer, this only keeps a copy
+	ma_uint32 channels = tap->channels;
+	const float* input = frames_in[0];
+	ma_uint32 frame_count = *frame_count_in;
+	ma_uint64 written = tap->written.load(std::memory_order_relaxed);
+	if (frame_count > RING_FRAMES) {
+		input += std::size_t(frame_count - RING_FRAMES) * channels;
+		written += frame_count - RING_FRAMES;
+		frame_count = RING_FRAMES;
+	}
+
+	tap->claimed.store(written + frame_count, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	ma_uint32 position = ma_uint32(written % RING_FRAMES);
+	ma_uint32 first = std::min(frame_count, RING_FRAMES - position);
+	std::memcpy(&tap->ring[std::size_t(position) * channels], input, std::size_t(first) * channels * sizeof(float));
+	std::memcpy(&tap->ring[0], input + std::size_t(first) * channels, std::size_t(frame_count - first) * channels * sizeof(float));
+	tap->written.store(written + frame_count, std::memory_order_release);
+}
+
+static ma_node_vtable spectrum_tap_vtable = {
+	spectrum_tap_process,
+	NULL,
+	1,
+	1,
+	MA_NODE_FLAG_PASSTHROUGH,
+};
+
+spectrum_tap* spectrum_tap_create(ma_node_graph* graph, ma_uint32 channels) {
+	if (channels == 0)
+		return NULL;
+
+	auto tap = new spectrum_tap;
+	tap->channels = channels;
+	tap->ring.assign(std::size_t(RING_FRAMES) * channels, 0);
+
+	ma_node_config node_config = ma_node_config_init();
+	node_config.vtable = &spectrum_tap_vtable;
+	node_config.pInputChannels = &tap->channels;
+	node_config.pOutputChannels = &tap->channels;
+	if (ma_node_init(graph, &node_config, NULL, &tap->base) != MA_SUCCESS) {
+		delete tap;
+		return NULL;
+	}
+	return tap;
+}
+
+void spectrum_tap_destroy(spectrum_tap* tap) {
+	if (tap == NULL)
+		return;
+	ma_node_uninit(&tap->base, NULL);
+	delete tap;
+}
+
+void spectrum_tap_set_enabled(spectrum_tap* tap, bool enabled) {
+	tap->enabled.store(enabled, std::memory_order_relaxed);
+}
+
+spectrum_analyser* spectrum_analyser_create(spectrum_tap* tap, ma_uint32 sample_rate, int bars) {
+	fft_plan* plan = fft_plan_create(FFT_SIZE);
+	if (tap == NULL || plan == NULL || sample_rate == 0 || bars <= 0) {
+		fft_plan_destroy(plan);
+		return NULL;
+	}
+
+	auto analyser = new spectrum_analyser;
+	analyser->tap = tap;
+	analyser->plan = plan;
+	analyser->frames.resize(std::size_t(FFT_SIZE) * tap->channels);
+	analyser->mono.resize(FFT_SIZE);
+	analyser->power.resize(FFT_SIZE / 2 + 1);
+	analyser->scratch.resize(FFT_SIZE * 2);
+	analyser->targets.assign(bars, 0);
+	analyser->levels.assign(bars, 0);
+
+	// * Hann, with the channel average folded in
+	analyser->window.resize(FFT_SIZE);
+	for (ma_uint32 i = 0; i < FFT_SIZE; i++)
+		analyser->window[i] = float((0.5 - 0.5 * std::cos(2 * M_PI * i / FFT_SIZE)) / tap->channels);
+	// * a full-scale sine peaks at FFT_SIZE / 4 through the window, that is 0 dB
+	analyser->scale = 16.0f / (float(FFT_SIZE) * FFT_SIZE);
+
+	// * log-spaced edges, every bar at least one bin wide so the low end doesn't repeat the same bin
+	double bin_hz = double(sample_rate) / FFT_SIZE;
+	double highest = std::min<double>(HIGHEST_HZ, sample_rate * 0.45);
+	analyser->first_bins.resize(bars + 1);
+	ma_uint32 bin = ma_uint32(LOWEST_HZ / bin_hz);
+	for (int bar = 0; bar <= bars; bar++) {
+		double edge = LOWEST_HZ * std::pow(highest / LOWEST_HZ, double(bar) / bars);
+		bin = std::max(bin + (bar > 0), ma_uint32(std::lround(edge / bin_hz)));
+		analyser->first_bins[bar] = std::min(bin, FFT_SIZE / 2 + 1);
+	}
+	return analyser;
+}
+
+void spectrum_analyser_destroy(spectrum_analyser* analyser) {
+	if (analyser == NULL)
+		return;
+	fft_plan_destroy(analyser->plan);
+	delete analyser;
+}
+
+/** @brief Copies the FFT_SIZE frames up to written out of the ring, false if there aren't enough or the writer lapped the copy. */
+static bool read_newest(spectrum_analyser* analyser, ma_uint64 written) {
+	spectrum_tap* tap = analyser->tap;
+	ma_uint32 channels = tap->channels;
+	if (written < FFT_SIZE)
+		return false;
+
+	ma_uint64 first_frame = written - FFT_SIZE;
+	ma_uint32 position = ma_uint32(first_frame % RING_FRAMES);
+	ma_uint32 first = std::min(FFT_SIZE, RING_FRAMES - position);
+	std::memcpy(analyser->frames.data(), &tap->ring[std::size_t(position) * channels], std::size_t(first) * channels * sizeof(float));
+	std::memcpy(analyser->frames.data() + std::size_t(first) * channels, &tap->ring[0], std::size_t(FFT_SIZE - first) * channels * sizeof(float));
+
+	std::atomic_thread_fence(std::memory_order_acquire);
+	return tap->claimed.load(std::memory_order_relaxed) - first_frame <= RING_FRAMES;
+}
+
+bool spectrum_analyser_update(spectrum_analyser* analyser, double elapsed_seconds) {
+	float fall = float(elapsed_seconds / FALL_SECONDS);
+	std::vector<float>& targets = analyser->targets;
+
+	// * paused, stopped or the device gone: the ring keeps its last frames, analysing them again would freeze the bars
+	ma_uint64 written = analyser->tap->written.load(std::memory_order_acquire);
+	if (written == analyser->last_written) {
+		analyser->stalled_seconds += elapsed_seconds;
+		if (analyser->stalled_seconds > STALL_SECONDS)
+			std::fill(targets.begin(), targets.end(), 0.0f);
+	} else {
+		analyser->last_written = written;
+		analyser->stalled_seconds = 0;
+		std::fill(targets.begin(), targets.end(), 0.0f);
+	}
+
+	if (analyser->stalled_seconds == 0 && read_newest(analyser, written)) {
+		ma_uint32 channels = analyser->tap->channels;
+		for (ma_uint32 i = 0; i < FFT_SIZE; i++) {
+			float sum = 0;
+			for (ma_uint32 channel = 0; channel < channels; channel++)
+				sum += analyser->frames[std::size_t(i) * channels + channel];
+			analyser->mono[i] = sum * analyser->window[i];
+		}
+		fft_power_spectrum(analyser->plan, analyser->mono.data(), analyser->power.data(), analyser->scratch.data());
+
+		for (std::size_t bar = 0; bar < targets.size(); bar++) {
+			ma_uint32 begin = std::min(analyser->first_bins[bar], FFT_SIZE / 2);
+			ma_uint32 end = std::max(begin + 1, analyser->first_bins[bar + 1]);
+			float peak = *std::max_element(analyser->power.begin() + begin, analyser->power.begin() + end);
+			float db = 10 * std::log10(peak * analyser->scale + 1e-12f);
+			targets[bar] = std::clamp((db - FLOOR_DB) / -FLOOR_DB, 0.0f, 1.0f);
+		}
+	}
+
+	bool changed = false;
+	for (std::size_t bar = 0; bar < targets.size(); bar++) {
+		float level = std::max(targets[bar], analyser->levels[bar] - fall);
+		changed |= std::fabs(level - analyser->levels[bar]) > 1e-4f;
+		analyser->levels[bar] = level;
+	}
+	return changed;
+}
+
+const std::vector<float>& spectrum_analyser_levels(const spectrum_analyser* analyser) {
+	return analyser->levels;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <vector>
+
+#include "include/miniaudio.h"
+
+/**
+ * @brief Spectrum analyser split between the audio thread and the UI.
+ *
+ * The tap is a passthrough node in front of the engine endpoint. While enabled it
+ * copies every period into a single-producer ring and moves one counter, nothing
+ * else. The analyser reads the newest frames from the UI thread, checks the writer
+ * did not lap it meanwhile, and turns them into log-spaced bar levels with a
+ * windowed FFT. Nothing happens on either side while the view is hidden.
+ */
+
+struct spectrum_tap;
+
+/** @brief NULL on failure. Attach it with (ma_node*)tap, starts disabled. */
+spectrum_tap* spectrum_tap_create(ma_node_graph* graph, ma_uint32 channels);
+void spectrum_tap_destroy(spectrum_tap* tap);
+/** @brief While disabled the tap only passes audio through. */
+void spectrum_tap_set_enabled(spectrum_tap* tap, bool enabled);
+
+struct spectrum_analyser;
+
+spectrum_analyser* spectrum_analyser_create(spectrum_tap* tap, ma_uint32 sample_rate, int bars);
+void spectrum_analyser_destroy(spectrum_analyser* analyser);
+
+/**
+ * @brief Analyses the newest audio, bars rise at once and fall at a fixed rate over elapsed_seconds.
+ * Once the tap stops writing (paused, stopped, no device) they fall to zero.
+ * @return false when the levels did not change, so there is nothing to redraw
+ */
+bool spectrum_analyser_update(spectrum_analyser* analyser, double elapsed_seconds);
+/** @brief One level per bar from 0 (silence) to 1 (full scale), lowest frequency first. */
+const std::vector<float>& spectrum_analyser_levels(const spectrum_analyser* analyser);
@@ -0,0 +1,85 @@
+#include "spectrum_view.hpp"
+
+#include <algorithm>
+
+struct _spectrum_view : GtkWidget {
+	spectrum_analyser* analyser;
+	spectrum_tap* tap;
+	guint tick;
+	gint64 last_frame_time;
+};
+
+G_DEFINE_TYPE(spectrum_view, spectrum_view, GTK_TYPE_WIDGET)
+
+static gboolean spectrum_view_tick(GtkWidget* widget, GdkFrameClock* clock, gpointer) {
+	auto view = SPECTRUM_VIEW(widget);
+	gint64 now = gdk_frame_clock_get_frame_time(clock);
+	double elapsed = view->last_frame_time > 0 ? double(now - view->last_frame_time) / G_USEC_PER_SEC : 0;
+	view->last_frame_time = now;
+	// * bars at rest need no redraw, so a silent player doesn't repaint every frame
+	if (spectrum_analyser_update(view->analyser, elapsed))
+		gtk_widget_queue_draw(widget);
+	return G_SOURCE_CONTINUE;
+}
+
+static void spectrum_view_map(GtkWidget* widget) {
+	GTK_WIDGET_CLASS(spectrum_view_parent_class)->map(widget);
+	auto view = SPECTRUM_VIEW(widget);
+	spectrum_tap_set_enabled(view->tap, true);
+	view->last_frame_time = 0;
+	view->tick = gtk_widget_add_tick_callback(widget, spectrum_view_tick, NULL, NULL);
+}
+
+static void spectrum_view_unmap(GtkWidget* widget) {
+	auto view = SPECTRUM_VIEW(widget);
+	gtk_widget_remove_tick_callback(widget, view->tick);
+	view->tick = 0;
+	spectrum_tap_set_enabled(view->tap, false);
+	GTK_WIDGET_CLASS(spectrum_view_parent_class)->unmap(widget);
+}
+
+static void spectrum_view_snapshot(GtkWidget* widget, GtkSnapshot* snapshot) {
+	auto view = SPECTRUM_VIEW(widget);
+	const std::vector<float>& levels = spectrum_analyser_levels(view->analyser);
+	float width = float(gtk_widget_get_width(widget));
+	float height = float(gtk_widget_get_height(widget));
+	if (levels.empty() || width <= 0 || height <= 0)
+		return;
+
+	GdkRGBA color;
+	gtk_widget_get_color(widget, &color);
+	color.alpha *= 0.7f;
+
+	float slot = width / float(levels.size());
+	float gap = std::min(2.0f, slot * 0.25f);
+	for (std::size_t bar = 0; bar < levels.size(); bar++) {
+		float bar_height = levels[bar] * height;
+		if (bar_height < 0.5f)
+			continue;
+		graphene_rect_t rect;
+		graphene_rect_init(&rect, float(bar) * slot + gap / 2, height - bar_height, slot - gap, bar_height);
+		gtk_snapshot_append_color(snapshot, &color, &rect);
+	}
+}
+
+static void spectrum_view_class_init(spectrum_viewClass* view_class) {
+	GtkWidgetClass* widget_class = GTK_WIDGET_CLASS(view_class);
+	widget_class->map = spectrum_view_map;
+	widget_class->unmap = spectrum_view_unmap;
+	widget_class->snapshot = spectrum_view_snapshot;
+	gtk_widget_class_set_css_name(widget_class, "spectrum");
+}
+
+static void spectrum_view_init(spectrum_view* view) {
+	view->analyser = NULL;
+	view->tap = NULL;
+	view->tick = 0;
+	view->last_frame_time = 0;
+}
+
+GtkWidget* spectrum_view_new(spectrum_analyser* analyser, spectrum_tap* tap) {
+	auto view = SPECTRUM_VIEW(g_object_new(spectrum_view_get_type(), NULL));
+	view->analyser = analyser;
+	view->tap = tap;
+	return GTK_WIDGET(view);
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <gtk/gtk.h>
+
+#include "spectrum.hpp"
+
+/**
+ * @brief Bar graph of a spectrum_analyser, drawn with GtkSnapshot.
+ *
+ * The analysis runs from a tick callback, so at most once per frame the compositor
+ * draws, and only while the widget is mapped. The tap is enabled on map and
+ * disabled on unmap, so a hidden view costs the audio thread nothing either.
+ */
+
+G_DECLARE_FINAL_TYPE(spectrum_view, spectrum_view, , SPECTRUM_VIEW, GtkWidget)
+
+/** @brief The analyser and its tap must outlive the widget. */
+GtkWidget* spectrum_view_new(spectrum_analyser* analyser, spectrum_tap* tap);
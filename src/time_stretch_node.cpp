@@ -0,0 +1,336 @@
+#include "time_stretch_node.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include "audio_stats.hpp"
+
+typedef float float8 __attribute__((vector_size(32)));
+
+// * 20ms windows, short enough not to smear speech, long enough to hold a period of low notes
+constexpr double WINDOW_MS = 20;
+// * how far a window may move either way, a whole period of voices down to about 60 Hz
+constexpr double SEEK_MS = 8;
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define DOT_CLONES __attribute__((target_clones("default", "avx2,fma")))
+#else
+#define DOT_CLONES
+#endif
+
+struct time_stretch_node {
+	ma_node_base base;
+	ma_uint32 channels;
+	int stage;
+	std::atomic<float> speed = 1;
+	std::atomic<ma_uint64> reset_requested = 0;
+	ma_uint64 reset_handled = 0;
+
+	// * output hop, half a window, and the search range either way
+	ma_uint32 hop;
+	ma_uint32 seek;
+	std::vector<float> window;
+
+	// * planar input, a row of capacity frames per channel, and its mono mix for the search; row index 0 is input frame start
+	std::vector<float> input;
+	std::vector<float> mono;
+	ma_uint32 capacity;
+	ma_int64 start = 0;
+	ma_uint32 filled = 0;
+
+	bool is_stretching = false;
+	// * passing through: the next input frame to hand out
+	ma_int64 read_position = 0;
+	// * stretching: where the last window was taken from and where the next one nominally goes
+	ma_int64 previous_position = 0;
+	double nominal = 0;
+	bool has_tail = false;
+	// * planar, the second half of the last window, waiting for the next one to be added
+	std::vector<float> tail;
+	// * interleaved, one hop of finished output
+	std::vector<float> block;
+	ma_uint32 block_offset = 0;
+	ma_uint32 block_frames = 0;
+
+	std::atomic<ma_uint64> blocks = 0;
+	std::atomic<ma_uint64> block_ns = 0;
+};
+
+static ma_uint64 now_ns() {
+	auto now = std::chrono::steady_clock::now().time_since_epoch();
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+}
+
+DOT_CLONES
+static float dot(const float* a, const float* b, ma_uint32 count) {
+	float8 sum = {};
+	for (ma_uint32 k = 0; k < count; k += 8) {
+		float8 x, y;
+		std::memcpy(&x, a + k, sizeof(x));
+		std::memcpy(&y, b + k, sizeof(y));
+		sum += x * y;
+	}
+	return (sum[0] + sum[4]) + (sum[1] + sum[5]) + (sum[2] + sum[6]) + (sum[3] + sum[7]);
+}
+
+/** @brief Drops input no window can reach anymore, so there is room for more. */
+static void compact(time_stretch_node* stretch) {
+	ma_int64 keep_from = stretch->read_position;
+	if (stretch->is_stretching)
+		keep_from = std::min<ma_int64>(ma_int64(stretch->nominal) - stretch->seek, stretch->previous_position + stretch->hop);
+	ma_int64 drop = std::clamp<ma_int64>(keep_from - stretch->start, 0, stretch->filled);
+	if (drop == 0)
+		return;
+
+	ma_uint32 kept = stretch->filled - ma_uint32(drop);
+	for (ma_uint32 channel = 0; channel < stretch->channels; channel++) {
+		float* row = &stretch->input[std::size_t(channel) * stretch->capacity];
+		std::memmove(row, row + drop, kept * sizeof(float));
+	}
+	std::memmove(stretch->mono.data(), stretch->mono.data() + drop, kept * sizeof(float));
+	stretch->start += drop;
+	stretch->filled = kept;
+}
+
+static ma_uint32 take_input(time_stretch_node* stretch, const float* frames, ma_uint32 frame_count) {
+	compact(stretch);
+	ma_uint32 channels = stretch->channels;
+	ma_uint32 count = std::min(frame_count, stretch->capacity - stretch->filled);
+	for (ma_uint32 channel = 0; channel < channels; channel++) {
+		float* row = &stretch->input[std::size_t(channel) * stretch->capacity + stretch->filled];
+		for (ma_uint32 frame = 0; frame < count; frame++)
+			row[frame] = frames[std::size_t(frame) * channels + channel];
+	}
+
+	float scale = 1.0f / float(channels);
+	float* mono = &stretch->mono[stretch->filled];
+	for (ma_uint32 frame = 0; frame < count; frame++) {
+		float sum = 0;
+		for (ma_uint32 channel = 0; channel < channels; channel++)
+			sum += frames[std::size_t(frame) * channels + channel];
+		mono[frame] = sum * scale;
+	}
+	stretch->filled += count;
+	return count;
+}
+
+/** @brief The first window after passing through is taken where it left off, so the switch is seamless. */
+static void start_stretching(time_stretch_node* stretch) {
+	stretch->is_stretching = true;
+	stretch->nominal = double(stretch->read_position);
+	stretch->previous_position = stretch->read_position - stretch->hop;
+	stretch->has_tail = false;
+}
+
+/** @brief The pending tail plus the next window's head at its natural place is exactly the input, so that is where passing through resumes. */
+static void stop_stretching(time_stretch_node* stretch) {
+	stretch->is_stretching = false;
+	stretch->read_position = stretch->previous_position + stretch->hop;
+}
+
+static bool can_step(const time_stretch_node* stretch) {
+	ma_int64 end = stretch->start + stretch->filled;
+	ma_int64 nominal = ma_int64(stretch->nominal);
+	if (!stretch->has_tail)
+		return end >= nominal + 2 * stretch->hop;
+	return end >= nominal + stretch->seek + 2 * stretch->hop && end >= stretch->previous_position + 2 * stretch->hop;
+}
+
+/** @brief The window position near nominal whose start correlates best with what naturally follows the last window. */
+static ma_int64 best_position(const time_stretch_node* stretch) {
+	ma_uint32 hop = stretch->hop;
+	ma_int64 nominal = ma_int64(stretch->nominal);
+	ma_int64 first = std::max<ma_int64>(nominal - stretch->seek, stretch->start);
+	ma_uint32 count = ma_uint32(nominal + stretch->seek - first + 1);
+	const float* reference = &stretch->mono[stretch->previous_position + hop - stretch->start];
+	const float* candidates = &stretch->mono[first - stretch->start];
+
+	// * the candidates' energy slides along with them, one add and one subtract per position
+	double energy = 0;
+	for (ma_uint32 i = 0; i < hop; i++)
+		energy += double(candidates[i]) * candidates[i];
+
+	ma_uint32 best = ma_uint32(nominal - first);
+	float best_score = -1;
+	for (ma_uint32 offset = 0; offset < count; offset++) {
+		float correlation = dot(reference, candidates + offset, hop);
+		float score = correlation / float(std::sqrt(std::max(energy, 0.0)) + 1e-9);
+		if (score > best_score) {
+			best_score = score;
+			best = offset;
+		}
+		energy += double(candidates[offset + hop]) * candidates[offset + hop] - double(candidates[offset]) * candidates[offset];
+	}
+	return first + best;
+}
+
+/** @brief One hop of output: the last window's tail plus the head of the next one, Hann windows half apart sum to one. */
+static void step(time_stretch_node* stretch, float speed) {
+	ma_uint64 start = now_ns();
+	ma_uint32 hop = stretch->hop;
+	ma_uint32 channels = stretch->channels;
+	ma_int64 position = stretch->has_tail ? best_position(stretch) : ma_int64(stretch->nominal);
+	const float* rise = stretch->window.data();
+	const float* fall = stretch->window.data() + hop;
+
+	for (ma_uint32 channel = 0; channel < channels; channel++) {
+		const float* x = &stretch->input[std::size_t(channel) * stretch->capacity + (position - stretch->start)];
+		float* tail = &stretch->tail[std::size_t(channel) * hop];
+		for (ma_uint32 i = 0; i < hop; i++) {
+			float head = stretch->has_tail ? tail[i] : fall[i] * x[i];
+			stretch->block[std::size_t(i) * channels + channel] = head + rise[i] * x[i];
+			tail[i] = fall[i] * x[hop + i];
+		}
+	}
+
+	stretch->has_tail = true;
+	stretch->previous_position = position;
+	stretch->nominal += double(speed) * hop;
+	stretch->block_offset = 0;
+	stretch->block_frames = hop;
+	stretch->blocks.fetch_add(1, std::memory_order_relaxed);
+	stretch->block_ns.fetch_add(now_ns() - start, std::memory_order_relaxed);
+}
+
+static void time_stretch_process(ma_node* node, const float** frames_in, ma_uint32* frame_count_in, float** frames_out, ma_uint32* frame_count_out) {
+	auto stretch = (time_stretch_node*)node;
+	ma_uint64 start = now_ns();
+	ma_uint32 channels = stretch->channels;
+
+	ma_uint64 reset = stretch->reset_requested.load(std::memory_order_acquire);
+	if (reset != stretch->reset_handled) {
+		stretch->reset_handled = reset;
+		stretch->start = 0;
+		stretch->filled = 0;
+		stretch->is_stretching = false;
+		stretch->read_position = 0;
+		stretch->block_frames = 0;
+	}
+
+	float speed = stretch->speed.load(std::memory_order_relaxed);
+	*frame_count_in = frames_in != NULL ? take_input(stretch, frames_in[0], *frame_count_in) : 0;
+
+	float* output = frames_out[0];
+	ma_uint32 capacity = *frame_count_out;
+	ma_uint32 produced = 0;
+	while (produced < capacity) {
+		if (stretch->block_offset < stretch->block_frames) {
+			ma_uint32 count = std::min(stretch->block_frames - stretch->block_offset, capacity - produced);
+			std::memcpy(output + std::size_t(produced) * channels, &stretch->block[std::size_t(stretch->block_offset) * channels],
+				std::size_t(count) * channels * sizeof(float));
+			stretch->block_offset += count;
+			produced += count;
+			continue;
+		}
+
+		// * speed changes take effect between blocks
+		if (!stretch->is_stretching && speed != 1)
+			start_stretching(stretch);
+		else if (stretch->is_stretching && speed == 1)
+			stop_stretching(stretch);
+
+		if (stretch->is_stretching) {
+			if (!can_step(stretch))
+				break;
+			step(stretch, speed);
+			continue;
+		}
+
+		ma_uint32 count = ma_uint32(std::min<ma_int64>(capacity - produced, stretch->start + stretch->filled - stretch->read_position));
+		if (count == 0)
+			break;
+		ma_uint32 offset = ma_uint32(stretch->read_position - stretch->start);
+		for (ma_uint32 channel = 0; channel < channels; channel++) {
+			const float* row = &stretch->input[std::size_t(channel) * stretch->capacity + offset];
+			for (ma_uint32 frame = 0; frame < count; frame++)
+				output[std::size_t(produced + frame) * channels + channel] = row[frame];
+		}
+		stretch->read_position += count;
+		produced += count;
+	}
+
+	*frame_count_out = produced;
+	audio_stats_record_stage(stretch->stage, now_ns() - start);
+}
+
+static ma_result time_stretch_required_input(ma_node* node, ma_uint32 output_frame_count, ma_uint32* input_frame_count) {
+	float speed = ((time_stretch_node*)node)->speed.load(std::memory_order_relaxed);
+	*input_frame_count = ma_uint32(std::ceil(output_frame_count * speed));
+	return MA_SUCCESS;
+}
+
+static ma_node_vtable time_stretch_vtable = {
+	time_stretch_process,
+	time_stretch_required_input,
+	1,
+	1,
+	MA_NODE_FLAG_DIFFERENT_PROCESSING_RATES,
+};
+
+time_stretch_node* time_stretch_node_create(ma_node_graph* graph, ma_uint32 channels, ma_uint32 sample_rate) {
+	if (channels == 0 || sample_rate == 0)
+		return NULL;
+
+	auto stretch = new time_stretch_node;
+	stretch->channels = channels;
+	stretch->stage = audio_stats_register_stage("time stretch");
+	// * a multiple of 8 for the vector loop in the search
+	stretch->hop = (ma_uint32(sample_rate * WINDOW_MS / 2000) + 7) & ~7u;
+	stretch->seek = ma_uint32(sample_rate * SEEK_MS / 1000);
+
+	// * periodic Hann, the rising half of one window and the falling half of the one before add up to one
+	stretch->window.resize(std::size_t(stretch->hop) * 2);
+	for (ma_uint32 i = 0; i < stretch->hop * 2; i++)
+		stretch->window[i] = float(0.5 - 0.5 * std::cos(M_PI * i / stretch->hop));
+
+	// * the widest span a step reads at 3x, plus a period of new input
+	stretch->capacity = 8 * stretch->hop + 4 * stretch->seek + 1024;
+	stretch->input.assign(std::size_t(stretch->capacity) * channels, 0);
+	stretch->mono.assign(stretch->capacity, 0);
+	stretch->tail.assign(std::size_t(stretch->hop) * channels, 0);
+	stretch->block.assign(std::size_t(stretch->hop) * channels, 0);
+
+	ma_node_config node_config = ma_node_config_init();
+	node_config.vtable = &time_stretch_vtable;
+	node_config.pInputChannels = &stretch->channels;
+	node_config.pOutputChannels = &stretch->channels;
+	if (ma_node_init(graph, &node_config, NULL, &stretch->base) != MA_SUCCESS) {
+		delete stretch;
+		return NULL;
+	}
+	return stretch;
+}
+
+void time_stretch_node_destroy(time_stretch_node* stretch) {
+	if (stretch == NULL)
+		return;
+	ma_node_uninit(&stretch->base, NULL);
+	delete stretch;
+}
+
+void time_stretch_node_set_speed(time_stretch_node* stretch, float speed) {
+	stretch->speed.store(std::clamp(speed, MIN_PLAYBACK_SPEED, MAX_PLAYBACK_SPEED), std::memory_order_relaxed);
+}
+
+float time_stretch_node_get_speed(time_stretch_node* stretch) {
+	return stretch->speed.load(std::memory_order_relaxed);
+}
+
+void time_stretch_node_reset(time_stretch_node* stretch) {
+	stretch->reset_requested.fetch_add(1, std::memory_order_release);
+}
+
+time_stretch_stats time_stretch_node_get_stats(time_stretch_node* stretch) {
+	ma_uint64 blocks = stretch->blocks.load(std::memory_order_relaxed);
+	ma_uint64 block_ns = stretch->block_ns.load(std::memory_order_relaxed);
+	return time_stretch_stats{
+		.speed = stretch->speed.load(std::memory_order_relaxed),
+		.block_frames = stretch->hop,
+		.blocks = blocks,
+		.us_per_block = blocks > 0 ? double(block_ns) / double(blocks) / 1000 : 0,
+	};
+}
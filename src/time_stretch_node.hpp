@@ -0,0 +1,42 @@
+#pragma once
+
+#include "include/miniaudio.h"
+
+/**
+ * @brief Pitch-preserving playback speed, a node between the sounds and the equalizer.
+ *
+ * WSOLA: the output is built from overlapping Hann windows a fixed hop apart, while
+ * the windows are taken from the input a hop of speed times that apart. Each window
+ * is moved by up to a few ms to where it best lines up with the natural continuation
+ * of the previous one, found by normalised cross-correlation on a mono mix, so
+ * waveforms join without phase jumps and pitch stays the same. At 1x audio is passed
+ * through untouched.
+ *
+ * The node pulls speed times as many frames from the sounds as it produces, so the
+ * sounds' own clocks keep counting source time.
+ */
+
+constexpr float MIN_PLAYBACK_SPEED = 0.5f;
+constexpr float MAX_PLAYBACK_SPEED = 3.0f;
+
+struct time_stretch_stats {
+	float speed;
+	// * one WSOLA step, a search and an overlap-add, produces block_frames
+	ma_uint32 block_frames;
+	ma_uint64 blocks;
+	double us_per_block;
+};
+
+struct time_stretch_node;
+
+/** @brief NULL on failure. Attach it with (ma_node*)stretch, starts at 1x. */
+time_stretch_node* time_stretch_node_create(ma_node_graph* graph, ma_uint32 channels, ma_uint32 sample_rate);
+void time_stretch_node_destroy(time_stretch_node* stretch);
+
+/** @brief From the main thread, clamped to MIN_PLAYBACK_SPEED..MAX_PLAYBACK_SPEED, takes effect at the next block. */
+void time_stretch_node_set_speed(time_stretch_node* stretch, float speed);
+float time_stretch_node_get_speed(time_stretch_node* stretch);
+/** @brief Drops the audio buffered for the old position, call it after seeking or changing tracks. */
+void time_stretch_node_reset(time_stretch_node* stretch);
+
+time_stretch_stats time_stretch_node_get_stats(time_stretch_node* stretch);
@@ -0,0 +1,19 @@
+#include "true_peak.hpp"
+
+#include <cmath>
+
+void true_peak_taps(float4* taps) {
+	constexpr int LENGTH = TRUE_PEAK_TAPS * 4;
+	float4 sums = {};
+	for (int k = 0; k < TRUE_PEAK_TAPS; k++) {
+		for (int phase = 0; phase < 4; phase++) {
+			int n = k * 4 + phase;
+			double x = (n - (LENGTH - 1) / 2.0) / 4;
+			double window = 0.5 - 0.5 * std::cos(2 * M_PI * (n + 0.5) / LENGTH);
+			taps[k][phase] = float(std::sin(M_PI * x) / (M_PI * x) * window);
+		}
+		sums += taps[k];
+	}
+	for (int k = 0; k < TRUE_PEAK_TAPS; k++)
+		taps[k] /= sums;
+}
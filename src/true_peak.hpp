@@ -0,0 +1,22 @@
+#pragma once
+
+/**
+ * @brief The four times oversampling interpolator true peak is found with. The loudness analysis
+ * measures with it and the limiter detects with it, so both agree on what is an over.
+ */
+
+typedef float float4 __attribute__((vector_size(16)));
+
+// * per oversampling phase, 48 in all like the BS.1770 reference filter
+constexpr int TRUE_PEAK_TAPS = 12;
+
+/** @brief Windowed-sinc interpolator, taps[k] holds tap k of all four phases so one multiply-add serves them all. */
+void true_peak_taps(float4* taps);
+
+/** @brief Magnitude of the four oversampled points behind newest, the TRUE_PEAK_TAPS - 1 samples before it must be readable. */
+inline float4 true_peak_phases(const float4* taps, const float* newest) {
+	float4 sum = {};
+	for (int k = 0; k < TRUE_PEAK_TAPS; k++)
+		sum += taps[k] * newest[-k];
+	return sum < 0 ? -sum : sum;
+}
@@ -0,0 +1,350 @@
+#include "wav_mmap_source.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csetjmp>
+#include <csignal>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "pcm_convert.hpp"
+
+constexpr ma_uint16 WAVE_FORMAT_PCM = 1;
+constexpr ma_uint16 WAVE_FORMAT_IEEE_FLOAT = 3;
+constexpr ma_uint16 WAVE_FORMAT_EXTENSIBLE = 0xFFFE;
+
+// * how far ahead of the cursor the warm thread keeps pages resident, and how much it faults in per step
+constexpr ma_uint64 WARM_SECONDS = 2;
+constexpr size_t WARM_STEP_BYTES = 256 * 1024;
+// * faulted in by wav_mmap_open so playback doesn't begin with silence
+constexpr ma_uint64 PREFILL_MS = 100;
+
+struct wav_mmap_source {
+	ma_data_source_base base;
+	const unsigned char* mapping;
+	size_t mapping_size;
+	const unsigned char* frames;
+	ma_uint64 frame_count;
+	ma_uint32 bytes_per_frame;
+	ma_format format;
+	ma_uint32 channels;
+	ma_uint32 sample_rate;
+	// * integer frames converted while copying them out
+	bool is_converted;
+	std::atomic<ma_uint64> cursor = 0;
+
+	// * kept open so the warm thread can notice the file being cut short
+	int fd = -1;
+	std::thread thread;
+	std::atomic<bool> quit = false;
+	// * frames from the cursor up to warm_end are resident, the callback never reads past it;
+	// * seeking resets it to the target and the warm thread only extends it with a compare-exchange
+	std::atomic<ma_uint64> warm_end = 0;
+	// * frame_count until the file shrinks or faults, then where the readable data ends
+	std::atomic<ma_uint64> readable_frames = 0;
+};
+
+// * a SIGBUS on a thread with a guard set jumps back to it instead of killing the process
+static thread_local sigjmp_buf* bus_guard = NULL;
+static struct sigaction previous_bus_action;
+static std::once_flag bus_handler_once;
+
+static void on_bus_error(int, siginfo_t*, void*) {
+	if (bus_guard != NULL)
+		siglongjmp(*bus_guard, 1);
+	// * not a mapping access, the fault repeats on return and gets the previous action
+	sigaction(SIGBUS, &previous_bus_action, NULL);
+}
+
+static void install_bus_handler() {
+	struct sigaction action = {};
+	action.sa_sigaction = on_bus_error;
+	action.sa_flags = SA_SIGINFO | SA_NODEFER;
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGBUS, &action, &previous_bus_action);
+}
+
+static ma_uint16 read_u16(const unsigned char* bytes) {
+	return ma_uint16(bytes[0] | bytes[1] << 8);
+}
+
+static ma_uint32 read_u32(const unsigned char* bytes) {
+	return ma_uint32(bytes[0]) | ma_uint32(bytes[1]) << 8 | ma_uint32(bytes[2]) << 16 | ma_uint32(bytes[3]) << 24;
+}
+
+static ma_format wav_sample_format(ma_uint16 format_tag, ma_uint16 bits_per_sample) {
+	if (format_tag == WAVE_FORMAT_IEEE_FLOAT)
+		return bits_per_sample == 32 ? ma_format_f32 : ma_format_unknown;
+	if (format_tag != WAVE_FORMAT_PCM)
+		return ma_format_unknown;
+
+	switch (bits_per_sample) {
+		case 8: return ma_format_u8;
+		case 16: return ma_format_s16;
+		case 24: return ma_format_s24;
+		case 32: return ma_format_s32;
+		default: return ma_format_unknown;
+	}
+}
+
+/** @brief Walks the RIFF chunks and fills in format and data location, false for anything unsupported. */
+static bool parse_wav(wav_mmap_source* source) {
+	const unsigned char* bytes = source->mapping;
+	size_t size = source->mapping_size;
+	if (size < 12 || std::memcmp(bytes, "RIFF", 4) != 0 || std::memcmp(bytes + 8, "WAVE", 4) != 0)
+		return false;
+
+	bool has_format = false;
+	size_t offset = 12;
+	while (offset + 8 <= size) {
+		const unsigned char* chunk = bytes + offset;
+		ma_uint64 chunk_size = read_u32(chunk + 4);
+		const unsigned char* body = chunk + 8;
+		size_t body_available = size - offset - 8;
+
+		if (std::memcmp(chunk, "fmt ", 4) == 0 && chunk_size >= 16 && body_available >= 16) {
+			ma_uint16 format_tag = read_u16(body);
+			ma_uint16 bits_per_sample = read_u16(body + 14);
+			// * extensible headers carry the real format tag in the first bytes of the sub-format GUID
+			if (format_tag == WAVE_FORMAT_EXTENSIBLE && chunk_size >= 40 && body_available >= 40)
+				format_tag = read_u16(body + 24);
+
+			source->channels = read_u16(body + 2);
+			source->sample_rate = read_u32(body + 4);
+			source->format = wav_sample_format(format_tag, bits_per_sample);
+			if (source->format == ma_format_unknown || source->channels == 0 || source->sample_rate == 0)
+				return false;
+			source->bytes_per_frame = ma_get_bytes_per_frame(source->format, source->channels);
+			has_format = true;
+		} else if (std::memcmp(chunk, "data", 4) == 0) {
+			if (!has_format)
+				return false;
+			// * recorders that crash leave a bogus size behind, trust the file length instead
+			ma_uint64 data_size = chunk_size > body_available ? body_available : chunk_size;
+			source->frames = body;
+			source->frame_count = data_size / source->bytes_per_frame;
+			return source->frame_count > 0;
+		}
+
+		offset += 8 + chunk_size + (chunk_size & 1);
+	}
+	return false;
+}
+
+/** @brief parse_wav reads the header through the mapping, a file cut short meanwhile faults there. */
+static bool parse_wav_guarded(wav_mmap_source* source) {
+	sigjmp_buf guard;
+	if (sigsetjmp(guard, 0) != 0) {
+		bus_guard = NULL;
+		return false;
+	}
+	bus_guard = &guard;
+	bool is_parsed = parse_wav(source);
+	bus_guard = NULL;
+	return is_parsed;
+}
+
+static ma_result wav_mmap_read(ma_data_source* data_source, void* output, ma_uint64 frame_count, ma_uint64* frames_read) {
+	auto source = (wav_mmap_source*)data_source;
+	ma_uint64 cursor = source->cursor.load(std::memory_order_relaxed);
+	ma_uint64 readable = source->readable_frames.load(std::memory_order_relaxed);
+	if (cursor >= readable) {
+		*frames_read = 0;
+		return MA_AT_END;
+	}
+
+	ma_uint64 warm_end = std::min(source->warm_end.load(std::memory_order_acquire), readable);
+	ma_uint64 frames = warm_end > cursor ? std::min(frame_count, warm_end - cursor) : 0;
+	ma_format output_format = source->is_converted ? ma_format_f32 : source->format;
+
+	sigjmp_buf guard;
+	if (sigsetjmp(guard, 0) != 0) {
+		// * the file was cut short under the mapping, end the track where it broke off
+		bus_guard = NULL;
+		source->readable_frames.store(cursor, std::memory_order_relaxed);
+		ma_silence_pcm_frames(output, frame_count, output_format, source->channels);
+		*frames_read = 0;
+		return MA_AT_END;
+	}
+	bus_guard = &guard;
+	const unsigned char* input = source->frames + cursor * source->bytes_per_frame;
+	if (source->is_converted)
+		pcm_int_to_f32((float*)output, input, source->format, frames * source->channels);
+	else
+		std::memcpy(output, input, frames * source->bytes_per_frame);
+	bus_guard = NULL;
+	source->cursor.store(cursor + frames, std::memory_order_relaxed);
+
+	// * the warm thread is still faulting in the frames after a seek, fill with silence instead of blocking on the disk
+	if (frames < frame_count) {
+		void* rest = (unsigned char*)output + frames * ma_get_bytes_per_frame(output_format, source->channels);
+		ma_silence_pcm_frames(rest, frame_count - frames, output_format, source->channels);
+	}
+	*frames_read = frame_count;
+	return MA_SUCCESS;
+}
+
+static ma_result wav_mmap_seek(ma_data_source* data_source, ma_uint64 frame_index) {
+	auto source = (wav_mmap_source*)data_source;
+	if (frame_index > source->frame_count)
+		return MA_INVALID_ARGS;
+	source->warm_end.store(frame_index, std::memory_order_release);
+	source->cursor.store(frame_index, std::memory_order_relaxed);
+	return MA_SUCCESS;
+}
+
+static ma_result wav_mmap_get_data_format(ma_data_source* data_source, ma_format* format, ma_uint32* channels, ma_uint32* sample_rate, ma_channel* channel_map, size_t channel_map_cap) {
+	auto source = (wav_mmap_source*)data_source;
+	*format = source->is_converted ? ma_format_f32 : source->format;
+	*channels = source->channels;
+	*sample_rate = source->sample_rate;
+	ma_channel_map_init_standard(ma_standard_channel_map_microsoft, channel_map, channel_map_cap, source->channels);
+	return MA_SUCCESS;
+}
+
+static ma_result wav_mmap_get_cursor(ma_data_source* data_source, ma_uint64* cursor) {
+	*cursor = ((wav_mmap_source*)data_source)->cursor.load(std::memory_order_relaxed);
+	return MA_SUCCESS;
+}
+
+static ma_result wav_mmap_get_length(ma_data_source* data_source, ma_uint64* length) {
+	*length = ((wav_mmap_source*)data_source)->frame_count;
+	return MA_SUCCESS;
+}
+
+static ma_data_source_vtable wav_mmap_vtable = {
+	wav_mmap_read,
+	wav_mmap_seek,
+	wav_mmap_get_data_format,
+	wav_mmap_get_cursor,
+	wav_mmap_get_length,
+	NULL,
+	0,
+};
+
+/** @brief Lowers readable_frames when the file no longer covers the whole data chunk. */
+static void check_file_length(wav_mmap_source* source) {
+	struct stat file_stat;
+	if (fstat(source->fd, &file_stat) != 0)
+		return;
+	size_t data_offset = size_t(source->frames - source->mapping);
+	ma_uint64 on_disk = size_t(file_stat.st_size) > data_offset ? (size_t(file_stat.st_size) - data_offset) / source->bytes_per_frame : 0;
+	if (on_disk < source->readable_frames.load(std::memory_order_relaxed))
+		source->readable_frames.store(on_disk, std::memory_order_relaxed);
+}
+
+/** @brief Faults in the pages holding frames [first, last), false when the file ended under them. */
+static bool fault_in(wav_mmap_source* source, ma_uint64 first, ma_uint64 last) {
+	size_t page_size = size_t(sysconf(_SC_PAGESIZE));
+	size_t begin = size_t(source->frames - source->mapping) + size_t(first) * source->bytes_per_frame;
+	size_t end = size_t(source->frames - source->mapping) + size_t(last) * source->bytes_per_frame;
+	begin -= begin % page_size;
+	madvise((void*)(source->mapping + begin), end - begin, MADV_WILLNEED);
+
+	sigjmp_buf guard;
+	if (sigsetjmp(guard, 0) != 0) {
+		bus_guard = NULL;
+		return false;
+	}
+	bus_guard = &guard;
+	for (size_t offset = begin; offset < end; offset += page_size)
+		(void)*(volatile const unsigned char*)(source->mapping + offset);
+	bus_guard = NULL;
+	return true;
+}
+
+/** @brief Keeps the next WARM_SECONDS after the cursor resident so the callback never waits on a page fault. */
+static void warm_loop(wav_mmap_source* source) {
+	ma_uint64 window_frames = WARM_SECONDS * source->sample_rate;
+	ma_uint64 step_frames = std::max<ma_uint64>(WARM_STEP_BYTES / source->bytes_per_frame, 1);
+	auto idle = std::chrono::milliseconds(5);
+
+	while (!source->quit.load(std::memory_order_relaxed)) {
+		ma_uint64 warm_end = source->warm_end.load(std::memory_order_acquire);
+		ma_uint64 cursor = source->cursor.load(std::memory_order_relaxed);
+		check_file_length(source);
+		ma_uint64 limit = std::min(cursor + window_frames, source->readable_frames.load(std::memory_order_relaxed));
+		if (warm_end >= limit) {
+			std::this_thread::sleep_for(idle);
+			continue;
+		}
+
+		ma_uint64 last = std::min(warm_end + step_frames, limit);
+		if (!fault_in(source, warm_end, last)) {
+			source->readable_frames.store(warm_end, std::memory_order_relaxed);
+			continue;
+		}
+		// * fails when the callback seeked meanwhile, the next pass starts from the new position
+		source->warm_end.compare_exchange_strong(warm_end, last, std::memory_order_release);
+	}
+}
+
+wav_mmap_source* wav_mmap_open(const char* path, bool is_f32) {
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return NULL;
+
+	struct stat file_stat;
+	if (fstat(fd, &file_stat) != 0 || file_stat.st_size < 44) {
+		close(fd);
+		return NULL;
+	}
+
+	void* mapping = mmap(NULL, size_t(file_stat.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+	if (mapping == MAP_FAILED) {
+		close(fd);
+		return NULL;
+	}
+
+	std::call_once(bus_handler_once, install_bus_handler);
+	auto source = new wav_mmap_source;
+	source->mapping = (const unsigned char*)mapping;
+	source->mapping_size = size_t(file_stat.st_size);
+	source->fd = fd;
+
+	if (!parse_wav_guarded(source)) {
+		munmap(mapping, source->mapping_size);
+		close(fd);
+		delete source;
+		return NULL;
+	}
+
+	source->is_converted = is_f32 && (source->format == ma_format_s16 || source->format == ma_format_s24 || source->format == ma_format_s32);
+
+	source->readable_frames.store(source->frame_count, std::memory_order_relaxed);
+
+	// * sequential hint for kernel read-ahead, and fault in the first few ms here
+	madvise(mapping, source->mapping_size, MADV_SEQUENTIAL);
+	ma_uint64 prefill_frames = std::min(PREFILL_MS * source->sample_rate / 1000, source->frame_count);
+	if (fault_in(source, 0, prefill_frames))
+		source->warm_end.store(prefill_frames, std::memory_order_relaxed);
+	else
+		source->readable_frames.store(0, std::memory_order_relaxed);
+
+	ma_data_source_config base_config = ma_data_source_config_init();
+	base_config.vtable = &wav_mmap_vtable;
+	ma_data_source_init(&base_config, &source->base);
+
+	source->thread = std::thread(warm_loop, source);
+	return source;
+}
+
+void wav_mmap_close(wav_mmap_source* source) {
+	if (source == NULL)
+		return;
+
+	source->quit.store(true, std::memory_order_relaxed);
+	source->thread.join();
+
+	ma_data_source_uninit(&source->base);
+	munmap((void*)source->mapping, source->mapping_size);
+	close(source->fd);
+	delete source;
+}
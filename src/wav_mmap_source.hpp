@@ -0,0 +1,25 @@
+#pragma once
+
+#include "include/miniaudio.h"
+
+/**
+ * @brief Data source serving uncompressed WAV frames straight from a memory mapping.
+ *
+ * Opening only parses the RIFF chunk list, so recordings of any size start immediately,
+ * seeking just moves the cursor, and no heap memory holds sample data. Frames are handed
+ * out in the file's own format (u8/s16/s24/s32/f32), or converted to f32 as they are copied
+ * out of the mapping.
+ *
+ * A thread per source faults in the next seconds after the cursor, the callback only reads
+ * frames it has already made resident and plays silence while it catches up after a seek.
+ * A file cut short while mapped ends the track where the data stops instead of raising SIGBUS.
+ */
+
+struct wav_mmap_source;
+
+/**
+ * @brief Returns NULL when the file is not a PCM or float WAV that can be mapped. With is_f32
+ * s16/s24/s32 are handed out as f32, the sound then has nothing left to convert.
+ */
+wav_mmap_source* wav_mmap_open(const char* path, bool is_f32 = false);
+void wav_mmap_close(wav_mmap_source* source);
@@ -0,0 +1,268 @@
+#include "waveform.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+typedef float float4 __attribute__((vector_size(16)));
+
+constexpr ma_uint32 FIRST_BUCKET_FRAMES = 256;
+constexpr std::size_t MAX_BUCKETS = 4096;
+constexpr ma_uint64 CHUNK_FRAMES = 4096;
+constexpr char CACHE_MAGIC[8] = { 'a', 'b', 'w', 'a', 'v', 'e', '0', '1' };
+
+/** @brief A bucket while it is filled and merged, before it shrinks to bytes. */
+struct bucket_sum {
+	float min = 0;
+	float max = 0;
+	double squares = 0;
+	ma_uint64 samples = 0;
+};
+
+// * in native byte order, the cache never leaves the machine
+struct cache_header {
+	char magic[8];
+	ma_uint64 size;
+	ma_int64 modified;
+	ma_uint64 frames;
+	ma_uint32 bucket_frames;
+	ma_uint32 buckets;
+};
+
+static_assert(sizeof(waveform_peak) == 3);
+
+/** @brief Min, max and sum of squares of count samples, four lanes at a time. */
+static void accumulate(const float* samples, std::size_t count, bucket_sum& bucket) {
+	float4 low = bucket.min + float4{};
+	float4 high = bucket.max + float4{};
+	float4 squares = {};
+	std::size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		float4 x;
+		std::memcpy(&x, samples + i, sizeof(x));
+		low = x < low ? x : low;
+		high = x > high ? x : high;
+		squares += x * x;
+	}
+
+	float sum = squares[0] + squares[1] + squares[2] + squares[3];
+	bucket.min = std::min({ low[0], low[1], low[2], low[3] });
+	bucket.max = std::max({ high[0], high[1], high[2], high[3] });
+	for (; i < count; i++) {
+		bucket.min = std::min(bucket.min, samples[i]);
+		bucket.max = std::max(bucket.max, samples[i]);
+		sum += samples[i] * samples[i];
+	}
+	bucket.squares += sum;
+	bucket.samples += count;
+}
+
+static bucket_sum merge(const bucket_sum& first, const bucket_sum& second) {
+	return bucket_sum{
+		.min = std::min(first.min, second.min),
+		.max = std::max(first.max, second.max),
+		.squares = first.squares + second.squares,
+		.samples = first.samples + second.samples,
+	};
+}
+
+/** @brief Merges pairs, an odd one out is kept as it is. */
+static std::vector<bucket_sum> halve(const std::vector<bucket_sum>& buckets) {
+	std::vector<bucket_sum> halved((buckets.size() + 1) / 2);
+	for (std::size_t i = 0; i < halved.size(); i++)
+		halved[i] = i * 2 + 1 < buckets.size() ? merge(buckets[i * 2], buckets[i * 2 + 1]) : buckets[i * 2];
+	return halved;
+}
+
+static waveform_peak to_peak(const bucket_sum& bucket) {
+	auto to_byte = [](float value, float scale) { return std::lround(std::clamp(value, -1.0f, 1.0f) * scale); };
+	float rms = bucket.samples > 0 ? float(std::sqrt(bucket.squares / double(bucket.samples))) : 0.0f;
+	return waveform_peak{ ma_int8(to_byte(bucket.min, 127)), ma_int8(to_byte(bucket.max, 127)), ma_uint8(to_byte(rms, 255)) };
+}
+
+/** @brief Bucket count of every level, with the same halving the pyramid is built with. */
+static std::vector<std::size_t> level_sizes(std::size_t buckets) {
+	std::vector<std::size_t> sizes = { buckets };
+	while (sizes.back() > 1)
+		sizes.push_back((sizes.back() + 1) / 2);
+	return sizes;
+}
+
+waveform waveform_analyse_file(const char* path, ma_encoding_format format, waveform_stats* stats) {
+	auto start = std::chrono::steady_clock::now();
+	waveform overview;
+	ma_decoder_config decoder_config = ma_decoder_config_init(ma_format_f32, 0, 0);
+	decoder_config.encodingFormat = format;
+	ma_decoder decoder;
+	if (ma_decoder_init_file(path, &decoder_config, &decoder) != MA_SUCCESS)
+		return overview;
+
+	ma_format sample_format;
+	ma_uint32 channels;
+	ma_uint32 sample_rate;
+	if (ma_decoder_get_data_format(&decoder, &sample_format, &channels, &sample_rate, NULL, 0) != MA_SUCCESS || channels == 0) {
+		ma_decoder_uninit(&decoder);
+		return overview;
+	}
+
+	// * the length isn't known for every format, so buckets double whenever there are too many
+	ma_uint64 bucket_frames = FIRST_BUCKET_FRAMES;
+	ma_uint64 frames_in_bucket = 0;
+	std::vector<bucket_sum> buckets;
+	bucket_sum current;
+	std::vector<float> samples(CHUNK_FRAMES * channels);
+
+	while (true) {
+		ma_uint64 frames = 0;
+		if (ma_decoder_read_pcm_frames(&decoder, samples.data(), CHUNK_FRAMES, &frames) != MA_SUCCESS || frames == 0)
+			break;
+		overview.frames += frames;
+
+		for (ma_uint64 position = 0; position < frames;) {
+			ma_uint64 taken = std::min(frames - position, bucket_frames - frames_in_bucket);
+			accumulate(samples.data() + position * channels, taken * channels, current);
+			position += taken;
+			frames_in_bucket += taken;
+			if (frames_in_bucket < bucket_frames)
+				continue;
+
+			buckets.push_back(current);
+			current = bucket_sum{};
+			frames_in_bucket = 0;
+			if (buckets.size() > MAX_BUCKETS) {
+				// * the odd bucket out is half of one at the new size, it goes on filling
+				current = buckets.back();
+				buckets.pop_back();
+				buckets = halve(buckets);
+				bucket_frames *= 2;
+				frames_in_bucket = bucket_frames / 2;
+			}
+		}
+	}
+	ma_decoder_uninit(&decoder);
+
+	// * a partial bucket behind a full set would be one more than the cache accepts
+	if (frames_in_bucket > 0)
+		buckets.push_back(current);
+	if (buckets.size() > MAX_BUCKETS) {
+		buckets = halve(buckets);
+		bucket_frames *= 2;
+	}
+	if (buckets.empty())
+		return overview;
+
+	overview.bucket_frames = ma_uint32(bucket_frames);
+	while (true) {
+		std::vector<waveform_peak>& level = overview.levels.emplace_back(buckets.size());
+		std::ranges::transform(buckets, level.begin(), to_peak);
+		if (buckets.size() == 1)
+			break;
+		buckets = halve(buckets);
+	}
+
+	if (stats != NULL) {
+		stats->frames = overview.frames;
+		stats->sample_rate = sample_rate;
+		stats->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+	return overview;
+}
+
+void waveform_render(const waveform& overview, ma_uint32 columns, std::vector<waveform_peak>& peaks) {
+	peaks.assign(columns, waveform_peak{});
+	if (overview.levels.empty() || columns == 0)
+		return;
+
+	// * the coarsest level with a bucket for every column has fewer than two per column, or only one when even level 0 has too few
+	std::size_t level = 0;
+	while (level + 1 < overview.levels.size() && overview.levels[level + 1].size() >= columns)
+		level++;
+	const std::vector<waveform_peak>& buckets = overview.levels[level];
+
+	for (ma_uint32 column = 0; column < columns; column++) {
+		std::size_t first = std::size_t(ma_uint64(column) * buckets.size() / columns);
+		std::size_t end = std::max(first + 1, std::size_t(ma_uint64(column + 1) * buckets.size() / columns));
+		waveform_peak peak = buckets[first];
+		float squares = float(peak.rms) * float(peak.rms);
+		for (std::size_t bucket = first + 1; bucket < end; bucket++) {
+			peak.min = std::min(peak.min, buckets[bucket].min);
+			peak.max = std::max(peak.max, buckets[bucket].max);
+			squares += float(buckets[bucket].rms) * float(buckets[bucket].rms);
+		}
+		peak.rms = ma_uint8(std::lround(std::sqrt(squares / float(end - first))));
+		peaks[column] = peak;
+	}
+}
+
+std::string waveform_cache_file(const std::string& directory, const std::string& path) {
+	// * FNV-1a, stable across runs and builds unlike std::hash
+	ma_uint64 hash = 0xcbf29ce484222325;
+	for (unsigned char byte : path)
+		hash = (hash ^ byte) * 0x100000001b3;
+	char name[32];
+	std::snprintf(name, sizeof(name), "/%016llx.peaks", (unsigned long long)hash);
+	return directory + name;
+}
+
+static bool read_header(std::ifstream& input, ma_uint64 size, ma_int64 modified, cache_header& header) {
+	return input.read((char*)&header, sizeof(header)) && std::memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) == 0
+		&& header.size == size && header.modified == modified && header.buckets > 0 && header.buckets <= MAX_BUCKETS;
+}
+
+bool waveform_cache_is_current(const std::string& file, ma_uint64 size, ma_int64 modified) {
+	std::ifstream input(file, std::ios::binary);
+	cache_header header;
+	return read_header(input, size, modified, header);
+}
+
+bool waveform_cache_load(const std::string& file, ma_uint64 size, ma_int64 modified, waveform& overview) {
+	std::ifstream input(file, std::ios::binary);
+	cache_header header;
+	if (!read_header(input, size, modified, header))
+		return false;
+
+	overview = waveform{};
+	overview.frames = header.frames;
+	overview.bucket_frames = header.bucket_frames;
+	for (std::size_t buckets : level_sizes(header.buckets)) {
+		std::vector<waveform_peak>& level = overview.levels.emplace_back(buckets);
+		if (!input.read((char*)level.data(), std::streamsize(buckets * sizeof(waveform_peak)))) {
+			overview = waveform{};
+			return false;
+		}
+	}
+	return true;
+}
+
+bool waveform_cache_save(const std::string& file, ma_uint64 size, ma_int64 modified, const waveform& overview) {
+	if (overview.levels.empty())
+		return false;
+
+	cache_header header{};
+	std::memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+	header.size = size;
+	header.modified = modified;
+	header.frames = overview.frames;
+	header.bucket_frames = overview.bucket_frames;
+	header.buckets = ma_uint32(overview.levels[0].size());
+
+	// * a track played while the library is analysed can be written by two jobs at once, each gets its own temporary
+	static std::atomic<unsigned> writes = 0;
+	std::string temporary = file + ".tmp" + std::to_string(writes++);
+	{
+		std::ofstream output(temporary, std::ios::binary | std::ios::trunc);
+		output.write((const char*)&header, sizeof(header));
+		for (const std::vector<waveform_peak>& level : overview.levels)
+			output.write((const char*)level.data(), std::streamsize(level.size() * sizeof(waveform_peak)));
+		if (!output.flush()) {
+			output.close();
+			std::remove(temporary.c_str());
+			return false;
+		}
+	}
+	return std::rename(temporary.c_str(), file.c_str()) == 0;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "include/miniaudio.h"
+
+/**
+ * @brief Overview of a whole track for the seek bar: min, max and RMS of all channels per bucket of frames.
+ *
+ * Level 0 starts at 256 frames a bucket and doubles them whenever it would pass 4096 buckets,
+ * so any track fits in a few kB. Each level above merges pairs of the one below, down to a single
+ * bucket, and drawing starts from the coarsest level that still has a bucket per column, which
+ * keeps a redraw O(columns) whatever the track's length. Values are bytes, finer than a seek bar shows.
+ */
+
+struct waveform_peak {
+	ma_int8 min;
+	ma_int8 max;
+	ma_uint8 rms;
+
+	bool operator==(const waveform_peak&) const = default;
+};
+
+struct waveform {
+	ma_uint64 frames = 0;
+	// * frames per bucket of levels[0], each level above doubles them
+	ma_uint32 bucket_frames = 0;
+	// * finest first, the last holds one bucket; empty when the track couldn't be decoded
+	std::vector<std::vector<waveform_peak>> levels;
+};
+
+struct waveform_stats {
+	ma_uint64 frames;
+	ma_uint32 sample_rate;
+	double seconds;
+};
+
+/** @brief Decodes the whole file once, levels is empty when it can't be decoded. */
+waveform waveform_analyse_file(const char* path, ma_encoding_format format, waveform_stats* stats = NULL);
+
+/** @brief One peak per column, each merged from the one or two buckets under it. */
+void waveform_render(const waveform& overview, ma_uint32 columns, std::vector<waveform_peak>& peaks);
+
+/**
+ * @brief The cache is one small binary file per track in directory, named after a hash of the path.
+ * Files are only trusted while the track's size and mtime still match, and are safe to delete.
+ */
+std::string waveform_cache_file(const std::string& directory, const std::string& path);
+/** @brief Reads the header only, for deciding whether a track needs analysing. */
+bool waveform_cache_is_current(const std::string& file, ma_uint64 size, ma_int64 modified);
+bool waveform_cache_load(const std::string& file, ma_uint64 size, ma_int64 modified, waveform& overview);
+bool waveform_cache_save(const std::string& file, ma_uint64 size, ma_int64 modified, const waveform& overview);
@@ -0,0 +1,107 @@
+#include "waveform_scale.hpp"
+
+#include <algorithm>
+
+struct _waveform_scale : GtkScale {
+	// * the instance isn't constructed as a C++ object, so members that need it are allocated in init
+	waveform* overview;
+	std::vector<waveform_peak>* columns;
+	int played_columns;
+};
+
+G_DEFINE_TYPE(waveform_scale, waveform_scale, GTK_TYPE_SCALE)
+
+static int played_columns(waveform_scale* scale) {
+	GtkRange* range = GTK_RANGE(scale);
+	GtkAdjustment* adjustment = gtk_range_get_adjustment(range);
+	double span = gtk_adjustment_get_upper(adjustment) - gtk_adjustment_get_lower(adjustment);
+	double played = span > 0 ? (gtk_range_get_value(range) - gtk_adjustment_get_lower(adjustment)) / span : 0;
+	return int(played * double(scale->columns->size()));
+}
+
+static void waveform_scale_value_changed(GtkRange* range, gpointer) {
+	// * the bar moves every frame, the waveform only needs drawing again when a column changes colour
+	auto scale = WAVEFORM_SCALE(range);
+	int played = played_columns(scale);
+	if (played != scale->played_columns) {
+		scale->played_columns = played;
+		gtk_widget_queue_draw(GTK_WIDGET(range));
+	}
+}
+
+static void waveform_scale_snapshot(GtkWidget* widget, GtkSnapshot* snapshot) {
+	auto scale = WAVEFORM_SCALE(widget);
+	GdkRectangle trough;
+	gtk_range_get_range_rect(GTK_RANGE(widget), &trough);
+	float height = float(gtk_widget_get_height(widget));
+	if (!scale->overview->levels.empty() && trough.width > 0 && height > 0) {
+		if (scale->columns->size() != std::size_t(trough.width)) {
+			waveform_render(*scale->overview, ma_uint32(trough.width), *scale->columns);
+			scale->played_columns = played_columns(scale);
+		}
+
+		GdkRGBA played;
+		gtk_widget_get_color(widget, &played);
+		GdkRGBA unplayed = played;
+		played.alpha *= 0.35f;
+		unplayed.alpha *= 0.15f;
+		GdkRGBA played_rms = played;
+		GdkRGBA unplayed_rms = unplayed;
+		played_rms.alpha *= 2;
+		unplayed_rms.alpha *= 2;
+
+		float middle = height / 2;
+		float scale_y = middle / 127;
+		for (std::size_t column = 0; column < scale->columns->size(); column++) {
+			const waveform_peak& peak = (*scale->columns)[column];
+			bool is_played = int(column) < scale->played_columns;
+			float x = float(trough.x) + float(column);
+			// * at least a pixel, so silence still shows where the track is
+			float top = middle - std::max(float(peak.max) * scale_y, 0.5f);
+			float bottom = middle - std::min(float(peak.min) * scale_y, -0.5f);
+			graphene_rect_t rect;
+			graphene_rect_init(&rect, x, top, 1, bottom - top);
+			gtk_snapshot_append_color(snapshot, is_played ? &played : &unplayed, &rect);
+
+			float rms = std::min(float(peak.rms) / 255 * middle, middle);
+			if (rms < 0.5f)
+				continue;
+			graphene_rect_init(&rect, x, middle - rms, 1, rms * 2);
+			gtk_snapshot_append_color(snapshot, is_played ? &played_rms : &unplayed_rms, &rect);
+		}
+	}
+	GTK_WIDGET_CLASS(waveform_scale_parent_class)->snapshot(widget, snapshot);
+}
+
+static void waveform_scale_finalize(GObject* object) {
+	auto scale = WAVEFORM_SCALE(object);
+	delete scale->overview;
+	delete scale->columns;
+	G_OBJECT_CLASS(waveform_scale_parent_class)->finalize(object);
+}
+
+static void waveform_scale_class_init(waveform_scaleClass* scale_class) {
+	G_OBJECT_CLASS(scale_class)->finalize = waveform_scale_finalize;
+	GtkWidgetClass* widget_class = GTK_WIDGET_CLASS(scale_class);
+	widget_class->snapshot = waveform_scale_snapshot;
+	gtk_widget_class_set_css_name(widget_class, "waveform");
+}
+
+static void waveform_scale_init(waveform_scale* scale) {
+	scale->overview = new waveform;
+	scale->columns = new std::vector<waveform_peak>;
+	scale->played_columns = 0;
+	g_signal_connect(scale, "value-changed", G_CALLBACK(waveform_scale_value_changed), NULL);
+}
+
+GtkWidget* waveform_scale_new() {
+	GtkAdjustment* adjustment = gtk_adjustment_new(0, 0, 1, 0.1, 1, 0);
+	return GTK_WIDGET(g_object_new(waveform_scale_get_type(), "orientation", GTK_ORIENTATION_HORIZONTAL, "adjustment", adjustment, NULL));
+}
+
+void waveform_scale_set_waveform(waveform_scale* scale, const waveform* overview) {
+	*scale->overview = overview != NULL ? *overview : waveform{};
+	// * an empty column list renders again on the next draw
+	scale->columns->clear();
+	gtk_widget_queue_draw(GTK_WIDGET(scale));
+}
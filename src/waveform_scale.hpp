@@ -0,0 +1,20 @@
+#pragma once
+
+#include <gtk/gtk.h>
+
+#include "waveform.hpp"
+
+/**
+ * @brief Horizontal GtkScale from 0 to 1 that draws the playing track's waveform behind its slider.
+ *
+ * It stays a GtkRange, so seeking and value updates work as with a plain scale. The peaks
+ * are rendered for the trough's width once per resize or track, after that a redraw appends
+ * two rectangles per column, and only when the played part grows by a whole column.
+ */
+
+G_DECLARE_FINAL_TYPE(waveform_scale, waveform_scale, , WAVEFORM_SCALE, GtkScale)
+
+GtkWidget* waveform_scale_new();
+
+/** @brief Copies the overview, NULL clears it back to a plain scale. */
+void waveform_scale_set_waveform(waveform_scale* scale, const waveform* overview);